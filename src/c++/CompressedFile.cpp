@@ -0,0 +1,265 @@
+//--------------------------------------------------
+//
+// File: CompressedFile.cpp
+//
+//--------------------------------------------------
+
+#include "CompressedFile.hpp"
+#include "Exception.hpp"
+#include "config.h"
+#include <string.h>
+#include <unistd.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif // HAVE_ZLIB
+
+using namespace std;
+
+//the size of the blocks that are decompressed or compressed at a time
+static const size_t COMPRESSED_BLOCK_SIZE = 1<<20;
+//the number of decompressed blocks that may wait for the reader
+static const size_t MAX_WAITING_BLOCKS = 4;
+
+bool
+isGzipData(const char *data, size_t size){
+  return size >= 2 && (unsigned char) data[0] == 0x1f && (unsigned char) data[1] == 0x8b;
+}
+
+bool
+isZstdData(const char *data, size_t size){
+  return size >= 4 && (unsigned char) data[0] == 0x28 && (unsigned char) data[1] == 0xb5
+    && (unsigned char) data[2] == 0x2f && (unsigned char) data[3] == 0xfd;
+}
+
+bool
+isGzipFileName(const char *fname){
+  const size_t length = strlen(fname);
+  return length > 3 && strcmp(fname + length - 3, ".gz") == 0;
+}
+
+//---------------------------------------------------------
+// READER
+
+GzipReader::GzipReader(FILE *fp, const char *prefix, size_t size)
+  : fp(fp), prefix(prefix, size), done(false), stopped(false){
+#ifndef HAVE_ZLIB
+  THROW_EXCEPTION("Can not read gzip compressed input, FastPhylo was built without zlib");
+#endif // HAVE_ZLIB
+  thread = std::thread(&GzipReader::_inflate, this);
+}
+
+GzipReader::~GzipReader(){
+  {
+    std::unique_lock<std::mutex> guard(lock);
+    stopped = true;
+  }
+  changed.notify_all();
+  if ( thread.joinable() )
+    thread.join();
+}
+
+bool
+GzipReader::readBlock(std::vector<char> &block){
+  std::unique_lock<std::mutex> guard(lock);
+  changed.wait(guard, [this]{ return ! blocks.empty() || done; });
+  if ( blocks.empty() ){
+    if ( ! error.empty() )
+      THROW_EXCEPTION(error);
+    return false;
+  }
+  block.swap(blocks.front());
+  blocks.pop_front();
+  guard.unlock();
+  changed.notify_all();
+  return true;
+}
+
+//Hands a full block to the reader, false if the reader is gone.
+bool
+GzipReader::_push(std::vector<char> &block){
+  std::unique_lock<std::mutex> guard(lock);
+  changed.wait(guard, [this]{ return blocks.size() < MAX_WAITING_BLOCKS || stopped; });
+  if ( stopped )
+    return false;
+  blocks.push_back(std::vector<char>());
+  blocks.back().swap(block);
+  guard.unlock();
+  changed.notify_all();
+  return true;
+}
+
+void
+GzipReader::_inflate(){
+#ifdef HAVE_ZLIB
+  string message;
+  z_stream zs;
+  memset(&zs, 0, sizeof zs);
+  //15+32 reads both gzip and zlib headers
+  if ( inflateInit2(&zs, 15+32) != Z_OK )
+    message = "Could not start decompressing the gzip input";
+
+  std::vector<char> in(COMPRESSED_BLOCK_SIZE);
+  std::vector<char> out(COMPRESSED_BLOCK_SIZE);
+  size_t outSize = 0;
+  bool prefixUsed = false;
+  int ret = Z_OK;
+  while ( message.empty() ){
+    if ( zs.avail_in == 0 ){
+      if ( ! prefixUsed && ! prefix.empty() ){
+        zs.next_in = (Bytef *) &prefix[0];
+        zs.avail_in = prefix.size();
+      }
+      else {
+        zs.next_in = (Bytef *) &in[0];
+        zs.avail_in = fread(&in[0], 1, in.size(), fp);
+      }
+      prefixUsed = true;
+      if ( zs.avail_in == 0 ){
+        if ( ret != Z_STREAM_END )
+          message = "The gzip input ends in the middle of the compressed data";
+        break;
+      }
+    }
+    //the next of several concatenated streams
+    if ( ret == Z_STREAM_END )
+      inflateReset(&zs);
+
+    zs.next_out = (Bytef *) &out[outSize];
+    zs.avail_out = out.size() - outSize;
+    ret = inflate(&zs, Z_NO_FLUSH);
+    if ( ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR ){
+      message = string("The gzip input is broken: ") + (zs.msg != NULL ? zs.msg : "unknown error");
+      break;
+    }
+    outSize = out.size() - zs.avail_out;
+    if ( outSize == out.size() ){
+      if ( ! _push(out) )
+        break;
+      out.resize(COMPRESSED_BLOCK_SIZE);
+      outSize = 0;
+    }
+  }
+  inflateEnd(&zs);
+  if ( outSize > 0 ){
+    out.resize(outSize);
+    _push(out);
+  }
+
+  {
+    std::unique_lock<std::mutex> guard(lock);
+    error = message;
+    done = true;
+  }
+  changed.notify_all();
+#endif // HAVE_ZLIB
+}
+
+//---------------------------------------------------------
+// WRITER
+
+GzipWriter::GzipWriter(const char *fname) : fname(fname), fp(NULL){
+#ifdef HAVE_ZLIB
+  gzFile gz = gzopen(fname, "wb");
+  if ( gz == NULL )
+    THROW_EXCEPTION("Could not open file for writing: \"" << fname << "\"");
+  int fds[2];
+  if ( pipe(fds) != 0 || (fp = fdopen(fds[1], "w")) == NULL ){
+    gzclose(gz);
+    THROW_EXCEPTION("Could not create a pipe to compress \"" << fname << "\"");
+  }
+  setvbuf(fp, NULL, _IOFBF, COMPRESSED_BLOCK_SIZE);
+  thread = std::thread(&GzipWriter::_deflate, this, fds[0], (void *) gz);
+#else
+  THROW_EXCEPTION("Can not write the gzip compressed file \"" << fname
+                  << "\", FastPhylo was built without zlib");
+#endif // HAVE_ZLIB
+}
+
+GzipWriter::~GzipWriter(){
+  close();
+}
+
+bool
+GzipWriter::close(){
+  if ( fp != NULL ){
+    if ( fclose(fp) != 0 && error.empty() )
+      error = "Could not write to the pipe of \"" + fname + "\"";
+    fp = NULL;
+  }
+  //the thread reads until the pipe is closed
+  if ( thread.joinable() ){
+    thread.join();
+    if ( error.empty() )
+      error = deflateError;
+  }
+  return error.empty();
+}
+
+void
+GzipWriter::_deflate(int fd, void *gz_){
+#ifdef HAVE_ZLIB
+  gzFile gz = (gzFile) gz_;
+  std::vector<char> block(COMPRESSED_BLOCK_SIZE);
+  string message;
+  for (;;){
+    const ssize_t numRead = read(fd, &block[0], block.size());
+    if ( numRead == 0 )
+      break;
+    if ( numRead < 0 ){
+      message = "Could not read the pipe of \"" + fname + "\"";
+      break;
+    }
+    //the pipe is drained after an error so that the writer never
+    //blocks
+    if ( message.empty() && gzwrite(gz, &block[0], numRead) != numRead )
+      message = "Could not write the compressed file \"" + fname + "\"";
+  }
+  ::close(fd);
+  if ( gzclose(gz) != Z_OK && message.empty() )
+    message = "Could not write the compressed file \"" + fname + "\"";
+  //read by close() after the join
+  deflateError = message;
+#endif // HAVE_ZLIB
+}
+
+//---------------------------------------------------------
+// OUTPUT STREAM
+
+//buf is constructed after the std::ostream, so it is set afterwards.
+GzipOutputStream::GzipOutputStream(const char *fname) : std::ostream(NULL), buf(fname){
+  rdbuf(&buf);
+}
+
+GzipOutputStream::~GzipOutputStream(){
+  close();
+}
+
+bool
+GzipOutputStream::close(){
+  flush();
+  return buf.writer.close();
+}
+
+//The FILE of the writer buffers the bytes, so the stream writes
+//through it.
+GzipOutputStream::int_type
+GzipOutputStream::Buf::overflow(int_type c){
+  if ( traits_type::eq_int_type(c, traits_type::eof()) )
+    return traits_type::not_eof(c);
+  if ( writer.getFile() == NULL || fputc(c, writer.getFile()) == EOF )
+    return traits_type::eof();
+  return c;
+}
+
+std::streamsize
+GzipOutputStream::Buf::xsputn(const char *s, std::streamsize n){
+  if ( writer.getFile() == NULL )
+    return 0;
+  return fwrite(s, 1, n, writer.getFile());
+}
+
+int
+GzipOutputStream::Buf::sync(){
+  return writer.getFile() == NULL ? 0 : fflush(writer.getFile());
+}
@@ -0,0 +1,132 @@
+//--------------------------------------------------
+//
+// File: CompressedFile.hpp
+//
+//--------------------------------------------------
+#ifndef COMPRESSEDFILE_HPP
+#define COMPRESSEDFILE_HPP
+
+#include <cstddef>
+#include <cstdio>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+//
+// Reading and writing gzip compressed files with zlib. The
+// decompression and compression run on a background thread, so they
+// overlap with the parsing and the computations of the caller.
+//
+// Files compressed with zstd are recognized but not supported.
+//
+
+// True if the first size bytes at data start a gzip stream.
+bool isGzipData(const char *data, size_t size);
+// True if the first size bytes at data start a zstd stream.
+bool isZstdData(const char *data, size_t size);
+// True if fname ends with ".gz".
+bool isGzipFileName(const char *fname);
+
+//
+// Inflates the gzip stream of a file a few blocks ahead of the
+// reader. Concatenated gzip streams are read as one.
+//
+class GzipReader
+{
+public:
+  // The stream is read from fp, after the size bytes at prefix which
+  // have already been read from fp.
+  GzipReader(FILE *fp, const char *prefix=NULL, size_t size=0);
+  ~GzipReader();
+
+  // Swaps the next block of inflated bytes into block, false at the
+  // end of the stream. Throws if the stream is broken.
+  bool readBlock(std::vector<char> &block);
+
+private:
+  // not copyable, the thread uses the members
+  GzipReader(const GzipReader &);
+  void operator=(const GzipReader &);
+
+  void _inflate();
+  bool _push(std::vector<char> &block);
+
+  FILE *fp;
+  std::string prefix;
+  std::mutex lock;
+  std::condition_variable changed;
+  std::deque<std::vector<char> > blocks;
+  bool done;
+  bool stopped;
+  std::string error;
+  std::thread thread;
+};
+
+//
+// Compresses the bytes written to getFile() into a gzip file. The
+// FILE is the write end of a pipe, so the output streams print to it
+// as to any other file.
+//
+class GzipWriter
+{
+public:
+  // Throws if fname can not be opened.
+  GzipWriter(const char *fname);
+  ~GzipWriter();
+
+  FILE *getFile() const {return fp;}
+
+  // Closes getFile() and waits until everything written to it has
+  // been compressed, false if the compressed file could not be
+  // written, see getError().
+  bool close();
+  const std::string &getError() const {return error;}
+
+private:
+  // not copyable, the thread uses the members
+  GzipWriter(const GzipWriter &);
+  void operator=(const GzipWriter &);
+
+  void _deflate(int fd, void *gz);
+
+  std::string fname;
+  FILE *fp;
+  std::string error;
+  std::string deflateError;  //set by the thread
+  std::thread thread;
+};
+
+//
+// A GzipWriter as a std::ostream for the binary outputs.
+//
+class GzipOutputStream : public std::ostream
+{
+public:
+  // Throws if fname can not be opened.
+  GzipOutputStream(const char *fname);
+  ~GzipOutputStream();
+
+  // As GzipWriter::close().
+  bool close();
+  const std::string &getError() const {return buf.writer.getError();}
+
+private:
+  class Buf : public std::streambuf
+  {
+  public:
+    Buf(const char *fname) : writer(fname){}
+    GzipWriter writer;
+  protected:
+    virtual int_type overflow(int_type c);
+    virtual std::streamsize xsputn(const char *s, std::streamsize n);
+    virtual int sync();
+  };
+
+  Buf buf;
+};
+
+#endif // COMPRESSEDFILE_HPP
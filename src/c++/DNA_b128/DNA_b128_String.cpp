@@ -10,6 +10,7 @@
 //--------------------------------------------------
 
 #include "DNA_b128_String.hpp"
+#include "SitePatterns.hpp"
 /*
 #include <climits>
 #include <string>
@@ -20,6 +21,7 @@
 #include <limits.h>
 #include "log_utils.hpp"
 #include <algorithm>
+#include <stdint.h>
 
 using namespace std;
 
@@ -33,7 +35,12 @@ DNA_b128_String::_init_mem(int capacity){
   MEM_CHECK(data);
   unknownData = calloc_b128(numDatas);
   MEM_CHECK(unknownData);
+  ownsMemory = true;
+  siteWeights = NULL;
   ambiguities.clear();
+  savedAmbiguities.clear();
+  _updateAmbiguityRuns();
+  savedAmbiguityRuns = ambiguityRuns;
 
   numChars = 0;
   num_As_ = 0;
@@ -43,29 +50,39 @@ DNA_b128_String::_init_mem(int capacity){
   num_unknowns_ = 0;
 }
 
+void
+DNA_b128_String::_clear(){
+  memset(unknownData, 0, sizeof(b128)*numDatas);//clear unknowns
+  siteWeights = NULL;
+  ambiguities.clear();
+  savedAmbiguities.clear();
+  _updateAmbiguityRuns();
+  savedAmbiguityRuns = ambiguityRuns;
+  numChars = 0;
+  num_As_ = 0;
+  num_Cs_ = 0;
+  num_Gs_ = 0;
+  num_Ts_ = 0;
+  num_unknowns_ = 0;
+}
+
 void DNA_b128_String::reInitiate(size_t capacity){
   if( getTotalCapacity() < capacity ){
     _free_mem();
     _init_mem(capacity);
   }
-  else{
-    memset(unknownData, 0, sizeof(b128)*numDatas);//clear unknowns
-    ambiguities.clear();
-    numChars = 0;
-    num_As_ = 0;
-    num_Cs_ = 0;
-    num_Gs_ = 0;
-    num_Ts_ = 0;
-    num_unknowns_ = 0;
-  }
+  else
+    _clear();
 }
 
 void
 DNA_b128_String::_free_mem(){
   if ( data != NULL ){
-    free_b128(data);
+    if ( ownsMemory ){
+      free_b128(data);
+      free_b128(unknownData);
+    }
     data = NULL;
-    free_b128(unknownData);
     unknownData = NULL;
   }
 }
@@ -79,22 +96,35 @@ DNA_b128_String::DNA_b128_String(int capacity){
   _init_mem(capacity);
 }
 
+DNA_b128_String::DNA_b128_String(b128 *data, b128 *unknownData, size_t numDatas){
+  this->data = data;
+  this->unknownData = unknownData;
+  this->numDatas = numDatas;
+  ownsMemory = false;
+  _clear();
+}
+
 DNA_b128_String::DNA_b128_String(const DNA_b128_String &str){
   data = NULL;
   unknownData = NULL;
   numDatas = 0;
+  ownsMemory = true;
   operator=(str);
 }
 
 void DNA_b128_String::operator=(const DNA_b128_String &str){
 
-  if(numDatas != str.numDatas){
+  const bool keepMemory = ( ! ownsMemory && data != NULL && numDatas >= str.numDatas );
+  if(numDatas != str.numDatas && ! keepMemory){
     _free_mem();
   
     _init_mem(str.getTotalCapacity()-1);
   }
-  memcpy(data,str.data,sizeof(b128)*numDatas);
-  memcpy(unknownData,str.unknownData,sizeof(b128)*numDatas);
+  memcpy(data,str.data,sizeof(b128)*str.numDatas);
+  memcpy(unknownData,str.unknownData,sizeof(b128)*str.numDatas);
+  //the rest of a larger memory is empty
+  memset(data+str.numDatas,0,sizeof(b128)*(numDatas-str.numDatas));
+  memset(unknownData+str.numDatas,0,sizeof(b128)*(numDatas-str.numDatas));
 
   numChars = str.numChars;
   num_As_ = str.num_As_;
@@ -102,7 +132,11 @@ void DNA_b128_String::operator=(const DNA_b128_String &str){
   num_Gs_ = str.num_Gs_;
   num_Ts_ = str.num_Ts_;
   num_unknowns_ = str.num_unknowns_;
+  siteWeights = str.siteWeights;
   ambiguities = str.ambiguities;
+  savedAmbiguities = str.savedAmbiguities;
+  ambiguityRuns = str.ambiguityRuns;
+  savedAmbiguityRuns = str.savedAmbiguityRuns;
 }
 
 DNA_b128_String::DNA_b128_String(int capacity, const std::string &str){
@@ -124,13 +158,67 @@ DNA_b128_String::~DNA_b128_String(){
 
 //-----------------------------------------
 // APPEND
+
+//Spreads the 16 bits of x to the even bits of an int.
+static __inline unsigned int
+spreadBits(unsigned int x){
+  x = (x | (x << 8)) & 0x00FF00FF;
+  x = (x | (x << 4)) & 0x0F0F0F0F;
+  x = (x | (x << 2)) & 0x33333333;
+  x = (x | (x << 1)) & 0x55555555;
+  return x;
+}
+
+//Packs the 16 chars at c_str as the chars of an int of the data, the
+//first char in the most significant bits, if they are all A, C, G,
+//T/U or gaps. The gaps are set in unknownInt and the nucleotides and
+//gaps are added to counts, A, C, G, T and the unknowns. Returns false
+//and changes nothing otherwise.
+static __inline bool
+packPlainNucleotides(const char *c_str, int &dataInt, int &unknownInt, size_t counts[5]){
+  b128 chars = _mm_loadu_si128(reinterpret_cast<const b128*>(c_str));
+  //reverse the chars so that the first one is the most significant
+  //bit of the masks
+  chars = _mm_shuffle_epi32(chars, _MM_SHUFFLE(0,1,2,3));
+  chars = _mm_shufflelo_epi16(chars, _MM_SHUFFLE(2,3,0,1));
+  chars = _mm_shufflehi_epi16(chars, _MM_SHUFFLE(2,3,0,1));
+  chars = _mm_or_si128(_mm_slli_epi16(chars, 8), _mm_srli_epi16(chars, 8));
+
+  const b128 lower = _mm_or_si128(chars, _mm_set1_epi8(0x20));
+  const unsigned int a = _mm_movemask_epi8(_mm_cmpeq_epi8(lower, _mm_set1_epi8('a')));
+  const unsigned int c = _mm_movemask_epi8(_mm_cmpeq_epi8(lower, _mm_set1_epi8('c')));
+  const unsigned int g = _mm_movemask_epi8(_mm_cmpeq_epi8(lower, _mm_set1_epi8('g')));
+  const unsigned int t = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(lower, _mm_set1_epi8('t')),
+                                                        _mm_cmpeq_epi8(lower, _mm_set1_epi8('u'))));
+  const unsigned int gap = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chars, _mm_set1_epi8('-')),
+                                                          _mm_cmpeq_epi8(chars, _mm_set1_epi8('.'))));
+  if ( (a | c | g | t | gap) != 0xFFFF )
+    return false;
+
+  //DNA_A_=00, DNA_C_=11, DNA_G_=01 and DNA_T_=10, a gap is an A
+  dataInt = (int) ((spreadBits(c | t) << 1) | spreadBits(c | g));
+  unknownInt = (int) (spreadBits(gap) * NUCLEOTIDE_INT_MASK);
+  counts[0] += __builtin_popcount(a);
+  counts[1] += __builtin_popcount(c);
+  counts[2] += __builtin_popcount(g);
+  counts[3] += __builtin_popcount(t);
+  counts[4] += __builtin_popcount(gap);
+  return true;
+}
+
 int
 DNA_b128_String::append(const char *c_str){
+  return append(c_str, strlen(c_str));
+}
+
+int
+DNA_b128_String::append(const char *c_str, size_t length){
   size_t _num_unknowns_ = num_unknowns_;
   size_t _num_As_ = num_As_;
   size_t _num_Cs_ = num_Cs_;
   size_t _num_Gs_ = num_Gs_;
   size_t _num_Ts_ = num_Ts_;
+  const size_t numAmbiguities = ambiguities.size();
       
   //-------------------  
   //INITIALIZE READING
@@ -158,10 +246,40 @@ DNA_b128_String::append(const char *c_str){
   int next_int_jump_pos = first_charpos_in_next_int(c_pos);
   
 
+  //the chars are packed 16 at a time while they are plain, see
+  //packPlainNucleotides()
+  const char *c_str_end = c_str + length;
+  size_t counts[5] = {0,0,0,0,0};
+
   // read until an unallowed char is found
   for ( ; true ; c_str++ ){
+    //SIXTEEN CHARS AT A TIME
+    //at the beginning of an int, which is then still 0
+    int dataInt, unknownInt;
+    while ( (c_pos & 0xf) == 0 && c_str_end - c_str >= 16
+            && packPlainNucleotides(c_str, dataInt, unknownInt, counts) ){
+      c_b128 = set_int_b128(c_b128, dataInt, INT_D_I(c_pos));
+      if ( unknownInt != 0 ){
+        b128 *u = unknownData + D_I(c_pos);
+        const b128 u_b128 = get_b128(u);
+        set_b128(u, set_int_b128(u_b128, get_int_b128(u_b128, INT_D_I(c_pos)) | unknownInt, INT_D_I(c_pos)));
+      }
+      c_str += 16;
+      c_pos += 16;
+      next_int_jump_pos = first_charpos_in_next_int(c_pos);
+      //JUMP B128
+      if ( c_pos == next_b128_jump_pos ){
+        set_b128(c_b128_ptr,c_b128);
+        c_b128_ptr++;
+        c_b128 = set_zero_b128();
+        next_b128_jump_pos = first_charpos_in_next_b128(c_pos);
+      }
+    }
+
     //nucleotide n = char2nucleotide(*c_str);
     //_mm_prefetch(c_str+32,_MM_HINT_NTA);  
+    if ( c_str == c_str_end )
+      goto END_FOR_LOOP;
     
     //UPDATE FREQUENCES
     switch ( *c_str ){
@@ -298,11 +416,15 @@ DNA_b128_String::append(const char *c_str){
   
 
   //update global variables
-  num_unknowns_ = _num_unknowns_;
-  num_As_ = _num_As_;
-  num_Cs_ = _num_Cs_;
-  num_Gs_ = _num_Gs_;
-  num_Ts_ = _num_Ts_;
+  num_unknowns_ = _num_unknowns_ + counts[4];
+  num_As_ = _num_As_ + counts[0];
+  num_Cs_ = _num_Cs_ + counts[1];
+  num_Gs_ = _num_Gs_ + counts[2];
+  num_Ts_ = _num_Ts_ + counts[3];
+  if ( ambiguityRuns.resolved.empty() )
+    _addAmbiguityRuns(numAmbiguities);
+  else
+    _updateAmbiguityRuns();
 
   c_int = numChars-c_pos;
   numChars = c_pos;
@@ -369,6 +491,7 @@ DNA_b128_String::setNucleotide(int pos, nucleotide n){
   
   //-----
   //update frequences
+  bool updateRuns = false;
   nucleotide old = getNucleotide(pos);//PENDING slow
   switch ( old ){
   case DNA_A_:num_As_--;break;
@@ -391,6 +514,7 @@ DNA_b128_String::setNucleotide(int pos, nucleotide n){
         break;
       }
     }
+    updateRuns = true;
   }
 
   //---
@@ -416,6 +540,7 @@ DNA_b128_String::setNucleotide(int pos, nucleotide n){
       ++iter;
     ambiguity_nucleotide_at_position nap = {{n,0,0,0,0}, pos};
     ambiguities.insert(iter, nap );
+    updateRuns = true;
     n = DNA_A_;
   }
 
@@ -431,6 +556,9 @@ DNA_b128_String::setNucleotide(int pos, nucleotide n){
   //update the memory
   data[D_I(pos)] = set_int_b128(c_b128, c_int, INT_D_I(pos));
 
+  if ( updateRuns )
+    _updateAmbiguityRuns();
+
   return old;
 }
   
@@ -469,164 +597,532 @@ DNA_b128_String::equals(const Object *o) const{
   return equal(ambiguities.begin(), ambiguities.end(), s2->ambiguities.begin());
 }
 
+size_t
+DNA_b128_String::hashCode() const{
+  //the same words as equals() compares, 64 bits at a time
+  const uint64_t *d = reinterpret_cast<const uint64_t*>(data);
+  const uint64_t *u = reinterpret_cast<const uint64_t*>(unknownData);
+  const size_t numWords = 2*getNumUsedDatas();
+  uint64_t h = numChars;
+  for ( size_t w = 0 ; w < numWords ; w++ ){
+    h = (h ^ d[w])*0x9E3779B97F4A7C15ULL;
+    h = (h ^ u[w])*0x9E3779B97F4A7C15ULL;
+    h ^= h >> 32;
+  }
+  return (size_t) h;
+}
 
-//-------------------- AMBIGUITIES --------------------------------------------------------------
 
-// RESOLVE AMBIGUITIES
+//-------------------- SITE WEIGHTS --------------------------------------------------------------
+
+//The number of set least significant bits of the two bit blocks in
+//mask, each weighted with the weight of its position.
+static inline size_t
+_weightedCount(uint64_t mask, const b128 *const *planes, size_t numPlanes, size_t word){
+  size_t count = 0;
+  for ( size_t b = 0 ; b < numPlanes ; b++ )
+    count += ((size_t) __builtin_popcountll(mask & reinterpret_cast<const uint64_t*>(planes[b])[word])) << b;
+  return count;
+}
+
 void
-DNA_b128_String::resolveAmbiguities(const DNA_b128_String &temp_str){
+DNA_b128_String::setSiteWeights(const SiteWeights *weights){
+  siteWeights = weights;
+
+  //recompute the base frequences from the bits, see TABLE 1 in
+  //computeDistance_DNA_b128_String.cpp
+  const uint64_t LEAST_SIGNIFCANT_BIT = 0x5555555555555555ULL;
+  const uint64_t *p = reinterpret_cast<const uint64_t*>(data);
+  const uint64_t *u = reinterpret_cast<const uint64_t*>(unknownData);
+  const size_t numWords = 2*getNumUsedDatas();
+  size_t As = 0, Cs = 0, Gs = 0, Ts = 0, unknowns = 0;
+  for ( size_t w = 0 ; w < numWords ; w++ ){
+    const uint64_t known = ~u[w] & LEAST_SIGNIFCANT_BIT;
+    const uint64_t lo = p[w] & known;
+    const uint64_t hi = (p[w] >> 1) & known;
+    const uint64_t A = known & ~hi & ~lo, C = hi & lo, G = ~hi & lo, T = hi & ~lo;
+    const uint64_t unknown = u[w] & LEAST_SIGNIFCANT_BIT;
+    if ( weights == NULL ){
+      As += __builtin_popcountll(A);
+      Cs += __builtin_popcountll(C);
+      Gs += __builtin_popcountll(G);
+      Ts += __builtin_popcountll(T);
+      unknowns += __builtin_popcountll(unknown);
+    }
+    else{
+      const b128 *const *planes = reinterpret_cast<const b128 *const *>(weights->getPlanes());
+      const size_t numPlanes = weights->getNumPlanes();
+      As += _weightedCount(A, planes, numPlanes, w);
+      Cs += _weightedCount(C, planes, numPlanes, w);
+      Gs += _weightedCount(G, planes, numPlanes, w);
+      Ts += _weightedCount(T, planes, numPlanes, w);
+      unknowns += _weightedCount(unknown, planes, numPlanes, w);
+    }
+  }
+  //the unused positions of the last b128 are zero, i.e. A
+  if ( weights == NULL )
+    As -= numWords*32 - numChars;
+
+  //the unknowns are the gaps, not the ambiguities
+  std::vector<ambiguity_nucleotide_at_position>::const_iterator iter = ambiguities.begin();
+  for ( ; iter != ambiguities.end() ; ++iter )
+    unknowns -= ( weights == NULL ? 1 : weights->getWeight((*iter).position) );
+
+  num_As_ = As;
+  num_Cs_ = Cs;
+  num_Gs_ = Gs;
+  num_Ts_ = Ts;
+  num_unknowns_ = unknowns;
+}
 
-  std::vector<ambiguity_nucleotide_at_position>::iterator iter = ambiguities.begin();
-  //  int numres = 0;
-  for ( ; iter != ambiguities.end() ; ++iter ){
-    ambiguity_nucleotide_at_position ambpos = *iter;
-    nucleotide template_nucleotide = temp_str.getNucleotideNOAMBIGUITY(ambpos.position);
+size_t
+DNA_b128_String::getNumSites() const{
+  return ( siteWeights == NULL ? numChars : siteWeights->getNumSites() );
+}
 
-    //only resolve if the template is a regular nucleotide and if the template nucleotide is
-    //contained in the ambiguity.    
-    if ( template_nucleotide != DNA_UNKNOWN_ ){
-      ambiguity_nucleotide tmp_amb = regularnucleotide2ambiguity_nucleotide(template_nucleotide);
-      if ( is_ambiguity_contained(tmp_amb,ambpos.ambiguity) ){
-	(*iter).ambiguity = tmp_amb;
-      }
+unsigned int
+DNA_b128_String::getSiteWeight(size_t pos) const{
+  return ( siteWeights == NULL ? 1 : siteWeights->getWeight(pos) );
+}
+
+
+//-------------------- AMBIGUITIES --------------------------------------------------------------
+
+// THE 64 BIT WORDS
+//
+// The ambiguity runs are read a 64 bit word at a time from data,
+// unknownData and the masks of the resolution.
+
+//the least significant bit of every position in a 64 bit word
+static const uint64_t LEAST_SIGNIFICANT_BITS = 0x5555555555555555ULL;
+
+//The 64 bit word with the position pos. Char 0 of a b128 is in its
+//most significant bits, i.e. in the second word, see THE DATA in
+//DNA_b128_String.hpp.
+static inline size_t
+_wordIndex(int pos){
+  return 2*(pos >> 6) + ( (pos & 0x3f) < 32 ? 1 : 0 );
+}
+
+//the lowest bit of position pos in its word
+static inline int
+_bitIndex(int pos){
+  return 62 - 2*(pos & 0x1f);
+}
+
+//The mask of the positions of the next word in [start,end), the word
+//is returned in word and start is moved to the next word.
+static inline uint64_t
+_nextWord(int &start, int end, size_t &word){
+  const int wordStart = start & ~0x1f;
+  const int wordEnd = ( end < wordStart + 32 ? end : wordStart + 32 );
+  word = _wordIndex(start);
+  const uint64_t mask = LEAST_SIGNIFICANT_BITS & (~0ULL >> (2*(start-wordStart))) & (~0ULL << (64-2*(wordEnd-wordStart)));
+  start = wordEnd;
+  return mask;
+}
+
+//Splits the positions mask by the nucleotides of the word d, the
+//positions must be known, i.e. not a gap or an ambiguity.
+static inline void
+_nucleotideMasks(uint64_t d, uint64_t mask, uint64_t masks[4]){
+  //see TABLE 1 in computeDistance_DNA_b128_String.cpp
+  const uint64_t lo = d & mask;
+  const uint64_t hi = (d >> 1) & mask;
+  masks[DNA_A_] = mask & ~hi & ~lo;
+  masks[DNA_G_] = ~hi & lo;
+  masks[DNA_T_] = hi & ~lo;
+  masks[DNA_C_] = hi & lo;
+}
+
+//the nucleotide at pos or DNA_UNKNOWN_ if it is a gap or an ambiguity
+static inline nucleotide
+_regularNucleotide(const b128 *data, const b128 *unknownData, int pos){
+  const size_t w = _wordIndex(pos);
+  const int bit = _bitIndex(pos);
+  if ( ((reinterpret_cast<const uint64_t*>(unknownData)[w] >> bit) & 1) != 0 )
+    return DNA_UNKNOWN_;
+  return (nucleotide) ((reinterpret_cast<const uint64_t*>(data)[w] >> bit) & 3);
+}
+
+static inline unsigned int
+_count(uint64_t mask, const SiteWeights *weights, size_t word){
+  if ( weights == NULL )
+    return __builtin_popcountll(mask);
+  return _weightedCount(mask, reinterpret_cast<const b128 *const *>(weights->getPlanes()),
+                        weights->getNumPlanes(), word);
+}
+
+
+// RESOLVE AMBIGUITIES
+
+//resolves to the template nucleotide
+struct ResolveToTemplate{
+  ambiguity_nucleotide operator()(const ambiguity_nucleotide &, nucleotide template_nucleotide) const{
+    return regularnucleotide2ambiguity_nucleotide(template_nucleotide);
+  }
+};
+
+//resolves with the transition probabilities to the template nucleotide
+struct ResolveWithTransitionProbabilities{
+  ML_string_distance mldist;
+  ambiguity_nucleotide operator()(const ambiguity_nucleotide &amb, nucleotide template_nucleotide) const{
+    ambiguity_nucleotide curramb = amb;
+    float totalprob;
+    switch( template_nucleotide ){
+    case DNA_A_:
+      totalprob = curramb.probA*mldist.A_A + curramb.probC*mldist.A_C + curramb.probG*mldist.A_G + curramb.probT*mldist.A_T;
+      curramb.probA = curramb.probA*mldist.A_A/totalprob;
+      curramb.probC = curramb.probC*mldist.A_C/totalprob;
+      curramb.probG = curramb.probG*mldist.A_G/totalprob;
+      curramb.probT = curramb.probT*mldist.A_T/totalprob;
+      break;
+    case DNA_C_:
+      totalprob = curramb.probA*mldist.A_C + curramb.probC*mldist.C_C + curramb.probG*mldist.C_G + curramb.probT*mldist.C_T;
+      curramb.probA = curramb.probA*mldist.A_C/totalprob;
+      curramb.probC = curramb.probC*mldist.C_C/totalprob;
+      curramb.probG = curramb.probG*mldist.C_G/totalprob;
+      curramb.probT = curramb.probT*mldist.C_T/totalprob;
+      break;
+    case DNA_G_:
+      totalprob = curramb.probA*mldist.A_G + curramb.probC*mldist.C_G + curramb.probG*mldist.G_G + curramb.probT*mldist.G_T;
+      curramb.probA = curramb.probA*mldist.A_G/totalprob;
+      curramb.probC = curramb.probC*mldist.C_G/totalprob;
+      curramb.probG = curramb.probG*mldist.G_G/totalprob;
+      curramb.probT = curramb.probT*mldist.G_T/totalprob;
+      break;
+    case DNA_T_:
+      totalprob = curramb.probA*mldist.A_T + curramb.probC*mldist.C_T + curramb.probG*mldist.G_T + curramb.probT*mldist.T_T;
+      curramb.probA = curramb.probA*mldist.A_T/totalprob;
+      curramb.probC = curramb.probC*mldist.C_T/totalprob;
+      curramb.probG = curramb.probG*mldist.G_T/totalprob;
+      curramb.probT = curramb.probT*mldist.T_T/totalprob;
+      break;
+    default:
+      PROG_ERROR("ERROR SHOULDNT COME HERE");
     }
+    return curramb;
   }
-  //  cout << "total num amb " << getNumAmbiguities() << "    num resolv " << numres << endl;
+};
 
+void
+DNA_b128_String::resolveAmbiguities(const DNA_b128_String &temp_str){
+  _resolveAmbiguities(temp_str, ResolveToTemplate());
 }
 
 void
 DNA_b128_String::resolveAmbiguitiesUsingTransitionProbabilities(const DNA_b128_String &temp_str, 
 								ML_string_distance mldist){
+  const ResolveWithTransitionProbabilities resolve = {mldist};
+  _resolveAmbiguities(temp_str, resolve);
+}
 
-  std::vector<ambiguity_nucleotide_at_position>::iterator iter = ambiguities.begin();
- 
-  for ( ; iter != ambiguities.end() ; ++iter ){
-    ambiguity_nucleotide_at_position ambpos = *iter;
-    nucleotide template_nucleotide = temp_str.getNucleotideNOAMBIGUITY(ambpos.position);
-
+template<class Resolve>
+void
+DNA_b128_String::_resolveAmbiguities(const DNA_b128_String &temp_str, const Resolve &resolve){
+  //the runs must have one probability each to be resolved
+  if ( ! ambiguityRuns.resolved.empty() )
+    _updateAmbiguityRuns();
+  if ( ambiguityRuns.runs.empty() )
+    return;
+
+  const uint64_t *td = reinterpret_cast<const uint64_t*>(temp_str.data);
+  const uint64_t *tu = reinterpret_cast<const uint64_t*>(temp_str.unknownData);
+  std::vector<uint64_t> &resolved = ambiguityRuns.resolved;
+  std::vector<uint64_t> &templateData = ambiguityRuns.templateData;
+  resolved.assign(2*getNumUsedDatas(), 0);
+  templateData.assign(2*getNumUsedDatas(), 0);
+
+  std::vector<ambiguity_run>::iterator iter = ambiguityRuns.runs.begin();
+  for ( ; iter != ambiguityRuns.runs.end() ; ++iter ){
+    ambiguity_run &run = *iter;
+    const ambiguity_nucleotide &amb = run.ambiguity[UNRESOLVED];
     //only resolve if the template is a regular nucleotide and if the template nucleotide is
-    //contained in the ambiguity.    
-    if ( template_nucleotide != DNA_UNKNOWN_ ){
-      ambiguity_nucleotide tmp_amb = regularnucleotide2ambiguity_nucleotide(template_nucleotide);
-      if ( is_ambiguity_contained(tmp_amb,ambpos.ambiguity) ){
-        ambiguity_nucleotide curramb = ambpos.ambiguity;
-        float totalprob;
-        switch( template_nucleotide ){
-        case DNA_A_:
-           totalprob = curramb.probA*mldist.A_A + curramb.probC*mldist.A_C + curramb.probG*mldist.A_G + curramb.probT*mldist.A_T;
-          curramb.probA = curramb.probA*mldist.A_A/totalprob;
-          curramb.probC = curramb.probC*mldist.A_C/totalprob;
-          curramb.probG = curramb.probG*mldist.A_G/totalprob;
-          curramb.probT = curramb.probT*mldist.A_T/totalprob;
-          break;
-        case DNA_C_:
-           totalprob = curramb.probA*mldist.A_C + curramb.probC*mldist.C_C + curramb.probG*mldist.C_G + curramb.probT*mldist.C_T;
-          curramb.probA = curramb.probA*mldist.A_C/totalprob;
-          curramb.probC = curramb.probC*mldist.C_C/totalprob;
-          curramb.probG = curramb.probG*mldist.C_G/totalprob;
-          curramb.probT = curramb.probT*mldist.C_T/totalprob;
-          break;
-        case DNA_G_:
-           totalprob = curramb.probA*mldist.A_G + curramb.probC*mldist.C_G + curramb.probG*mldist.G_G + curramb.probT*mldist.G_T;
-          curramb.probA = curramb.probA*mldist.A_G/totalprob;
-          curramb.probC = curramb.probC*mldist.C_G/totalprob;
-          curramb.probG = curramb.probG*mldist.G_G/totalprob;
-          curramb.probT = curramb.probT*mldist.G_T/totalprob;
-          break;
-        case DNA_T_:
-           totalprob = curramb.probA*mldist.A_T + curramb.probC*mldist.C_T + curramb.probG*mldist.G_T + curramb.probT*mldist.T_T;
-          curramb.probA = curramb.probA*mldist.A_T/totalprob;
-          curramb.probC = curramb.probC*mldist.C_T/totalprob;
-          curramb.probG = curramb.probG*mldist.G_T/totalprob;
-          curramb.probT = curramb.probT*mldist.T_T/totalprob;
-          break;
-        default:
-          PROG_ERROR("ERROR SHOULDNT COME HERE");
-        }
-        (*iter).ambiguity = curramb;
+    //contained in the ambiguity.
+    bool contained[4];
+    for ( int n = 0 ; n < 4 ; n++ ){
+      contained[n] = is_ambiguity_contained(regularnucleotide2ambiguity_nucleotide((nucleotide) n), amb);
+      run.ambiguity[n] = ( contained[n] ? resolve(amb, (nucleotide) n) : amb );
+    }
+    if ( run.end - run.start == 1 ){
+      //a single position is not in the masks, its run has its resolution
+      const nucleotide n = _regularNucleotide(temp_str.data, temp_str.unknownData, run.start);
+      const ambiguity_nucleotide resolution = run.ambiguity[( n == DNA_UNKNOWN_ ? (int) UNRESOLVED : (int) n )];
+      for ( int r = 0 ; r < NUM_RESOLUTIONS ; r++ )
+        run.ambiguity[r] = resolution;
+      ambiguities[run.index].ambiguity = resolution;
+      continue;
+    }
+    int start = run.start;
+    while ( start < run.end ){
+      size_t w;
+      const uint64_t mask = _nextWord(start, run.end, w);
+      uint64_t masks[4];
+      _nucleotideMasks(td[w], ~tu[w] & mask, masks);
+      uint64_t r = 0;
+      for ( int n = 0 ; n < 4 ; n++ )
+        r |= ( contained[n] ? masks[n] : 0 );
+      resolved[w] |= r;
+      templateData[w] |= td[w] & (r | (r << 1));
+    }
+    for ( int pos = run.start ; pos < run.end ; pos++ )
+      ambiguities[run.index + pos - run.start].ambiguity = run.ambiguity[_resolution(pos)];
+  }
+}
+
+// AMBIGUITY RUNS
+void
+DNA_b128_String::_addAmbiguityRuns(size_t first){
+  std::vector<ambiguity_run> &runs = ambiguityRuns.runs;
+  for ( size_t i = first ; i < ambiguities.size() ; i++ ){
+    const ambiguity_nucleotide_at_position &ambpos = ambiguities[i];
+    //the probabilities are compared bit by bit, a run has one distance
+    if ( ! runs.empty() ){
+      ambiguity_run &run = runs.back();
+      if ( run.end == ambpos.position &&
+           memcmp(&run.ambiguity[UNRESOLVED], &ambpos.ambiguity, sizeof(ambiguity_nucleotide)) == 0 ){
+        run.end++;
+        continue;
       }
     }
+    ambiguity_run run;
+    run.start = ambpos.position;
+    run.end = ambpos.position+1;
+    run.index = i;
+    for ( int r = 0 ; r < NUM_RESOLUTIONS ; r++ )
+      run.ambiguity[r] = ambpos.ambiguity;
+    runs.push_back(run);
   }
 }
 
+int
+DNA_b128_String::_resolution(int pos) const{
+  if ( ambiguityRuns.resolved.empty() )
+    return UNRESOLVED;
+  const size_t w = _wordIndex(pos);
+  const int bit = _bitIndex(pos);
+  if ( ((ambiguityRuns.resolved[w] >> bit) & 1) == 0 )
+    return UNRESOLVED;
+  return (ambiguityRuns.templateData[w] >> bit) & 3;
+}
+
+const ambiguity_nucleotide &
+DNA_b128_String::_runAmbiguity(const ambiguity_run &run, int pos) const{
+  if ( run.end - run.start == 1 )
+    return run.ambiguity[UNRESOLVED];
+  return run.ambiguity[_resolution(pos)];
+}
+
+void
+DNA_b128_String::_resolutionMasks(uint64_t mask, size_t w, uint64_t masks[NUM_RESOLUTIONS]) const{
+  if ( ambiguityRuns.resolved.empty() ){
+    masks[DNA_A_] = masks[DNA_C_] = masks[DNA_G_] = masks[DNA_T_] = 0;
+    masks[UNRESOLVED] = mask;
+    return;
+  }
+  const uint64_t r = ambiguityRuns.resolved[w] & mask;
+  _nucleotideMasks(ambiguityRuns.templateData[w], r, masks);
+  masks[UNRESOLVED] = mask & ~r;
+}
+
 
 //
 // CORRECT DISTANCE COMPUTATION WITH AMBIGUITIES
 //
-simple_string_distance
-DNA_b128_String::correctDistanceWithAmbiguitiesUsingBackgroundFrequences(simple_string_distance sp,
-                                                                         const DNA_b128_String &s1,
-                                                                         const DNA_b128_String &s2){
-  simple_string_distance real_distance = sp;
-
-  //traverse the ambiguities and compute the correct distance.
-  std::vector<ambiguity_nucleotide_at_position>::const_iterator i1 = s1.ambiguities.begin();
-  std::vector<ambiguity_nucleotide_at_position>::const_iterator i2 = s2.ambiguities.begin();
-  int pos1 = ( i1 != s1.ambiguities.end() ? (*i1).position : INT_MAX);
-  int pos2 = ( i2 != s2.ambiguities.end() ? (*i2).position : INT_MAX);
-
-  //TRAVERSE
-  // all ambiguities in order
-  while( pos1 < INT_MAX || pos2 < INT_MAX ){
-
-    //if two ambiguities match then there has been one then this has been
-    //treated as a match of two unkowns.
-    ambiguity_distance amdist;
-    if ( pos1 == pos2 ){
-      ambiguity_nucleotide an1 = (*i1).ambiguity;
-      ambiguity_nucleotide an2 = (*i2).ambiguity;
-
-      amdist = compute_ambiguity_distance(an1,an2);
-      
-      //---
-      //update the distance
-      real_distance.transitions += amdist.purine_transition_prob+amdist.pyrimidine_transition_prob;
-      real_distance.transversions += amdist.transversion_prob;
-      real_distance.deletedPositions -= 1;
-      
-      ++i1;
-      ++i2;
-      pos1 = ( i1 != s1.ambiguities.end() ? (*i1).position : INT_MAX);
-      pos2 = ( i2 != s2.ambiguities.end() ? (*i2).position : INT_MAX);
+
+void
+DNA_b128_String::_countResolutions(const DNA_b128_String &s, const DNA_b128_String &other,
+                                   int start, int end, const SiteWeights *weights,
+                                   unsigned int counts[NUM_RESOLUTIONS][4]){
+  const uint64_t *d = reinterpret_cast<const uint64_t*>(other.data);
+  const uint64_t *u = reinterpret_cast<const uint64_t*>(other.unknownData);
+  memset(counts, 0, NUM_RESOLUTIONS*sizeof(counts[0]));
+  while ( start < end ){
+    size_t w;
+    const uint64_t mask = _nextWord(start, end, w);
+    uint64_t nucleotides[4];
+    uint64_t resolutions[NUM_RESOLUTIONS];
+    _nucleotideMasks(d[w], ~u[w] & mask, nucleotides);
+    s._resolutionMasks(mask, w, resolutions);
+    for ( int r = 0 ; r < NUM_RESOLUTIONS ; r++ ){
+      if ( resolutions[r] == 0 )
+        continue;
+      for ( int n = 0 ; n < 4 ; n++ )
+        counts[r][n] += _count(resolutions[r] & nucleotides[n], weights, w);
     }
-    else if ( pos1 < pos2 ){
-      ambiguity_nucleotide an1 = (*i1).ambiguity;
-      nucleotide n = s2.getNucleotideNOAMBIGUITY(pos1);
-      if ( n != DNA_UNKNOWN_ ){
-        ambiguity_nucleotide an2 = regularnucleotide2ambiguity_nucleotide(n);
-        amdist = compute_ambiguity_distance(an1,an2);
-        
-        //---
-        //update the distance
-        real_distance.transitions += amdist.purine_transition_prob+amdist.pyrimidine_transition_prob;
-        real_distance.transversions += amdist.transversion_prob;
-        real_distance.deletedPositions -= 1;
-      }
-      ++i1;
-      pos1 = ( i1 != s1.ambiguities.end() ? (*i1).position : INT_MAX);
+  }
+}
+
+void
+DNA_b128_String::_countResolutions(const DNA_b128_String &s1, const DNA_b128_String &s2,
+                                   int start, int end, const SiteWeights *weights,
+                                   unsigned int counts[NUM_RESOLUTIONS][NUM_RESOLUTIONS]){
+  memset(counts, 0, NUM_RESOLUTIONS*sizeof(counts[0]));
+  while ( start < end ){
+    size_t w;
+    const uint64_t mask = _nextWord(start, end, w);
+    uint64_t resolutions1[NUM_RESOLUTIONS];
+    uint64_t resolutions2[NUM_RESOLUTIONS];
+    s1._resolutionMasks(mask, w, resolutions1);
+    s2._resolutionMasks(mask, w, resolutions2);
+    for ( int r1 = 0 ; r1 < NUM_RESOLUTIONS ; r1++ ){
+      if ( resolutions1[r1] == 0 )
+        continue;
+      for ( int r2 = 0 ; r2 < NUM_RESOLUTIONS ; r2++ )
+        counts[r1][r2] += _count(resolutions1[r1] & resolutions2[r2], weights, w);
     }
-    else {// pos1 > pos2
-      ambiguity_nucleotide an2 = (*i2).ambiguity;
-      nucleotide n = s1.getNucleotideNOAMBIGUITY(pos2);
-      if ( n != DNA_UNKNOWN_ ){
-        ambiguity_nucleotide an1 = regularnucleotide2ambiguity_nucleotide(n);
-        amdist = compute_ambiguity_distance(an1,an2);
-        //---
-        //update the distance
-        real_distance.transitions += amdist.purine_transition_prob+amdist.pyrimidine_transition_prob;
-        real_distance.transversions += amdist.transversion_prob;
-        real_distance.deletedPositions -= 1;
-      }
-      
-      ++i2;
-      pos2 = ( i2 != s2.ambiguities.end() ? (*i2).position : INT_MAX);
+  }
+}
+
+template<class Correction>
+void
+DNA_b128_String::_forEachAmbiguityRun(const DNA_b128_String &s1, const DNA_b128_String &s2, Correction &correct){
+  const SiteWeights *weights = s1.siteWeights;
+  const std::vector<ambiguity_run> &runs1 = s1.ambiguityRuns.runs;
+  const std::vector<ambiguity_run> &runs2 = s2.ambiguityRuns.runs;
+  unsigned int counts[NUM_RESOLUTIONS][4];
+  unsigned int bothCounts[NUM_RESOLUTIONS][NUM_RESOLUTIONS];
+
+  //the runs of s1 against the regular nucleotides of s2
+  std::vector<ambiguity_run>::const_iterator r1 = runs1.begin();
+  for ( ; r1 != runs1.end() ; ++r1 ){
+    const ambiguity_run &run = *r1;
+    if ( run.end - run.start == 1 ){
+      //the runs of the scattered ambiguity codes are single positions
+      const nucleotide n = _regularNucleotide(s2.data, s2.unknownData, run.start);
+      const unsigned int count = ( weights == NULL ? 1 : weights->getWeight(run.start) );
+      if ( n != DNA_UNKNOWN_ && count != 0 )
+        correct(count, &run.ambiguity[UNRESOLVED], DNA_UNKNOWN_, (const ambiguity_nucleotide *) NULL, n);
+      continue;
+    }
+    _countResolutions(s1, s2, run.start, run.end, weights, counts);
+    for ( int r = 0 ; r < NUM_RESOLUTIONS ; r++ )
+      for ( int n = 0 ; n < 4 ; n++ )
+        if ( counts[r][n] != 0 )
+          correct(counts[r][n], &run.ambiguity[r], DNA_UNKNOWN_, (const ambiguity_nucleotide *) NULL, (nucleotide) n);
+  }
+  //the runs of s2 against the regular nucleotides of s1
+  std::vector<ambiguity_run>::const_iterator r2 = runs2.begin();
+  for ( ; r2 != runs2.end() ; ++r2 ){
+    const ambiguity_run &run = *r2;
+    if ( run.end - run.start == 1 ){
+      const nucleotide n = _regularNucleotide(s1.data, s1.unknownData, run.start);
+      const unsigned int count = ( weights == NULL ? 1 : weights->getWeight(run.start) );
+      if ( n != DNA_UNKNOWN_ && count != 0 )
+        correct(count, (const ambiguity_nucleotide *) NULL, n, &run.ambiguity[UNRESOLVED], DNA_UNKNOWN_);
+      continue;
+    }
+    _countResolutions(s2, s1, run.start, run.end, weights, counts);
+    for ( int r = 0 ; r < NUM_RESOLUTIONS ; r++ )
+      for ( int n = 0 ; n < 4 ; n++ )
+        if ( counts[r][n] != 0 )
+          correct(counts[r][n], (const ambiguity_nucleotide *) NULL, (nucleotide) n, &run.ambiguity[r], DNA_UNKNOWN_);
+  }
+  //the runs of both
+  r1 = runs1.begin();
+  r2 = runs2.begin();
+  while ( r1 != runs1.end() && r2 != runs2.end() ){
+    const int start = ( (*r1).start > (*r2).start ? (*r1).start : (*r2).start );
+    const int end = ( (*r1).end < (*r2).end ? (*r1).end : (*r2).end );
+    if ( start + 1 == end ){
+      const unsigned int count = ( weights == NULL ? 1 : weights->getWeight(start) );
+      if ( count != 0 )
+        correct(count, &s1._runAmbiguity(*r1, start), DNA_UNKNOWN_, &s2._runAmbiguity(*r2, start), DNA_UNKNOWN_);
     }
+    else if ( start < end ){
+      _countResolutions(s1, s2, start, end, weights, bothCounts);
+      for ( int i = 0 ; i < NUM_RESOLUTIONS ; i++ )
+        for ( int j = 0 ; j < NUM_RESOLUTIONS ; j++ )
+          if ( bothCounts[i][j] != 0 )
+            correct(bothCounts[i][j], &(*r1).ambiguity[i], DNA_UNKNOWN_, &(*r2).ambiguity[j], DNA_UNKNOWN_);
+    }
+    if ( (*r1).end < (*r2).end )
+      ++r1;
+    else
+      ++r2;
+  }
+}
 
+//the distance with the probabilities of the background frequences
+struct BackgroundAmbiguityDistance{
+  ambiguity_distance operator()(const ambiguity_nucleotide *a1, nucleotide n1,
+                                const ambiguity_nucleotide *a2, nucleotide n2) const{
+    return compute_ambiguity_distance(( a1 == NULL ? regularnucleotide2ambiguity_nucleotide(n1) : *a1 ),
+                                      ( a2 == NULL ? regularnucleotide2ambiguity_nucleotide(n2) : *a2 ));
   }
-  //---------------------
-  
-  return real_distance;  
+};
+
+//the distance with the transition probabilities
+struct TransitionAmbiguityDistance{
+  ML_string_distance tp;
+  ambiguity_distance operator()(const ambiguity_nucleotide *a1, nucleotide n1,
+                                const ambiguity_nucleotide *a2, nucleotide n2) const{
+    return compute_ambiguity_distance_using_transition_probabilities(
+                                      ( a1 == NULL ? regularnucleotide2ambiguity_nucleotide(n1) : *a1 ),
+                                      ( a2 == NULL ? regularnucleotide2ambiguity_nucleotide(n2) : *a2 ), tp);
+  }
+};
+
+//the same as above but a regular nucleotide is not converted to an
+//ambiguity, which is faster
+struct RegularTransitionAmbiguityDistance{
+  ML_string_distance tp;
+  ambiguity_distance operator()(const ambiguity_nucleotide *a1, nucleotide n1,
+                                const ambiguity_nucleotide *a2, nucleotide n2) const{
+    if ( a1 == NULL )
+      return compute_ambiguity_distance_using_transition_probabilities(n1, *a2, tp);
+    if ( a2 == NULL )
+      return compute_ambiguity_distance_using_transition_probabilities(n2, *a1, tp);
+    return compute_ambiguity_distance_using_transition_probabilities(*a1, *a2, tp);
+  }
+};
+
+//Adds the distances of the ambiguities to a simple distance
+template<class Distance>
+struct SimpleAmbiguityCorrection{
+  simple_string_distance real_distance;
+  const Distance &distance;
+
+  SimpleAmbiguityCorrection(const simple_string_distance &d, const Distance &distance_)
+    : real_distance(d), distance(distance_){}
+
+  void operator()(unsigned int count, const ambiguity_nucleotide *a1, nucleotide n1,
+                  const ambiguity_nucleotide *a2, nucleotide n2){
+    const ambiguity_distance amdist = distance(a1, n1, a2, n2);
+    real_distance.transitions += count*(amdist.purine_transition_prob+amdist.pyrimidine_transition_prob);
+    real_distance.transversions += count*amdist.transversion_prob;
+    real_distance.deletedPositions -= count;
+  }
+};
+
+//Adds the distances of the ambiguities to a TN distance
+template<class Distance>
+struct TNAmbiguityCorrection{
+  TN_string_distance real_distance;
+  const Distance &distance;
+
+  TNAmbiguityCorrection(const TN_string_distance &d, const Distance &distance_)
+    : real_distance(d), distance(distance_){}
+
+  void operator()(unsigned int count, const ambiguity_nucleotide *a1, nucleotide n1,
+                  const ambiguity_nucleotide *a2, nucleotide n2){
+    const ambiguity_distance amdist = distance(a1, n1, a2, n2);
+    real_distance.purine_transitions += count*amdist.purine_transition_prob;
+    real_distance.pyrimidine_transitions += count*amdist.pyrimidine_transition_prob;
+    real_distance.transversions += count*amdist.transversion_prob;
+    real_distance.deletedPositions -= count;
+  }
+};
+
+
+simple_string_distance
+DNA_b128_String::correctDistanceWithAmbiguitiesUsingBackgroundFrequences(simple_string_distance sp,
+                                                                         const DNA_b128_String &s1,
+                                                                         const DNA_b128_String &s2){
+  const BackgroundAmbiguityDistance distance = BackgroundAmbiguityDistance();
+  SimpleAmbiguityCorrection<BackgroundAmbiguityDistance> correction(sp, distance);
+  _forEachAmbiguityRun(s1, s2, correction);
+  return correction.real_distance;
 }
 
 
@@ -634,78 +1130,10 @@ TN_string_distance
 DNA_b128_String::correctDistanceWithAmbiguitiesUsingBackgroundFrequences(TN_string_distance sp,
                                                                          const DNA_b128_String &s1,
                                                                          const DNA_b128_String &s2){
-  TN_string_distance real_distance = sp;
-
-  //traverse the ambiguities and compute the correct distance.
-  std::vector<ambiguity_nucleotide_at_position>::const_iterator i1 = s1.ambiguities.begin();
-  std::vector<ambiguity_nucleotide_at_position>::const_iterator i2 = s2.ambiguities.begin();
-  int pos1 = ( i1 != s1.ambiguities.end() ? (*i1).position : INT_MAX);
-  int pos2 = ( i2 != s2.ambiguities.end() ? (*i2).position : INT_MAX);
-
-  //TRAVERSE
-  // all ambiguities in order
-  while( pos1 < INT_MAX || pos2 < INT_MAX ){
-
-    //if two ambiguities match then there has been one then this has been
-    //treated as a match of two unkowns.
-    ambiguity_distance amdist;
-    if ( pos1 == pos2 ){
-      ambiguity_nucleotide an1 = (*i1).ambiguity;
-      ambiguity_nucleotide an2 = (*i2).ambiguity;
-
-      amdist = compute_ambiguity_distance(an1,an2);
-      
-      //---
-      //update the distance
-      real_distance.purine_transitions += amdist.purine_transition_prob;
-      real_distance.pyrimidine_transitions += amdist.pyrimidine_transition_prob;
-      real_distance.transversions += amdist.transversion_prob;
-      real_distance.deletedPositions -= 1;
-      
-      ++i1;
-      ++i2;
-      pos1 = ( i1 != s1.ambiguities.end() ? (*i1).position : INT_MAX);
-      pos2 = ( i2 != s2.ambiguities.end() ? (*i2).position : INT_MAX);
-    }
-    else if ( pos1 < pos2 ){
-      ambiguity_nucleotide an1 = (*i1).ambiguity;
-      nucleotide n = s2.getNucleotideNOAMBIGUITY(pos1);
-      if ( n != DNA_UNKNOWN_ ){
-        ambiguity_nucleotide an2 = regularnucleotide2ambiguity_nucleotide(n);
-        amdist = compute_ambiguity_distance(an1,an2);
-        
-        //---
-        //update the distance
-        real_distance.purine_transitions += amdist.purine_transition_prob;
-        real_distance.pyrimidine_transitions += amdist.pyrimidine_transition_prob;
-        real_distance.transversions += amdist.transversion_prob;
-        real_distance.deletedPositions -= 1;
-      }
-      ++i1;
-      pos1 = ( i1 != s1.ambiguities.end() ? (*i1).position : INT_MAX);
-    }
-    else {// pos1 > pos2
-      ambiguity_nucleotide an2 = (*i2).ambiguity;
-      nucleotide n = s1.getNucleotideNOAMBIGUITY(pos2);
-      if ( n != DNA_UNKNOWN_ ){
-        ambiguity_nucleotide an1 = regularnucleotide2ambiguity_nucleotide(n);
-        amdist = compute_ambiguity_distance(an1,an2);
-        //---
-        //update the distance
-        real_distance.purine_transitions += amdist.purine_transition_prob;
-        real_distance.pyrimidine_transitions += amdist.pyrimidine_transition_prob;
-        real_distance.transversions += amdist.transversion_prob;
-        real_distance.deletedPositions -= 1;
-      }
-      
-      ++i2;
-      pos2 = ( i2 != s2.ambiguities.end() ? (*i2).position : INT_MAX);
-    }
-
-  }
-  //---------------------
-  
-  return real_distance;  
+  const BackgroundAmbiguityDistance distance = BackgroundAmbiguityDistance();
+  TNAmbiguityCorrection<BackgroundAmbiguityDistance> correction(sp, distance);
+  _forEachAmbiguityRun(s1, s2, correction);
+  return correction.real_distance;
 } 
 
 
@@ -714,78 +1142,10 @@ DNA_b128_String::correctDistanceWithAmbiguitiesUsingTransitionProbabilities(simp
                                                                             ML_string_distance tp,
                                                                             const DNA_b128_String &s1,
                                                                             const DNA_b128_String &s2){
-  
-  simple_string_distance real_distance = sp;
-
-  //traverse the ambiguities and compute the correct distance.
-  std::vector<ambiguity_nucleotide_at_position>::const_iterator i1 = s1.ambiguities.begin();
-  std::vector<ambiguity_nucleotide_at_position>::const_iterator i2 = s2.ambiguities.begin();
-  int pos1 = ( i1 != s1.ambiguities.end() ? (*i1).position : INT_MAX);
-  int pos2 = ( i2 != s2.ambiguities.end() ? (*i2).position : INT_MAX);
-
-  //TRAVERSE
-  // all ambiguities in order
-  while( pos1 < INT_MAX || pos2 < INT_MAX ){
-    ambiguity_distance amdist;
-    //if two ambiguities match then there has been one then this has been
-    //treated as a match of two unkowns.
-    if ( pos1 == pos2 ){
-      ambiguity_nucleotide an1 = (*i1).ambiguity;
-      ambiguity_nucleotide an2 = (*i2).ambiguity;
-
-      amdist = compute_ambiguity_distance_using_transition_probabilities(an1,an2,tp);
-
-      //---
-      //update the distance
-      real_distance.transitions += amdist.purine_transition_prob+amdist.pyrimidine_transition_prob;
-      real_distance.transversions += amdist.transversion_prob;
-      real_distance.deletedPositions -= 1;
-
-      ++i1;
-      ++i2;
-      pos1 = ( i1 != s1.ambiguities.end() ? (*i1).position : INT_MAX);
-      pos2 = ( i2 != s2.ambiguities.end() ? (*i2).position : INT_MAX);
-    }
-    else if ( pos1 < pos2 ){
-      ambiguity_nucleotide an1 = (*i1).ambiguity;
-      nucleotide n = s2.getNucleotideNOAMBIGUITY(pos1);
-      if ( n != DNA_UNKNOWN_ ){
-	//        ambiguity_nucleotide an2 = regularnucleotide2ambiguity_nucleotide(n);
-      
-        amdist = compute_ambiguity_distance_using_transition_probabilities(n,an1,tp);
-        //---
-        //update the distance
-        real_distance.transitions += amdist.purine_transition_prob+amdist.pyrimidine_transition_prob;
-        real_distance.transversions += amdist.transversion_prob;
-        real_distance.deletedPositions -= 1;
-      }
-      ++i1;
-      pos1 = ( i1 != s1.ambiguities.end() ? (*i1).position : INT_MAX);
-    }
-    else {// pos1 > pos2
-      ambiguity_nucleotide an2 = (*i2).ambiguity;
-      nucleotide n = s1.getNucleotideNOAMBIGUITY(pos2);
-      if ( n != DNA_UNKNOWN_ ){
-	//        ambiguity_nucleotide an1 = regularnucleotide2ambiguity_nucleotide(n);
-      
-        amdist = compute_ambiguity_distance_using_transition_probabilities(n,an2,tp);
-        //---
-        //update the distance
-        real_distance.transitions += amdist.purine_transition_prob+amdist.pyrimidine_transition_prob;
-        real_distance.transversions += amdist.transversion_prob;
-        real_distance.deletedPositions -= 1;
-
-      }
-      
-      ++i2;
-      pos2 = ( i2 != s2.ambiguities.end() ? (*i2).position : INT_MAX);
-    }
-
-  }
-
-  
-  return real_distance;  
-  
+  const RegularTransitionAmbiguityDistance distance = {tp};
+  SimpleAmbiguityCorrection<RegularTransitionAmbiguityDistance> correction(sp, distance);
+  _forEachAmbiguityRun(s1, s2, correction);
+  return correction.real_distance;
 }
 
 
@@ -794,85 +1154,8 @@ DNA_b128_String::correctDistanceWithAmbiguitiesUsingTransitionProbabilities(TN_s
                                                                             ML_string_distance tp,
                                                                             const DNA_b128_String &s1,
                                                                             const DNA_b128_String &s2){
-  
-  TN_string_distance real_distance = sp;
-
-  //traverse the ambiguities and compute the correct distance.
-  std::vector<ambiguity_nucleotide_at_position>::const_iterator i1 = s1.ambiguities.begin();
-  std::vector<ambiguity_nucleotide_at_position>::const_iterator i2 = s2.ambiguities.begin();
-  int pos1 = ( i1 != s1.ambiguities.end() ? (*i1).position : INT_MAX);
-  int pos2 = ( i2 != s2.ambiguities.end() ? (*i2).position : INT_MAX);
-
-  //TRAVERSE
-  // all ambiguities in order
-  while( pos1 < INT_MAX || pos2 < INT_MAX ){
-    ambiguity_distance amdist;
-    //if two ambiguities match then there has been one then this has been
-    //treated as a match of two unkowns.
-    if ( pos1 == pos2 ){
-      ambiguity_nucleotide an1 = (*i1).ambiguity;
-      ambiguity_nucleotide an2 = (*i2).ambiguity;
-
-      amdist = compute_ambiguity_distance_using_transition_probabilities(an1,an2,tp);
-      //---
-      //update the distance
-      real_distance.purine_transitions += amdist.purine_transition_prob;
-      real_distance.pyrimidine_transitions+= amdist.pyrimidine_transition_prob;
-      real_distance.transversions += amdist.transversion_prob;
-      real_distance.deletedPositions -= 1;
-
-      ++i1;
-      ++i2;
-      pos1 = ( i1 != s1.ambiguities.end() ? (*i1).position : INT_MAX);
-      pos2 = ( i2 != s2.ambiguities.end() ? (*i2).position : INT_MAX);
-    }
-    else if ( pos1 < pos2 ){
-      ambiguity_nucleotide an1 = (*i1).ambiguity;
-      nucleotide n = s2.getNucleotideNOAMBIGUITY(pos1);
-      if ( n != DNA_UNKNOWN_ ){
-        ambiguity_nucleotide an2 = regularnucleotide2ambiguity_nucleotide(n);
-      
-        amdist = compute_ambiguity_distance_using_transition_probabilities(an1,an2,tp);
-        //---
-        //update the distance
-        real_distance.purine_transitions += amdist.purine_transition_prob;
-        real_distance.pyrimidine_transitions+= amdist.pyrimidine_transition_prob;
-        real_distance.transversions += amdist.transversion_prob;
-        real_distance.deletedPositions -= 1;
-      }
-      ++i1;
-      pos1 = ( i1 != s1.ambiguities.end() ? (*i1).position : INT_MAX);
-    }
-    else {// pos1 > pos2
-      ambiguity_nucleotide an2 = (*i2).ambiguity;
-      nucleotide n = s1.getNucleotideNOAMBIGUITY(pos2);
-      if ( n != DNA_UNKNOWN_ ){
-        ambiguity_nucleotide an1 = regularnucleotide2ambiguity_nucleotide(n);
-      
-        amdist = compute_ambiguity_distance_using_transition_probabilities(an1,an2,tp);
-        //---
-        //update the distance
-        real_distance.purine_transitions += amdist.purine_transition_prob;
-        real_distance.pyrimidine_transitions+= amdist.pyrimidine_transition_prob;
-        real_distance.transversions += amdist.transversion_prob;
-        real_distance.deletedPositions -= 1;
-
-      }
-      
-      ++i2;
-      pos2 = ( i2 != s2.ambiguities.end() ? (*i2).position : INT_MAX);
-    }
-
-  }
-  //---------------------
-  
-  return real_distance;  
-  
+  const TransitionAmbiguityDistance distance = {tp};
+  TNAmbiguityCorrection<TransitionAmbiguityDistance> correction(sp, distance);
+  _forEachAmbiguityRun(s1, s2, correction);
+  return correction.real_distance;
 }
-
-
-
-
-
-
-
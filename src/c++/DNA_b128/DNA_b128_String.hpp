@@ -23,6 +23,8 @@
 #include "dna_pairwise_sequence_likelihood.hpp"
 #include "Object.hpp"
 
+class SiteWeights;
+
 //-----------------------------------------------
 // DNA_b128_String
 //
@@ -62,6 +64,9 @@ public:
   DNA_b128_String(int capacity);
  
   //COPY
+  //A string that does not own its memory keeps it if it is as large
+  //as the memory of str_b128, which is how a PackedAlignment moves its
+  //strings.
   DNA_b128_String(const DNA_b128_String &str_b128);
   void operator=(const DNA_b128_String &str_b128);
  
@@ -69,11 +74,19 @@ public:
   // See append() below.
   DNA_b128_String(int capacity, const std::string &str);
   DNA_b128_String(int capacity, const char *c_str);
+
+  // Creates an empty string stored in memory owned by someone else,
+  // e.g. a PackedAlignment. data and unknownData must each hold
+  // numDatas b128s and outlive the string. The memory is not freed by
+  // the string.
+  DNA_b128_String(b128 *data, b128 *unknownData, size_t numDatas);
   
   virtual ~DNA_b128_String();
 
   // If capacity>getTotalCapacity() then new memory is allocated.
   // Otherwise the chars and unknown datas are cleared.
+  // A string that does not own its memory gets its own memory if it
+  // has to grow.
   void reInitiate(size_t capacity=0);
 
   //---------------------------------------
@@ -106,6 +119,9 @@ public:
   // Returns the number of chars read. 
   
   int append(const char *c_str);
+  // The same for the length chars at c_str, which need not be null
+  // terminated, e.g. a line of a mapped file.
+  int append(const char *c_str, size_t length);
   int append(const std::string &str){
     return append(str.c_str());
   }
@@ -126,6 +142,9 @@ public:
   // EQUALS
   // VERY SLOW IMPLEMENTATION! 
   virtual bool equals(const Object *o) const;
+  // A hash of the chars and the unknowns, equal strings have equal
+  // hash codes. The ambiguities are not included.
+  virtual size_t hashCode() const;
 
   //------------------------------------
   // DISTANCE COMPUTATION
@@ -134,11 +153,38 @@ public:
   // strings.  All ambiguities are treated as unknowns. To update
   // distance computation to include the ambiguities call the
   // associated methods below.
+  //
+  // The functions keep no state between calls and may be called
+  // concurrently from several threads.
   static simple_string_distance computeDistance(const DNA_b128_String &s1,
                                                 const DNA_b128_String &s2);
   static TN_string_distance computeTAMURANEIDistance(const DNA_b128_String &s1,
                                                      const DNA_b128_String &s2);
 
+  //
+  // The same computations for one string s against numOthers other
+  // strings, the result for others[k] is written to distances[k].
+  // The others are compared in small blocks and s is read once for
+  // each block instead of once for each string. Use these when one
+  // string is compared to many, e.g. a row of the distance matrix.
+  //
+  // If maxDifferences is given the counting of a pair may stop as
+  // soon as it has more than maxDifferences transitions and
+  // transversions. The counts of such a pair are not complete but also
+  // have more than maxDifferences differences, so only the pairs with
+  // at most maxDifferences differences are known exactly.
+
+  static void computeDistances(const DNA_b128_String &s,
+                               const DNA_b128_String *const *others,
+                               size_t numOthers,
+                               simple_string_distance *distances,
+                               unsigned int maxDifferences=UINT_MAX);
+  static void computeTAMURANEIDistances(const DNA_b128_String &s,
+                                        const DNA_b128_String *const *others,
+                                        size_t numOthers,
+                                        TN_string_distance *distances,
+                                        unsigned int maxDifferences=UINT_MAX);
+
 
   //the number of gaps is the number of missmatches of '-' toward something that is not '-'.
   static int getNumberOfGaps(const DNA_b128_String &s1,
@@ -164,11 +210,28 @@ public:
   void resolveAmbiguities(const DNA_b128_String &temp_str);
   void resolveAmbiguitiesUsingTransitionProbabilities(const DNA_b128_String &temp_str, ML_string_distance mldist);
 
+  // The resolution and calcAmbiguityProbabilities() change the
+  // ambiguities in place. A string that is used for several distance
+  // matrices, e.g. the site patterns of the bootstrap replicates, can
+  // save its ambiguities once and restore them before each matrix.
+  void saveAmbiguities(){
+    savedAmbiguities = ambiguities;
+    savedAmbiguityRuns = ambiguityRuns;
+  }
+  void restoreAmbiguities(){
+    ambiguities = savedAmbiguities;
+    ambiguityRuns = savedAmbiguityRuns;
+  }
+
   // CORRECT DISTANCE WITH AMBIGUITIES
   //
   // There are two models for this:
   //      1) use the frequencies of nucleotides to assign probabilities of each ambiguity (uniform or background).
   //      2) use the frequencies AND the transprobabilities to compute the ambiguity distance
+  //
+  // The ambiguities are corrected a run at a time, see ambiguityRuns
+  // below, i.e. the distance of a run is multiplied by the number of
+  // positions it covers.
   
   //Before this function is called make sure that calcAmbiguityProbabilities() have been called.
   static simple_string_distance correctDistanceWithAmbiguitiesUsingBackgroundFrequences(simple_string_distance sp,
@@ -201,6 +264,7 @@ public:
     for ( ; iter != ambiguities.end() ; ++iter ){
       (*iter).ambiguity = nucleotide2ambiguity_nucleotide((*iter).ambiguity.n, basefreqA, basefreqC, basefreqG, basefreqT);
     }
+    _updateAmbiguityRuns();
   }
   //set the distribution of each ambiguity to be uniform over the allowed nucleotides in the position.
   void calcAmbiguityProbabilitiesUNIFORM(){
@@ -208,9 +272,32 @@ public:
     for ( ; iter != ambiguities.end() ; ++iter ){
       (*iter).ambiguity = nucleotide2ambiguity_nucleotideUNIFORM((*iter).ambiguity.n);
     }
+    _updateAmbiguityRuns();
   }  
 
 
+  //---------------------------------------------------------------------
+  // SITE WEIGHTS
+  //
+  // A string can hold the site patterns of an alignment instead of
+  // its columns, see SitePatterns.hpp. Each position is then counted
+  // with the weight of its pattern, both in the distance computations
+  // and in the base frequences, which are recomputed by
+  // setSiteWeights(). All strings that are compared must use the same
+  // weights. The weights are not owned by the string and are removed
+  // by reInitiate().
+  void setSiteWeights(const SiteWeights *weights);
+  const SiteWeights *getSiteWeights() const{
+    return siteWeights;
+  }
+  // The number of alignment columns the string represents,
+  // getNumChars() unless it has site weights.
+  size_t getNumSites() const;
+
+  // The weight of the position pos, one if the string has no site
+  // weights. Bootstrap replicates give some positions weight zero.
+  unsigned int getSiteWeight(size_t pos) const;
+
   //---------------------------------------------------------------------
   // BASE FREQUENCES
   typedef struct{
@@ -251,11 +338,23 @@ private:
   // and their positions. WARNING. Note that this implementation
   // depends on that there are very few ambiguities. Especially the
   // get/set methods are very slow due to this array.
+  //
+  // 4) ambiguityRuns: the ambiguities grouped into runs of consecutive
+  // positions with the same probabilities, e.g. the N's at the ends of
+  // a sequence or of a failed amplicon. The resolution keeps the runs
+  // and marks the resolved positions and their template nucleotides
+  // in two masks of the same size as data, so a run has at most five
+  // different probabilities. The distance corrections count the
+  // nucleotides of the other string in a run with the masks, data and
+  // unknownData, and intersect the runs of the two strings. The runs
+  // are updated by every method that changes the ambiguities.
 
   size_t numChars;    
   b128 *data;
   size_t numDatas;
   b128 *unknownData;
+  bool ownsMemory;//false if data and unknownData belong to someone else
+  const SiteWeights *siteWeights;//NULL if every position has weight one
   
   typedef struct{
     ambiguity_nucleotide ambiguity;
@@ -263,6 +362,32 @@ private:
   } ambiguity_nucleotide_at_position;
   
   std::vector<ambiguity_nucleotide_at_position> ambiguities;
+  std::vector<ambiguity_nucleotide_at_position> savedAmbiguities;
+
+  //the template nucleotides are the indices of the resolutions
+  enum { UNRESOLVED = 4, NUM_RESOLUTIONS = 5 };
+
+  typedef struct{
+    int start;
+    int end;//one past the last position
+    int index;//of the first ambiguity of the run
+    //the probabilities of the positions resolved from each template
+    //nucleotide and of the UNRESOLVED ones. A run of one position is
+    //not in the masks below and has its probabilities everywhere.
+    ambiguity_nucleotide ambiguity[NUM_RESOLUTIONS];
+  } ambiguity_run;
+
+  typedef struct{
+    std::vector<ambiguity_run> runs;
+    //the least significant bits of the resolved positions and their
+    //template nucleotides, as the 64 bit words of data. Both are empty
+    //if no position has been resolved.
+    std::vector<uint64_t> resolved;
+    std::vector<uint64_t> templateData;
+  } ambiguity_runs;
+
+  ambiguity_runs ambiguityRuns;
+  ambiguity_runs savedAmbiguityRuns;
   friend bool operator== (const DNA_b128_String::ambiguity_nucleotide_at_position &a,  
 			  const DNA_b128_String::ambiguity_nucleotide_at_position &b);
   
@@ -285,6 +410,54 @@ private:
   //
   void _init_mem(int capacity);
   void _free_mem();
+  void _clear();
+
+  //
+  // Adds the runs of the ambiguities from index first and onwards,
+  // the ambiguities before first must already be in runs.
+  //
+  void _addAmbiguityRuns(size_t first);
+  void _updateAmbiguityRuns(){
+    ambiguityRuns.runs.clear();
+    ambiguityRuns.resolved.clear();
+    ambiguityRuns.templateData.clear();
+    _addAmbiguityRuns(0);
+  }
+  // Resolves the runs and the ambiguities from the template string,
+  // resolve(ambiguity, n) is the resolution of an ambiguity that
+  // contains the template nucleotide n.
+  template<class Resolve>
+  void _resolveAmbiguities(const DNA_b128_String &temp_str, const Resolve &resolve);
+
+  // The resolution of the ambiguity at pos, i.e. its template
+  // nucleotide or UNRESOLVED.
+  int _resolution(int pos) const;
+  // The probabilities of the ambiguity of the run at pos.
+  const ambiguity_nucleotide &_runAmbiguity(const ambiguity_run &run, int pos) const;
+  // Splits the positions mask of the 64 bit word w by their
+  // resolutions.
+  void _resolutionMasks(uint64_t mask, size_t w, uint64_t masks[NUM_RESOLUTIONS]) const;
+
+  // Counts the positions [start,end), at which s has ambiguities, by
+  // their resolutions in s and the regular nucleotides of other,
+  // weighted by weights if it is not NULL.
+  static void _countResolutions(const DNA_b128_String &s, const DNA_b128_String &other,
+                                int start, int end, const SiteWeights *weights,
+                                unsigned int counts[NUM_RESOLUTIONS][4]);
+  // Counts the positions [start,end), at which both strings have
+  // ambiguities, by their resolutions in s1 and s2.
+  static void _countResolutions(const DNA_b128_String &s1, const DNA_b128_String &s2,
+                                int start, int end, const SiteWeights *weights,
+                                unsigned int counts[NUM_RESOLUTIONS][NUM_RESOLUTIONS]);
+
+  // Calls correct(count, a1, n1, a2, n2) for the positions at which
+  // one of the strings has an ambiguity and the other one an
+  // ambiguity or a regular nucleotide. a1 is NULL if s1 has the
+  // regular nucleotide n1 at the positions and likewise for s2, and
+  // count is the number of such positions, weighted by the site
+  // weights.
+  template<class Correction>
+  static void _forEachAmbiguityRun(const DNA_b128_String &s1, const DNA_b128_String &s2, Correction &correct);
 
   //
   // Sets and clears the position in unkownData
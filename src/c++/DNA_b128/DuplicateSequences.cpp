@@ -0,0 +1,100 @@
+//--------------------------------------------------
+//
+// File: DuplicateSequences.cpp
+//
+//--------------------------------------------------
+
+#include "DuplicateSequences.hpp"
+#include "log_utils.hpp"
+#include "Object.hpp"
+#include <unordered_map>
+
+using namespace std;
+
+DuplicateSequences::DuplicateSequences(){
+}
+
+void
+DuplicateSequences::find(const std::vector<DNA_b128_String> &seqs){
+  const size_t numSequences = seqs.size();
+  representatives.resize(numSequences);
+  representativeSequences.clear();
+  multiplicities.clear();
+
+  //the first string of each content, compared with equals()
+  unordered_map<const Object*, size_t, objhash_ptr, objeq_ptr> firstOfContent(2*numSequences);
+  for ( size_t i = 0 ; i < numSequences ; i++ ){
+    if ( ! seqs[i].hasAmbiguities() ){
+      pair<unordered_map<const Object*, size_t, objhash_ptr, objeq_ptr>::iterator, bool> found =
+        firstOfContent.insert(make_pair(&seqs[i], representativeSequences.size()));
+      if ( ! found.second ){
+        representatives[i] = found.first->second;
+        multiplicities[representatives[i]]++;
+        continue;
+      }
+    }
+    representatives[i] = representativeSequences.size();
+    representativeSequences.push_back(i);
+    multiplicities.push_back(1);
+  }
+
+  firstColumns.resize(numSequences);
+  size_t first = representativeSequences.size();
+  for ( size_t i = numSequences ; i > 0 ; i-- ){
+    firstColumns[i-1] = first;
+    if ( representatives[i-1] < first )
+      first = representatives[i-1];
+  }
+}
+
+void
+DuplicateSequences::joinNames(const std::vector<std::string> &names, std::vector<std::string> &joined,
+                              char separator) const{
+  joined.assign(getNumRepresentatives(), "");
+  for ( size_t i = 0 ; i < getNumSequences() ; i++ ){
+    std::string &name = joined[representatives[i]];
+    if ( ! name.empty() )
+      name += separator;
+    name += names[i];
+  }
+}
+
+//---------------------------------------------------------
+// EXPANSION
+
+void
+DuplicateSequences::expand(const StrDblMatrix &repdm, const std::vector<float> &duplicateDists,
+                           StrDblMatrix &dm) const{
+  const size_t numSequences = getNumSequences();
+  if ( repdm.getSize() != getNumRepresentatives() )
+    PROG_ERROR("The matrix is not the matrix of the representatives");
+  dm.resize(numSequences);
+  for ( size_t i = 0 ; i < numSequences ; i++ ){
+    const size_t ri = representatives[i];
+    dm.setDistance(i,i,0);
+    for ( size_t j = i+1 ; j < numSequences ; j++ ){
+      const size_t rj = representatives[j];
+      if ( ri == rj )
+        dm.setDistance(i,j,duplicateDists[ri]);
+      else
+        dm.setDistance(i,j,repdm.getDistance(ri,rj));
+    }
+  }
+}
+
+void
+DuplicateSequences::expandRow(const StrFloRow &reprow, const std::vector<float> &duplicateDists,
+                              size_t i, bool mem_eff_flag, StrFloRow &row) const{
+  const size_t numSequences = getNumSequences();
+  const size_t ri = representatives[i];
+  row.resize(numSequences);
+  for ( size_t j = 0 ; j < numSequences ; j++ ){
+    const size_t rj = representatives[j];
+    if ( j == i || ( j < i && ! mem_eff_flag ) )
+      row.setDistance(j,0);
+    else if ( ri == rj )
+      row.setDistance(j,duplicateDists[ri]);
+    else
+      row.setDistance(j,reprow.getDistance(rj));
+  }
+}
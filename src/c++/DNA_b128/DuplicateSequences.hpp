@@ -0,0 +1,117 @@
+//--------------------------------------------------
+//
+// File: DuplicateSequences.hpp
+//
+//--------------------------------------------------
+
+#ifndef DUPLICATESEQUENCES_HPP
+#define DUPLICATESEQUENCES_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "DNA_b128_String.hpp"
+#include "PackedAlignment.hpp"
+#include "DistanceMatrix.hpp"
+#include "DistanceRow.hpp"
+
+//-----------------------------------------------
+// DUPLICATE SEQUENCES
+//
+// Alignments from outbreak sequencing often contain many identical
+// sequences. Identical sequences have the same distances to all other
+// sequences, so the distances only have to be computed between one
+// representative of each set of identical sequences.
+//
+// find() hashes the strings and gives each sequence the
+// representative of the first sequence it is identical to. The
+// representatives keep the order of the sequences, so the closest
+// neighbor of a string with ambiguities, the first of the sequences at
+// the smallest distance, is the same among the representatives as
+// among all the sequences. Strings with ambiguities are never merged
+// since the distance between two of them is not 0 and their ambiguities
+// are resolved from their closest neighbors. The base frequences must
+// be summed with the multiplicities of the representatives, see
+// AlignmentContext::prepare().
+//
+// The matrix of the representatives is expanded to all sequences with
+// expand(). The distance between two identical sequences is the
+// distance of a representative to itself, see fillDuplicateDistances().
+//
+// EXAMPLE USAGE
+// DuplicateSequences duplicates;
+// duplicates.find(alignment);
+// PackedAlignment representatives;
+// representatives.assign(alignment, duplicates.getRepresentativeSequences());
+// fillMatrices(repdms, representatives, trans_models, numThreads, &duplicates.getMultiplicities());
+// fillDuplicateDistances(dists, representatives, trans_models[0], &duplicates.getMultiplicities());
+// duplicates.expand(repdms[0], dists, dm);
+//
+class DuplicateSequences
+{
+public:
+  DuplicateSequences();
+
+  void find(const std::vector<DNA_b128_String> &seqs);
+  void find(PackedAlignment &seqs){
+    find(seqs.getSequences());
+  }
+
+  size_t getNumSequences() const{
+    return representatives.size();
+  }
+  size_t getNumRepresentatives() const{
+    return representativeSequences.size();
+  }
+  bool hasDuplicates() const{
+    return getNumRepresentatives() < getNumSequences();
+  }
+  // The index of the representative of sequence i.
+  size_t getRepresentative(size_t i) const{
+    return representatives[i];
+  }
+  // The index of the sequence of each representative, the first of
+  // its identical sequences.
+  const std::vector<size_t> &getRepresentativeSequences() const{
+    return representativeSequences;
+  }
+  // The number of sequences of each representative.
+  const std::vector<size_t> &getMultiplicities() const{
+    return multiplicities;
+  }
+
+  // The names of the sequences of each representative separated by
+  // separator, e.g. "a,b,c".
+  void joinNames(const std::vector<std::string> &names, std::vector<std::string> &joined,
+                 char separator=',') const;
+
+  //---------------------------------------
+  // EXPANSION
+  //
+  // duplicateDists[r] is the distance between two sequences of
+  // representative r.
+
+  // dm is the matrix of all sequences given the matrix of the
+  // representatives. The identifiers are untouched.
+  void expand(const StrDblMatrix &repdm, const std::vector<float> &duplicateDists, StrDblMatrix &dm) const;
+
+  // The row of sequence i given the row of its representative. If
+  // mem_eff_flag is false only the distances after the diagonal are
+  // set, as in fillMatrixRow(), and the row of the representative
+  // only needs the distances to the representatives
+  // getFirstColumn(i),...
+  void expandRow(const StrFloRow &reprow, const std::vector<float> &duplicateDists,
+                 size_t i, bool mem_eff_flag, StrFloRow &row) const;
+  // The first representative of the sequences after i.
+  size_t getFirstColumn(size_t i) const{
+    return firstColumns[i];
+  }
+
+private:
+  std::vector<size_t> representatives;
+  std::vector<size_t> representativeSequences;
+  std::vector<size_t> multiplicities;
+  std::vector<size_t> firstColumns;
+};
+
+#endif // DUPLICATESEQUENCES_HPP
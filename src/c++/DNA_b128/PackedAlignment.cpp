@@ -0,0 +1,121 @@
+//--------------------------------------------------
+//
+// File: PackedAlignment.cpp
+//
+//--------------------------------------------------
+
+#include "PackedAlignment.hpp"
+#include "log_utils.hpp"
+#include <stdint.h>
+#include <algorithm>
+#include <string.h>
+
+using namespace std;
+
+//the number of b128s in a cache line
+static const size_t B128_PER_CACHE_LINE = 4;
+
+PackedAlignment::PackedAlignment(){
+  slab = NULL;
+  records = NULL;
+  slabSize = 0;
+  capacity = 0;
+  stride = 0;
+}
+
+PackedAlignment::~PackedAlignment(){
+  sequences.clear();
+  _free_mem();
+}
+
+void
+PackedAlignment::_free_mem(){
+  if ( slab != NULL ){
+    free_b128(slab);
+    slab = NULL;
+    records = NULL;
+    slabSize = 0;
+  }
+}
+
+void
+PackedAlignment::reInitiate(size_t numSequences, size_t capacity){
+  //the same number of b128s as DNA_b128_String::_init_mem
+  const size_t numDatas = (128+capacity)/64;
+  stride = (numDatas + B128_PER_CACHE_LINE - 1)/B128_PER_CACHE_LINE*B128_PER_CACHE_LINE;
+  this->capacity = capacity;
+
+  //the old strings point into the slab
+  sequences.clear();
+
+  const size_t needed = 2*stride*numSequences;
+  if ( needed > slabSize ){
+    _free_mem();
+    slab = alloc_b128(needed + B128_PER_CACHE_LINE - 1);
+    MEM_CHECK(slab);
+    const size_t misalignment = (((uintptr_t) slab)/sizeof(b128)) % B128_PER_CACHE_LINE;
+    records = slab + (misalignment == 0 ? 0 : B128_PER_CACHE_LINE - misalignment);
+    slabSize = needed;
+  }
+
+  sequences.reserve(numSequences);
+  for ( size_t i = 0 ; i < numSequences ; i++ ){
+    b128 *record = records + 2*stride*i;
+    sequences.emplace_back(record, record + stride, numDatas);
+  }
+}
+
+DNA_b128_String &
+PackedAlignment::addSequence(size_t capacity){
+  const size_t numSequences = sequences.size();
+  if ( numSequences == 0 )
+    reInitiate(0, capacity);
+  capacity = max(capacity, this->capacity);
+
+  //the strings are moved when they need more b128s or there is no
+  //room for another string, the vector must not reallocate them
+  //itself since copies would own their memory
+  const bool longer = (128+capacity)/64 > (128+this->capacity)/64;
+  const bool full = ( 2*stride*(numSequences+1) > slabSize || numSequences == sequences.capacity() );
+  if ( longer || full ){
+    PackedAlignment larger;
+    larger.reInitiate(full ? max((size_t) 16, 2*numSequences) : sequences.capacity(), capacity);
+    larger.sequences.resize(numSequences);
+    for ( size_t i = 0 ; i < numSequences ; i++ )
+      larger.sequences[i] = sequences[i];
+    _swap(larger);
+  }
+  this->capacity = capacity;
+
+  //the record may hold an earlier string, and the chars after the
+  //end of a shorter string are compared as empty
+  b128 *record = records + 2*stride*numSequences;
+  memset(record, 0, 2*stride*sizeof(b128));
+  sequences.emplace_back(record, record + stride, (128+capacity)/64);
+  return sequences.back();
+}
+
+void
+PackedAlignment::_swap(PackedAlignment &other){
+  swap(slab, other.slab);
+  swap(records, other.records);
+  swap(slabSize, other.slabSize);
+  swap(capacity, other.capacity);
+  swap(stride, other.stride);
+  sequences.swap(other.sequences);
+}
+
+void
+PackedAlignment::assign(const PackedAlignment &other){
+  reInitiate(other.size(), other.capacity);
+  //the strings have the same number of b128s and are copied in place
+  for ( size_t i = 0 ; i < other.size() ; i++ )
+    sequences[i] = other.sequences[i];
+}
+
+void
+PackedAlignment::assign(const PackedAlignment &other, const std::vector<size_t> &indices){
+  reInitiate(indices.size(), other.capacity);
+  for ( size_t i = 0 ; i < indices.size() ; i++ )
+    sequences[i] = other.sequences[indices[i]];
+}
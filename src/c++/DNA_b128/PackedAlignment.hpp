@@ -0,0 +1,109 @@
+//--------------------------------------------------
+//
+// File: PackedAlignment.hpp
+//
+//--------------------------------------------------
+
+#ifndef PACKEDALIGNMENT_HPP
+#define PACKEDALIGNMENT_HPP
+
+#include <cstddef>
+#include <vector>
+#include "DNA_b128_String.hpp"
+
+//-----------------------------------------------
+// PackedAlignment
+//
+// A set of DNA_b128_Strings whose data and unknownData are stored in
+// one slab of memory instead of in two allocations per string.
+//
+// Every sequence occupies a record of 2*getStride() b128s, the data
+// followed by the unknownData, and record i starts at
+// getStride()*2*i. The stride is rounded up to whole cache lines and
+// the slab is cache line aligned, so no record shares a line with
+// another. Sequences that are compared after each other, e.g. the
+// rows of a tile of the distance matrix, are therefore next to each
+// other in memory, and freeing the alignment is a single free.
+//
+// The strings returned by getSequences() do not own their memory and
+// can be passed to everything that takes a
+// std::vector<DNA_b128_String>, but the vector itself must not be
+// resized. The slab is reused by reInitiate() as long as it is large
+// enough, which avoids reallocations between bootstrap replicates.
+//
+// EXAMPLE USAGE
+// PackedAlignment alignment;
+// alignment.reInitiate(numSequences, seqlen);
+// for ( size_t i = 0 ; i < numSequences ; i++ )
+//   alignment[i].append(strs[i]);
+// fillMatrix(dm, alignment.getSequences(), trans_model);
+//
+// When the number of sequences or their length is not known in
+// advance, e.g. while a FASTA file is read, the strings are added one
+// at a time with addSequence().
+//
+
+class PackedAlignment
+{
+public:
+  PackedAlignment();
+  ~PackedAlignment();
+
+  // Makes room for numSequences empty strings of atleast capacity
+  // chars each.
+  void reInitiate(size_t numSequences, size_t capacity);
+
+  // Adds an empty string of atleast capacity chars. The slab grows by
+  // doubling, and to the largest capacity given, and the strings added
+  // before are moved into it, so references to them are invalidated.
+  DNA_b128_String &addSequence(size_t capacity);
+
+  // Makes this a copy of other, reusing the slab if it is large
+  // enough.
+  void assign(const PackedAlignment &other);
+  // The same with only the sequences indices[0], indices[1],... of
+  // other, in that order.
+  void assign(const PackedAlignment &other, const std::vector<size_t> &indices);
+
+  size_t size() const{
+    return sequences.size();
+  }
+  DNA_b128_String &operator[](size_t i){
+    return sequences[i];
+  }
+  const DNA_b128_String &operator[](size_t i) const{
+    return sequences[i];
+  }
+  std::vector<DNA_b128_String> &getSequences(){
+    return sequences;
+  }
+
+  // The number of b128s between the data of sequence i and its
+  // unknownData, half the distance between two records.
+  size_t getStride() const{
+    return stride;
+  }
+  const b128 *getData(size_t i) const{
+    return records + 2*stride*i;
+  }
+  const b128 *getUnknownData(size_t i) const{
+    return records + 2*stride*i + stride;
+  }
+
+private:
+  // not copyable, the strings point into the slab
+  PackedAlignment(const PackedAlignment &);
+  void operator=(const PackedAlignment &);
+
+  void _free_mem();
+  void _swap(PackedAlignment &other);
+
+  b128 *slab;        //as returned by alloc_b128
+  b128 *records;     //slab aligned to a cache line
+  size_t slabSize;   //the number of b128s in records
+  size_t capacity;   //as given to reInitiate
+  size_t stride;
+  std::vector<DNA_b128_String> sequences;
+};
+
+#endif // PACKEDALIGNMENT_HPP
@@ -18,7 +18,12 @@
 #include "stl_utils.hpp"
 #include "log_utils.hpp"
 #include "file_utils.hpp"
+#include "thread_utils.hpp"
+#include "PhylipAlignmentReader.hpp"
+#include "InputBuffer.hpp"
+#include <string.h>
 #include <float.h>
+#include <limits.h>
 #include <stdio.h>
 
 using namespace std;
@@ -36,121 +41,112 @@ Sequences2DNA_b128(std::vector<Sequence> &seqs, std::vector<DNA_b128_String> &b1
 }
 
 void
-DNA_b128_StringsFromPHYLIP(istream &fin, std::vector<std::string> &names, std::vector<DNA_b128_String> &b128_strings){
+Sequences2DNA_b128(std::vector<Sequence> &seqs, PackedAlignment &b128){
 
-	int numSequences;
-	int seqlen;
-	const int MAXLINE = 16384;
-	char line[MAXLINE];
-	do{//skip lines that does not contain two integers
-		fin.getline(line,MAXLINE);
-	} while( sscanf(line,"%d %d",&numSequences,&seqlen) != 2 );
+	size_t cap = 0;
+	for(size_t i=0;i<seqs.size();i++)
+		cap = std::max(cap, seqs[i].seq.length()+1);
+	b128.reInitiate(seqs.size(),cap);
+	for(size_t i=0;i<seqs.size();i++)
+		b128[i].append(seqs[i].seq);
+}
 
+//The chars DNA_b128_String::append() packs, it stops at the first
+//other char.
+static const char PHYLIP_DNA_CHARS[] = "acgtumrwsykvhdbnxACGTUMRWSYKVHDBNX-.?";
 
-	names.clear();
-	names.reserve(numSequences);
-	b128_strings.resize(numSequences);
-	for ( int i = 0 ; i < numSequences ; i++ ){
-		b128_strings[i].reInitiate(seqlen);
-		names.push_back(string());
-	}
-	//phylip has name lenght 10.
-	//read the names and map the sequences onto the tree
-	char tmpName[11];
-	for ( int i = 0 ; i < numSequences ; i++ ){
-		DNA_b128_String &s = b128_strings[i];
-
-		fin.getline(tmpName,11);//reads atmost 10 chars
-		//skip lines without 10 chars per line
-		if( !fin.fail() ){
-			if( fin.eof() ) THROW_EXCEPTION("Unexpected reading format fin.eof() == " << fin.eof());
-			i--;
+struct PhylipCharTable{
+	bool valid[256];
+	PhylipCharTable(){
+		memset(valid, 0, sizeof valid);
+		for ( const char *c = PHYLIP_DNA_CHARS ; *c != '\0' ; c++ )
+			valid[(unsigned char) *c] = true;
+	}
+};
+static const PhylipCharTable phylipChars;
+
+//The number of chars of [begin,end) that append() packs, i.e. the
+//chars up to the first other char, without the spaces.
+static size_t
+_numPackedChars(const char *begin, const char *end){
+	size_t num = 0;
+	for ( ; begin != end ; begin++ ){
+		if ( *begin == ' ' )
 			continue;
-		}
-		appendUntil(names[i],tmpName,fin.gcount(), ' ');
-
-		fin.clear();
-		fin.getline(line,MAXLINE);
-
-		while( fin.fail() && fin.gcount()==MAXLINE-1 ){//didn't read all the line
-			s.append(line);
-			fin.clear();
-			fin.getline(line,MAXLINE);
-		}
-		if( !fin.fail()) {//we read it all including the newline char unless it ended with eof
-			s.append(line);
-		}
-		else //fail
-			THROW_EXCEPTION("Unexpected reading format fin.eof() == " << fin.eof());
-	}//end for loop
-
-//Mehmood changes starts here
-	//The sequences aren't neccesarily on one line but my be spread out interleaving
-	//over several lines. Therefore we read until seqlen chars have been read.
-	bool whileTrue= true;
-	// check if all the sequences has been completely read.
-	for ( int i = 0 ; i < numSequences ; i++ ){
-		if ( b128_strings[i].getNumChars() == seqlen ){
-			whileTrue= false;
-		}
+		if ( ! phylipChars.valid[(unsigned char) *begin] )
+			break;
+		num++;
 	}
+	return num;
+}
 
-	while ( whileTrue || fin.eof() ){
-		for ( int i = 0 ; i < numSequences ; i++ ){
+//Reads the PHYLIP file into the strings returned by
+//allocate(numSequences,seqlen), which must hold numSequences empty
+//strings of capacity seqlen. Every line is packed where it is read.
+template<class Allocator>
+static void
+_DNA_b128_StringsFromPHYLIP(PhylipAlignmentReader &reader, std::vector<std::string> &names, Allocator allocate){
+
+	reader.readHeader();
+	const size_t seqlen = reader.getLength();
+	std::vector<DNA_b128_String> &b128_strings = allocate(reader.getNumSequences(), seqlen);
+	reader.readSequences(names, [&](size_t i, const char *begin, const char *end) -> size_t {
 			DNA_b128_String &s = b128_strings[i];
+			//the strings only have room for seqlen chars, the spaces
+			//of the line are only counted when it may not fit
+			const size_t numChars = s.getNumChars();
+			if ( numChars + (end-begin) > seqlen && numChars + _numPackedChars(begin,end) > seqlen )
+				THROW_EXCEPTION("Sequence longer than " << seqlen << ": " << names[i]);
+			s.append(begin, end-begin);
+			return s.getNumChars();
+		});
+}
 
-			fin.getline(line,MAXLINE);
-
-			std::string myStr;
-			myStr=line;
-
-			if (myStr.empty()){
-				if( fin.eof() )
-					THROW_EXCEPTION("Sequence not of correct length: " << names[i]<< "    length is " << b128_strings[i].getNumChars());
-				i=i-1;
-				continue;
-			}
-
-			if (!( fin.fail() && fin.gcount()==MAXLINE-1 )){
-				s.append(line);
-
-			}
-
+template<class Input>
+static void
+_DNA_b128_StringsFromPHYLIP(Input &fin, std::vector<std::string> &names, std::vector<DNA_b128_String> &b128_strings){
+	PhylipAlignmentReader reader(fin);
+	_DNA_b128_StringsFromPHYLIP(reader, names, [&](size_t numSequences, size_t seqlen) -> std::vector<DNA_b128_String>& {
+			b128_strings.resize(numSequences);
+			for ( size_t i = 0 ; i < numSequences ; i++ )
+				b128_strings[i].reInitiate(seqlen);
+			return b128_strings;
+		});
+}
 
-			// check if any one of the sequences is read completely and has correct
-			// seq.length but some don't have that break the loop with error msg:
-			for ( int i = 0 ; i < numSequences ; i++ ){
-					if ( b128_strings[i].getNumChars() == seqlen ){
-						whileTrue= false;
-					}
-				}
+template<class Input>
+static void
+_DNA_b128_StringsFromPHYLIP(Input &fin, std::vector<std::string> &names, PackedAlignment &b128_strings){
+	PhylipAlignmentReader reader(fin);
+	_DNA_b128_StringsFromPHYLIP(reader, names, [&](size_t numSequences, size_t seqlen) -> std::vector<DNA_b128_String>& {
+			b128_strings.reInitiate(numSequences, seqlen);
+			return b128_strings.getSequences();
+		});
+}
 
-		}//end for loop
-	}
+void
+DNA_b128_StringsFromPHYLIP(istream &fin, std::vector<std::string> &names, std::vector<DNA_b128_String> &b128_strings){
+	_DNA_b128_StringsFromPHYLIP(fin, names, b128_strings);
+}
 
-	// CHECK THAT ALL STRINGS HAVE THE SAME LENGTH
-	for ( int i = 0 ; i < numSequences ; i++ ){
-		if ( b128_strings[i].getNumChars() != seqlen ){
-			THROW_EXCEPTION("Sequence not of correct length: " << names[i]
-			                                                            << "    length is " << b128_strings[i].getNumChars());
-			DNA_b128_String &s = b128_strings[i];
-			cerr<< s<<endl;
-		}
-	}
-	//-----------------------------
+void
+DNA_b128_StringsFromPHYLIP(istream &fin, std::vector<std::string> &names, PackedAlignment &b128_strings){
+	_DNA_b128_StringsFromPHYLIP(fin, names, b128_strings);
+}
 
+void
+DNA_b128_StringsFromPHYLIP(InputBuffer &input, std::vector<std::string> &names, PackedAlignment &b128_strings){
+	_DNA_b128_StringsFromPHYLIP(input, names, b128_strings);
 }
 //---------------------------------------------------------
-void 
-bootstrapSequences(const std::vector<Sequence> &seqs, std::vector<DNA_b128_String> &b128_strings){
-
-
-	//ensure capacity in bootsequences
-	b128_strings.resize(seqs.size());
+//Appends a bootstrap replicate of seqs to b128_strings, which must
+//be empty and have capacity for the sequences. The columns are drawn
+//from random as SitePatternBootstrap::drawReplicate() draws them.
+static void 
+_bootstrapSequences(const std::vector<Sequence> &seqs, std::vector<DNA_b128_String> &b128_strings,
+		const ReplicateRandom &random){
 
 	const size_t seqlen = seqs[0].seq.length();
-	for ( size_t i = 0 ; i < seqs.size() ; i++ )
-		b128_strings[i].reInitiate(seqlen);
 
 	// Do the bootstrapping
 	size_t pos=0;
@@ -164,9 +160,9 @@ bootstrapSequences(const std::vector<Sequence> &seqs, std::vector<DNA_b128_Strin
 	if( stride < seqlen){
 		for( pos=0; pos<(seqlen-stride); pos+= stride)
 			for( size_t i=0; i<stride; i++)
-				samplePositions[pos+i] = (int) (seqlen*1.0*rand()/(RAND_MAX+1.0));
+				samplePositions[pos+i] = (int) random.uniformIndex(pos+i, seqlen);
 		for (; pos<seqlen; pos++)
-			samplePositions[pos] = (int) (seqlen*1.0*rand()/(RAND_MAX+1.0));
+			samplePositions[pos] = (int) random.uniformIndex(pos, seqlen);
 
 
 		for( seq=0; seq<seqs.size(); seq++){
@@ -189,7 +185,7 @@ bootstrapSequences(const std::vector<Sequence> &seqs, std::vector<DNA_b128_Strin
 	}
 	else{//seqlen<stride
 		for (pos=0; pos<seqlen; pos++)
-			samplePositions[pos] = (int) (seqlen*1.0*rand()/(RAND_MAX+1.0));
+			samplePositions[pos] = (int) random.uniformIndex(pos, seqlen);
 
 		for( seq=0; seq<seqs.size(); seq++){
 			const string & s = seqs[seq].seq;
@@ -201,32 +197,158 @@ bootstrapSequences(const std::vector<Sequence> &seqs, std::vector<DNA_b128_Strin
 	}
 }
 
+void 
+bootstrapSequences(const std::vector<Sequence> &seqs, std::vector<DNA_b128_String> &b128_strings,
+		const ReplicateRandom &random){
+
+	//ensure capacity in bootsequences
+	b128_strings.resize(seqs.size());
+
+	const size_t seqlen = seqs[0].seq.length();
+	for ( size_t i = 0 ; i < seqs.size() ; i++ )
+		b128_strings[i].reInitiate(seqlen);
+
+	_bootstrapSequences(seqs, b128_strings, random);
+}
+
+void 
+bootstrapSequences(const std::vector<Sequence> &seqs, PackedAlignment &b128_strings, const ReplicateRandom &random){
+
+	b128_strings.reInitiate(seqs.size(), seqs[0].seq.length());
+	_bootstrapSequences(seqs, b128_strings.getSequences(), random);
+}
+
 
 
 
 
 
 //----------------------------------------------------------
+// PARALLEL COMPUTATION OF THE MATRIX
+//
+// The full matrix is computed in three passes:
+//
+// 1) All pairwise distances are computed without the ambiguities.
+//    The pairs are independent and the upper triangle is split into
+//    tiles which are scheduled on a WorkStealingPool. Within a tile
+//    each row is computed with the block distance functions of
+//    DNA_b128_String.
+//
+// 2) The ambiguities of each sequence are resolved using its closest
+//    neighbor. Resolving only changes the ambiguity probabilities of
+//    the sequence itself and never the nucleotides that are read from
+//    the neighbor. Hence the sequences can be resolved independently.
+//
+// 3) The distances of the pairs with ambiguities are updated, again
+//    tile by tile.
+//
+// The result is identical to computing the matrix row by row on one
+// thread.
+
+//The number of sequences per side of a tile. The two blocks of
+//sequences that a tile reads should fit in the L2 cache.
+static const size_t MAX_TILE_SIDE = 128;
+
+static size_t
+tileSideForSequences(const std::vector<DNA_b128_String> &seqs){
+	const size_t TILE_CACHE_BYTES = 256*1024;
+	//data and unknownData, two bits each per char
+	const size_t bytesPerSequence = 2*(seqs[0].getNumChars()/4 + sizeof(b128));
+	size_t side = TILE_CACHE_BYTES/(2*bytesPerSequence);
+	if ( side < 4 ) side = 4;
+	if ( side > MAX_TILE_SIDE ) side = MAX_TILE_SIDE;
+	return side;
+}
 
-void
-fillMatrix(StrDblMatrix &dm, std::vector<DNA_b128_String> &seqs,
-		sequence_translation_model trans_model){
+//Pointers to the sequences, used to pass a range of sequences to the
+//block distance functions of DNA_b128_String.
+static std::vector<const DNA_b128_String*>
+sequencePointers(const std::vector<DNA_b128_String> &seqs){
+	std::vector<const DNA_b128_String*> ptrs(seqs.size());
+	for ( size_t i = 0 ; i < seqs.size() ; i++ )
+		ptrs[i] = &seqs[i];
+	return ptrs;
+}
 
-	const size_t numSequences = seqs.size();
-	dm.resize(numSequences);
+//Returns the closest neighbor of sequence i, or i if no other
+//sequence has a non-negative distance to i. Ties are broken by the
+//lowest index, exactly as in the row by row computation.
+static size_t
+closestNeighbor(const StrDblMatrix &dm, size_t i){
+	size_t closestNeig = i;
+	float closestDist = FLT_MAX;
+	for ( size_t k = 0 ; k < i ; k++ ){
+		float dist = dm.getDistance(k,i);
+		if (  dist < closestDist && dist >= 0 ){
+			closestDist = dist;
+			closestNeig = k;
+		}
+	}
+	for ( size_t j = i+1 ; j < dm.getSize() ; j++ ){
+		double dist = dm.getDistance(i,j);
+		if (  dist < closestDist && dist >= 0 ){
+			closestDist = dist;
+			closestNeig = j;
+		}
+	}
+	return closestNeig;
+}
 
+//The same for a row of distances, distances[i] is not read.
+static size_t
+closestNeighbor(const std::vector<float> &distances, size_t i){
+	size_t closestNeig = i;
+	float closestDist = FLT_MAX;
+	for ( size_t j = 0 ; j < distances.size() ; j++ ){
+		if ( j != i && distances[j] < closestDist && distances[j] >= 0 ){
+			closestDist = distances[j];
+			closestNeig = j;
+		}
+	}
+	return closestNeig;
+}
 
-	//base frequences
-	DNA_b128_String::base_frequences freqs = seqs[0].getBaseFrequences();
-	for ( size_t i = 1 ; i < numSequences ; i++ ){
+//---------------------------------------------------------
+// ALIGNMENT CONTEXT
+
+//The base frequences summed over all sequences, seqs[i] counted
+//multiplicities[i] times if multiplicities is given.
+static DNA_b128_String::base_frequences
+sumBaseFrequences(const std::vector<DNA_b128_String> &seqs, const std::vector<size_t> *multiplicities){
+	DNA_b128_String::base_frequences freqs = {0,0,0,0,0,0};
+	if ( multiplicities != NULL && multiplicities->size() != seqs.size() )
+		PROG_ERROR("There is not one multiplicity per sequence");
+	for ( size_t i = 0 ; i < seqs.size() ; i++ ){
 		DNA_b128_String::base_frequences tmpfreqs = seqs[i].getBaseFrequences();
-		freqs.num_As_+= tmpfreqs.num_As_;
-		freqs.num_Cs_+= tmpfreqs.num_Cs_;
-		freqs.num_Gs_+= tmpfreqs.num_Gs_;
-		freqs.num_Ts_+= tmpfreqs.num_Ts_;
-		freqs.num_unknowns_+= tmpfreqs.num_unknowns_;
-		freqs.num_ambiguities_+= tmpfreqs.num_ambiguities_;
+		const size_t m = ( multiplicities == NULL ? 1 : (*multiplicities)[i] );
+		freqs.num_As_+= m*tmpfreqs.num_As_;
+		freqs.num_Cs_+= m*tmpfreqs.num_Cs_;
+		freqs.num_Gs_+= m*tmpfreqs.num_Gs_;
+		freqs.num_Ts_+= m*tmpfreqs.num_Ts_;
+		freqs.num_unknowns_+= m*tmpfreqs.num_unknowns_;
+		freqs.num_ambiguities_+= m*tmpfreqs.num_ambiguities_;
 	}
+	return freqs;
+}
+
+AlignmentContext::AlignmentContext(){
+	DNA_b128_String::base_frequences none = {0,0,0,0,0,0};
+	freqs = none;
+	numSites = 0;
+	preparedRows = false;
+}
+
+void
+AlignmentContext::prepare(std::vector<DNA_b128_String> &seqs, const sequence_translation_model &trans_model,
+		const std::vector<size_t> *multiplicities){
+
+	const size_t numSequences = seqs.size();
+	numSites = ( numSequences == 0 ? 0 : seqs[0].getNumSites() );
+	seqPtrs = sequencePointers(seqs);
+	preparedRows = false;
+
+	//base frequences
+	freqs = sumBaseFrequences(seqs, multiplicities);
 
 	//compute ambiguities probabilities
 	if ( ! trans_model.no_ambiguities ){
@@ -241,779 +363,929 @@ fillMatrix(StrDblMatrix &dm, std::vector<DNA_b128_String> &seqs,
 			}
 		}
 	}
+}
 
-	//CALL DISTANCE COMPUTATION
-	switch( trans_model.model ){
-	case HAMMING_DISTANCE: fillMatrix_Hamming(dm,seqs,trans_model);break;
-	case JC:  fillMatrix_JC(dm,seqs,trans_model);break;
-	case K2P:  fillMatrix_K2P(dm,seqs,trans_model);break;
-	case TN93: fillMatrix_TN93(dm,seqs,freqs,trans_model);break;
-	default:
-		PROG_ERROR("Non handled model: " << trans_model.model);
-	}
-
+//---------------------------------------------------------
+// DISTANCE MODELS
+//
+// The matrices and rows of all models are computed by the same two
+// engines below. What differs between the models is given by a model
+// class:
+//
+// Counts                the differences of a pair the model needs
+// count()               counts si against num sequences, a pair with
+//                       more than maxDifferences differences may be
+//                       counted in part
+// maxDifferences()      the differences above which a pair without
+//                       ambiguities is further apart than a distance
+// fromTN()              the Counts contained in Tamura-Nei counts
+// distances()           the distances of num pairs
+// changeProbabilities() the ML_string_distance of a pair, only used
+//                       for the ambiguities
+// resolve()             resolves the ambiguities of si from its
+//                       closest neighbor
+// correct()             corrects the counts of a pair with the
+//                       ambiguities
+// distance()            the distance of one pair
+//
+// The engines are instantiated for each model, for fixed and free
+// transition/transversion ratios and for each way of handling the
+// ambiguities, so the loops over the pairs do not look at the
+// sequence_translation_model.
+
+//The number of differences of a pair.
+static inline float
+numDifferences(const simple_string_distance &c){
+	return c.transitions + c.transversions;
+}
+static inline float
+numDifferences(const TN_string_distance &c){
+	return c.purine_transitions + c.pyrimidine_transitions + c.transversions;
+}
 
+//The JC, K2P and TN93 distances are convex in the probabilities of
+//change and equal to the p-distance to the first order, so they are
+//at least the p-distance, which is at least the differences over all
+//strlen sites. A pair with more differences than returned is further
+//apart than maxDistance. The margin covers the rounding of the float
+//formulas.
+static unsigned int
+pDistanceBound(float maxDistance, size_t strlen){
+	const double bound = ( maxDistance*(1.0+1e-4) + 1e-5 )*strlen;
+	return ( bound >= UINT_MAX ? UINT_MAX : (unsigned int) bound );
 }
 
+//The ML distances with a fixed transition/transversion ratio are not
+//bounded by the p-distance, so those pairs are counted in full.
+static const unsigned int NO_BOUND = UINT_MAX;
+
+//The models correct the counts with the ambiguities using the change
+//probabilities of the pair.
+struct TransitionProbabilityModel{
+	template<class Counts>
+	static Counts correct(const Counts &c, const ML_string_distance &ml_dist,
+			const DNA_b128_String &si, const DNA_b128_String &sj){
+		return DNA_b128_String::correctDistanceWithAmbiguitiesUsingTransitionProbabilities(c,ml_dist,si,sj);
+	}
+	static void resolve(DNA_b128_String &si, const DNA_b128_String &neighbor, const ML_string_distance &ml_dist){
+		si.resolveAmbiguitiesUsingTransitionProbabilities(neighbor,ml_dist);
+	}
+};
 
+struct HammingModel : public TransitionProbabilityModel{
+	typedef simple_string_distance Counts;
 
+	HammingModel(size_t strlen, const DNA_b128_String::base_frequences &freqs,
+			const sequence_translation_model &trans_model) : strlen(strlen) {}
 
-void 
-fillMatrix_Hamming(StrDblMatrix &dm, std::vector<DNA_b128_String> &seqs,
-		sequence_translation_model trans_model){
+	static void count(const DNA_b128_String &si, const DNA_b128_String *const *seqs, size_t num, Counts *counts,
+			unsigned int maxDifferences=NO_BOUND){
+		DNA_b128_String::computeDistances(si, seqs, num, counts, maxDifferences);
+	}
+	static Counts fromTN(TN_string_distance tn){
+		return convert_TN_string_distance_to_simple(tn);
+	}
+	void distances(const Counts *counts, size_t num, float *dists) const{
+		for ( size_t k = 0 ; k < num ; k++ )
+			dists[k] = compute_Hamming_distance(counts[k]);
+	}
+	//the ambiguities are corrected with the JC probabilities
+	ML_string_distance changeProbabilities(const Counts &c) const{
+		return compute_JC(strlen,c);
+	}
+	//resolves to the nucleotide of the neighbor
+	static void resolve(DNA_b128_String &si, const DNA_b128_String &neighbor, const ML_string_distance &){
+		si.resolveAmbiguities(neighbor);
+	}
+	float distance(const Counts &c) const{
+		return compute_Hamming_distance(c);
+	}
+	//the distance is the number of differences
+	unsigned int maxDifferences(float maxDistance) const{
+		return ( maxDistance >= UINT_MAX ? UINT_MAX : (unsigned int) maxDistance );
+	}
 
-	const size_t numSequences = seqs.size();
-	const size_t strlen = seqs[0].getNumChars();
+	size_t strlen;
+};
 
-	dm.resize(numSequences);
+struct JCModel : public TransitionProbabilityModel{
+	typedef simple_string_distance Counts;
 
-	//extended information used to compute ambiguities
-	static DistanceMatrix<int,simple_string_distance,
-	empty_Data_init<int>,empty_Data_printOn<int>,
-	empty_Data_init<simple_string_distance>, empty_Data_printOn<simple_string_distance> >
-	extendedDistanceInfo(numSequences);
-	extendedDistanceInfo.resize(numSequences);
-
-	//
-	// The loop will resolve the ambiguities according to the translation model
-	//
-	for ( size_t i = 0 ; i < numSequences; i++ ){
-		dm.setDistance(i,i,0);
-		size_t closestNeig = i;
-		float closestDist =  FLT_MAX;
-
-		DNA_b128_String &si = seqs[i];
-		//only if it has ambiguities does it need to be resolved
-		//start by checking the allready computed distances for si
-		if ( si.hasAmbiguities() ){
-			for ( size_t k = 0 ; k < i ; k++ ){
-				float dist = dm.getDistance(k,i);
-				if (  dist < closestDist && dist >= 0 ){
-					closestDist = dist;
-					closestNeig = k;
-				}
-			}
-		}
+	JCModel(size_t strlen, const DNA_b128_String::base_frequences &freqs,
+			const sequence_translation_model &trans_model) : strlen(strlen) {}
 
-		// compute the remaining distances for si
-		for ( size_t j = i+1 ; j < numSequences ; j++ ){
-			//compute distance without using the ambiguities
-			simple_string_distance sd = DNA_b128_String::computeDistance(si,seqs[j]);
-			float hamdist = compute_Hamming_distance(sd);
+	static void count(const DNA_b128_String &si, const DNA_b128_String *const *seqs, size_t num, Counts *counts,
+			unsigned int maxDifferences=NO_BOUND){
+		DNA_b128_String::computeDistances(si, seqs, num, counts, maxDifferences);
+	}
+	static Counts fromTN(TN_string_distance tn){
+		return convert_TN_string_distance_to_simple(tn);
+	}
+	void distances(const Counts *counts, size_t num, float *dists) const{
+		compute_JC_distances(strlen, counts, num, dists);
+	}
+	ML_string_distance changeProbabilities(const Counts &c) const{
+		return compute_JC(strlen,c);
+	}
+	float distance(const Counts &c) const{
+		return compute_JC(strlen,c).distance;
+	}
+	unsigned int maxDifferences(float maxDistance) const{
+		return pDistanceBound(maxDistance, strlen);
+	}
 
-			dm.setDistance(i,j,hamdist);
-			extendedDistanceInfo.setDistance(i,j,sd);
+	size_t strlen;
+};
 
-			if ( hamdist < closestDist && hamdist >= 0 ){//update the closest neighbor
-				closestDist = hamdist;
-				closestNeig = j;
-			}
-		}
-		//all distances for si have been compted
+//With a fixed ratio the distances are found by the cached solver of
+//compute_K2P_fixratio(). The solver can not start from a pair
+//without differences, whose distance is 0 and whose probabilities are
+//those of the regular model.
+template<bool FixedRatio>
+struct K2PModel : public TransitionProbabilityModel{
+	typedef simple_string_distance Counts;
 
-		//Resolve the ambiguities according to the closest neighbor
-		if ( si.hasAmbiguities() && ! trans_model.no_ambig_resolve ){
-			si.resolveAmbiguities(seqs[closestNeig]);
+	K2PModel(size_t strlen, const DNA_b128_String::base_frequences &freqs,
+			const sequence_translation_model &trans_model) :
+		strlen(strlen), tstvratio(trans_model.tstvratio) {}
+
+	static void count(const DNA_b128_String &si, const DNA_b128_String *const *seqs, size_t num, Counts *counts,
+			unsigned int maxDifferences=NO_BOUND){
+		DNA_b128_String::computeDistances(si, seqs, num, counts, maxDifferences);
+	}
+	static Counts fromTN(TN_string_distance tn){
+		return convert_TN_string_distance_to_simple(tn);
+	}
+	void distances(const Counts *counts, size_t num, float *dists) const{
+		if ( FixedRatio ){
+			for ( size_t k = 0 ; k < num ; k++ )
+				dists[k] = distance(counts[k]);
 		}
+		else
+			compute_K2P_distances(strlen, counts, num, dists);
+	}
+	ML_string_distance changeProbabilities(const Counts &c) const{
+		if ( FixedRatio && numDifferences(c) != 0 )
+			return compute_K2P_fixratio(strlen,c,tstvratio);
+		return compute_K2P(strlen,c);
+	}
+	float distance(const Counts &c) const{
+		if ( FixedRatio && numDifferences(c) == 0 )
+			return 0;
+		return changeProbabilities(c).distance;
+	}
+	unsigned int maxDifferences(float maxDistance) const{
+		return ( FixedRatio ? NO_BOUND : pDistanceBound(maxDistance, strlen) );
 	}
 
+	size_t strlen;
+	float tstvratio;
+};
 
-	//Update the computed distances with the ambiguities
-	if ( !trans_model.no_ambiguities ){
-		for ( size_t i = 0 ; i < numSequences ; i++ ){
-			DNA_b128_String &si = seqs[i];
-			for ( size_t j = i+1 ; j < numSequences ; j++ ){
-				if ( si.hasAmbiguities() || seqs[j].hasAmbiguities() ){
-					simple_string_distance sd = extendedDistanceInfo.getDistance(i,j);
-					ML_string_distance ml_dist = compute_JC(strlen,sd);
-					sd = DNA_b128_String::correctDistanceWithAmbiguitiesUsingTransitionProbabilities(sd,ml_dist,si,seqs[j]);
+template<bool FixedRatio>
+struct TN93Model : public TransitionProbabilityModel{
+	typedef TN_string_distance Counts;
 
-					//hamming
-					dm.setDistance(i,j,compute_Hamming_distance(sd));
+	TN93Model(size_t strlen, const DNA_b128_String::base_frequences &freqs,
+			const sequence_translation_model &trans_model) :
+		strlen(strlen), freqs(freqs), tstvratio(trans_model.tstvratio), pyrtvratio(trans_model.pyrtvratio),
+		no_transition_probs(trans_model.no_transition_probs) {}
 
-				}
-			}
+	static void count(const DNA_b128_String &si, const DNA_b128_String *const *seqs, size_t num, Counts *counts,
+			unsigned int maxDifferences=NO_BOUND){
+		DNA_b128_String::computeTAMURANEIDistances(si, seqs, num, counts, maxDifferences);
+	}
+	static Counts fromTN(TN_string_distance tn){
+		return tn;
+	}
+	void distances(const Counts *counts, size_t num, float *dists) const{
+		if ( FixedRatio ){
+			for ( size_t k = 0 ; k < num ; k++ )
+				dists[k] = distance(counts[k]);
 		}
+		else
+			compute_Tamura_Nei_distances(strlen, counts, num,
+					freqs.num_As_,freqs.num_Cs_,freqs.num_Gs_,freqs.num_Ts_, dists);
+	}
+	ML_string_distance changeProbabilities(const Counts &c) const{
+		if ( FixedRatio && numDifferences(c) != 0 )
+			return compute_Tamura_Nei_fixratio(strlen,c,
+					freqs.num_As_,freqs.num_Cs_,freqs.num_Gs_,freqs.num_Ts_,
+					tstvratio, pyrtvratio);
+		return compute_Tamura_Nei(strlen,c,freqs.num_As_,freqs.num_Cs_,freqs.num_Gs_,freqs.num_Ts_);
+	}
+	Counts correct(const Counts &c, const ML_string_distance &ml_dist,
+			const DNA_b128_String &si, const DNA_b128_String &sj) const{
+		if ( no_transition_probs )
+			return DNA_b128_String::correctDistanceWithAmbiguitiesUsingBackgroundFrequences(c,si,sj);
+		return TransitionProbabilityModel::correct(c,ml_dist,si,sj);
+	}
+	//as for K2P a pair without differences is left to the regular
+	//model and has distance 0
+	float distance(const Counts &c) const{
+		if ( FixedRatio && numDifferences(c) == 0 )
+			return 0;
+		return changeProbabilities(c).distance;
+	}
+	unsigned int maxDifferences(float maxDistance) const{
+		return ( FixedRatio ? NO_BOUND : pDistanceBound(maxDistance, strlen) );
 	}
 
+	size_t strlen;
+	DNA_b128_String::base_frequences freqs;
+	float tstvratio;
+	float pyrtvratio;
+	bool no_transition_probs;
+};
+
+//Calls engine.run<Model>() with the model class of trans_model.
+template<class Engine>
+static void
+runWithModel(Engine &engine, const sequence_translation_model &trans_model){
+	switch( trans_model.model ){
+	case HAMMING_DISTANCE: engine.template run<HammingModel>();break;
+	case JC:  engine.template run<JCModel>();break;
+	case K2P:
+		if ( trans_model.no_tstvratio )
+			engine.template run<K2PModel<false> >();
+		else
+			engine.template run<K2PModel<true> >();
+		break;
+	case TN93:
+		if ( trans_model.no_tstvratio )
+			engine.template run<TN93Model<false> >();
+		else
+			engine.template run<TN93Model<true> >();
+		break;
+	default:
+		PROG_ERROR("Non handled model: " << trans_model.model);
+	}
 }
 
+//---------------------------------------------------------
+// AMBIGUITIES
+//
+// The ambiguity handling of the engines. In the matrix engine record()
+// is called for every pair in the first pass and correct() does the
+// second and third pass. The row engine calls correctRow() for every
+// row, the sequences having been resolved before the first row by
+// AlignmentContext::prepareRows().
+
+//The ambiguities are treated as unknowns.
+template<class Model>
+class IgnoreAmbiguities
+{
+public:
+	IgnoreAmbiguities(size_t numSequences){}
+
+	void record(const Model &model, size_t i, size_t j, const DNA_b128_String &si, const DNA_b128_String &sj,
+			const typename Model::Counts &c){}
+
+	void correct(StrDblMatrix &dm, std::vector<DNA_b128_String> &seqs, const Model &model,
+			const sequence_translation_model &trans_model, WorkStealingPool &pool, size_t tileSide){}
+
+	static unsigned int rowBound(const DNA_b128_String &si, unsigned int maxDifferences){
+		return maxDifferences;
+	}
 
-void 
-fillMatrix_JC(StrDblMatrix &dm, std::vector<DNA_b128_String> &seqs,
-		sequence_translation_model trans_model){
+	static void completeRow(std::vector<typename Model::Counts> &rowCounts, const std::vector<DNA_b128_String> &seqs,
+			const DNA_b128_String *const *seqPtrs, size_t row, size_t first, size_t last, unsigned int maxDifferences){}
 
-	const size_t numSequences = seqs.size();
-	const size_t strlen = seqs[0].getNumChars();
+	static void correctRow(std::vector<float> &distances, const std::vector<typename Model::Counts> &rowCounts,
+			const std::vector<DNA_b128_String> &seqs, const Model &model, size_t row, size_t first, size_t last){}
+};
 
-	dm.resize(numSequences);
+//The ambiguities are resolved and/or included according to the
+//translation model. The counts and change probabilities are kept for
+//the pairs with ambiguities.
+template<class Model>
+class CorrectAmbiguities
+{
+public:
+	typedef typename Model::Counts Counts;
 
-	//extended information used to compute ambiguities
-	static DistanceMatrix<int,pair<simple_string_distance,ML_string_distance>,
-	empty_Data_init<int>,empty_Data_printOn<int>,
-	empty_Data_init<pair<simple_string_distance,ML_string_distance> >,
-	empty_Data_printOn<pair<simple_string_distance,ML_string_distance> > >
-	extendedDistanceInfo(numSequences);
+	CorrectAmbiguities(size_t numSequences) : extendedDistanceInfo(numSequences) {}
 
-	extendedDistanceInfo.resize(numSequences);
+	void record(const Model &model, size_t i, size_t j, const DNA_b128_String &si, const DNA_b128_String &sj,
+			const Counts &c){
+		if ( si.hasAmbiguities() || sj.hasAmbiguities() )
+			extendedDistanceInfo.setDistance(i,j,pair<Counts,ML_string_distance>(c,model.changeProbabilities(c)));
+	}
 
-	for ( size_t i = 0 ; i < numSequences ; i++ ){
-		dm.setDistance(i,i,0);
-		size_t closestNeig = i;
-		float closestDist =  FLT_MAX;
+	void correct(StrDblMatrix &dm, std::vector<DNA_b128_String> &seqs, const Model &model,
+			const sequence_translation_model &trans_model, WorkStealingPool &pool, size_t tileSide){
 
-		DNA_b128_String &si = seqs[i];
+		const size_t numSequences = seqs.size();
 
 		//if has ambig find closest string and resolve.
-		if ( si.hasAmbiguities() ){
-			for ( size_t k = 0 ; k < i ; k++ ){
-				float dist = dm.getDistance(k,i);
-				if (  dist < closestDist && dist >= 0 ){
-					closestDist = dist;
-					closestNeig = k;
+		if ( ! trans_model.no_ambig_resolve ){
+			pool.run(numSequences, [&](size_t i){
+				DNA_b128_String &si = seqs[i];
+				if ( si.hasAmbiguities() ){
+					size_t closestNeig = closestNeighbor(dm,i);
+					if ( closestNeig != i )
+						model.resolve(si, seqs[closestNeig], extendedDistanceInfo.getDistance(i,closestNeig).second);
 				}
-			}
+			});
 		}
 
-
-		ML_string_distance  ml_dist;
-		for ( size_t j = i+1 ; j < numSequences ; j++ ){
-			simple_string_distance sd = DNA_b128_String::computeDistance(si,seqs[j]);
-			//     cout << sd << endl;
-			ml_dist = compute_JC(strlen,sd);
-
-			dm.setDistance(i,j,ml_dist.distance);
-			extendedDistanceInfo.setDistance(i,j,pair<simple_string_distance,ML_string_distance>(sd,ml_dist));
-
-			if ( ml_dist.distance < closestDist && ml_dist.distance >= 0 ){
-				closestDist = ml_dist.distance;
-				closestNeig = j;
-			}
+		//UPDATE USING AMBIGUITIES
+		if ( ! trans_model.no_ambiguities ){
+			forEachPairInTiles(pool, numSequences, tileSide, [&](size_t i, size_t j){
+				if ( seqs[i].hasAmbiguities() || seqs[j].hasAmbiguities() ){
+					const pair<Counts,ML_string_distance> &info = extendedDistanceInfo.getDistance(i,j);
+					Counts c = model.correct(info.first,info.second,seqs[i],seqs[j]);
+					dm.setDistance(i,j,model.distance(c));
+				}
+			});
 		}
+	}
+
+	//The corrected distances are not bounded by the differences, so
+	//the row of a string with ambiguities is counted in full.
+	static unsigned int rowBound(const DNA_b128_String &si, unsigned int maxDifferences){
+		return ( si.hasAmbiguities() ? NO_BOUND : maxDifferences );
+	}
 
-		if ( si.hasAmbiguities() && ! trans_model.no_ambig_resolve ){
-			ml_dist = extendedDistanceInfo.getDistance(i,closestNeig).second;
-			si.resolveAmbiguitiesUsingTransitionProbabilities(seqs[closestNeig],ml_dist);
+	//The pairs with ambiguities that were counted in part, see
+	//rowDistances(), are counted again in full.
+	static void completeRow(std::vector<Counts> &rowCounts, const std::vector<DNA_b128_String> &seqs,
+			const DNA_b128_String *const *seqPtrs, size_t row, size_t first, size_t last, unsigned int maxDifferences){
+		if ( maxDifferences == NO_BOUND )
+			return;
+		for ( size_t j = first ; j < last ; j++ ){
+			if ( j != row && seqs[j].hasAmbiguities() && numDifferences(rowCounts[j-first]) > maxDifferences )
+				Model::count(seqs[row], seqPtrs+j, 1, &rowCounts[j-first]);
 		}
 	}
 
-	//UPDATE USING AMBIGUITIES
-	if ( !trans_model.no_ambiguities ){
-		for (size_t i = 0 ; i < numSequences ; i++ ){
-			DNA_b128_String &si = seqs[i];
-			for ( size_t j = i+1 ; j < numSequences ; j++ ){
-				if ( si.hasAmbiguities() || seqs[j].hasAmbiguities() ){
-					simple_string_distance sd = extendedDistanceInfo.getDistance(i,j).first;
-					ML_string_distance ml_dist = extendedDistanceInfo.getDistance(i,j).second;
-					sd = DNA_b128_String::correctDistanceWithAmbiguitiesUsingTransitionProbabilities(sd,ml_dist,si,seqs[j]);
-
-					ml_dist = compute_JC(strlen,sd);
-					dm.setDistance(i,j,ml_dist.distance);
-				}
-			}
+	//The pairs with ambiguities are corrected as in correct(), the
+	//string with the lower index being the first.
+	static void correctRow(std::vector<float> &distances, const std::vector<Counts> &rowCounts,
+			const std::vector<DNA_b128_String> &seqs, const Model &model, size_t row, size_t first, size_t last){
+		const DNA_b128_String &si = seqs[row];
+		for ( size_t j = first ; j < last ; j++ ){
+			if ( j == row || !( si.hasAmbiguities() || seqs[j].hasAmbiguities() ) )
+				continue;
+			const ML_string_distance ml_dist = model.changeProbabilities(rowCounts[j-first]);
+			Counts c;
+			if ( j < row )
+				c = model.correct(rowCounts[j-first],ml_dist,seqs[j],si);
+			else
+				c = model.correct(rowCounts[j-first],ml_dist,si,seqs[j]);
+			distances[j-first] = model.distance(c);
 		}
 	}
-}
 
+private:
+	DistanceMatrix<int,pair<Counts,ML_string_distance>,
+	empty_Data_init<int>,empty_Data_printOn<int>,
+	empty_Data_init<pair<Counts,ML_string_distance> >,
+	empty_Data_printOn<pair<Counts,ML_string_distance> > > extendedDistanceInfo;
+};
 
+//---------------------------------------------------------
+// MATRIX ENGINE
+
+//The counts of si against the sequences jBegin,...,jEnd-1, pointed to
+//by tile. They are counted unless the caller has counted them all
+//before, see fillMatrices().
+template<class Model>
+static void
+countTile(const DNA_b128_String &si, const DNA_b128_String *const *tile, size_t i, size_t jBegin, size_t jEnd,
+		const TNCountMatrix *counts, typename Model::Counts *tileCounts){
+	if ( counts == NULL ){
+		Model::count(si, tile, jEnd-jBegin, tileCounts);
+		return;
+	}
+	for ( size_t j = jBegin ; j < jEnd ; j++ )
+		tileCounts[j-jBegin] = Model::fromTN(counts->getDistance(i,j));
+}
 
-void 
-fillMatrix_K2P(StrDblMatrix &dm, std::vector<DNA_b128_String> &seqs,
-		sequence_translation_model trans_model){
+template<class Model, template<class> class Ambiguities>
+static void
+fillMatrixEngine(StrDblMatrix &dm, std::vector<DNA_b128_String> &seqs, const Model &model,
+		const sequence_translation_model &trans_model, size_t numThreads, const TNCountMatrix *counts){
 
 	const size_t numSequences = seqs.size();
-	const size_t strlen = seqs[0].getNumChars();
-
 	dm.resize(numSequences);
 
+	Ambiguities<Model> ambiguities(numSequences);
+	WorkStealingPool pool(numThreads);
+	const size_t tileSide = tileSideForSequences(seqs);
+	const std::vector<const DNA_b128_String*> seqPtrs = sequencePointers(seqs);
 
-	//extended information used to compute ambiguities
-	static DistanceMatrix<int,pair<simple_string_distance,ML_string_distance>,
-	empty_Data_init<int>,empty_Data_printOn<int>,
-	empty_Data_init<pair<simple_string_distance,ML_string_distance> >,
-	empty_Data_printOn<pair<simple_string_distance,ML_string_distance> > >
-	extendedDistanceInfo(numSequences);
-	extendedDistanceInfo.resize(numSequences);
-
-	for ( size_t i = 0 ; i < numSequences ; i++ ){
+	//compute distance without using the ambiguities
+	for ( size_t i = 0 ; i < numSequences; i++ )
 		dm.setDistance(i,i,0);
-		int closestNeig = i;
-		float closestDist =  FLT_MAX;
-		DNA_b128_String &si = seqs[i];
-
-		//if has ambig find closest string and resolve.
-		if ( si.hasAmbiguities() ){
-			for ( size_t k = 0 ; k < i ; k++ ){
-				float dist = dm.getDistance(k,i);
-				if (  dist < closestDist && dist >= 0 ){
-					closestDist = dist;
-					closestNeig = k;
-				}
-			}
-		}
-
-
-		for ( size_t j = i+1 ; j < numSequences ; j++ ){
-			simple_string_distance sd = DNA_b128_String::computeDistance(si,seqs[j]);
-			ML_string_distance  ml_dist;
-			if ( trans_model.no_tstvratio )
-				ml_dist = compute_K2P(strlen,sd);
-			else
-				ml_dist = compute_K2P_fixratio(strlen,sd,trans_model.tstvratio);
-
-			dm.setDistance(i,j,ml_dist.distance);
-			extendedDistanceInfo.setDistance(i,j,pair<simple_string_distance,ML_string_distance>(sd,ml_dist));
-
-			if ( ml_dist.distance < closestDist && ml_dist.distance >= 0 ){
-				closestDist = ml_dist.distance;
-				closestNeig = j;
-			}
+	forEachRowSegmentInTiles(pool, numSequences, tileSide, [&](size_t i, size_t jBegin, size_t jEnd){
+		typename Model::Counts tileCounts[MAX_TILE_SIDE];
+		float distances[MAX_TILE_SIDE];
+		countTile<Model>(seqs[i], &seqPtrs[jBegin], i, jBegin, jEnd, counts, tileCounts);
+		model.distances(tileCounts, jEnd-jBegin, distances);
+		for ( size_t j = jBegin ; j < jEnd ; j++ ){
+			dm.setDistance(i,j,distances[j-jBegin]);
+			ambiguities.record(model, i, j, seqs[i], seqs[j], tileCounts[j-jBegin]);
 		}
+	});
 
-		if ( si.hasAmbiguities() && ! trans_model.no_ambig_resolve ){
-			ML_string_distance  ml_dist = extendedDistanceInfo.getDistance(i,closestNeig).second;
-			si.resolveAmbiguitiesUsingTransitionProbabilities(seqs[closestNeig],ml_dist);
-		}
-	}
+	ambiguities.correct(dm, seqs, model, trans_model, pool, tileSide);
+}
 
-	//UPDATE USING AMBIGUITIES
-	if( ! trans_model.no_ambiguities ){
-		for ( size_t i = 0 ; i < numSequences ; i++ ){
-			DNA_b128_String &si = seqs[i];
-			for ( size_t j = i+1 ; j < numSequences ; j++ ){
-				if ( si.hasAmbiguities() || seqs[j].hasAmbiguities() ){
-					simple_string_distance sd = extendedDistanceInfo.getDistance(i,j).first;
-					ML_string_distance ml_dist = extendedDistanceInfo.getDistance(i,j).second;
-					sd = DNA_b128_String::correctDistanceWithAmbiguitiesUsingTransitionProbabilities(sd,ml_dist,si,seqs[j]);
-					if ( trans_model.no_tstvratio )
-						ml_dist = compute_K2P(strlen,sd);
-					else
-						ml_dist = compute_K2P_fixratio(strlen,sd,trans_model.tstvratio);
-
-					dm.setDistance(i,j,ml_dist.distance);
-				}
-			}
-		}
+//Fills a matrix with the engine of a model, see runWithModel().
+struct MatrixEngine{
+	StrDblMatrix &dm;
+	std::vector<DNA_b128_String> &seqs;
+	const DNA_b128_String::base_frequences &freqs;
+	const sequence_translation_model &trans_model;
+	size_t numThreads;
+	const TNCountMatrix *counts;
+
+	template<class Model>
+	void run(){
+		const Model model(seqs[0].getNumSites(), freqs, trans_model);
+		if ( trans_model.no_ambig_resolve && trans_model.no_ambiguities )
+			fillMatrixEngine<Model,IgnoreAmbiguities>(dm, seqs, model, trans_model, numThreads, counts);
+		else
+			fillMatrixEngine<Model,CorrectAmbiguities>(dm, seqs, model, trans_model, numThreads, counts);
 	}
-
+};
+
+static void
+fillMatrixModel(StrDblMatrix &dm, std::vector<DNA_b128_String> &seqs,
+		const DNA_b128_String::base_frequences &freqs,
+		const sequence_translation_model &trans_model, size_t numThreads, const TNCountMatrix *counts){
+	MatrixEngine engine = {dm, seqs, freqs, trans_model, numThreads, counts};
+	runWithModel(engine, trans_model);
 }
 
+//---------------------------------------------------------
 
+void
+fillMatrix(StrDblMatrix &dm, std::vector<DNA_b128_String> &seqs,
+		sequence_translation_model trans_model, size_t numThreads){
+	AlignmentContext context;
+	context.prepare(seqs, trans_model);
+	fillMatrix(dm, seqs, context, trans_model, numThreads);
+}
 
-void fillMatrix_TN93(StrDblMatrix &dm, std::vector<DNA_b128_String> &seqs, 
-		DNA_b128_String::base_frequences freqs,
-		sequence_translation_model trans_model){
+void
+fillMatrix(StrDblMatrix &dm, std::vector<DNA_b128_String> &seqs, const AlignmentContext &context,
+		sequence_translation_model trans_model, size_t numThreads){
 
 	const size_t numSequences = seqs.size();
-	const size_t strlen = seqs[0].getNumChars();
-
+	if ( context.getNumSequences() != numSequences )
+		PROG_ERROR("The context is not prepared for the sequences");
 	dm.resize(numSequences);
+	fillMatrixModel(dm, seqs, context.getBaseFrequences(), trans_model, numThreads, NULL);
+}
 
+void
+fillMatrices(std::vector<StrDblMatrix> &dms, std::vector<DNA_b128_String> &seqs,
+		const std::vector<sequence_translation_model> &trans_models, size_t numThreads,
+		const std::vector<size_t> *multiplicities){
 
-	//extended information used to compute ambiguities
-	static DistanceMatrix<int,pair<TN_string_distance,ML_string_distance>,
-	empty_Data_init<int>,empty_Data_printOn<int>,
-	empty_Data_init<pair<TN_string_distance,ML_string_distance> >,
-	empty_Data_printOn<pair<TN_string_distance,ML_string_distance> > >
-	extendedDistanceInfo(numSequences);
-	extendedDistanceInfo.resize(numSequences);
-
-	for ( size_t i = 0 ; i < numSequences ; i++ ){
-		dm.setDistance(i,i,0);
-		size_t closestNeig = i;
-		float closestDist =  FLT_MAX;
-
-		DNA_b128_String &si = seqs[i];
-
-		//if has ambig find closest string and resolve.
-		if ( si.hasAmbiguities() ){
-			for ( size_t k = 0 ; k < i ; k++ ){
-				float dist = dm.getDistance(k,i);
-				if (  dist < closestDist && dist >= 0 ){
-					closestDist = dist;
-					closestNeig = k;
-				}
-			}
-		}
-
-
-		ML_string_distance  ml_dist;
-		for ( size_t j = i+1 ; j < numSequences ; j++ ){
-			TN_string_distance tn = DNA_b128_String::computeTAMURANEIDistance(si,seqs[j]);
-
-			if ( trans_model.no_tstvratio )
-				ml_dist = compute_Tamura_Nei(strlen,tn,freqs.num_As_,freqs.num_Cs_,freqs.num_Gs_,freqs.num_Ts_);
-			else
-				ml_dist = compute_Tamura_Nei_fixratio(strlen,tn,
-						freqs.num_As_,freqs.num_Cs_,freqs.num_Gs_,freqs.num_Ts_,
-						trans_model.tstvratio, trans_model.pyrtvratio);
-			dm.setDistance(i,j,ml_dist.distance);
-			extendedDistanceInfo.setDistance(i,j,pair<TN_string_distance,ML_string_distance>(tn,ml_dist));
-
-			if ( ml_dist.distance < closestDist && ml_dist.distance >= 0 ){
-				closestDist = ml_dist.distance;
-				closestNeig = j;
-			}
-		}
-
-		if ( si.hasAmbiguities() && ! trans_model.no_ambig_resolve ){
-			ml_dist = extendedDistanceInfo.getDistance(i,closestNeig).second;
-			si.resolveAmbiguitiesUsingTransitionProbabilities(seqs[closestNeig],ml_dist);
-		}
+	const size_t numSequences = seqs.size();
+	const size_t numModels = trans_models.size();
+	AlignmentContext context;
+	dms.resize(numModels);
+	if ( numModels == 1 ){
+		context.prepare(seqs, trans_models[0], multiplicities);
+		fillMatrix(dms[0], seqs, context, trans_models[0], numThreads);
+		return;
 	}
 
-	//UPDATE USING AMBIGUITIES
-	if( !trans_model.no_ambiguities ){
-		for ( size_t i = 0 ; i < numSequences ; i++ ){
-			DNA_b128_String &si = seqs[i];
-			for ( size_t j = i+1 ; j < numSequences ; j++ ){
-				if ( si.hasAmbiguities() || seqs[j].hasAmbiguities() ){
-					TN_string_distance tn = extendedDistanceInfo.getDistance(i,j).first;
-					ML_string_distance ml_dist = extendedDistanceInfo.getDistance(i,j).second;
-					if ( trans_model.no_transition_probs ){
-						tn = DNA_b128_String::correctDistanceWithAmbiguitiesUsingBackgroundFrequences(tn,si,seqs[j]);
-					}
-					else {
-						tn = DNA_b128_String::correctDistanceWithAmbiguitiesUsingTransitionProbabilities(tn,ml_dist,si,seqs[j]);
-					}
-					if ( trans_model.no_tstvratio )
-						ml_dist = compute_Tamura_Nei(strlen,tn,freqs.num_As_,freqs.num_Cs_,freqs.num_Gs_,freqs.num_Ts_);
-					else
-						ml_dist = compute_Tamura_Nei_fixratio(strlen,tn,
-								freqs.num_As_,freqs.num_Cs_,freqs.num_Gs_,freqs.num_Ts_,
-								trans_model.tstvratio, trans_model.pyrtvratio);
-
-					dm.setDistance(i,j,ml_dist.distance);
+	//count the differences of every pair once
+	TNCountMatrix counts(numSequences);
+	WorkStealingPool pool(numThreads);
+	const size_t tileSide = tileSideForSequences(seqs);
+	const std::vector<const DNA_b128_String*> seqPtrs = sequencePointers(seqs);
+	forEachRowSegmentInTiles(pool, numSequences, tileSide, [&](size_t i, size_t jBegin, size_t jEnd){
+		TN_string_distance tns[MAX_TILE_SIDE];
+		DNA_b128_String::computeTAMURANEIDistances(seqs[i], &seqPtrs[jBegin], jEnd-jBegin, tns);
+		for ( size_t j = jBegin ; j < jEnd ; j++ )
+			counts.setDistance(i,j,tns[j-jBegin]);
+	});
+
+	//every model resolves the ambiguities of the strings as they are now
+	for ( size_t i = 0 ; i < numSequences ; i++ )
+		seqs[i].saveAmbiguities();
+
+	for ( size_t m = 0 ; m < numModels ; m++ ){
+		if ( m > 0 )
+			for ( size_t i = 0 ; i < numSequences ; i++ )
+				seqs[i].restoreAmbiguities();
+		context.prepare(seqs, trans_models[m], multiplicities);
+		dms[m].resize(numSequences);
+		fillMatrixModel(dms[m], seqs, context.getBaseFrequences(), trans_models[m], numThreads, &counts);
+	}
+}
 
-				}
-			}
+//The distances of identical strings with the engine of a model, see
+//runWithModel().
+struct DuplicateEngine{
+	std::vector<float> &dists;
+	const std::vector<DNA_b128_String> &seqs;
+	const DNA_b128_String::base_frequences &freqs;
+	const sequence_translation_model &trans_model;
+	const std::vector<size_t> *multiplicities;
+
+	template<class Model>
+	void run(){
+		const Model model(seqs[0].getNumSites(), freqs, trans_model);
+		for ( size_t i = 0 ; i < seqs.size() ; i++ ){
+			//a string without copies has no pair with itself
+			if ( seqs[i].hasAmbiguities() || (multiplicities != NULL && (*multiplicities)[i] < 2) )
+				continue;
+			//counted and corrected as a pair of the matrix engine
+			const DNA_b128_String *si = &seqs[i];
+			typename Model::Counts c;
+			Model::count(*si, &si, 1, &c);
+			model.distances(&c, 1, &dists[i]);
 		}
 	}
+};
+
+void
+fillDuplicateDistances(std::vector<float> &dists, const std::vector<DNA_b128_String> &seqs,
+		sequence_translation_model trans_model, const std::vector<size_t> *multiplicities){
+	dists.resize(seqs.size());
+	if ( seqs.empty() )
+		return;
+	const DNA_b128_String::base_frequences freqs = sumBaseFrequences(seqs, multiplicities);
+	DuplicateEngine engine = {dists, seqs, freqs, trans_model, multiplicities};
+	runWithModel(engine, trans_model);
 }
 
-//-------- mehmood warka dang---------------
+//The base frequences are only used by TN93.
+static const DNA_b128_String::base_frequences NO_FREQUENCES = {0,0,0,0,0,0};
 
-void fillMatrixRow(StrFloRow &dm, std::vector<DNA_b128_String> &seqs,
-		sequence_translation_model trans_model, size_t row, bool mem_eff_flag){
+void
+fillMatrix_Hamming(StrDblMatrix &dm, std::vector<DNA_b128_String> &seqs,
+		sequence_translation_model trans_model, size_t numThreads, const TNCountMatrix *counts){
+	trans_model.model = HAMMING_DISTANCE;
+	fillMatrixModel(dm, seqs, NO_FREQUENCES, trans_model, numThreads, counts);
+}
 
-	const size_t numSequences = seqs.size();
-	dm.resize(numSequences);
+void
+fillMatrix_JC(StrDblMatrix &dm, std::vector<DNA_b128_String> &seqs,
+		sequence_translation_model trans_model, size_t numThreads, const TNCountMatrix *counts){
+	trans_model.model = JC;
+	fillMatrixModel(dm, seqs, NO_FREQUENCES, trans_model, numThreads, counts);
+}
 
+void
+fillMatrix_K2P(StrDblMatrix &dm, std::vector<DNA_b128_String> &seqs,
+		sequence_translation_model trans_model, size_t numThreads, const TNCountMatrix *counts){
+	trans_model.model = K2P;
+	fillMatrixModel(dm, seqs, NO_FREQUENCES, trans_model, numThreads, counts);
+}
 
-	//base frequences
-	DNA_b128_String::base_frequences freqs = seqs[0].getBaseFrequences();
-	for ( size_t i = 1 ; i < numSequences ; i++ ){
-		DNA_b128_String::base_frequences tmpfreqs = seqs[i].getBaseFrequences();
-		freqs.num_As_+= tmpfreqs.num_As_;
-		freqs.num_Cs_+= tmpfreqs.num_Cs_;
-		freqs.num_Gs_+= tmpfreqs.num_Gs_;
-		freqs.num_Ts_+= tmpfreqs.num_Ts_;
-		freqs.num_unknowns_+= tmpfreqs.num_unknowns_;
-		freqs.num_ambiguities_+= tmpfreqs.num_ambiguities_;
-	}
+void fillMatrix_TN93(StrDblMatrix &dm, std::vector<DNA_b128_String> &seqs,
+		DNA_b128_String::base_frequences freqs,
+		sequence_translation_model trans_model, size_t numThreads, const TNCountMatrix *counts){
+	trans_model.model = TN93;
+	fillMatrixModel(dm, seqs, freqs, trans_model, numThreads, counts);
+}
 
-	//compute ambiguities probabilities
-	if ( ! trans_model.no_ambiguities ){
-		if ( trans_model.use_base_freqs ){
-			for ( size_t i = 0 ; i < numSequences ; i++ ){
-				seqs[i].calcAmbiguityProbabilities( freqs.num_As_,freqs.num_Cs_,freqs.num_Gs_,freqs.num_Ts_);
-			}
-		}
-		else {
-			for ( size_t i = 0 ; i < numSequences ; i++ ){
-				seqs[i].calcAmbiguityProbabilitiesUNIFORM();
-			}
-		}
-	}
+//-------- mehmood warka dang---------------
 
-	//CALL DISTANCE COMPUTATION
-	switch( trans_model.model ){
-	case HAMMING_DISTANCE: fillMatrixRow_Hamming(dm,seqs,trans_model, row, mem_eff_flag);break;
-	case JC:  fillMatrixRow_JC(dm,seqs,trans_model, row , mem_eff_flag);break;
-	case K2P:  fillMatrixRow_K2P(dm,seqs,trans_model, row, mem_eff_flag);break;
-	case TN93: fillMatrixRow_TN93(dm,seqs,freqs,trans_model, row, mem_eff_flag);break;
-	default:
-		PROG_ERROR("Non handled model: " << trans_model.model);
+//---------------------------------------------------------
+// ROW ENGINE
+//
+// Computes one row of the matrix with the same models as the matrix
+// engine. The ambiguities of a sequence are resolved from its closest
+// neighbor, which is only known when its whole row has been computed.
+// AlignmentContext::prepareRows() therefore computes the row of every
+// sequence with ambiguities and resolves it before the first row is
+// filled. The pairs with ambiguities are then corrected row by row and
+// the rows are the same as the rows of the matrix, without storing
+// anything per pair.
+
+//The uncorrected distances of row to the sequences first,...,last-1,
+//except to itself, in distances[0],...,distances[last-first-1]. The
+//pairs with more than maxDifferences differences may be counted in
+//part and their distances are set to FLT_MAX.
+template<class Model>
+static void
+rowDistances(const Model &model, const std::vector<DNA_b128_String> &seqs, const DNA_b128_String *const *seqPtrs,
+		size_t row, size_t first, size_t last, std::vector<typename Model::Counts> &rowCounts,
+		std::vector<float> &distances, unsigned int maxDifferences=NO_BOUND){
+	rowCounts.resize(last-first);
+	distances.resize(last-first);
+	Model::count(seqs[row], seqPtrs+first, last-first, rowCounts.data(), maxDifferences);
+	//the pair of the row with itself is left out
+	if ( first < row )
+		model.distances(rowCounts.data(), min(row,last)-first, distances.data());
+	const size_t after = max(first, min(row+1,last));
+	model.distances(rowCounts.data()+after-first, last-after, distances.data()+after-first);
+	if ( maxDifferences == NO_BOUND )
+		return;
+	for ( size_t j = 0 ; j < last-first ; j++ ){
+		if ( numDifferences(rowCounts[j]) > maxDifferences )
+			distances[j] = FLT_MAX;
 	}
 }
 
-void fillMatrixRow_K2P(StrFloRow &dm, std::vector<DNA_b128_String> &seqs,
-		sequence_translation_model trans_model, size_t row, bool mem_eff_flag){
+//The corrected distances of row to the sequences first,...,last-1 as
+//rowDistances() gives them.
+template<class Model, template<class> class Ambiguities>
+static void
+rowSegmentDistances(const Model &model, const std::vector<DNA_b128_String> &seqs, const AlignmentContext &context,
+		size_t row, size_t first, size_t last, std::vector<typename Model::Counts> &rowCounts,
+		std::vector<float> &distances, unsigned int maxDifferences){
+	rowDistances(model, seqs, context.getSequencePointers(), row, first, last, rowCounts, distances, maxDifferences);
+	Ambiguities<Model>::completeRow(rowCounts, seqs, context.getSequencePointers(), row, first, last, maxDifferences);
+	Ambiguities<Model>::correctRow(distances, rowCounts, seqs, model, row, first, last);
+}
 
+template<class Model, template<class> class Ambiguities>
+static void
+fillMatrixRowEngine(StrFloRow &dm, std::vector<DNA_b128_String> &seqs, const AlignmentContext &context,
+		const Model &model, size_t row, size_t first, float maxDistance){
 
-	//saves the number of sequences and the length of the first sequence
 	const size_t numSequences = seqs.size();
-	const size_t strlen = seqs[0].getNumChars();
-
-	//Resizes the datamatrix to fit the sequences
-	dm.resize(numSequences);
-
-
-	//extended information used to compute ambiguities
-	static DistanceRow<int,pair<simple_string_distance,ML_string_distance>,
-	empty_Data_init<int>,empty_Data_printOn<int>,
-	empty_Data_init<pair<simple_string_distance,ML_string_distance> >,
-	empty_Data_printOn<pair<simple_string_distance,ML_string_distance> > >
-	extendedDistanceInfo(numSequences);
-	extendedDistanceInfo.resize(numSequences);
-
 
 	//same sequence has of course distance zero
 	dm.setDistance(row,0);
-	int closestNeig = row;
-	float closestDist =  FLT_MAX;
-	//saves the actual sequence within si
-	DNA_b128_String &si = seqs[row];
-	/*
-    //if has ambig find closest string and resolve.
-    if ( si.hasAmbiguities() ){
-      for ( size_t k = 0 ; k < row ; k++ ){
-		float dist = dm.getDistance(row);
-		if (  dist < closestDist && dist >= 0 ){
-		  closestDist = dist;
-		  closestNeig = k;
-		}
-      }
-    }*/
-	if (mem_eff_flag == false){
-		for ( size_t j = 0 ; j < row ; j++ ){
-			dm.setDistance(j, 0);
-		}
-	}else{
-		row=-1;
+
+	//Only the distances to the sequences first,... are computed. In
+	//memory efficient mode that is the whole row, otherwise only the
+	//part after the diagonal.
+	for ( size_t j = 0 ; j < first ; j++ ){
+		dm.setDistance(j, 0);
 	}
 
+	//The pairs further apart than maxDistance are only counted until
+	//that is certain.
+	unsigned int maxDifferences = NO_BOUND;
+	if ( maxDistance != FLT_MAX )
+		maxDifferences = Ambiguities<Model>::rowBound(seqs[row], model.maxDifferences(maxDistance));
+
 	//Calculates distances from si to every other sequence. One row of the matrix
-	for ( size_t j = row+1 ; j < numSequences ; j++ ){
-		simple_string_distance sd = DNA_b128_String::computeDistance(si,seqs[j]);
-		ML_string_distance  ml_dist;
+	std::vector<typename Model::Counts> rowCounts;
+	std::vector<float> distances;
+	rowSegmentDistances<Model,Ambiguities>(model, seqs, context, row, first, numSequences, rowCounts, distances,
+			maxDifferences);
+	for ( size_t j = first ; j < numSequences ; j++ ){
+		if ( j != row )
+			dm.setDistance(j,distances[j-first]);
+	}
+}
 
-		//Controlls if the tstvratio exists for K2P.
-		if ( trans_model.no_tstvratio )
-			ml_dist = compute_K2P(strlen,sd);
+//Fills a row with the engine of a model, see runWithModel().
+struct RowEngine{
+	StrFloRow &dm;
+	std::vector<DNA_b128_String> &seqs;
+	const AlignmentContext &context;
+	const sequence_translation_model &trans_model;
+	size_t row;
+	size_t first;
+	float maxDistance;
+
+	template<class Model>
+	void run(){
+		const Model model(context.getNumSites(), context.getBaseFrequences(), trans_model);
+		if ( trans_model.no_ambiguities )
+			fillMatrixRowEngine<Model,IgnoreAmbiguities>(dm, seqs, context, model, row, first, maxDistance);
 		else
-			ml_dist = compute_K2P_fixratio(strlen,sd,trans_model.tstvratio);
-
-		//Sets distance in the matrix between i and j
-		dm.setDistance(j,ml_dist.distance);
-		extendedDistanceInfo.setDistance(j,pair<simple_string_distance,ML_string_distance>(sd,ml_dist));
-
-		//Controlling if new distance is the closest neighbor
-		if ( ml_dist.distance < closestDist && ml_dist.distance >= 0 ){
-			closestDist = ml_dist.distance;
-			closestNeig = j;
-		}
+			fillMatrixRowEngine<Model,CorrectAmbiguities>(dm, seqs, context, model, row, first, maxDistance);
 	}
-	/*
-    //Looks at ambiguities
-    if ( si.hasAmbiguities() && ! trans_model.no_ambig_resolve ){
-      ML_string_distance  ml_dist = extendedDistanceInfo.getDistance(closestNeig).second;
-      si.resolveAmbiguitiesUsingTransitionProbabilities(seqs[closestNeig],ml_dist);
-    }
-
-  //UPDATE USING AMBIGUITIES
-  if( ! trans_model.no_ambiguities ){
-      DNA_b128_String &si = seqs[row];
-      for ( size_t j = row+1 ; j < numSequences ; j++ ){
-		if ( si.hasAmbiguities() || seqs[j].hasAmbiguities() ){
-		  simple_string_distance sd = extendedDistanceInfo.getDistance(j).first;
-		  ML_string_distance ml_dist = extendedDistanceInfo.getDistance(j).second;
-		  sd = DNA_b128_String::correctDistanceWithAmbiguitiesUsingTransitionProbabilities(sd,ml_dist,si,seqs[j]);
-		  if ( trans_model.no_tstvratio )
-		    ml_dist = compute_K2P(strlen,sd);
-		  else
-		    ml_dist = compute_K2P_fixratio(strlen,sd,trans_model.tstvratio);
-		  //sets distance with ambiguities
-		  dm.setDistance(j,ml_dist.distance);
-		}
-      }
-
-  }*/
+};
+
+//Resolves the ambiguities of the sequences first,... from their
+//closest neighbor as the matrix engine does. The sequences are
+//independent, see PARALLEL COMPUTATION OF THE MATRIX.
+struct RowResolver{
+	std::vector<DNA_b128_String> &seqs;
+	const AlignmentContext &context;
+	const sequence_translation_model &trans_model;
+	size_t first;
+	size_t numThreads;
+
+	template<class Model>
+	void run(){
+		const Model model(context.getNumSites(), context.getBaseFrequences(), trans_model);
+		WorkStealingPool pool(numThreads);
+		pool.run(seqs.size()-first, [&](size_t k){
+			const size_t i = first+k;
+			DNA_b128_String &si = seqs[i];
+			if ( ! si.hasAmbiguities() )
+				return;
+			std::vector<typename Model::Counts> rowCounts;
+			std::vector<float> distances;
+			rowDistances(model, seqs, context.getSequencePointers(), i, 0, seqs.size(), rowCounts, distances);
+			size_t closestNeig = closestNeighbor(distances, i);
+			if ( closestNeig != i )
+				model.resolve(si, seqs[closestNeig], model.changeProbabilities(rowCounts[closestNeig]));
+		});
+	}
+};
 
-}
 void
-fillMatrixRow_Hamming(StrFloRow &dm, std::vector<DNA_b128_String> &seqs,
-		sequence_translation_model trans_model, size_t row, bool mem_eff_flag){
-
-	const size_t numSequences = seqs.size();
-	const size_t strlen = seqs[0].getNumChars();
-
-	dm.resize(numSequences);
-
-	//extended information used to compute ambiguities
-	static DistanceRow<int,simple_string_distance,
-	empty_Data_init<int>,empty_Data_printOn<int>,
-	empty_Data_init<simple_string_distance>, empty_Data_printOn<simple_string_distance> >
-	extendedDistanceInfo(numSequences);
-	extendedDistanceInfo.resize(numSequences);
-
-	//
-	// The loop will resolve the ambiguities according to the translation model
-	//
-	dm.setDistance(row,0);
-	size_t closestNeig = row;
-	float closestDist =  FLT_MAX;
-
-	DNA_b128_String &si = seqs[row];
-	//only if it has ambiguities does it need to be resolved
-	//start by checking the allready computed distances for si
-	//We don't use ambiguities no more!
-	/*if ( si.hasAmbiguities() ){
-        for ( size_t k = 0 ; k < i ; k++ ){
-          float dist = dm.getDistance(k,i);
-          if (  dist < closestDist && dist >= 0 ){
-            closestDist = dist;
-            closestNeig = k;
-          }
-        }
-    }*/
-	if (mem_eff_flag == false){
-			for ( size_t j = 0 ; j < row ; j++ ){
-				dm.setDistance(j, 0);
-			}
-		}else{
-			row=-1;
-		}
-	// compute the remaining distances for si
-	for ( size_t j = row+1 ; j < numSequences ; j++ ){
-		//compute distance without using the ambiguities
-		simple_string_distance sd = DNA_b128_String::computeDistance(si,seqs[j]);
-		float hamdist = compute_Hamming_distance(sd);
-
-		dm.setDistance(j,hamdist);
-		extendedDistanceInfo.setDistance(j,sd);
-
-		if ( hamdist < closestDist && hamdist >= 0 ){//update the closest neighbor
-			closestDist = hamdist;
-			closestNeig = j;
-		}
+AlignmentContext::prepareRows(std::vector<DNA_b128_String> &seqs, const sequence_translation_model &trans_model,
+		size_t numThreads, const std::vector<size_t> *multiplicities){
+	prepare(seqs, trans_model, multiplicities);
+	//the resolution only changes the rows if the ambiguities are included
+	if ( ! trans_model.no_ambiguities && ! trans_model.no_ambig_resolve ){
+		RowResolver resolver = {seqs, *this, trans_model, 0, numThreads};
+		runWithModel(resolver, trans_model);
 	}
-	//all distances for si have been compted
-	//We don't use ambiguities no more!
-	//Resolve the ambiguities according to the closest neighbor
-	/*    if ( si.hasAmbiguities() && ! trans_model.no_ambig_resolve ){
-      si.resolveAmbiguities(seqs[closestNeig]);
-    }
-  }
-
- //We don't use ambiguities no more!
-  //Update the computed distances with the ambiguities
-  if ( !trans_model.no_ambiguities ){
-    for ( size_t i = 0 ; i < numSequences ; i++ ){
-      DNA_b128_String &si = seqs[i];
-      for ( size_t j = i+1 ; j < numSequences ; j++ ){
-        if ( si.hasAmbiguities() || seqs[j].hasAmbiguities() ){
-          simple_string_distance sd = extendedDistanceInfo.getDistance(i,j);
-	  ML_string_distance ml_dist = compute_JC(strlen,sd);
-          sd = DNA_b128_String::correctDistanceWithAmbiguitiesUsingTransitionProbabilities(sd,ml_dist,si,seqs[j]);
-
-          //hamming
-          dm.setDistance(i,j,compute_Hamming_distance(sd));
-
-        }
-      }
-    }
-  }	*/
-
+	preparedRows = true;
 }
 
-void fillMatrixRow_JC(StrFloRow &dm, std::vector<DNA_b128_String> &seqs,
-		sequence_translation_model trans_model, size_t row, bool mem_eff_flag){
-		const size_t numSequences = seqs.size();
-		const size_t strlen = seqs[0].getNumChars();
-
-		dm.resize(numSequences);
-
-		//extended information used to compute ambiguities
-		static DistanceRow<int,pair<simple_string_distance,ML_string_distance>,
-		empty_Data_init<int>,empty_Data_printOn<int>,
-		empty_Data_init<pair<simple_string_distance,ML_string_distance> >,
-		empty_Data_printOn<pair<simple_string_distance,ML_string_distance> > >
-		extendedDistanceInfo(numSequences);
+void
+AlignmentContext::prepareAppendedRows(std::vector<DNA_b128_String> &seqs, const sequence_translation_model &trans_model,
+		size_t numOld, size_t numThreads){
+	prepare(seqs, trans_model);
+	if ( ! trans_model.no_ambiguities && ! trans_model.no_ambig_resolve ){
+		RowResolver resolver = {seqs, *this, trans_model, min(numOld, seqs.size()), numThreads};
+		runWithModel(resolver, trans_model);
+	}
+	preparedRows = true;
+}
 
-		extendedDistanceInfo.resize(numSequences);
+//Resolves an old row of an appended matrix and computes its
+//distances to the appended sequences, see fillAppendedRow().
+struct AppendedRowEngine{
+	StrFloRow &dm;
+	std::vector<DNA_b128_String> &seqs;
+	const AlignmentContext &context;
+	const sequence_translation_model &trans_model;
+	size_t row;
+	size_t numOld;
+	size_t oldNeighbor;
+
+	template<class Model>
+	void run(){
+		const Model model(context.getNumSites(), context.getBaseFrequences(), trans_model);
+		if ( trans_model.no_ambiguities )
+			fill<Model,IgnoreAmbiguities>(model);
+		else
+			fill<Model,CorrectAmbiguities>(model);
+	}
 
-		dm.setDistance(row,0);
-		size_t closestNeig = row;
-		float closestDist =  FLT_MAX;
+	template<class Model, template<class> class Ambiguities>
+	void fill(const Model &model){
+		const size_t numSequences = seqs.size();
+		const DNA_b128_String *const *seqPtrs = context.getSequencePointers();
+		std::vector<typename Model::Counts> rowCounts;
+		std::vector<float> distances;
+		rowDistances(model, seqs, seqPtrs, row, numOld, numSequences, rowCounts, distances);
 
 		DNA_b128_String &si = seqs[row];
-
-		//if has ambig find closest string and resolve.
-		/*if ( si.hasAmbiguities() ){
-        for ( size_t k = 0 ; k < i ; k++ ){
-          float dist = dm.getDistance(k,i);
-          if (  dist < closestDist && dist >= 0 ){
-            closestDist = dist;
-            closestNeig = k;
-          }
-        }
-    }*/
-		if (!mem_eff_flag == false){
-				for ( size_t j = 0 ; j < row ; j++ ){
-					dm.setDistance(j, 0);
+		if ( ! trans_model.no_ambiguities && ! trans_model.no_ambig_resolve && si.hasAmbiguities() ){
+			//the old neighbor is compared by its uncorrected distance as
+			//well, and wins the ties as it has the lower index
+			std::vector<typename Model::Counts> pairCounts;
+			std::vector<float> pairDistances;
+			size_t closestNeig = row;
+			float closestDist = FLT_MAX;
+			if ( oldNeighbor != row ){
+				rowDistances(model, seqs, seqPtrs, row, oldNeighbor, oldNeighbor+1, pairCounts, pairDistances);
+				if ( pairDistances[0] >= 0 ){
+					closestNeig = oldNeighbor;
+					closestDist = pairDistances[0];
 				}
-			}else{
-				row=-1;
 			}
-
-		ML_string_distance  ml_dist;
-		for ( size_t j = row+1 ; j < numSequences ; j++ ){
-			simple_string_distance sd = DNA_b128_String::computeDistance(si,seqs[j]);
-			//     cout << sd << endl;
-			ml_dist = compute_JC(strlen,sd);
-
-			dm.setDistance(j,ml_dist.distance);
-			extendedDistanceInfo.setDistance(j,pair<simple_string_distance,ML_string_distance>(sd,ml_dist));
-
-			if ( ml_dist.distance < closestDist && ml_dist.distance >= 0 ){
-				closestDist = ml_dist.distance;
-				closestNeig = j;
+			for ( size_t j = numOld ; j < numSequences ; j++ ){
+				if ( distances[j-numOld] < closestDist && distances[j-numOld] >= 0 ){
+					closestDist = distances[j-numOld];
+					closestNeig = j;
+				}
 			}
+			if ( closestNeig >= numOld )
+				model.resolve(si, seqs[closestNeig], model.changeProbabilities(rowCounts[closestNeig-numOld]));
+			else if ( closestNeig != row )
+				model.resolve(si, seqs[closestNeig], model.changeProbabilities(pairCounts[0]));
 		}
 
-		/*  if ( si.hasAmbiguities() && ! trans_model.no_ambig_resolve ){
-      ml_dist = extendedDistanceInfo.getDistance(i,closestNeig).second;
-      si.resolveAmbiguitiesUsingTransitionProbabilities(seqs[closestNeig],ml_dist);
-    }
-  }
-
-  //UPDATE USING AMBIGUITIES
-  if ( !trans_model.no_ambiguities ){
-    for (size_t i = 0 ; i < numSequences ; i++ ){
-      DNA_b128_String &si = seqs[i];
-      for ( size_t j = i+1 ; j < numSequences ; j++ ){
-        if ( si.hasAmbiguities() || seqs[j].hasAmbiguities() ){
-          simple_string_distance sd = extendedDistanceInfo.getDistance(i,j).first;
-          ML_string_distance ml_dist = extendedDistanceInfo.getDistance(i,j).second;
-          sd = DNA_b128_String::correctDistanceWithAmbiguitiesUsingTransitionProbabilities(sd,ml_dist,si,seqs[j]);
-
-          ml_dist = compute_JC(strlen,sd);
-          dm.setDistance(i,j,ml_dist.distance);
-        }
-      }
-    }*/
-}
-
+		Ambiguities<Model>::completeRow(rowCounts, seqs, seqPtrs, row, numOld, numSequences, NO_BOUND);
+		Ambiguities<Model>::correctRow(distances, rowCounts, seqs, model, row, numOld, numSequences);
+		for ( size_t j = numOld ; j < numSequences ; j++ )
+			dm.setDistance(j, distances[j-numOld]);
+	}
+};
 
-void fillMatrixRow_TN93(StrFloRow &dm, std::vector<DNA_b128_String> &seqs,
-		DNA_b128_String::base_frequences freqs,
-		sequence_translation_model trans_model, size_t row, bool mem_eff_flag){
+void fillAppendedRow(StrFloRow &dm, std::vector<DNA_b128_String> &seqs, const AlignmentContext &context,
+		sequence_translation_model trans_model, size_t row, size_t numOld, size_t oldNeighbor){
 	const size_t numSequences = seqs.size();
-	const size_t strlen = seqs[0].getNumChars();
-
+	if ( context.getNumSequences() != numSequences )
+		PROG_ERROR("The context is not prepared for the sequences");
+	if ( ! context.isPreparedForRows() )
+		PROG_ERROR("The appended sequences are not resolved, see AlignmentContext::prepareAppendedRows()");
+	if ( row >= numOld || numOld > numSequences )
+		PROG_ERROR("Row " << row << " is not one of the " << numOld << " old sequences");
 	dm.resize(numSequences);
 
+	AppendedRowEngine engine = {dm, seqs, context, trans_model, row, numOld, oldNeighbor};
+	runWithModel(engine, trans_model);
+}
 
-	//extended information used to compute ambiguities
-	static DistanceRow<int,pair<TN_string_distance,ML_string_distance>,
-	empty_Data_init<int>,empty_Data_printOn<int>,
-	empty_Data_init<pair<TN_string_distance,ML_string_distance> >,
-	empty_Data_printOn<pair<TN_string_distance,ML_string_distance> > >
-	extendedDistanceInfo(numSequences);
-	extendedDistanceInfo.resize(numSequences);
-
+void fillMatrixRow(StrFloRow &dm, std::vector<DNA_b128_String> &seqs,
+		sequence_translation_model trans_model, size_t row, bool mem_eff_flag){
+	AlignmentContext context;
+	context.prepareRows(seqs, trans_model);
+	fillMatrixRow(dm, seqs, context, trans_model, row, mem_eff_flag);
+}
 
-	dm.setDistance(row,0);
-	size_t closestNeig = row;
-	float closestDist =  FLT_MAX;
+void fillMatrixRow(StrFloRow &dm, std::vector<DNA_b128_String> &seqs, const AlignmentContext &context,
+		sequence_translation_model trans_model, size_t row, bool mem_eff_flag){
+	fillMatrixRowFrom(dm, seqs, context, trans_model, row, ( mem_eff_flag ? 0 : row+1 ));
+}
 
-	DNA_b128_String &si = seqs[row];
+void fillMatrixRowFrom(StrFloRow &dm, std::vector<DNA_b128_String> &seqs, const AlignmentContext &context,
+		sequence_translation_model trans_model, size_t row, size_t first){
+	fillMatrixRowWithin(dm, seqs, context, trans_model, row, first, FLT_MAX);
+}
 
-	//if has ambig find closest string and resolve.
-	/*if ( si.hasAmbiguities() ){
-      for ( size_t k = 0 ; k < i ; k++ ){
-	float dist = dm.getDistance(k,i);
-	if (  dist < closestDist && dist >= 0 ){
-	  closestDist = dist;
-	  closestNeig = k;
-	}
-      }
-    }*/
+void fillMatrixRowWithin(StrFloRow &dm, std::vector<DNA_b128_String> &seqs, const AlignmentContext &context,
+		sequence_translation_model trans_model, size_t row, size_t first, float maxDistance){
 
-	if (mem_eff_flag == false){
-			for ( size_t j = 0 ; j < row ; j++ ){
-				dm.setDistance(j, 0);
-			}
-		}else{
-			row=-1;
-		}
+	const size_t numSequences = seqs.size();
+	if ( context.getNumSequences() != numSequences )
+		PROG_ERROR("The context is not prepared for the sequences");
+	if ( ! trans_model.no_ambiguities && ! trans_model.no_ambig_resolve && ! context.isPreparedForRows() )
+		PROG_ERROR("The ambiguities are not resolved, see AlignmentContext::prepareRows()");
+	dm.resize(numSequences);
+	first = min(first, numSequences);
 
-	ML_string_distance  ml_dist;
-	for ( size_t j = row+1 ; j < numSequences ; j++ ){
-		TN_string_distance tn = DNA_b128_String::computeTAMURANEIDistance(si,seqs[j]);
+	//CALL DISTANCE COMPUTATION
+	RowEngine engine = {dm, seqs, context, trans_model, row, first, maxDistance};
+	runWithModel(engine, trans_model);
+}
 
-		if ( trans_model.no_tstvratio )
-			ml_dist = compute_Tamura_Nei(strlen,tn,freqs.num_As_,freqs.num_Cs_,freqs.num_Gs_,freqs.num_Ts_);
+//Fills a tile with the engine of a model, see runWithModel().
+struct TileEngine{
+	float *tile;
+	std::vector<DNA_b128_String> &seqs;
+	const AlignmentContext &context;
+	const sequence_translation_model &trans_model;
+	size_t rowBegin, rowEnd, colBegin, colEnd;
+
+	template<class Model>
+	void run(){
+		const Model model(context.getNumSites(), context.getBaseFrequences(), trans_model);
+		if ( trans_model.no_ambiguities )
+			fill<Model,IgnoreAmbiguities>(model);
 		else
-			ml_dist = compute_Tamura_Nei_fixratio(strlen,tn,
-					freqs.num_As_,freqs.num_Cs_,freqs.num_Gs_,freqs.num_Ts_,
-					trans_model.tstvratio, trans_model.pyrtvratio);
-		dm.setDistance(j,ml_dist.distance);
-		extendedDistanceInfo.setDistance(j,pair<TN_string_distance,ML_string_distance>(tn,ml_dist));
+			fill<Model,CorrectAmbiguities>(model);
+	}
 
-		if ( ml_dist.distance < closestDist && ml_dist.distance >= 0 ){
-			closestDist = ml_dist.distance;
-			closestNeig = j;
+	template<class Model, template<class> class Ambiguities>
+	void fill(const Model &model){
+		const size_t numCols = colEnd-colBegin;
+		std::vector<typename Model::Counts> rowCounts;
+		std::vector<float> distances;
+		for ( size_t i = rowBegin ; i < rowEnd ; i++ ){
+			rowSegmentDistances<Model,Ambiguities>(model, seqs, context, i, colBegin, colEnd, rowCounts, distances,
+					NO_BOUND);
+			float *tileRow = tile + (i-rowBegin)*numCols;
+			copy(distances.begin(), distances.end(), tileRow);
+			if ( i >= colBegin && i < colEnd )
+				tileRow[i-colBegin] = 0;
 		}
 	}
-	/*
-    if ( si.hasAmbiguities() && ! trans_model.no_ambig_resolve ){
-      ml_dist = extendedDistanceInfo.getDistance(i,closestNeig).second;
-      si.resolveAmbiguitiesUsingTransitionProbabilities(seqs[closestNeig],ml_dist);
-    }
-  }
-
-  //UPDATE USING AMBIGUITIES
-  if( !trans_model.no_ambiguities ){
-    for ( size_t i = 0 ; i < numSequences ; i++ ){
-      DNA_b128_String &si = seqs[i];
-      for ( size_t j = i+1 ; j < numSequences ; j++ ){
-        if ( si.hasAmbiguities() || seqs[j].hasAmbiguities() ){
-          TN_string_distance tn = extendedDistanceInfo.getDistance(i,j).first;
-          ML_string_distance ml_dist = extendedDistanceInfo.getDistance(i,j).second;
-          if ( trans_model.no_transition_probs ){
-            tn = DNA_b128_String::correctDistanceWithAmbiguitiesUsingBackgroundFrequences(tn,si,seqs[j]);
-          }
-          else {
-            tn = DNA_b128_String::correctDistanceWithAmbiguitiesUsingTransitionProbabilities(tn,ml_dist,si,seqs[j]);
-          }
-          if ( trans_model.no_tstvratio )
-            ml_dist = compute_Tamura_Nei(strlen,tn,freqs.num_As_,freqs.num_Cs_,freqs.num_Gs_,freqs.num_Ts_);
-          else
-            ml_dist = compute_Tamura_Nei_fixratio(strlen,tn,
-						  freqs.num_As_,freqs.num_Cs_,freqs.num_Gs_,freqs.num_Ts_,
-						  trans_model.tstvratio, trans_model.pyrtvratio);
-
-          dm.setDistance(i,j,ml_dist.distance);
-
-        }
-      }
-    }*/
-}
-
-
-//----------- khatam sho janana--------------
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
-
+};
 
+void fillTile(float *tile, std::vector<DNA_b128_String> &seqs, const AlignmentContext &context,
+		sequence_translation_model trans_model, size_t rowBegin, size_t rowEnd, size_t colBegin, size_t colEnd){
 
+	const size_t numSequences = seqs.size();
+	if ( context.getNumSequences() != numSequences )
+		PROG_ERROR("The context is not prepared for the sequences");
+	if ( ! trans_model.no_ambiguities && ! trans_model.no_ambig_resolve && ! context.isPreparedForRows() )
+		PROG_ERROR("The ambiguities are not resolved, see AlignmentContext::prepareRows()");
+	if ( rowBegin > rowEnd || rowEnd > numSequences || colBegin > colEnd || colEnd > numSequences )
+		PROG_ERROR("The tile is not within the matrix");
+
+	TileEngine engine = {tile, seqs, context, trans_model, rowBegin, rowEnd, colBegin, colEnd};
+	runWithModel(engine, trans_model);
+}
 
+void
+fillMatrixRow_Hamming(StrFloRow &dm, std::vector<DNA_b128_String> &seqs, const AlignmentContext &context,
+		sequence_translation_model trans_model, size_t row, bool mem_eff_flag){
+	trans_model.model = HAMMING_DISTANCE;
+	fillMatrixRow(dm, seqs, context, trans_model, row, mem_eff_flag);
+}
 
+void fillMatrixRow_JC(StrFloRow &dm, std::vector<DNA_b128_String> &seqs, const AlignmentContext &context,
+		sequence_translation_model trans_model, size_t row, bool mem_eff_flag){
+	trans_model.model = JC;
+	fillMatrixRow(dm, seqs, context, trans_model, row, mem_eff_flag);
+}
 
+void fillMatrixRow_K2P(StrFloRow &dm, std::vector<DNA_b128_String> &seqs, const AlignmentContext &context,
+		sequence_translation_model trans_model, size_t row, bool mem_eff_flag){
+	trans_model.model = K2P;
+	fillMatrixRow(dm, seqs, context, trans_model, row, mem_eff_flag);
+}
 
+void fillMatrixRow_TN93(StrFloRow &dm, std::vector<DNA_b128_String> &seqs, const AlignmentContext &context,
+		sequence_translation_model trans_model, size_t row, bool mem_eff_flag){
+	trans_model.model = TN93;
+	fillMatrixRow(dm, seqs, context, trans_model, row, mem_eff_flag);
+}
 
+//----------- khatam sho janana--------------
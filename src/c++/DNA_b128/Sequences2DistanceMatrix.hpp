@@ -17,9 +17,14 @@
 #include "DistanceRow.hpp"
 #include <string>
 #include "DNA_b128_String.hpp"
+#include "PackedAlignment.hpp"
 #include <fstream>
 #include "dna_pairwise_sequence_likelihood.hpp"
 #include "SequenceTree.hpp"
+#include "random_utils.hpp"
+
+class InputBuffer;
+
 //
 // This file contains functions for creating a distance matrix from
 // DNA sequences using different models of evolution.
@@ -27,12 +32,15 @@
 // The general function is:
 //
 // void fillMatrix(StrDblMatrix &dm, std::vector<DNA_b128_String> &seqs,
-//		  sequence_translation_model trans_model);
+//		  sequence_translation_model trans_model, size_t numThreads=1);
 //
 // It fills the distance matrix dm using the input sequences and the
 // translation model. Note that the identifiers of the rows in the
 // matrix are untouched and need to be set by the caller.
 //
+// The pairwise distances are computed on numThreads threads. The
+// result does not depend on the number of threads.
+//
 
 //This struct describes how the distance should be computed from the strings.
 typedef struct {
@@ -54,31 +62,181 @@ typedef struct {
 } sequence_translation_model;
 
 
+//---------------------------------------------------------------
+// ALIGNMENT CONTEXT
+//
+// What the distance computations need to know about the alignment as
+// a whole: the base frequences summed over all sequences, the number
+// of sites and pointers to the sequences. prepare() also computes the
+// probabilities of the ambiguities of every sequence, which are
+// stored in the sequences.
+//
+// fillMatrix() prepares a context for every matrix. fillMatrixRow()
+// is called once per row, so the caller should prepare the context
+// once per alignment, or bootstrap replicate, with prepareRows() and
+// pass it to every row. prepareRows() also resolves the ambiguities
+// of the sequences from their closest neighbors, as fillMatrix()
+// does, which costs one row per sequence with ambiguities. The rows
+// are then the same as the rows of the matrix. The context must be
+// prepared again when the sequences change.
+//
+// If multiplicities is given seqs[i] stands for multiplicities[i]
+// identical sequences, see DuplicateSequences.hpp, and the base
+// frequences are summed accordingly.
+//
+// EXAMPLE USAGE
+// AlignmentContext context;
+// context.prepareRows(seqs, trans_model, numThreads);
+// for ( size_t i = 0 ; i < seqs.size() ; i++ )
+//   fillMatrixRow(dm, seqs, context, trans_model, i, true);
+//
+class AlignmentContext
+{
+public:
+  AlignmentContext();
+
+  void prepare(std::vector<DNA_b128_String> &seqs, const sequence_translation_model &trans_model,
+               const std::vector<size_t> *multiplicities=NULL);
+  void prepare(PackedAlignment &seqs, const sequence_translation_model &trans_model,
+               const std::vector<size_t> *multiplicities=NULL){
+    prepare(seqs.getSequences(), trans_model, multiplicities);
+  }
+
+  // prepare() followed by the resolution of the ambiguities for
+  // fillMatrixRow(). The rows are computed on numThreads threads.
+  void prepareRows(std::vector<DNA_b128_String> &seqs, const sequence_translation_model &trans_model,
+                   size_t numThreads=1, const std::vector<size_t> *multiplicities=NULL);
+  void prepareRows(PackedAlignment &seqs, const sequence_translation_model &trans_model,
+                   size_t numThreads=1, const std::vector<size_t> *multiplicities=NULL){
+    prepareRows(seqs.getSequences(), trans_model, numThreads, multiplicities);
+  }
+  // prepareRows() for a matrix of the first numOld sequences
+  // extended with the others, see fillAppendedRow(). Only the
+  // ambiguities of the appended sequences are resolved here.
+  void prepareAppendedRows(std::vector<DNA_b128_String> &seqs, const sequence_translation_model &trans_model,
+                           size_t numOld, size_t numThreads=1);
+  void prepareAppendedRows(PackedAlignment &seqs, const sequence_translation_model &trans_model,
+                           size_t numOld, size_t numThreads=1){
+    prepareAppendedRows(seqs.getSequences(), trans_model, numOld, numThreads);
+  }
+  bool isPreparedForRows() const{
+    return preparedRows;
+  }
+
+  size_t getNumSequences() const{
+    return seqPtrs.size();
+  }
+  // The number of alignment columns, see DNA_b128_String::getNumSites().
+  size_t getNumSites() const{
+    return numSites;
+  }
+  const DNA_b128_String::base_frequences &getBaseFrequences() const{
+    return freqs;
+  }
+  const DNA_b128_String *const *getSequencePointers() const{
+    return (seqPtrs.empty() ? NULL : &seqPtrs[0]);
+  }
+
+private:
+  DNA_b128_String::base_frequences freqs;
+  size_t numSites;
+  std::vector<const DNA_b128_String*> seqPtrs;
+  bool preparedRows;
+};
+
+
 
 //---------------------------------------------------------------
 //Fills the distance matrix according to the sequence_translation_model.
 
 void fillMatrix(StrDblMatrix &dm, std::vector<DNA_b128_String> &b128_strings,
-		sequence_translation_model trans_model);
+		sequence_translation_model trans_model, size_t numThreads=1);
+
+inline void fillMatrix(StrDblMatrix &dm, PackedAlignment &b128_strings,
+		sequence_translation_model trans_model, size_t numThreads=1){
+  fillMatrix(dm, b128_strings.getSequences(), trans_model, numThreads);
+}
+
+//The same with a context prepared by the caller.
+void fillMatrix(StrDblMatrix &dm, std::vector<DNA_b128_String> &b128_strings, const AlignmentContext &context,
+		sequence_translation_model trans_model, size_t numThreads=1);
+
+
+//---------------------------------------------------------------
+// SEVERAL MODELS IN ONE PASS
+//
+// The Tamura-Nei counts of a pair contain the counts used by the
+// other models, see convert_TN_string_distance_to_simple().
+// fillMatrices() counts the differences of every pair once and
+// corrects the counts with each model, dms[m] being the matrix of
+// trans_models[m]. The matrices are the same as the ones fillMatrix()
+// computes one model at a time.
+//
+// The ambiguities are resolved for each model from the ambiguities
+// the strings have when the function is called, which are saved with
+// DNA_b128_String::saveAmbiguities(). multiplicities is the same as
+// in AlignmentContext::prepare().
+//
+// EXAMPLE USAGE
+// std::vector<sequence_translation_model> trans_models(2,trans_model);
+// trans_models[0].model = JC;
+// trans_models[1].model = TN93;
+// std::vector<StrDblMatrix> dms;
+// fillMatrices(dms, seqs, trans_models, numThreads);
+//
+
+//The Tamura-Nei counts of all pairs.
+typedef DistanceMatrix<int,TN_string_distance,
+		       empty_Data_init<int>,empty_Data_printOn<int>,
+		       empty_Data_init<TN_string_distance>,empty_Data_printOn<TN_string_distance> > TNCountMatrix;
+
+void fillMatrices(std::vector<StrDblMatrix> &dms, std::vector<DNA_b128_String> &b128_strings,
+		const std::vector<sequence_translation_model> &trans_models, size_t numThreads=1,
+		const std::vector<size_t> *multiplicities=NULL);
+
+inline void fillMatrices(std::vector<StrDblMatrix> &dms, PackedAlignment &b128_strings,
+		const std::vector<sequence_translation_model> &trans_models, size_t numThreads=1,
+		const std::vector<size_t> *multiplicities=NULL){
+  fillMatrices(dms, b128_strings.getSequences(), trans_models, numThreads, multiplicities);
+}
+
+//The distance between each string without ambiguities and an
+//identical copy of it, as fillMatrix() computes it for two identical
+//sequences, e.g. -0.0 with JC. The distance of a string with
+//ambiguities, or with multiplicity 1, is not set. See
+//DuplicateSequences.hpp.
+void fillDuplicateDistances(std::vector<float> &dists, const std::vector<DNA_b128_String> &b128_strings,
+		sequence_translation_model trans_model, const std::vector<size_t> *multiplicities=NULL);
+
+inline void fillDuplicateDistances(std::vector<float> &dists, PackedAlignment &b128_strings,
+		sequence_translation_model trans_model, const std::vector<size_t> *multiplicities=NULL){
+  fillDuplicateDistances(dists, b128_strings.getSequences(), trans_model, multiplicities);
+}
 
 
 //--------------------------------------------------------------------
-//Functions for specific models.
+//Functions for specific models. They are the same as fillMatrix()
+//with trans_model.model set to the model. If counts is given the
+//differences are taken from it instead of being counted.
 void 
 fillMatrix_Hamming(StrDblMatrix &dm, std::vector<DNA_b128_String> &seqs,
-		   sequence_translation_model trans_model);
+		   sequence_translation_model trans_model, size_t numThreads=1,
+		   const TNCountMatrix *counts=NULL);
 
 void fillMatrix_JC(StrDblMatrix &dm, std::vector<DNA_b128_String> &seqs,
-		   sequence_translation_model trans_model);
+		   sequence_translation_model trans_model, size_t numThreads=1,
+		   const TNCountMatrix *counts=NULL);
 
 void fillMatrix_K2P(StrDblMatrix &dm, std::vector<DNA_b128_String> &seqs,
-		    sequence_translation_model trans_model);
+		    sequence_translation_model trans_model, size_t numThreads=1,
+		    const TNCountMatrix *counts=NULL);
   
 
 
 void fillMatrix_TN93(StrDblMatrix &dm, std::vector<DNA_b128_String> &seqs, 
 		     DNA_b128_String::base_frequences freqs,
-		     sequence_translation_model trans_model);
+		     sequence_translation_model trans_model, size_t numThreads=1,
+		     const TNCountMatrix *counts=NULL);
 
 //-----------
 //--------- mehmood warka dang---------------
@@ -86,21 +244,93 @@ void fillMatrix_TN93(StrDblMatrix &dm, std::vector<DNA_b128_String> &seqs,
 void fillMatrixRow(StrFloRow &dm, std::vector<DNA_b128_String> &b128_strings,
 		sequence_translation_model trans_model, size_t row, bool mem_eff_flag);
 
+inline void fillMatrixRow(StrFloRow &dm, PackedAlignment &b128_strings,
+		sequence_translation_model trans_model, size_t row, bool mem_eff_flag){
+  fillMatrixRow(dm, b128_strings.getSequences(), trans_model, row, mem_eff_flag);
+}
+
+//The same with a context prepared by the caller with
+//AlignmentContext::prepareRows(). The functions above prepare the
+//context for every row, which costs O(n) per row and more if there
+//are ambiguities.
+void fillMatrixRow(StrFloRow &dm, std::vector<DNA_b128_String> &b128_strings, const AlignmentContext &context,
+		sequence_translation_model trans_model, size_t row, bool mem_eff_flag);
+
+inline void fillMatrixRow(StrFloRow &dm, PackedAlignment &b128_strings, const AlignmentContext &context,
+		sequence_translation_model trans_model, size_t row, bool mem_eff_flag){
+  fillMatrixRow(dm, b128_strings.getSequences(), context, trans_model, row, mem_eff_flag);
+}
+
+//The same with the distances to the sequences first,...,n-1, the
+//others being 0. mem_eff_flag is the same as first=0, otherwise
+//first=row+1.
+void fillMatrixRowFrom(StrFloRow &dm, std::vector<DNA_b128_String> &b128_strings, const AlignmentContext &context,
+		sequence_translation_model trans_model, size_t row, size_t first);
+
+inline void fillMatrixRowFrom(StrFloRow &dm, PackedAlignment &b128_strings, const AlignmentContext &context,
+		sequence_translation_model trans_model, size_t row, size_t first){
+  fillMatrixRowFrom(dm, b128_strings.getSequences(), context, trans_model, row, first);
+}
+
+//The same where only the distances of at most maxDistance are
+//computed exactly. The differences of a pair are counted until they
+//show that the pair is further apart than maxDistance, which for JC,
+//K2P and TN93 is when the p-distance is greater than maxDistance, and
+//its distance is then set to FLT_MAX. The pairs with ambiguities and
+//the models with fixed transition/transversion ratios are counted in
+//full. maxDistance=FLT_MAX is the same as fillMatrixRowFrom().
+void fillMatrixRowWithin(StrFloRow &dm, std::vector<DNA_b128_String> &b128_strings, const AlignmentContext &context,
+		sequence_translation_model trans_model, size_t row, size_t first, float maxDistance);
+
+inline void fillMatrixRowWithin(StrFloRow &dm, PackedAlignment &b128_strings, const AlignmentContext &context,
+		sequence_translation_model trans_model, size_t row, size_t first, float maxDistance){
+  fillMatrixRowWithin(dm, b128_strings.getSequences(), context, trans_model, row, first, maxDistance);
+}
+
+//The distances of the old sequence row < numOld to the appended
+//sequences numOld,...,n-1, for a context prepared with
+//AlignmentContext::prepareAppendedRows(). The ambiguities of row are
+//first resolved from the closer of oldNeighbor, its closest old
+//sequence in the old matrix (row if none), and the closest appended
+//sequence. The old matrix holds corrected distances, so oldNeighbor
+//may differ from the neighbor prepareRows() finds. The distances to
+//the first numOld sequences are left as they are. Different old
+//rows may be filled in parallel.
+void fillAppendedRow(StrFloRow &dm, std::vector<DNA_b128_String> &b128_strings, const AlignmentContext &context,
+		sequence_translation_model trans_model, size_t row, size_t numOld, size_t oldNeighbor);
+
+inline void fillAppendedRow(StrFloRow &dm, PackedAlignment &b128_strings, const AlignmentContext &context,
+		sequence_translation_model trans_model, size_t row, size_t numOld, size_t oldNeighbor){
+  fillAppendedRow(dm, b128_strings.getSequences(), context, trans_model, row, numOld, oldNeighbor);
+}
+
+//The block of the matrix of the rows rowBegin,...,rowEnd-1 and the
+//columns colBegin,...,colEnd-1, stored row by row in tile, computed
+//with the row engine. The blocks of a matrix may be computed in any
+//order and on several threads, see TiledMatrixFile.hpp.
+void fillTile(float *tile, std::vector<DNA_b128_String> &b128_strings, const AlignmentContext &context,
+		sequence_translation_model trans_model, size_t rowBegin, size_t rowEnd, size_t colBegin, size_t colEnd);
+
+inline void fillTile(float *tile, PackedAlignment &b128_strings, const AlignmentContext &context,
+		sequence_translation_model trans_model, size_t rowBegin, size_t rowEnd, size_t colBegin, size_t colEnd){
+  fillTile(tile, b128_strings.getSequences(), context, trans_model, rowBegin, rowEnd, colBegin, colEnd);
+}
+
 //--------------------------------------------------------------------
-//Functions for specific models.
+//Functions for specific models, the same as fillMatrixRow() with
+//trans_model.model set to the model.
 
 void
-fillMatrixRow_Hamming(StrFloRow &dm, std::vector<DNA_b128_String> &seqs,
+fillMatrixRow_Hamming(StrFloRow &dm, std::vector<DNA_b128_String> &seqs, const AlignmentContext &context,
 		   sequence_translation_model trans_model, size_t row, bool mem_eff_flag);
 
-void fillMatrixRow_JC(StrFloRow &dm, std::vector<DNA_b128_String> &seqs,
+void fillMatrixRow_JC(StrFloRow &dm, std::vector<DNA_b128_String> &seqs, const AlignmentContext &context,
 		   sequence_translation_model trans_model, size_t row, bool mem_eff_flag);
 
-void fillMatrixRow_K2P(StrFloRow &dm, std::vector<DNA_b128_String> &seqs,
+void fillMatrixRow_K2P(StrFloRow &dm, std::vector<DNA_b128_String> &seqs, const AlignmentContext &context,
 		    sequence_translation_model trans_model, size_t row, bool mem_eff_flag);
 
-void fillMatrixRow_TN93(StrFloRow &dm, std::vector<DNA_b128_String> &seqs,
-		     DNA_b128_String::base_frequences freqs,
+void fillMatrixRow_TN93(StrFloRow &dm, std::vector<DNA_b128_String> &seqs, const AlignmentContext &context,
 		     sequence_translation_model trans_model, size_t row, bool mem_eff_flag);
 
 //-----------
@@ -117,17 +347,27 @@ void fillMatrixRow_TN93(StrFloRow &dm, std::vector<DNA_b128_String> &seqs,
 //Takes a vector of Sequences and converts them to b128 strings.
 void
 Sequences2DNA_b128(std::vector<Sequence> &seqs, std::vector<DNA_b128_String> &b128); 
+void
+Sequences2DNA_b128(std::vector<Sequence> &seqs, PackedAlignment &b128); 
 
 //Reads a phylip file and instantiates a vector of b128 strings. The
 //names of the sequences are stored in names s.t. names[i] is the name
-//of b128_strings[i].
+//of b128_strings[i]. Sequential and interleaved files are read in one
+//pass, see PhylipAlignmentReader.
 void DNA_b128_StringsFromPHYLIP(std::istream &fin, std::vector<std::string> &names, std::vector<DNA_b128_String> &b128_strings);
+void DNA_b128_StringsFromPHYLIP(std::istream &fin, std::vector<std::string> &names, PackedAlignment &b128_strings);
+void DNA_b128_StringsFromPHYLIP(InputBuffer &input, std::vector<std::string> &names, PackedAlignment &b128_strings);
 
 //
 // Creates a bootstrapped set of b128_strings from the input sequences.
+// The columns are drawn from the random stream of the replicate, see
+// random_utils.hpp.
 //
 void 
-bootstrapSequences(const std::vector<Sequence> &seqs, std::vector<DNA_b128_String> &b128_strings);
+bootstrapSequences(const std::vector<Sequence> &seqs, std::vector<DNA_b128_String> &b128_strings,
+		const ReplicateRandom &random);
+void 
+bootstrapSequences(const std::vector<Sequence> &seqs, PackedAlignment &b128_strings, const ReplicateRandom &random);
   
 #endif // SEQUENCES2DISTANCEMATRIX_HPP
 
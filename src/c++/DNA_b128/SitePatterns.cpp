@@ -0,0 +1,222 @@
+//--------------------------------------------------
+//
+// File: SitePatterns.cpp
+//
+//--------------------------------------------------
+
+#include "SitePatterns.hpp"
+#include "log_utils.hpp"
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <algorithm>
+
+using namespace std;
+
+//--------------------------------------------------
+// SiteWeights
+
+SiteWeights::SiteWeights(){
+  numSites = 0;
+}
+
+void
+SiteWeights::setWeights(const std::vector<unsigned int> &w){
+  weights = w;
+
+  numSites = 0;
+  unsigned int maxWeight = 0;
+  for ( size_t p = 0 ; p < weights.size() ; p++ ){
+    numSites += weights[p];
+    if ( weights[p] > maxWeight )
+      maxWeight = weights[p];
+  }
+  size_t numPlanes = 0;
+  while ( (maxWeight >> numPlanes) != 0 )
+    numPlanes++;
+
+  //plane b has a C (11) at the patterns whose weight has bit b set
+  //and an A (00) at the others.
+  planes.reInitiate(numPlanes, weights.size());
+  planePtrs.resize(numPlanes);
+  planeWords.resize(numPlanes);
+  string plane(weights.size(),'A');
+  for ( size_t b = 0 ; b < numPlanes ; b++ ){
+    size_t end = 0;
+    for ( size_t p = 0 ; p < weights.size() ; p++ ){
+      plane[p] = ( (weights[p] >> b) & 1 ? 'C' : 'A' );
+      if ( (weights[p] >> b) & 1 )
+        end = p+1;
+    }
+    planes[b].append(plane);
+    planePtrs[b] = reinterpret_cast<const uint64_t*>(planes.getData(b));
+    //the words of the b128s up to the last pattern in the plane
+    planeWords[b] = 2*((end + 63)/64);
+  }
+  //the kernels stop at the first plane that is zero after a word
+  for ( size_t b = numPlanes ; b-- > 1 ; )
+    if ( planeWords[b-1] < planeWords[b] )
+      planeWords[b-1] = planeWords[b];
+}
+
+//--------------------------------------------------
+// COMPRESSION
+
+//The char a column is compared with, e.g. 'a', 'A' are the same
+//nucleotide and '.' and '-' are both gaps. Returns 0 for ambiguity
+//symbols.
+static char
+plainSymbol(char c){
+  switch ( c ){
+  case 'a': case 'A': return 'A';
+  case 'c': case 'C': return 'C';
+  case 'g': case 'G': return 'G';
+  case 't': case 'T': case 'u': case 'U': return 'T';
+  case '-': case '.': return '-';
+  default: return 0;
+  }
+}
+
+//Orders the patterns that are not ambiguous by decreasing weight,
+//followed by the ambiguous ones in their original order.
+struct pattern_order{
+  const std::vector<unsigned int> &weights;
+  const std::vector<char> &ambiguous;
+  pattern_order(const std::vector<unsigned int> &w, const std::vector<char> &a) : weights(w), ambiguous(a) {}
+  bool operator()(size_t p1, size_t p2) const{
+    if ( ambiguous[p1] != ambiguous[p2] )
+      return ambiguous[p2] != 0;
+    if ( ambiguous[p1] )
+      return false;
+    return weights[p1] > weights[p2];
+  }
+};
+
+void
+compressSitePatterns(const std::vector<Sequence> &seqs, PackedAlignment &patterns,
+                     SiteWeights &weights, std::vector<size_t> *patternOfSite){
+
+  const size_t numSeqs = seqs.size();
+  const size_t numSites = ( numSeqs == 0 ? 0 : seqs[0].seq.length() );
+  for ( size_t i = 0 ; i < numSeqs ; i++ )
+    if ( seqs[i].seq.length() != numSites )
+      THROW_EXCEPTION("Only aligned sequences can be compressed into site patterns: "
+                      << seqs[i].name << " has length " << seqs[i].seq.length());
+
+  //HASH THE COLUMNS
+  //The sequences are read row by row, which is the order they are
+  //stored in.
+  const uint64_t FNV_OFFSET = 14695981039346656037ULL;
+  const uint64_t FNV_PRIME = 1099511628211ULL;
+  vector<uint64_t> hash(numSites, FNV_OFFSET);
+  vector<char> ambiguous(numSites, 0);
+  for ( size_t i = 0 ; i < numSeqs ; i++ ){
+    const string &s = seqs[i].seq;
+    for ( size_t j = 0 ; j < numSites ; j++ ){
+      const char c = plainSymbol(s[j]);
+      ambiguous[j] |= (c == 0);
+      hash[j] = (hash[j] ^ (unsigned char) c) * FNV_PRIME;
+    }
+  }
+
+  //GROUP THE COLUMNS
+  //Patterns are numbered in the order of their first column. rep[p]
+  //is the first column of pattern p.
+  vector<size_t> pattern(numSites);
+  vector<size_t> rep;
+  unordered_map<uint64_t,size_t> patternOfHash;
+  for ( size_t j = 0 ; j < numSites ; j++ ){
+    if ( ! ambiguous[j] ){
+      unordered_map<uint64_t,size_t>::iterator found = patternOfHash.find(hash[j]);
+      if ( found != patternOfHash.end() ){
+        pattern[j] = found->second;
+        continue;
+      }
+      patternOfHash[hash[j]] = rep.size();
+    }
+    pattern[j] = rep.size();
+    rep.push_back(j);
+  }
+
+  //Check that the columns with the same hash are equal. A column
+  //that is not gets a pattern of its own.
+  vector<char> collision(numSites, 0);
+  for ( size_t i = 0 ; i < numSeqs ; i++ ){
+    const string &s = seqs[i].seq;
+    for ( size_t j = 0 ; j < numSites ; j++ )
+      if ( plainSymbol(s[j]) != plainSymbol(s[rep[pattern[j]]]) )
+        collision[j] = 1;
+  }
+  for ( size_t j = 0 ; j < numSites ; j++ ){
+    if ( collision[j] ){
+      pattern[j] = rep.size();
+      rep.push_back(j);
+    }
+  }
+
+  const size_t numPatterns = rep.size();
+  vector<unsigned int> w(numPatterns, 0);
+  vector<char> ambiguousPattern(numPatterns);
+  for ( size_t j = 0 ; j < numSites ; j++ )
+    w[pattern[j]]++;
+  for ( size_t p = 0 ; p < numPatterns ; p++ )
+    ambiguousPattern[p] = ambiguous[rep[p]];
+
+  //ORDER THE PATTERNS
+  vector<size_t> order(numPatterns);
+  for ( size_t p = 0 ; p < numPatterns ; p++ )
+    order[p] = p;
+  stable_sort(order.begin(), order.end(), pattern_order(w, ambiguousPattern));
+  vector<size_t> newIndex(numPatterns);
+  vector<size_t> sortedRep(numPatterns);
+  vector<unsigned int> sortedW(numPatterns);
+  for ( size_t p = 0 ; p < numPatterns ; p++ ){
+    newIndex[order[p]] = p;
+    sortedRep[p] = rep[order[p]];
+    sortedW[p] = w[order[p]];
+  }
+  for ( size_t j = 0 ; j < numSites ; j++ )
+    pattern[j] = newIndex[pattern[j]];
+  rep.swap(sortedRep);
+  weights.setWeights(sortedW);
+
+  //BUILD THE STRINGS
+  patterns.reInitiate(numSeqs, rep.size());
+  string buff(rep.size(), ' ');
+  for ( size_t i = 0 ; i < numSeqs ; i++ ){
+    const string &s = seqs[i].seq;
+    for ( size_t p = 0 ; p < rep.size() ; p++ )
+      buff[p] = s[rep[p]];
+    patterns[i].append(buff);
+    patterns[i].setSiteWeights(&weights);
+  }
+
+  if ( patternOfSite != NULL )
+    patternOfSite->swap(pattern);
+}
+
+//--------------------------------------------------
+// BOOTSTRAP
+
+void
+SitePatternBootstrap::reInitiate(const std::vector<Sequence> &seqs){
+  compressSitePatterns(seqs, patterns, weights, &patternOfSite);
+  //the distance computations resolve the ambiguities in place
+  for ( size_t i = 0 ; i < patterns.size() ; i++ )
+    patterns[i].saveAmbiguities();
+}
+
+void
+SitePatternBootstrap::drawReplicate(const ReplicateRandom &random, SitePatternReplicate &replicate) const{
+  const size_t seqlen = patternOfSite.size();
+  replicate.counts.assign(weights.getNumPatterns(), 0);
+  for ( size_t j = 0 ; j < seqlen ; j++ )
+    replicate.counts[patternOfSite[random.uniformIndex(j, seqlen)]]++;
+  replicate.weights.setWeights(replicate.counts);
+
+  replicate.patterns.assign(patterns);
+  for ( size_t i = 0 ; i < replicate.patterns.size() ; i++ ){
+    replicate.patterns[i].restoreAmbiguities();
+    replicate.patterns[i].setSiteWeights(&replicate.weights);
+  }
+}
@@ -0,0 +1,184 @@
+//--------------------------------------------------
+//
+// File: SitePatterns.hpp
+//
+//--------------------------------------------------
+
+#ifndef SITEPATTERNS_HPP
+#define SITEPATTERNS_HPP
+
+#include <cstddef>
+#include <vector>
+#include "DNA_b128_String.hpp"
+#include "PackedAlignment.hpp"
+#include "Sequence.hpp"
+#include "random_utils.hpp"
+
+//-----------------------------------------------
+// SITE PATTERNS
+//
+// The distances only depend on how many times each column occurs in
+// an alignment, not on the order of the columns. Alignments of
+// closely related sequences, e.g. from outbreak sequencing, have few
+// distinct columns. compressSitePatterns() keeps one column, a site
+// pattern, for each distinct column and weights it with the number
+// of times it occurs. The distances computed from the patterns are
+// the same as the ones computed from the alignment.
+//
+// Columns with an ambiguity symbol are never merged, so the ambiguity
+// corrections can walk the ambiguities of a string as before and
+// weight each with the weight of its position. They are placed last, in their original order.
+// The other patterns are ordered by decreasing weight, which makes
+// the high bit planes of the weights short.
+//
+// EXAMPLE USAGE
+// PackedAlignment patterns;
+// SiteWeights weights;
+// compressSitePatterns(seqs, patterns, weights);
+// fillMatrix(dm, patterns, trans_model);
+//
+
+//-----------------------------------------------
+// SiteWeights
+//
+// The weights of the site patterns, shared by all strings of a
+// compressed alignment. The weights are also stored as bit planes
+// for the weighted distance kernels, see mismatch_kernels.hpp.
+//
+class SiteWeights
+{
+public:
+  SiteWeights();
+
+  // Sets the weight of each pattern. The strings that use the weights
+  // must be told with DNA_b128_String::setSiteWeights() afterwards so
+  // that their base frequences are recomputed.
+  void setWeights(const std::vector<unsigned int> &weights);
+
+  size_t getNumPatterns() const{
+    return weights.size();
+  }
+  // The sum of the weights, i.e. the number of alignment columns.
+  size_t getNumSites() const{
+    return numSites;
+  }
+  unsigned int getWeight(size_t pattern) const{
+    return weights[pattern];
+  }
+
+  size_t getNumPlanes() const{
+    return planePtrs.size();
+  }
+  // The b128s of the planes, cast to const b128 *const * for the
+  // kernels.
+  const uint64_t *const *getPlanes() const{
+    return (planePtrs.empty() ? NULL : &planePtrs[0]);
+  }
+  // Plane b is zero after its first getPlaneWords()[b] 64 bit words.
+  // The numbers do not increase with b.
+  const size_t *getPlaneWords() const{
+    return (planeWords.empty() ? NULL : &planeWords[0]);
+  }
+
+private:
+  // not copyable, the strings point to the weights
+  SiteWeights(const SiteWeights &);
+  void operator=(const SiteWeights &);
+
+  std::vector<unsigned int> weights;
+  size_t numSites;
+  PackedAlignment planes;
+  std::vector<const uint64_t*> planePtrs; //not b128, whose alignment a template argument drops
+  std::vector<size_t> planeWords;
+};
+
+//
+// Fills patterns with the site patterns of the aligned sequences
+// seqs and weights with their weights. The strings of patterns use
+// weights, which must not be destroyed before them. If patternOfSite
+// is given, (*patternOfSite)[j] is set to the pattern of column j.
+//
+void
+compressSitePatterns(const std::vector<Sequence> &seqs, PackedAlignment &patterns,
+                     SiteWeights &weights, std::vector<size_t> *patternOfSite=NULL);
+
+//-----------------------------------------------
+// SitePatternBootstrap
+//
+// Bootstrap replicates of an alignment expressed as weights of its
+// site patterns. The alignment is compressed and encoded once, and a
+// replicate only draws how many times each column is resampled and
+// sums these counts per pattern. No sequence is encoded per
+// replicate, and the kernels count the mismatches with the new
+// weights.
+//
+// The columns of a replicate are drawn from its own ReplicateRandom
+// stream, see random_utils.hpp. drawReplicate() only reads the
+// bootstrap, so several replicates can be drawn and computed at the
+// same time, each into its own SitePatternReplicate.
+//
+// EXAMPLE USAGE
+// SitePatternBootstrap bootstrap;
+// SitePatternReplicate replicate;
+// bootstrap.reInitiate(seqs);
+// fillMatrix(dm, bootstrap.getPatterns(), trans_model); //the original alignment
+// for ( int b = 0 ; b < numBootstraps ; b++ ){
+//   bootstrap.drawReplicate(ReplicateRandom(seed,b), replicate);
+//   fillMatrix(dm, replicate.getPatterns(), trans_model);
+// }
+//
+
+class SitePatternReplicate
+{
+public:
+  SitePatternReplicate(){}
+
+  PackedAlignment &getPatterns(){
+    return patterns;
+  }
+  const SiteWeights &getWeights() const{
+    return weights;
+  }
+
+private:
+  // not copyable, the patterns point to the weights
+  SitePatternReplicate(const SitePatternReplicate &);
+  void operator=(const SitePatternReplicate &);
+
+  friend class SitePatternBootstrap;
+  PackedAlignment patterns;
+  SiteWeights weights;
+  std::vector<unsigned int> counts;
+};
+
+class SitePatternBootstrap
+{
+public:
+  SitePatternBootstrap(){}
+
+  // Compresses seqs. getPatterns() are weighted as the original
+  // alignment.
+  void reInitiate(const std::vector<Sequence> &seqs);
+
+  PackedAlignment &getPatterns(){
+    return patterns;
+  }
+  const SiteWeights &getWeights() const{
+    return weights;
+  }
+
+  // Fills replicate with the patterns weighted by the bootstrap
+  // replicate drawn from random.
+  void drawReplicate(const ReplicateRandom &random, SitePatternReplicate &replicate) const;
+
+private:
+  // not copyable, the patterns point to the weights
+  SitePatternBootstrap(const SitePatternBootstrap &);
+  void operator=(const SitePatternBootstrap &);
+
+  PackedAlignment patterns;
+  SiteWeights weights;
+  std::vector<size_t> patternOfSite;
+};
+
+#endif // SITEPATTERNS_HPP
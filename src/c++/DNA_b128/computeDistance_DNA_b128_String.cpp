@@ -12,6 +12,8 @@
 #include <string>
 
 #include "DNA_b128_String.hpp"
+#include "mismatch_kernels.hpp"
+#include "SitePatterns.hpp"
 #include <iostream>
 
 using namespace std;
@@ -45,7 +47,7 @@ using namespace std;
 // The number of transitions, transversions, and deletions are counted
 // using calls to the dist_level_X functions. 
 //
-// dist_level_1(b128 &sum_ts_l1, b128 &sum_tv_l1, b128 &sum_del_l1) :
+// dist_level_1(b128_cursor &cur, b128 &sum_ts_l1, b128 &sum_tv_l1, b128 &sum_del_l1) :
 // Reads three b128s from the two DNA_b128_strings and returns b128s
 // divided into blocks of two bits each and hold integers [0-3]. The
 // total number of missmatches of a kind is the sum of integers in
@@ -53,7 +55,7 @@ using namespace std;
 // i.e. 64 integers in the b128 and the total number of transitions is
 // the sum of all these integers.
 //
-// dist_level_2(b128 &sum_ts_l2, b128 &sum_tv_l2, b128 &sum_del_l2):
+// dist_level_2(b128_cursor &cur, b128 &sum_ts_l2, b128 &sum_tv_l2, b128 &sum_del_l2):
 // Reads six b128s from the two DNA_b128_strings and returns b128s
 // divided into blocks of four bits each and hold integers
 // [0-15]. E.g.  sum_ts_l2 = {13,12,3,0,15,....} i.e. 32 integers in
@@ -77,28 +79,32 @@ using namespace std;
 //
 // SEE THE CODE FOR FURTHER DOCUMENTATION.
 
-//-----------------------------
-// Declarations of methods that compute the sums
-// at different levels
-
-static void dist_level_1(b128 &sum_ts_l1, b128 &sum_tv_l1, b128 &sum_del_l1);
-static void dist_level_2(b128 &sum_ts_l2, b128 &sum_tv_l2, b128 &sum_del_l2);
-static void dist_level_3(b128 &sum_ts_l3, b128 &sum_tv_l3, b128 &sum_del_l3);
-static void dist_level_4(b128 &sum_ts_l4, b128 &sum_tv_l4, b128 &sum_del_l4);
-
-
-
 //-------------------------
 // THE DATA
 //
-// All functions below work on this memory. The pointers are
-// initialized in computeDistance().
+// All functions below work on the memory given by a cursor. The
+// cursor is initialized in computeDistance() and advanced by
+// dist_level_1() as the b128s are read. Since the cursor is local to
+// each call the computation is reentrant and can be run by several
+// threads at the same time.
+
+typedef struct {
+  const b128 *ptr1;
+  const b128 *ptr2;
+
+  const b128 *del_ptr1;
+  const b128 *del_ptr2;
+} b128_cursor;
+
+//-----------------------------
+// Declarations of methods that compute the sums
+// at different levels
 
-static b128 *ptr1;
-static b128 *ptr2;
+static void dist_level_1(b128_cursor &cur, b128 &sum_ts_l1, b128 &sum_tv_l1, b128 &sum_del_l1);
+static void dist_level_2(b128_cursor &cur, b128 &sum_ts_l2, b128 &sum_tv_l2, b128 &sum_del_l2);
+static void dist_level_3(b128_cursor &cur, b128 &sum_ts_l3, b128 &sum_tv_l3, b128 &sum_del_l3);
+static void dist_level_4(b128_cursor &cur, b128 &sum_ts_l4, b128 &sum_tv_l4, b128 &sum_del_l4);
 
-static b128 *del_ptr1;
-static b128 *del_ptr2;
 
 //----------------------
 // LEVEL SUMS etc
@@ -171,13 +177,42 @@ simple_string_distance
 DNA_b128_String::computeDistance(const DNA_b128_String &s1,
                                  const DNA_b128_String &s2){
 
+  //Site patterns are counted with their weights.
+  if ( s1.siteWeights != NULL ){
+    assert ( s1.siteWeights == s2.siteWeights );
+    b128_mismatch_counts c;
+    widestWeightedMismatchKernel()(s1.data, s2.data, s1.unknownData, s2.unknownData,
+                                   reinterpret_cast<const b128 *const *>(s1.siteWeights->getPlanes()),
+                                   s1.siteWeights->getPlaneWords(),
+                                   s1.siteWeights->getNumPlanes(),
+                                   s1.getNumUsedDatas(), false, c);
+    simple_string_distance d= {static_cast<int>(c.deleted),
+                               static_cast<float>(c.transitions),
+                               static_cast<float>(c.transversions)};
+    return d;
+  }
+
+  //Use the widest kernel that the processor supports. The level sums
+  //below are used if only SSE2 is available.
+  b128_mismatch_kernel kernel = widestMismatchKernel();
+  if ( kernel != NULL ){
+    assert ( s1.getNumChars() == s2.getNumChars() );
+    b128_mismatch_counts c;
+    kernel(s1.data, s2.data, s1.unknownData, s2.unknownData, s1.getNumUsedDatas(), false, c);
+    simple_string_distance d= {static_cast<int>(c.deleted),
+                               static_cast<float>(c.transitions),
+                               static_cast<float>(c.transversions)};
+    return d;
+  }
+
   //The date that the functions will work on.
   //Note! it is only in this function and in dist_level_1()
   //that data is actually read.
-  ptr1 = s1.data;
-  ptr2 = s2.data;
-  del_ptr1 = s1.unknownData;
-  del_ptr2 = s2.unknownData;
+  b128_cursor cur;
+  cur.ptr1 = s1.data;
+  cur.ptr2 = s2.data;
+  cur.del_ptr1 = s1.unknownData;
+  cur.del_ptr2 = s2.unknownData;
   assert ( s1.getNumChars() == s2.getNumChars() );
 
   //----
@@ -248,8 +283,8 @@ DNA_b128_String::computeDistance(const DNA_b128_String &s1,
     assert ( equal_b128(total_sum_ts,set_zero_b128()) );//assuming that nothing summed so far.
     assert ( equal_b128(total_sum_del,set_zero_b128()) );//assuming that nothing summed so far.
     
-    del = or_b128(get_b128(del_ptr1),get_b128(del_ptr2));
-    diff = andnot_b128(del,xor_b128(get_b128(ptr1),get_b128(ptr2)));
+    del = or_b128(get_b128(cur.del_ptr1),get_b128(cur.del_ptr2));
+    diff = andnot_b128(del,xor_b128(get_b128(cur.ptr1),get_b128(cur.ptr2)));
   
     total_sum_del = and_b128(del,LEAST_SIGNIFCANT_BIT);
     
@@ -257,12 +292,12 @@ DNA_b128_String::computeDistance(const DNA_b128_String &s1,
     total_sum_tv = tmp_tv;
     total_sum_ts = andnot_b128(tmp_tv, and_b128(diff,LEAST_SIGNIFCANT_BIT));
 
-    ++ptr1;++ptr2;
-    ++del_ptr1;++del_ptr2;
+    ++cur.ptr1;++cur.ptr2;
+    ++cur.del_ptr1;++cur.del_ptr2;
   case 1:
-    del = or_b128(get_b128(del_ptr1),get_b128(del_ptr2));
+    del = or_b128(get_b128(cur.del_ptr1),get_b128(cur.del_ptr2));
 
-    diff = andnot_b128(del,xor_b128(get_b128(ptr1),get_b128(ptr2)));
+    diff = andnot_b128(del,xor_b128(get_b128(cur.ptr1),get_b128(cur.ptr2)));
 
     total_sum_del = add_b128(total_sum_del, and_b128(del,LEAST_SIGNIFCANT_BIT));
  
@@ -270,8 +305,8 @@ DNA_b128_String::computeDistance(const DNA_b128_String &s1,
     total_sum_tv = add_b128(total_sum_tv, tmp_tv);
     total_sum_ts = add_b128(total_sum_ts,andnot_b128(tmp_tv, and_b128(diff,LEAST_SIGNIFCANT_BIT)));
 
-    ++ptr1;++ptr2;
-    ++del_ptr1;++del_ptr2;
+    ++cur.ptr1;++cur.ptr2;
+    ++cur.del_ptr1;++cur.del_ptr2;
   }
 
   DEBUG_MAIN( cout << "MAIN_S = "; print_blocks_b128(total_sum_ts,2));
@@ -303,7 +338,7 @@ DNA_b128_String::computeDistance(const DNA_b128_String &s1,
   //   }
   b128 sum_ts_l1,  sum_tv_l1,  sum_del_l1;
   for (  ; num_level_1 != 0 ; num_level_1-- ){    
-    dist_level_1(sum_ts_l1, sum_tv_l1, sum_del_l1);
+    dist_level_1(cur, sum_ts_l1, sum_tv_l1, sum_del_l1);
     SUM_WITH_PREVIOUS_LEVEL(total_sum_ts,sum_ts_l1, TWO_BIT_MASK, TWO);
     SUM_WITH_PREVIOUS_LEVEL(total_sum_tv,sum_tv_l1, TWO_BIT_MASK, TWO);
     SUM_WITH_PREVIOUS_LEVEL(total_sum_del,sum_del_l1, TWO_BIT_MASK, TWO);
@@ -326,7 +361,7 @@ DNA_b128_String::computeDistance(const DNA_b128_String &s1,
   DEBUG_MAIN( cout << "level 2 loop " << num_level_2 << endl;);
   b128 sum_ts_l2,  sum_tv_l2,  sum_del_l2;
   for ( ; num_level_2 != 0 ; num_level_2-- ){
-    dist_level_2(sum_ts_l2,  sum_tv_l2,  sum_del_l2);
+    dist_level_2(cur, sum_ts_l2,  sum_tv_l2,  sum_del_l2);
     SUM_WITH_PREVIOUS_LEVEL(total_sum_ts,sum_ts_l2, FOUR_BIT_MASK, FOUR);
     SUM_WITH_PREVIOUS_LEVEL(total_sum_tv,sum_tv_l2, FOUR_BIT_MASK, FOUR);
     SUM_WITH_PREVIOUS_LEVEL(total_sum_del,sum_del_l2, FOUR_BIT_MASK, FOUR);
@@ -353,7 +388,7 @@ DNA_b128_String::computeDistance(const DNA_b128_String &s1,
   DEBUG_MAIN( cout << "level 3 loop " << num_level_3 << endl;);
   b128 sum_ts_l3,  sum_tv_l3,  sum_del_l3;
   for ( ; num_level_3 != 0 ; num_level_3-- ){
-    dist_level_3(sum_ts_l3,  sum_tv_l3,  sum_del_l3);
+    dist_level_3(cur, sum_ts_l3,  sum_tv_l3,  sum_del_l3);
     //    SUM_WITH_PREVIOUS_LEVEL(total_sum_ts,sum_ts_l3, EIGHT_BIT_MASK, EIGHT);
     //    SUM_WITH_PREVIOUS_LEVEL(total_sum_tv,sum_tv_l3, EIGHT_BIT_MASK, EIGHT);
     //    SUM_WITH_PREVIOUS_LEVEL(total_sum_del,sum_del_l3, EIGHT_BIT_MASK, EIGHT);
@@ -383,7 +418,7 @@ DNA_b128_String::computeDistance(const DNA_b128_String &s1,
   DEBUG_MAIN( cout << "level 4 loop " << num_level_4 << endl;);
   b128 sum_ts_l4,  sum_tv_l4,  sum_del_l4;
   for (  ; num_level_4 != 0 ; num_level_4-- ){
-    dist_level_4(sum_ts_l4,  sum_tv_l4,  sum_del_l4);
+    dist_level_4(cur, sum_ts_l4,  sum_tv_l4,  sum_del_l4);
     //    SUM_WITH_PREVIOUS_LEVEL(total_sum_ts,sum_ts_l4, SIXTEEN_BIT_MASK, SIXTEEN);
     //    SUM_WITH_PREVIOUS_LEVEL(total_sum_tv,sum_tv_l4, SIXTEEN_BIT_MASK, SIXTEEN);
     //    SUM_WITH_PREVIOUS_LEVEL(total_sum_del,sum_del_l4, SIXTEEN_BIT_MASK, SIXTEEN);
@@ -424,6 +459,46 @@ DNA_b128_String::computeDistance(const DNA_b128_String &s1,
 }
 
 
+//------------------------------------
+// DISTANCES TO A BLOCK OF STRINGS
+void
+DNA_b128_String::computeDistances(const DNA_b128_String &s,
+                                  const DNA_b128_String *const *others,
+                                  size_t numOthers,
+                                  simple_string_distance *distances,
+                                  unsigned int maxDifferences){
+  b128_mismatch_block_kernel kernel = widestMismatchBlockKernel();
+  if ( kernel == NULL || s.siteWeights != NULL ){
+    for ( size_t k = 0 ; k < numOthers ; k++ )
+      distances[k] = computeDistance(s,*others[k]);
+    return;
+  }
+
+  const b128 *datas[MISMATCH_BLOCK_SIZE];
+  const b128 *unknowns[MISMATCH_BLOCK_SIZE];
+  b128_mismatch_counts c[MISMATCH_BLOCK_SIZE];
+  for ( size_t begin = 0 ; begin < numOthers ; begin += MISMATCH_BLOCK_SIZE ){
+    const size_t num = ( numOthers - begin < MISMATCH_BLOCK_SIZE ? numOthers - begin : MISMATCH_BLOCK_SIZE );
+    for ( size_t k = 0 ; k < num ; k++ ){
+      assert ( s.getNumChars() == others[begin+k]->getNumChars() );
+      datas[k] = others[begin+k]->data;
+      unknowns[k] = others[begin+k]->unknownData;
+    }
+    if ( maxDifferences == UINT_MAX )
+      kernel(s.data, s.unknownData, datas, unknowns, num, s.getNumUsedDatas(), false, c);
+    else
+      count_mismatches_block_bounded(kernel, s.data, s.unknownData, datas, unknowns, num, s.getNumUsedDatas(),
+                                     false, maxDifferences, c);
+    for ( size_t k = 0 ; k < num ; k++ ){
+      simple_string_distance d= {static_cast<int>(c[k].deleted),
+                                 static_cast<float>(c[k].transitions),
+                                 static_cast<float>(c[k].transversions)};
+      distances[begin+k] = d;
+    }
+  }
+}
+
+
 //--------------------------------------
 // LEVEL 1
 //
@@ -434,10 +509,10 @@ DNA_b128_String::computeDistance(const DNA_b128_String &s1,
 // the three read b128s.
 
 static __inline void
-dist_level_1(b128 &sum_ts_l1, b128 &sum_tv_l1, b128 &sum_del_l1){
+dist_level_1(b128_cursor &cur, b128 &sum_ts_l1, b128 &sum_tv_l1, b128 &sum_del_l1){
   b128 diff1,diff2,diff3;
   b128 del1,del2,del3;
-  b128 *_del_ptr1,*_del_ptr2,*_ptr1,*_ptr2;
+  const b128 *_del_ptr1,*_del_ptr2,*_ptr1,*_ptr2;
   
 
   //--------
@@ -445,8 +520,8 @@ dist_level_1(b128 &sum_ts_l1, b128 &sum_tv_l1, b128 &sum_del_l1){
   // del has '11' in the blocks which should be disregarded.
   // diff = ( ~del) & (ptr1 ^ ptr2 )
   // diff has ones in the blocks that differ.
-  _del_ptr1 = del_ptr1;
-  _del_ptr2 = del_ptr2;
+  _del_ptr1 = cur.del_ptr1;
+  _del_ptr2 = cur.del_ptr2;
 
   _mm_prefetch((char*) _del_ptr1,_MM_HINT_NTA);
   _mm_prefetch((char*) _del_ptr2,_MM_HINT_NTA);
@@ -460,11 +535,11 @@ dist_level_1(b128 &sum_ts_l1, b128 &sum_tv_l1, b128 &sum_del_l1){
   del2 = or_b128(get_b128(_del_ptr1+1),get_b128(_del_ptr2+1));
   del3 = or_b128(get_b128(_del_ptr1+2),get_b128(_del_ptr2+2));
 
-  del_ptr1 = _del_ptr1 + 3;
-  del_ptr2 = _del_ptr2 + 3;
+  cur.del_ptr1 = _del_ptr1 + 3;
+  cur.del_ptr2 = _del_ptr2 + 3;
   
-  _ptr1 = ptr1;
-  _ptr2 = ptr2;
+  _ptr1 = cur.ptr1;
+  _ptr2 = cur.ptr2;
   _mm_lfence();
   _mm_prefetch((char*) _ptr1,_MM_HINT_NTA);
   _mm_prefetch((char*) _ptr2,_MM_HINT_NTA);
@@ -486,8 +561,8 @@ dist_level_1(b128 &sum_ts_l1, b128 &sum_tv_l1, b128 &sum_del_l1){
   diff2 = andnot_b128(del2,xor_b128(get_b128(_ptr1+1),get_b128(_ptr2+1)));
   diff3 = andnot_b128(del3,xor_b128(get_b128(_ptr1+2),get_b128(_ptr2+2)));
 
-  ptr1 = _ptr1 + 3;
-  ptr2 = _ptr2 + 3;
+  cur.ptr1 = _ptr1 + 3;
+  cur.ptr2 = _ptr2 + 3;
 
   //_mm_lfence();
                 
@@ -536,7 +611,7 @@ dist_level_1(b128 &sum_ts_l1, b128 &sum_tv_l1, b128 &sum_del_l1){
 // BLOCK SIZE 4 BITS REPRESENTING ATMOST <= 15
 //
 void
-dist_level_2(b128 &sum_ts_l2, b128 &sum_tv_l2, b128 &sum_del_l2){
+dist_level_2(b128_cursor &cur, b128 &sum_ts_l2, b128 &sum_tv_l2, b128 &sum_del_l2){
   b128 sum_ts_l1, sum_tv_l1, sum_del_l1;
 
   //  const b128 TWO_BIT_MASK = set_all_ints(0x33333333);
@@ -546,7 +621,7 @@ dist_level_2(b128 &sum_ts_l2, b128 &sum_tv_l2, b128 &sum_del_l2){
   // LOOP 1
   // Call level 1 and add the blocks of size 2 into
   // a block of size 4.
-  dist_level_1(sum_ts_l1, sum_tv_l1, sum_del_l1);
+  dist_level_1(cur, sum_ts_l1, sum_tv_l1, sum_del_l1);
 
   CONVERT_SUM(sum_ts_l2,sum_ts_l1, TWO_BIT_MASK, TWO);
   CONVERT_SUM(sum_tv_l2,sum_tv_l1, TWO_BIT_MASK, TWO);
@@ -556,7 +631,7 @@ dist_level_2(b128 &sum_ts_l2, b128 &sum_tv_l2, b128 &sum_del_l2){
   DEBUG_L2( cout << "TS2 = "; print_blocks_b128(sum_ts_l2,4));
   //----
   // LOOP 2
-  dist_level_1(sum_ts_l1, sum_tv_l1, sum_del_l1);
+  dist_level_1(cur, sum_ts_l1, sum_tv_l1, sum_del_l1);
   SUM_WITH_PREVIOUS_LEVEL(sum_ts_l2,sum_ts_l1, TWO_BIT_MASK, TWO);
   SUM_WITH_PREVIOUS_LEVEL(sum_tv_l2,sum_tv_l1, TWO_BIT_MASK, TWO);
   SUM_WITH_PREVIOUS_LEVEL(sum_del_l2,sum_del_l1, TWO_BIT_MASK, TWO);
@@ -575,7 +650,7 @@ dist_level_2(b128 &sum_ts_l2, b128 &sum_tv_l2, b128 &sum_del_l2){
 // and the number of TS and TV are in the associated variables for
 // level 3.
 void
-dist_level_3(b128 &sum_ts_l3, b128 &sum_tv_l3, b128 &sum_del_l3){
+dist_level_3(b128_cursor &cur, b128 &sum_ts_l3, b128 &sum_tv_l3, b128 &sum_del_l3){
   b128 sum_ts_l2, sum_tv_l2, sum_del_l2;
 
   //  const b128 FOUR_BIT_MASK = set_all_ints(0x0f0f0f0f);
@@ -585,7 +660,7 @@ dist_level_3(b128 &sum_ts_l3, b128 &sum_tv_l3, b128 &sum_del_l3){
   // LOOP 1
   // Call level 2 and add the blocks of size 4 into
   // a block of size 8.
-  dist_level_2(sum_ts_l2, sum_tv_l2, sum_del_l2);
+  dist_level_2(cur, sum_ts_l2, sum_tv_l2, sum_del_l2);
   CONVERT_SUM(sum_ts_l3,sum_ts_l2, FOUR_BIT_MASK, FOUR);
   CONVERT_SUM(sum_tv_l3,sum_tv_l2, FOUR_BIT_MASK, FOUR);
   CONVERT_SUM(sum_del_l3,sum_del_l2, FOUR_BIT_MASK, FOUR);
@@ -596,7 +671,7 @@ dist_level_3(b128 &sum_ts_l3, b128 &sum_tv_l3, b128 &sum_del_l3){
 
   //----
   // LOOP 2
-  dist_level_2(sum_ts_l2, sum_tv_l2, sum_del_l2);
+  dist_level_2(cur, sum_ts_l2, sum_tv_l2, sum_del_l2);
   SUM_WITH_PREVIOUS_LEVEL(sum_ts_l3,sum_ts_l2, FOUR_BIT_MASK, FOUR);
   SUM_WITH_PREVIOUS_LEVEL(sum_tv_l3,sum_tv_l2, FOUR_BIT_MASK, FOUR);
   SUM_WITH_PREVIOUS_LEVEL(sum_del_l3,sum_del_l2, FOUR_BIT_MASK, FOUR);
@@ -608,7 +683,7 @@ dist_level_3(b128 &sum_ts_l3, b128 &sum_tv_l3, b128 &sum_del_l3){
   
   //----
   // LOOP 3
-  dist_level_2(sum_ts_l2, sum_tv_l2, sum_del_l2);
+  dist_level_2(cur, sum_ts_l2, sum_tv_l2, sum_del_l2);
   SUM_WITH_PREVIOUS_LEVEL(sum_ts_l3,sum_ts_l2, FOUR_BIT_MASK, FOUR);
   SUM_WITH_PREVIOUS_LEVEL(sum_tv_l3,sum_tv_l2, FOUR_BIT_MASK, FOUR);
   SUM_WITH_PREVIOUS_LEVEL(sum_del_l3,sum_del_l2, FOUR_BIT_MASK, FOUR);
@@ -619,7 +694,7 @@ dist_level_3(b128 &sum_ts_l3, b128 &sum_tv_l3, b128 &sum_del_l3){
   
   //----
   // LOOP 4
-  dist_level_2(sum_ts_l2, sum_tv_l2, sum_del_l2);
+  dist_level_2(cur, sum_ts_l2, sum_tv_l2, sum_del_l2);
   SUM_WITH_PREVIOUS_LEVEL(sum_ts_l3,sum_ts_l2, FOUR_BIT_MASK, FOUR);
   SUM_WITH_PREVIOUS_LEVEL(sum_tv_l3,sum_tv_l2, FOUR_BIT_MASK, FOUR);
   SUM_WITH_PREVIOUS_LEVEL(sum_del_l3,sum_del_l2, FOUR_BIT_MASK, FOUR);
@@ -631,7 +706,7 @@ dist_level_3(b128 &sum_ts_l3, b128 &sum_tv_l3, b128 &sum_del_l3){
   
   //----
   // LOOP 5
-  dist_level_2(sum_ts_l2, sum_tv_l2, sum_del_l2);
+  dist_level_2(cur, sum_ts_l2, sum_tv_l2, sum_del_l2);
   SUM_WITH_PREVIOUS_LEVEL(sum_ts_l3,sum_ts_l2, FOUR_BIT_MASK, FOUR);
   SUM_WITH_PREVIOUS_LEVEL(sum_tv_l3,sum_tv_l2, FOUR_BIT_MASK, FOUR);
   SUM_WITH_PREVIOUS_LEVEL(sum_del_l3,sum_del_l2, FOUR_BIT_MASK, FOUR);
@@ -642,7 +717,7 @@ dist_level_3(b128 &sum_ts_l3, b128 &sum_tv_l3, b128 &sum_del_l3){
   
   //----
   // LOOP 6
-  dist_level_2(sum_ts_l2, sum_tv_l2, sum_del_l2);
+  dist_level_2(cur, sum_ts_l2, sum_tv_l2, sum_del_l2);
   SUM_WITH_PREVIOUS_LEVEL(sum_ts_l3,sum_ts_l2, FOUR_BIT_MASK, FOUR);
   SUM_WITH_PREVIOUS_LEVEL(sum_tv_l3,sum_tv_l2, FOUR_BIT_MASK, FOUR);
   SUM_WITH_PREVIOUS_LEVEL(sum_del_l3,sum_del_l2, FOUR_BIT_MASK, FOUR);
@@ -653,7 +728,7 @@ dist_level_3(b128 &sum_ts_l3, b128 &sum_tv_l3, b128 &sum_del_l3){
   
   //----
   // LOOP 7
-  dist_level_2(sum_ts_l2, sum_tv_l2, sum_del_l2);
+  dist_level_2(cur, sum_ts_l2, sum_tv_l2, sum_del_l2);
   SUM_WITH_PREVIOUS_LEVEL(sum_ts_l3,sum_ts_l2, FOUR_BIT_MASK, FOUR);
   SUM_WITH_PREVIOUS_LEVEL(sum_tv_l3,sum_tv_l2, FOUR_BIT_MASK, FOUR);
   SUM_WITH_PREVIOUS_LEVEL(sum_del_l3,sum_del_l2, FOUR_BIT_MASK, FOUR);
@@ -664,7 +739,7 @@ dist_level_3(b128 &sum_ts_l3, b128 &sum_tv_l3, b128 &sum_del_l3){
   
   //----
   // LOOP 8
-  dist_level_2(sum_ts_l2, sum_tv_l2, sum_del_l2);
+  dist_level_2(cur, sum_ts_l2, sum_tv_l2, sum_del_l2);
   SUM_WITH_PREVIOUS_LEVEL(sum_ts_l3,sum_ts_l2, FOUR_BIT_MASK, FOUR);
   SUM_WITH_PREVIOUS_LEVEL(sum_tv_l3,sum_tv_l2, FOUR_BIT_MASK, FOUR);
   SUM_WITH_PREVIOUS_LEVEL(sum_del_l3,sum_del_l2, FOUR_BIT_MASK, FOUR);
@@ -686,7 +761,7 @@ dist_level_3(b128 &sum_ts_l3, b128 &sum_tv_l3, b128 &sum_del_l3){
 //
 //
 void
-dist_level_4(b128 &sum_ts_l4, b128 &sum_tv_l4, b128 &sum_del_l4){
+dist_level_4(b128_cursor &cur, b128 &sum_ts_l4, b128 &sum_tv_l4, b128 &sum_del_l4){
   b128 sum_ts_l3, sum_tv_l3, sum_del_l3;
 
   //  const b128 EIGHT_BIT_MASK = set_all_ints(0x00ff00ff);
@@ -696,7 +771,7 @@ dist_level_4(b128 &sum_ts_l4, b128 &sum_tv_l4, b128 &sum_del_l4){
   // LOOP 1
   // Call level 3 and add the blocks of size 8 into
   // a block of size 16.
-  dist_level_3(sum_ts_l3, sum_tv_l3, sum_del_l3);
+  dist_level_3(cur, sum_ts_l3, sum_tv_l3, sum_del_l3);
   //  CONVERT_SUM(sum_ts_l4,sum_ts_l3, EIGHT_BIT_MASK, EIGHT);
   //  CONVERT_SUM(sum_tv_l4,sum_tv_l3, EIGHT_BIT_MASK, EIGHT);
   //  CONVERT_SUM(sum_del_l4,sum_del_l3, EIGHT_BIT_MASK, EIGHT);
@@ -712,7 +787,7 @@ dist_level_4(b128 &sum_ts_l4, b128 &sum_tv_l4, b128 &sum_del_l4){
   // LOOP 2-128
   //PENDING can of course unroll this loop to
   for ( int i = 127 ; i != 0 ; i-- ){
-    dist_level_3(sum_ts_l3, sum_tv_l3, sum_del_l3);
+    dist_level_3(cur, sum_ts_l3, sum_tv_l3, sum_del_l3);
     //    SUM_WITH_PREVIOUS_LEVEL(sum_ts_l4,sum_ts_l3, EIGHT_BIT_MASK, EIGHT);
     //    SUM_WITH_PREVIOUS_LEVEL(sum_tv_l4,sum_tv_l3, EIGHT_BIT_MASK, EIGHT);
     //    SUM_WITH_PREVIOUS_LEVEL(sum_del_l4,sum_del_l3, EIGHT_BIT_MASK, EIGHT);
@@ -12,6 +12,8 @@
 #include <string>
 
 #include "DNA_b128_String.hpp"
+#include "mismatch_kernels.hpp"
+#include "SitePatterns.hpp"
 #include <iostream>
 
 using namespace std;
@@ -28,36 +30,40 @@ using namespace std;
 // See computeDistance_DNA_b128_String.cpp for further documentation.
 
 
-//-----------------------------
-// Declarations of methods that compute the sums
-// at different levels
-static void dist_level_1(b128 &sum_ts_l1, b128 &sum_pyrts_l1, b128 &sum_tv_l1, b128 &sum_del_l1);
-static void dist_level_2(b128 &sum_ts_l1, b128 &sum_pyrts_l1, b128 &sum_tv_l1, b128 &sum_del_l1);
-static void dist_level_3(b128 &sum_ts_l1, b128 &sum_pyrts_l1, b128 &sum_tv_l1, b128 &sum_del_l1);
-static void dist_level_4(b128 &sum_ts_l1, b128 &sum_pyrts_l1, b128 &sum_tv_l1, b128 &sum_del_l1);
-
-
-
 //-------------------------
 // THE DATA
 //
-// All functions below work on this memory. The pointers are
-// initialized in computeDistance().
+// All functions below work on the memory given by a cursor. The
+// cursor is initialized in computeDistance() and advanced by
+// dist_level_1() as the b128s are read. Since the cursor is local to
+// each call the computation is reentrant and can be run by several
+// threads at the same time.
 
-static b128 *ptr1;
-static b128 *ptr2;
+typedef struct {
+  const b128 *ptr1;
+  const b128 *ptr2;
+
+  const b128 *del_ptr1;
+  const b128 *del_ptr2;
+} b128_cursor;
+
+//-----------------------------
+// Declarations of methods that compute the sums
+// at different levels
+static void dist_level_1(b128_cursor &cur, b128 &sum_ts_l1, b128 &sum_pyrts_l1, b128 &sum_tv_l1, b128 &sum_del_l1);
+static void dist_level_2(b128_cursor &cur, b128 &sum_ts_l1, b128 &sum_pyrts_l1, b128 &sum_tv_l1, b128 &sum_del_l1);
+static void dist_level_3(b128_cursor &cur, b128 &sum_ts_l1, b128 &sum_pyrts_l1, b128 &sum_tv_l1, b128 &sum_del_l1);
+static void dist_level_4(b128_cursor &cur, b128 &sum_ts_l1, b128 &sum_pyrts_l1, b128 &sum_tv_l1, b128 &sum_del_l1);
 
-static b128 *del_ptr1;
-static b128 *del_ptr2;
 
 static void inline 
-PREFETCH_DATA(size_t numDatas){
-  b128 *_del_ptr1,*_del_ptr2,*_ptr1,*_ptr2;
+PREFETCH_DATA(const b128_cursor &cur, size_t numDatas){
+  const b128 *_del_ptr1,*_del_ptr2,*_ptr1,*_ptr2;
   
-  _del_ptr1 = del_ptr1;
-  _del_ptr2 = del_ptr2;
-  _ptr1 = ptr1;
-  _ptr2 = ptr2;
+  _del_ptr1 = cur.del_ptr1;
+  _del_ptr2 = cur.del_ptr2;
+  _ptr1 = cur.ptr1;
+  _ptr2 = cur.ptr2;
   
   for(size_t i = 0 ; i<numDatas ; i++){
     _mm_prefetch((char*) (_del_ptr1++),_MM_HINT_NTA);
@@ -154,13 +160,44 @@ TN_string_distance
 DNA_b128_String::computeTAMURANEIDistance(const DNA_b128_String &s1,
                                  const DNA_b128_String &s2){
 
+  //Site patterns are counted with their weights.
+  if ( s1.siteWeights != NULL ){
+    assert ( s1.siteWeights == s2.siteWeights );
+    b128_mismatch_counts c;
+    widestWeightedMismatchKernel()(s1.data, s2.data, s1.unknownData, s2.unknownData,
+                                   reinterpret_cast<const b128 *const *>(s1.siteWeights->getPlanes()),
+                                   s1.siteWeights->getPlaneWords(),
+                                   s1.siteWeights->getNumPlanes(),
+                                   s1.getNumUsedDatas(), true, c);
+    TN_string_distance d= {static_cast<int>(c.deleted),
+                           static_cast<float>(c.transitions-c.pyrimidine_transitions),
+                           static_cast<float>(c.pyrimidine_transitions),
+                           static_cast<float>(c.transversions)};
+    return d;
+  }
+
+  //Use the widest kernel that the processor supports. The level sums
+  //below are used if only SSE2 is available.
+  b128_mismatch_kernel kernel = widestMismatchKernel();
+  if ( kernel != NULL ){
+    assert ( s1.getNumChars() == s2.getNumChars() );
+    b128_mismatch_counts c;
+    kernel(s1.data, s2.data, s1.unknownData, s2.unknownData, s1.getNumUsedDatas(), true, c);
+    TN_string_distance d= {static_cast<int>(c.deleted),
+                           static_cast<float>(c.transitions-c.pyrimidine_transitions),
+                           static_cast<float>(c.pyrimidine_transitions),
+                           static_cast<float>(c.transversions)};
+    return d;
+  }
+
   //The date that the functions will work on.
   //Note! it is only in this function and in dist_level_1()
   //that data is actually read.
-  ptr1 = s1.data;
-  ptr2 = s2.data;
-  del_ptr1 = s1.unknownData;
-  del_ptr2 = s2.unknownData;
+  b128_cursor cur;
+  cur.ptr1 = s1.data;
+  cur.ptr2 = s2.data;
+  cur.del_ptr1 = s1.unknownData;
+  cur.del_ptr2 = s2.unknownData;
   assert ( s1.getNumChars() == s2.getNumChars() );
 
   //----
@@ -221,7 +258,7 @@ DNA_b128_String::computeTAMURANEIDistance(const DNA_b128_String &s1,
   b128 total_sum_del = set_zero_b128();
   
   //Compute the remaining b128s. There are atmost two remaining.
-  PREFETCH_DATA(rest_num_b128s);
+  PREFETCH_DATA(cur, rest_num_b128s);
   DEBUG_MAIN( cout << "rest loop " << rest_num_b128s << endl;);
   b128 diff,del,tmp_tv;
   switch( rest_num_b128s ){
@@ -231,22 +268,22 @@ DNA_b128_String::computeTAMURANEIDistance(const DNA_b128_String &s1,
     assert ( equal_b128(total_sum_pyrts,set_zero_b128()) );//assuming that nothing summed so far.
     assert ( equal_b128(total_sum_del,set_zero_b128()) );//assuming that nothing summed so far.
     
-    del = or_b128(get_b128(del_ptr1),get_b128(del_ptr2));
-    diff = andnot_b128(del,xor_b128(get_b128(ptr1),get_b128(ptr2)));
+    del = or_b128(get_b128(cur.del_ptr1),get_b128(cur.del_ptr2));
+    diff = andnot_b128(del,xor_b128(get_b128(cur.ptr1),get_b128(cur.ptr2)));
   
     total_sum_del = and_b128(del,LEAST_SIGNIFCANT_BIT);
     
     tmp_tv = and_b128(shift_each32_bits_right_b128(diff,ONE),LEAST_SIGNIFCANT_BIT);
     total_sum_tv = tmp_tv;
     total_sum_ts = andnot_b128(tmp_tv, and_b128(diff,LEAST_SIGNIFCANT_BIT));
-    total_sum_pyrts = and_b128(shift_each32_bits_right_b128(and_b128(get_b128(ptr1),get_b128(ptr2)),ONE),total_sum_ts);
+    total_sum_pyrts = and_b128(shift_each32_bits_right_b128(and_b128(get_b128(cur.ptr1),get_b128(cur.ptr2)),ONE),total_sum_ts);
 
-    ++ptr1;++ptr2;
-    ++del_ptr1;++del_ptr2;
+    ++cur.ptr1;++cur.ptr2;
+    ++cur.del_ptr1;++cur.del_ptr2;
   case 1:
-    del = or_b128(get_b128(del_ptr1),get_b128(del_ptr2));
+    del = or_b128(get_b128(cur.del_ptr1),get_b128(cur.del_ptr2));
 
-    diff = andnot_b128(del,xor_b128(get_b128(ptr1),get_b128(ptr2)));
+    diff = andnot_b128(del,xor_b128(get_b128(cur.ptr1),get_b128(cur.ptr2)));
 
     total_sum_del = add_b128(total_sum_del, and_b128(del,LEAST_SIGNIFCANT_BIT));
  
@@ -254,10 +291,10 @@ DNA_b128_String::computeTAMURANEIDistance(const DNA_b128_String &s1,
     total_sum_tv = add_b128(total_sum_tv, tmp_tv);
     b128 tmp_ts = andnot_b128(tmp_tv, and_b128(diff,LEAST_SIGNIFCANT_BIT));
     total_sum_ts = add_b128(total_sum_ts,tmp_ts);
-    total_sum_pyrts = add_b128(total_sum_pyrts,and_b128(shift_each32_bits_right_b128(and_b128(get_b128(ptr1),get_b128(ptr2)),ONE),tmp_ts));
+    total_sum_pyrts = add_b128(total_sum_pyrts,and_b128(shift_each32_bits_right_b128(and_b128(get_b128(cur.ptr1),get_b128(cur.ptr2)),ONE),tmp_ts));
 
-    ++ptr1;++ptr2;
-    ++del_ptr1;++del_ptr2;
+    ++cur.ptr1;++cur.ptr2;
+    ++cur.del_ptr1;++cur.del_ptr2;
   }
   
 
@@ -292,9 +329,9 @@ DNA_b128_String::computeTAMURANEIDistance(const DNA_b128_String &s1,
   //     SUM_WITH_PREVIOUS_LEVEL(total_sum_del,sum_del_l1, TWO_BIT_MASK, TWO);
   //   }
   b128 sum_ts_l1,  sum_pyrts_l1, sum_tv_l1,  sum_del_l1;
-  PREFETCH_DATA(num_level_1*3);
+  PREFETCH_DATA(cur, num_level_1*3);
   for (  ; num_level_1 != 0 ; num_level_1-- ){    
-    dist_level_1(sum_ts_l1,  sum_pyrts_l1, sum_tv_l1,  sum_del_l1);
+    dist_level_1(cur, sum_ts_l1,  sum_pyrts_l1, sum_tv_l1,  sum_del_l1);
     SUM_WITH_PREVIOUS_LEVEL(total_sum_ts,sum_ts_l1, TWO_BIT_MASK, TWO);
     SUM_WITH_PREVIOUS_LEVEL(total_sum_pyrts,sum_pyrts_l1, TWO_BIT_MASK, TWO);
     SUM_WITH_PREVIOUS_LEVEL(total_sum_tv,sum_tv_l1, TWO_BIT_MASK, TWO);
@@ -321,7 +358,7 @@ DNA_b128_String::computeTAMURANEIDistance(const DNA_b128_String &s1,
   DEBUG_MAIN( cout << "level 2 loop " << num_level_2 << endl;);
   b128 sum_ts_l2,  sum_pyrts_l2, sum_tv_l2,  sum_del_l2;
   for ( ; num_level_2 != 0 ; num_level_2-- ){
-    dist_level_2(sum_ts_l2,  sum_pyrts_l2, sum_tv_l2,  sum_del_l2);
+    dist_level_2(cur, sum_ts_l2,  sum_pyrts_l2, sum_tv_l2,  sum_del_l2);
     SUM_WITH_PREVIOUS_LEVEL(total_sum_ts,sum_ts_l2, FOUR_BIT_MASK, FOUR);
     SUM_WITH_PREVIOUS_LEVEL(total_sum_pyrts,sum_pyrts_l2, FOUR_BIT_MASK, FOUR);
     SUM_WITH_PREVIOUS_LEVEL(total_sum_tv,sum_tv_l2, FOUR_BIT_MASK, FOUR);
@@ -351,7 +388,7 @@ DNA_b128_String::computeTAMURANEIDistance(const DNA_b128_String &s1,
   DEBUG_MAIN( cout << "level 3 loop " << num_level_3 << endl;);
   b128 sum_ts_l3,  sum_pyrts_l3, sum_tv_l3,  sum_del_l3;
   for ( ; num_level_3 != 0 ; num_level_3-- ){
-    dist_level_3(sum_ts_l3,  sum_pyrts_l3, sum_tv_l3,  sum_del_l3);
+    dist_level_3(cur, sum_ts_l3,  sum_pyrts_l3, sum_tv_l3,  sum_del_l3);
     //    SUM_WITH_PREVIOUS_LEVEL(total_sum_ts,sum_ts_l3, EIGHT_BIT_MASK, EIGHT);
     //    SUM_WITH_PREVIOUS_LEVEL(total_sum_tv,sum_tv_l3, EIGHT_BIT_MASK, EIGHT);
     //    SUM_WITH_PREVIOUS_LEVEL(total_sum_del,sum_del_l3, EIGHT_BIT_MASK, EIGHT);
@@ -384,7 +421,7 @@ DNA_b128_String::computeTAMURANEIDistance(const DNA_b128_String &s1,
   DEBUG_MAIN( cout << "level 4 loop " << num_level_4 << endl;);
   b128 sum_ts_l4,  sum_pyrts_l4, sum_tv_l4,  sum_del_l4;
   for (  ; num_level_4 != 0 ; num_level_4-- ){
-    dist_level_4(sum_ts_l4,  sum_pyrts_l4, sum_tv_l4,  sum_del_l4);
+    dist_level_4(cur, sum_ts_l4,  sum_pyrts_l4, sum_tv_l4,  sum_del_l4);
     //    SUM_WITH_PREVIOUS_LEVEL(total_sum_ts,sum_ts_l4, SIXTEEN_BIT_MASK, SIXTEEN);
     //    SUM_WITH_PREVIOUS_LEVEL(total_sum_tv,sum_tv_l4, SIXTEEN_BIT_MASK, SIXTEEN);
     //    SUM_WITH_PREVIOUS_LEVEL(total_sum_del,sum_del_l4, SIXTEEN_BIT_MASK, SIXTEEN);
@@ -429,6 +466,47 @@ DNA_b128_String::computeTAMURANEIDistance(const DNA_b128_String &s1,
   
   return d;
 }
+
+//------------------------------------
+// DISTANCES TO A BLOCK OF STRINGS
+void
+DNA_b128_String::computeTAMURANEIDistances(const DNA_b128_String &s,
+                                           const DNA_b128_String *const *others,
+                                           size_t numOthers,
+                                           TN_string_distance *distances,
+                                           unsigned int maxDifferences){
+  b128_mismatch_block_kernel kernel = widestMismatchBlockKernel();
+  if ( kernel == NULL || s.siteWeights != NULL ){
+    for ( size_t k = 0 ; k < numOthers ; k++ )
+      distances[k] = computeTAMURANEIDistance(s,*others[k]);
+    return;
+  }
+
+  const b128 *datas[MISMATCH_BLOCK_SIZE];
+  const b128 *unknowns[MISMATCH_BLOCK_SIZE];
+  b128_mismatch_counts c[MISMATCH_BLOCK_SIZE];
+  for ( size_t begin = 0 ; begin < numOthers ; begin += MISMATCH_BLOCK_SIZE ){
+    const size_t num = ( numOthers - begin < MISMATCH_BLOCK_SIZE ? numOthers - begin : MISMATCH_BLOCK_SIZE );
+    for ( size_t k = 0 ; k < num ; k++ ){
+      assert ( s.getNumChars() == others[begin+k]->getNumChars() );
+      datas[k] = others[begin+k]->data;
+      unknowns[k] = others[begin+k]->unknownData;
+    }
+    if ( maxDifferences == UINT_MAX )
+      kernel(s.data, s.unknownData, datas, unknowns, num, s.getNumUsedDatas(), true, c);
+    else
+      count_mismatches_block_bounded(kernel, s.data, s.unknownData, datas, unknowns, num, s.getNumUsedDatas(),
+                                     true, maxDifferences, c);
+    for ( size_t k = 0 ; k < num ; k++ ){
+      TN_string_distance d= {static_cast<int>(c[k].deleted),
+                             static_cast<float>(c[k].transitions-c[k].pyrimidine_transitions),
+                             static_cast<float>(c[k].pyrimidine_transitions),
+                             static_cast<float>(c[k].transversions)};
+      distances[begin+k] = d;
+    }
+  }
+}
+
 //---------------------------------
 // Tamura Nei.
 //
@@ -462,11 +540,11 @@ DNA_b128_String::computeTAMURANEIDistance(const DNA_b128_String &s1,
 // the three read b128s.
 
 static void
-dist_level_1(b128 &sum_ts_l1, b128 &sum_pyrts_l1, b128 &sum_tv_l1, b128 &sum_del_l1){
+dist_level_1(b128_cursor &cur, b128 &sum_ts_l1, b128 &sum_pyrts_l1, b128 &sum_tv_l1, b128 &sum_del_l1){
   b128 diff1,diff2,diff3;
   b128 ptrand1, ptrand2, ptrand3;
   b128 del1,del2,del3;
-  b128 *_del_ptr1,*_del_ptr2,*_ptr1,*_ptr2;
+  const b128 *_del_ptr1,*_del_ptr2,*_ptr1,*_ptr2;
   
   //--------
   // LOOP 1
@@ -474,17 +552,17 @@ dist_level_1(b128 &sum_ts_l1, b128 &sum_pyrts_l1, b128 &sum_tv_l1, b128 &sum_del
   // diff = ( ~del) & (ptr1 ^ ptr2 )
   // diff has ones in the blocks that differ.
   
-  _del_ptr1 = del_ptr1;
-  _del_ptr2 = del_ptr2;
+  _del_ptr1 = cur.del_ptr1;
+  _del_ptr2 = cur.del_ptr2;
 
   del1 = or_b128(get_b128(_del_ptr1),get_b128(_del_ptr2));
   del2 = or_b128(get_b128(_del_ptr1+1),get_b128(_del_ptr2+1));
   del3 = or_b128(get_b128(_del_ptr1+2),get_b128(_del_ptr2+2));
-  del_ptr1 = _del_ptr1 + 3;
-  del_ptr2 = _del_ptr2 + 3;
+  cur.del_ptr1 = _del_ptr1 + 3;
+  cur.del_ptr2 = _del_ptr2 + 3;
   
-  _ptr1 = ptr1;
-  _ptr2 = ptr2;
+  _ptr1 = cur.ptr1;
+  _ptr2 = cur.ptr2;
   b128 p1 = get_b128(_ptr1);
   b128 p2 = get_b128(_ptr2);
   ptrand1 = shift_each32_bits_right_b128(and_b128(p1,p2),ONE);
@@ -499,8 +577,8 @@ dist_level_1(b128 &sum_ts_l1, b128 &sum_pyrts_l1, b128 &sum_tv_l1, b128 &sum_del
   diff3 = andnot_b128(del3,xor_b128(p1,p2));
 
 
-  ptr1 = _ptr1 + 3;
-  ptr2 = _ptr2 + 3;
+  cur.ptr1 = _ptr1 + 3;
+  cur.ptr2 = _ptr2 + 3;
   
   //  DEBUG_L2( cout << "diff ";print_blocks_b128(diff,2));
 
@@ -563,14 +641,14 @@ dist_level_1(b128 &sum_ts_l1, b128 &sum_pyrts_l1, b128 &sum_tv_l1, b128 &sum_del
 // BLOCK SIZE 4 BITS REPRESENTING ATMOST <= 15
 //
 void
-dist_level_2(b128 &sum_ts_l2, b128 &sum_pyrts_l2, b128 &sum_tv_l2, b128 &sum_del_l2){
+dist_level_2(b128_cursor &cur, b128 &sum_ts_l2, b128 &sum_pyrts_l2, b128 &sum_tv_l2, b128 &sum_del_l2){
   b128 sum_ts_l1, sum_pyrts_l1, sum_tv_l1, sum_del_l1;
-  PREFETCH_DATA(6);
+  PREFETCH_DATA(cur, 6);
   //----
   // LOOP 1
   // Call level 1 and add the blocks of size 2 into
   // a block of size 4.
-  dist_level_1(sum_ts_l1, sum_pyrts_l1, sum_tv_l1, sum_del_l1);
+  dist_level_1(cur, sum_ts_l1, sum_pyrts_l1, sum_tv_l1, sum_del_l1);
 
   CONVERT_SUM(sum_ts_l2,sum_ts_l1, TWO_BIT_MASK, TWO);
   CONVERT_SUM(sum_pyrts_l2,sum_pyrts_l1, TWO_BIT_MASK, TWO);
@@ -582,7 +660,7 @@ dist_level_2(b128 &sum_ts_l2, b128 &sum_pyrts_l2, b128 &sum_tv_l2, b128 &sum_del
   DEBUG_L2( cout << "TP2 = "; print_blocks_b128(sum_pyrts_l2,4));
   //----
   // LOOP 2
-  dist_level_1(sum_ts_l1, sum_pyrts_l1, sum_tv_l1, sum_del_l1);
+  dist_level_1(cur, sum_ts_l1, sum_pyrts_l1, sum_tv_l1, sum_del_l1);
   SUM_WITH_PREVIOUS_LEVEL(sum_ts_l2,sum_ts_l1, TWO_BIT_MASK, TWO);
   SUM_WITH_PREVIOUS_LEVEL(sum_pyrts_l2,sum_pyrts_l1, TWO_BIT_MASK, TWO);
   SUM_WITH_PREVIOUS_LEVEL(sum_tv_l2,sum_tv_l1, TWO_BIT_MASK, TWO);
@@ -603,13 +681,13 @@ dist_level_2(b128 &sum_ts_l2, b128 &sum_pyrts_l2, b128 &sum_tv_l2, b128 &sum_del
 // and the number of TS and TV are in the associated variables for
 // level 3.
 void
-dist_level_3(b128 &sum_ts_l3, b128 &sum_pyrts_l3, b128 &sum_tv_l3, b128 &sum_del_l3){
+dist_level_3(b128_cursor &cur, b128 &sum_ts_l3, b128 &sum_pyrts_l3, b128 &sum_tv_l3, b128 &sum_del_l3){
   b128 sum_ts_l2, sum_pyrts_l2, sum_tv_l2, sum_del_l2;
   //----
   // LOOP 1
   // Call level 2 and add the blocks of size 4 into
   // a block of size 8.
-  dist_level_2(sum_ts_l2, sum_pyrts_l2, sum_tv_l2, sum_del_l2);
+  dist_level_2(cur, sum_ts_l2, sum_pyrts_l2, sum_tv_l2, sum_del_l2);
   CONVERT_SUM(sum_ts_l3,sum_ts_l2, FOUR_BIT_MASK, FOUR);
   CONVERT_SUM(sum_pyrts_l3,sum_pyrts_l2, FOUR_BIT_MASK, FOUR);
   CONVERT_SUM(sum_tv_l3,sum_tv_l2, FOUR_BIT_MASK, FOUR);
@@ -622,7 +700,7 @@ dist_level_3(b128 &sum_ts_l3, b128 &sum_pyrts_l3, b128 &sum_tv_l3, b128 &sum_del
 
   //----
   // LOOP 2
-  dist_level_2(sum_ts_l2, sum_pyrts_l2, sum_tv_l2, sum_del_l2);
+  dist_level_2(cur, sum_ts_l2, sum_pyrts_l2, sum_tv_l2, sum_del_l2);
   SUM_WITH_PREVIOUS_LEVEL(sum_ts_l3,sum_ts_l2, FOUR_BIT_MASK, FOUR);
   SUM_WITH_PREVIOUS_LEVEL(sum_pyrts_l3,sum_pyrts_l2, FOUR_BIT_MASK, FOUR);
   SUM_WITH_PREVIOUS_LEVEL(sum_tv_l3,sum_tv_l2, FOUR_BIT_MASK, FOUR);
@@ -636,7 +714,7 @@ dist_level_3(b128 &sum_ts_l3, b128 &sum_pyrts_l3, b128 &sum_tv_l3, b128 &sum_del
   
   //----
   // LOOP 3
-  dist_level_2(sum_ts_l2, sum_pyrts_l2, sum_tv_l2, sum_del_l2);
+  dist_level_2(cur, sum_ts_l2, sum_pyrts_l2, sum_tv_l2, sum_del_l2);
   SUM_WITH_PREVIOUS_LEVEL(sum_ts_l3,sum_ts_l2, FOUR_BIT_MASK, FOUR);
   SUM_WITH_PREVIOUS_LEVEL(sum_pyrts_l3,sum_pyrts_l2, FOUR_BIT_MASK, FOUR);
   SUM_WITH_PREVIOUS_LEVEL(sum_tv_l3,sum_tv_l2, FOUR_BIT_MASK, FOUR);
@@ -649,7 +727,7 @@ dist_level_3(b128 &sum_ts_l3, b128 &sum_pyrts_l3, b128 &sum_tv_l3, b128 &sum_del
   
   //----
   // LOOP 4
-  dist_level_2(sum_ts_l2, sum_pyrts_l2, sum_tv_l2, sum_del_l2);
+  dist_level_2(cur, sum_ts_l2, sum_pyrts_l2, sum_tv_l2, sum_del_l2);
   SUM_WITH_PREVIOUS_LEVEL(sum_ts_l3,sum_ts_l2, FOUR_BIT_MASK, FOUR);
   SUM_WITH_PREVIOUS_LEVEL(sum_pyrts_l3,sum_pyrts_l2, FOUR_BIT_MASK, FOUR);
   SUM_WITH_PREVIOUS_LEVEL(sum_tv_l3,sum_tv_l2, FOUR_BIT_MASK, FOUR);
@@ -663,7 +741,7 @@ dist_level_3(b128 &sum_ts_l3, b128 &sum_pyrts_l3, b128 &sum_tv_l3, b128 &sum_del
   
   //----
   // LOOP 5
-  dist_level_2(sum_ts_l2, sum_pyrts_l2, sum_tv_l2, sum_del_l2);
+  dist_level_2(cur, sum_ts_l2, sum_pyrts_l2, sum_tv_l2, sum_del_l2);
   SUM_WITH_PREVIOUS_LEVEL(sum_ts_l3,sum_ts_l2, FOUR_BIT_MASK, FOUR);
   SUM_WITH_PREVIOUS_LEVEL(sum_pyrts_l3,sum_pyrts_l2, FOUR_BIT_MASK, FOUR);
   SUM_WITH_PREVIOUS_LEVEL(sum_tv_l3,sum_tv_l2, FOUR_BIT_MASK, FOUR);
@@ -676,7 +754,7 @@ dist_level_3(b128 &sum_ts_l3, b128 &sum_pyrts_l3, b128 &sum_tv_l3, b128 &sum_del
   
   //----
   // LOOP 6
-  dist_level_2(sum_ts_l2, sum_pyrts_l2, sum_tv_l2, sum_del_l2);
+  dist_level_2(cur, sum_ts_l2, sum_pyrts_l2, sum_tv_l2, sum_del_l2);
   SUM_WITH_PREVIOUS_LEVEL(sum_ts_l3,sum_ts_l2, FOUR_BIT_MASK, FOUR);
   SUM_WITH_PREVIOUS_LEVEL(sum_pyrts_l3,sum_pyrts_l2, FOUR_BIT_MASK, FOUR);
   SUM_WITH_PREVIOUS_LEVEL(sum_tv_l3,sum_tv_l2, FOUR_BIT_MASK, FOUR);
@@ -689,7 +767,7 @@ dist_level_3(b128 &sum_ts_l3, b128 &sum_pyrts_l3, b128 &sum_tv_l3, b128 &sum_del
   
   //----
   // LOOP 7
-  dist_level_2(sum_ts_l2, sum_pyrts_l2, sum_tv_l2, sum_del_l2);
+  dist_level_2(cur, sum_ts_l2, sum_pyrts_l2, sum_tv_l2, sum_del_l2);
   SUM_WITH_PREVIOUS_LEVEL(sum_ts_l3,sum_ts_l2, FOUR_BIT_MASK, FOUR);
   SUM_WITH_PREVIOUS_LEVEL(sum_pyrts_l3,sum_pyrts_l2, FOUR_BIT_MASK, FOUR);
   SUM_WITH_PREVIOUS_LEVEL(sum_tv_l3,sum_tv_l2, FOUR_BIT_MASK, FOUR);
@@ -702,7 +780,7 @@ dist_level_3(b128 &sum_ts_l3, b128 &sum_pyrts_l3, b128 &sum_tv_l3, b128 &sum_del
   
   //----
   // LOOP 8
-  dist_level_2(sum_ts_l2, sum_pyrts_l2, sum_tv_l2, sum_del_l2);
+  dist_level_2(cur, sum_ts_l2, sum_pyrts_l2, sum_tv_l2, sum_del_l2);
   SUM_WITH_PREVIOUS_LEVEL(sum_ts_l3,sum_ts_l2, FOUR_BIT_MASK, FOUR);
   SUM_WITH_PREVIOUS_LEVEL(sum_pyrts_l3,sum_pyrts_l2, FOUR_BIT_MASK, FOUR);
   SUM_WITH_PREVIOUS_LEVEL(sum_tv_l3,sum_tv_l2, FOUR_BIT_MASK, FOUR);
@@ -726,13 +804,13 @@ dist_level_3(b128 &sum_ts_l3, b128 &sum_pyrts_l3, b128 &sum_tv_l3, b128 &sum_del
 //
 //
 void
-dist_level_4(b128 &sum_ts_l4, b128 &sum_pyrts_l4, b128 &sum_tv_l4, b128 &sum_del_l4){
+dist_level_4(b128_cursor &cur, b128 &sum_ts_l4, b128 &sum_pyrts_l4, b128 &sum_tv_l4, b128 &sum_del_l4){
   b128 sum_ts_l3, sum_pyrts_l3, sum_tv_l3, sum_del_l3;
   //----
   // LOOP 1
   // Call level 3 and add the blocks of size 8 into
   // a block of size 16.
-  dist_level_3(sum_ts_l3, sum_pyrts_l3, sum_tv_l3, sum_del_l3);
+  dist_level_3(cur, sum_ts_l3, sum_pyrts_l3, sum_tv_l3, sum_del_l3);
   //  CONVERT_SUM(sum_ts_l4,sum_ts_l3, EIGHT_BIT_MASK, EIGHT);
   //  CONVERT_SUM(sum_tv_l4,sum_tv_l3, EIGHT_BIT_MASK, EIGHT);
   //  CONVERT_SUM(sum_del_l4,sum_del_l3, EIGHT_BIT_MASK, EIGHT);
@@ -750,7 +828,7 @@ dist_level_4(b128 &sum_ts_l4, b128 &sum_pyrts_l4, b128 &sum_tv_l4, b128 &sum_del
   // LOOP 2-128
   //PENDING can of course unroll this loop to
   for ( int i = 127 ; i != 0 ; i-- ){
-    dist_level_3(sum_ts_l3, sum_pyrts_l3, sum_tv_l3, sum_del_l3);
+    dist_level_3(cur, sum_ts_l3, sum_pyrts_l3, sum_tv_l3, sum_del_l3);
     //    SUM_WITH_PREVIOUS_LEVEL(sum_ts_l4,sum_ts_l3, EIGHT_BIT_MASK, EIGHT);
     //    SUM_WITH_PREVIOUS_LEVEL(sum_tv_l4,sum_tv_l3, EIGHT_BIT_MASK, EIGHT);
     //    SUM_WITH_PREVIOUS_LEVEL(sum_del_l4,sum_del_l3, EIGHT_BIT_MASK, EIGHT);
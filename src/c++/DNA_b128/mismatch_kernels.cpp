@@ -0,0 +1,148 @@
+//--------------------------------------------------
+//
+// File: mismatch_kernels.cpp
+//
+//--------------------------------------------------
+
+#include "mismatch_kernels.hpp"
+#include <stdint.h>
+
+using namespace std;
+
+void
+count_mismatches_weighted(const b128 *data1, const b128 *data2,
+                          const b128 *unknown1, const b128 *unknown2,
+                          const b128 *const *weightPlanes, const size_t *planeWords, size_t numPlanes,
+                          size_t numDatas, bool countPyrimidines,
+                          b128_mismatch_counts &counts){
+
+  const uint64_t LEAST_SIGNIFCANT_BIT = 0x5555555555555555ULL;
+  const uint64_t *p1 = reinterpret_cast<const uint64_t*>(data1);
+  const uint64_t *p2 = reinterpret_cast<const uint64_t*>(data2);
+  const uint64_t *u1 = reinterpret_cast<const uint64_t*>(unknown1);
+  const uint64_t *u2 = reinterpret_cast<const uint64_t*>(unknown2);
+
+  uint64_t sum_del = 0, sum_ts = 0, sum_pyrts = 0, sum_tv = 0;
+  const size_t numWords = 2*numDatas;
+  for ( size_t w = 0 ; w < numWords ; w++ ){
+    const uint64_t del = (u1[w] | u2[w]) & LEAST_SIGNIFCANT_BIT;
+    const uint64_t diff = ~(u1[w] | u2[w]) & (p1[w] ^ p2[w]);
+    const uint64_t tv = (diff >> 1) & LEAST_SIGNIFCANT_BIT;
+    const uint64_t ts = ~tv & diff & LEAST_SIGNIFCANT_BIT;
+    const uint64_t pyrts = ((p1[w] & p2[w]) >> 1) & ts;
+    for ( size_t b = 0 ; b < numPlanes && w < planeWords[b] ; b++ ){
+      const uint64_t plane = reinterpret_cast<const uint64_t*>(weightPlanes[b])[w];
+      sum_del += ((uint64_t) __builtin_popcountll(del & plane)) << b;
+      sum_ts += ((uint64_t) __builtin_popcountll(ts & plane)) << b;
+      sum_tv += ((uint64_t) __builtin_popcountll(tv & plane)) << b;
+      if ( countPyrimidines )
+        sum_pyrts += ((uint64_t) __builtin_popcountll(pyrts & plane)) << b;
+    }
+  }
+
+  counts.deleted = (unsigned int) sum_del;
+  counts.transitions = (unsigned int) sum_ts;
+  counts.pyrimidine_transitions = (unsigned int) sum_pyrts;
+  counts.transversions = (unsigned int) sum_tv;
+}
+
+void
+count_mismatches_block_bounded(b128_mismatch_block_kernel kernel,
+                               const b128 *data, const b128 *unknown,
+                               const b128 *const *otherDatas,
+                               const b128 *const *otherUnknowns,
+                               size_t numOthers, size_t numDatas,
+                               bool countPyrimidines, unsigned int maxDifferences,
+                               b128_mismatch_counts *counts){
+  //the others that are still counted
+  size_t active[MISMATCH_BLOCK_SIZE];
+  size_t numActive = numOthers;
+  for ( size_t k = 0 ; k < numOthers ; k++ ){
+    active[k] = k;
+    counts[k].deleted = counts[k].transitions = 0;
+    counts[k].pyrimidine_transitions = counts[k].transversions = 0;
+  }
+
+  const b128 *datas[MISMATCH_BLOCK_SIZE];
+  const b128 *unknowns[MISMATCH_BLOCK_SIZE];
+  b128_mismatch_counts strip[MISMATCH_BLOCK_SIZE];
+  for ( size_t begin = 0 ; begin < numDatas && numActive != 0 ; begin += MISMATCH_BOUND_STRIP ){
+    const size_t num = ( numDatas - begin < MISMATCH_BOUND_STRIP ? numDatas - begin : MISMATCH_BOUND_STRIP );
+    for ( size_t a = 0 ; a < numActive ; a++ ){
+      datas[a] = otherDatas[active[a]] + begin;
+      unknowns[a] = otherUnknowns[active[a]] + begin;
+    }
+    kernel(data + begin, unknown + begin, datas, unknowns, numActive, num, countPyrimidines, strip);
+
+    size_t stillActive = 0;
+    for ( size_t a = 0 ; a < numActive ; a++ ){
+      b128_mismatch_counts &c = counts[active[a]];
+      c.deleted += strip[a].deleted;
+      c.transitions += strip[a].transitions;
+      c.pyrimidine_transitions += strip[a].pyrimidine_transitions;
+      c.transversions += strip[a].transversions;
+      if ( c.transitions + c.transversions <= maxDifferences )
+        active[stillActive++] = active[a];
+    }
+    numActive = stillActive;
+  }
+}
+
+typedef struct {
+  b128_mismatch_kernel kernel;
+  b128_mismatch_block_kernel blockKernel;
+  b128_weighted_mismatch_kernel weightedKernel;
+  const char *name;
+} named_kernel;
+
+static named_kernel
+selectMismatchKernel(){
+  named_kernel k = {NULL, NULL, count_mismatches_weighted, "sse2"};
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  __builtin_cpu_init();
+#ifdef HAVE_AVX512_KERNELS
+  if ( __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vpopcntdq") ){
+    k.kernel = count_mismatches_avx512;
+    k.blockKernel = count_mismatches_block_avx512;
+    k.weightedKernel = count_mismatches_weighted_avx512;
+    k.name = "avx512";
+    return k;
+  }
+#endif
+#ifdef HAVE_AVX2_KERNELS
+  if ( __builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt") ){
+    k.kernel = count_mismatches_avx2;
+    k.blockKernel = count_mismatches_block_avx2;
+    k.name = "avx2";
+    return k;
+  }
+#endif
+#endif
+  return k;
+}
+
+static const named_kernel &
+widestNamedKernel(){
+  static const named_kernel k = selectMismatchKernel();
+  return k;
+}
+
+b128_mismatch_kernel
+widestMismatchKernel(){
+  return widestNamedKernel().kernel;
+}
+
+b128_mismatch_block_kernel
+widestMismatchBlockKernel(){
+  return widestNamedKernel().blockKernel;
+}
+
+b128_weighted_mismatch_kernel
+widestWeightedMismatchKernel(){
+  return widestNamedKernel().weightedKernel;
+}
+
+const char *
+widestMismatchKernelName(){
+  return widestNamedKernel().name;
+}
@@ -0,0 +1,144 @@
+//--------------------------------------------------
+//
+// File: mismatch_kernels.hpp
+//
+//--------------------------------------------------
+
+#ifndef MISMATCH_KERNELS_HPP
+#define MISMATCH_KERNELS_HPP
+
+#include <cstddef>
+#include "config.h"
+#include "sse2_wrapper.h"
+
+//
+// Wide versions of the mismatch counting in
+// computeDistance_DNA_b128_String.cpp and
+// computeTAMURANEIDistance_DNA_b128_String.cpp.
+//
+// The kernels read the data and unknownData of two DNA_b128_Strings
+// and count the mismatches with the same bit operations as the
+// dist_level_1() functions, i.e. for each two bit block:
+//
+// del   = unknown1 | unknown2
+// diff  = ~del & (data1 ^ data2)
+// tv    = the high bit of diff
+// ts    = the low bit of diff but not the high bit
+// pyrts = ts & the high bit of (data1 & data2)
+//
+// Instead of summing the blocks in levels the bits are counted with
+// the hardware popcount. The counts are therefore identical to the
+// ones of the SSE2 code.
+//
+// The block kernels compare one string with up to
+// MISMATCH_BLOCK_SIZE other strings in one pass. The words of the
+// first string are read once per strip and kept in registers while
+// they are compared with each of the others, which divides the memory
+// traffic for the first string by the size of the block.
+//
+// The weighted kernels count every position with an integer weight,
+// e.g. the number of alignment columns a site pattern stands for, see
+// SitePatterns.hpp. The weights are given as bit planes: plane b has
+// the two bit block of a position set if bit b of its weight is set.
+// A count is then the sum over the planes of the popcount of the
+// mismatches in the plane shifted by b. Plane b is zero after its
+// first planeWords[b] 64 bit words, which are all that is read of it.
+// planeWords must not increase with b.
+//
+// count_mismatches_block_bounded() runs a block kernel a strip of
+// MISMATCH_BOUND_STRIP datas at a time and stops counting a string as
+// soon as it has more than maxDifferences transitions and
+// transversions. Its counts are then the counts of the strips read so
+// far, which also have more than maxDifferences differences.
+//
+// The kernels are compiled in separate files with the flags of their
+// instruction set. widestMismatchKernel() checks the processor once
+// and returns the widest kernel that can be run, or NULL if only
+// SSE2 is available and the level sums should be used.
+//
+
+typedef struct {
+  unsigned int deleted;
+  unsigned int transitions;
+  unsigned int pyrimidine_transitions;//only if countPyrimidines
+  unsigned int transversions;
+} b128_mismatch_counts;
+
+typedef void (*b128_mismatch_kernel)(const b128 *data1, const b128 *data2,
+                                     const b128 *unknown1, const b128 *unknown2,
+                                     size_t numDatas, bool countPyrimidines,
+                                     b128_mismatch_counts &counts);
+
+#define MISMATCH_BLOCK_SIZE 8
+
+typedef void (*b128_mismatch_block_kernel)(const b128 *data, const b128 *unknown,
+                                           const b128 *const *otherDatas,
+                                           const b128 *const *otherUnknowns,
+                                           size_t numOthers, size_t numDatas,
+                                           bool countPyrimidines,
+                                           b128_mismatch_counts *counts);
+
+typedef void (*b128_weighted_mismatch_kernel)(const b128 *data1, const b128 *data2,
+                                              const b128 *unknown1, const b128 *unknown2,
+                                              const b128 *const *weightPlanes, const size_t *planeWords, size_t numPlanes,
+                                              size_t numDatas, bool countPyrimidines,
+                                              b128_mismatch_counts &counts);
+
+#define MISMATCH_BOUND_STRIP 32
+
+void count_mismatches_block_bounded(b128_mismatch_block_kernel kernel,
+                                    const b128 *data, const b128 *unknown,
+                                    const b128 *const *otherDatas,
+                                    const b128 *const *otherUnknowns,
+                                    size_t numOthers, size_t numDatas,
+                                    bool countPyrimidines, unsigned int maxDifferences,
+                                    b128_mismatch_counts *counts);
+
+b128_mismatch_kernel widestMismatchKernel();
+b128_mismatch_block_kernel widestMismatchBlockKernel();
+// Never NULL, falls back on count_mismatches_weighted().
+b128_weighted_mismatch_kernel widestWeightedMismatchKernel();
+
+// The name of the kernel returned by widestMismatchKernel(),
+// "sse2" if it is NULL.
+const char *widestMismatchKernelName();
+
+// Portable version of the weighted kernel using 64 bit words.
+void count_mismatches_weighted(const b128 *data1, const b128 *data2,
+                               const b128 *unknown1, const b128 *unknown2,
+                               const b128 *const *weightPlanes, const size_t *planeWords, size_t numPlanes,
+                               size_t numDatas, bool countPyrimidines,
+                               b128_mismatch_counts &counts);
+
+#ifdef HAVE_AVX2_KERNELS
+void count_mismatches_avx2(const b128 *data1, const b128 *data2,
+                           const b128 *unknown1, const b128 *unknown2,
+                           size_t numDatas, bool countPyrimidines,
+                           b128_mismatch_counts &counts);
+void count_mismatches_block_avx2(const b128 *data, const b128 *unknown,
+                                 const b128 *const *otherDatas,
+                                 const b128 *const *otherUnknowns,
+                                 size_t numOthers, size_t numDatas,
+                                 bool countPyrimidines,
+                                 b128_mismatch_counts *counts);
+#endif
+
+#ifdef HAVE_AVX512_KERNELS
+void count_mismatches_avx512(const b128 *data1, const b128 *data2,
+                             const b128 *unknown1, const b128 *unknown2,
+                             size_t numDatas, bool countPyrimidines,
+                             b128_mismatch_counts &counts);
+void count_mismatches_block_avx512(const b128 *data, const b128 *unknown,
+                                   const b128 *const *otherDatas,
+                                   const b128 *const *otherUnknowns,
+                                   size_t numOthers, size_t numDatas,
+                                   bool countPyrimidines,
+                                   b128_mismatch_counts *counts);
+void count_mismatches_weighted_avx512(const b128 *data1, const b128 *data2,
+                                      const b128 *unknown1, const b128 *unknown2,
+                                      const b128 *const *weightPlanes, const size_t *planeWords, size_t numPlanes,
+                                      size_t numDatas, bool countPyrimidines,
+                                      b128_mismatch_counts &counts);
+#endif
+
+#endif // MISMATCH_KERNELS_HPP
@@ -0,0 +1,164 @@
+//--------------------------------------------------
+//
+// File: mismatch_kernels_avx2.cpp
+//
+// Compiled with -mavx2 -mpopcnt. Only called if the processor
+// supports these, see widestMismatchKernel().
+//
+//--------------------------------------------------
+
+#include "mismatch_kernels.hpp"
+#include <immintrin.h>
+#include <stdint.h>
+
+using namespace std;
+
+//The number of 64 bit words of the first string that are compared
+//with all other strings of a block before moving on. The masked
+//values have at most four bits set in each byte, so the byte counts
+//can be added 63 times, i.e. for 63*4 words, before they have to be
+//summed into 64 bit lanes. 252 words of data and unknownData is
+//about 4 KiB which stays in the L1 cache.
+static const size_t STRIP_WORDS = 63*4;
+
+//The number of other strings whose sums are kept in registers.
+static const size_t REGISTER_BLOCK = 2;
+
+//The number of set bits in each byte of v, using a lookup table of
+//the number of bits in each nibble.
+static inline __m256i
+popcount_bytes(__m256i v){
+  const __m256i NIBBLE_COUNT = _mm256_setr_epi8(0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4,
+                                                0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4);
+  const __m256i LOW_NIBBLE = _mm256_set1_epi8(0x0f);
+  __m256i lo = _mm256_and_si256(v,LOW_NIBBLE);
+  __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v,4),LOW_NIBBLE);
+  return _mm256_add_epi8(_mm256_shuffle_epi8(NIBBLE_COUNT,lo),
+                         _mm256_shuffle_epi8(NIBBLE_COUNT,hi));
+}
+
+//The sum of all bytes in v.
+static inline unsigned int
+reduce_add_bytes(__m256i v){
+  v = _mm256_sad_epu8(v,_mm256_setzero_si256());
+  return (unsigned int)(_mm256_extract_epi64(v,0) + _mm256_extract_epi64(v,1) +
+                        _mm256_extract_epi64(v,2) + _mm256_extract_epi64(v,3));
+}
+
+//
+// Counts the mismatches between words [begin,end) of the first string
+// and K other strings, end-begin <= STRIP_WORDS. The words of the
+// first string are loaded once for all K strings. Four words at a
+// time, the remaining words are counted with the scalar popcount.
+//
+template<int K, bool PYRIMIDINES>
+static inline void
+count_block(const uint64_t *p1, const uint64_t *u1,
+            const uint64_t *const *p2, const uint64_t *const *u2,
+            size_t begin, size_t end, b128_mismatch_counts *counts){
+
+  const __m256i LEAST_SIGNIFCANT_BIT = _mm256_set1_epi64x(0x5555555555555555LL);
+  __m256i bytes_del[K], bytes_ts[K], bytes_pyrts[K], bytes_tv[K];
+  for ( int k = 0 ; k < K ; k++ ){
+    bytes_del[k] = _mm256_setzero_si256();
+    bytes_ts[k] = _mm256_setzero_si256();
+    bytes_pyrts[k] = _mm256_setzero_si256();
+    bytes_tv[k] = _mm256_setzero_si256();
+  }
+
+  size_t w = begin;
+  for ( ; w + 4 <= end ; w += 4 ){
+    const __m256i x1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p1+w));
+    const __m256i d1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(u1+w));
+
+    for ( int k = 0 ; k < K ; k++ ){
+      __m256i x2 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p2[k]+w));
+      __m256i del = _mm256_or_si256(d1,_mm256_loadu_si256(reinterpret_cast<const __m256i*>(u2[k]+w)));
+      __m256i diff = _mm256_andnot_si256(del,_mm256_xor_si256(x1,x2));
+      __m256i tv = _mm256_and_si256(_mm256_srli_epi64(diff,1),LEAST_SIGNIFCANT_BIT);
+      __m256i ts = _mm256_andnot_si256(tv,_mm256_and_si256(diff,LEAST_SIGNIFCANT_BIT));
+
+      bytes_del[k] = _mm256_add_epi8(bytes_del[k],popcount_bytes(_mm256_and_si256(del,LEAST_SIGNIFCANT_BIT)));
+      bytes_ts[k] = _mm256_add_epi8(bytes_ts[k],popcount_bytes(ts));
+      bytes_tv[k] = _mm256_add_epi8(bytes_tv[k],popcount_bytes(tv));
+      if ( PYRIMIDINES ){
+        __m256i pyrts = _mm256_and_si256(_mm256_srli_epi64(_mm256_and_si256(x1,x2),1),ts);
+        bytes_pyrts[k] = _mm256_add_epi8(bytes_pyrts[k],popcount_bytes(pyrts));
+      }
+    }
+  }
+
+  for ( int k = 0 ; k < K ; k++ ){
+    counts[k].deleted += reduce_add_bytes(bytes_del[k]);
+    counts[k].transitions += reduce_add_bytes(bytes_ts[k]);
+    counts[k].pyrimidine_transitions += reduce_add_bytes(bytes_pyrts[k]);
+    counts[k].transversions += reduce_add_bytes(bytes_tv[k]);
+  }
+
+  const uint64_t LSB = 0x5555555555555555ULL;
+  for ( ; w < end ; w++ ){
+    for ( int k = 0 ; k < K ; k++ ){
+      uint64_t del = u1[w] | u2[k][w];
+      uint64_t diff = ~del & (p1[w] ^ p2[k][w]);
+      uint64_t tv = (diff >> 1) & LSB;
+      uint64_t ts = ~tv & diff & LSB;
+      counts[k].deleted += _mm_popcnt_u64(del & LSB);
+      counts[k].transitions += _mm_popcnt_u64(ts);
+      counts[k].transversions += _mm_popcnt_u64(tv);
+      if ( PYRIMIDINES )
+        counts[k].pyrimidine_transitions += _mm_popcnt_u64(((p1[w] & p2[k][w]) >> 1) & ts);
+    }
+  }
+}
+
+template<bool PYRIMIDINES>
+static void
+count_block(size_t K,
+            const uint64_t *p1, const uint64_t *u1,
+            const uint64_t *const *p2, const uint64_t *const *u2,
+            size_t begin, size_t end, b128_mismatch_counts *counts){
+  switch ( K ){
+  case 2: count_block<2,PYRIMIDINES>(p1,u1,p2,u2,begin,end,counts); break;
+  case 1: count_block<1,PYRIMIDINES>(p1,u1,p2,u2,begin,end,counts); break;
+  }
+}
+
+void
+count_mismatches_avx2(const b128 *data1, const b128 *data2,
+                      const b128 *unknown1, const b128 *unknown2,
+                      size_t numDatas, bool countPyrimidines,
+                      b128_mismatch_counts &counts){
+  count_mismatches_block_avx2(data1,unknown1,&data2,&unknown2,1,
+                              numDatas,countPyrimidines,&counts);
+}
+
+void
+count_mismatches_block_avx2(const b128 *data, const b128 *unknown,
+                            const b128 *const *otherDatas,
+                            const b128 *const *otherUnknowns,
+                            size_t numOthers, size_t numDatas,
+                            bool countPyrimidines,
+                            b128_mismatch_counts *counts){
+  const uint64_t *p1 = reinterpret_cast<const uint64_t*>(data);
+  const uint64_t *u1 = reinterpret_cast<const uint64_t*>(unknown);
+  const uint64_t *p2[MISMATCH_BLOCK_SIZE];
+  const uint64_t *u2[MISMATCH_BLOCK_SIZE];
+  for ( size_t k = 0 ; k < numOthers ; k++ ){
+    p2[k] = reinterpret_cast<const uint64_t*>(otherDatas[k]);
+    u2[k] = reinterpret_cast<const uint64_t*>(otherUnknowns[k]);
+    counts[k].deleted = counts[k].transitions = 0;
+    counts[k].pyrimidine_transitions = counts[k].transversions = 0;
+  }
+  const size_t numWords = 2*numDatas;
+
+  for ( size_t begin = 0 ; begin < numWords ; begin += STRIP_WORDS ){
+    const size_t end = ( numWords - begin < STRIP_WORDS ? numWords : begin + STRIP_WORDS );
+    for ( size_t k = 0 ; k < numOthers ; k += REGISTER_BLOCK ){
+      const size_t K = ( numOthers - k < REGISTER_BLOCK ? numOthers - k : REGISTER_BLOCK );
+      if ( countPyrimidines )
+        count_block<true>(K,p1,u1,p2+k,u2+k,begin,end,counts+k);
+      else
+        count_block<false>(K,p1,u1,p2+k,u2+k,begin,end,counts+k);
+    }
+  }
+}
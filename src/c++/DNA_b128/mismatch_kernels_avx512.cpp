@@ -0,0 +1,173 @@
+//--------------------------------------------------
+//
+// File: mismatch_kernels_avx512.cpp
+//
+// Compiled with -mavx512f -mavx512vpopcntdq. Only called if the
+// processor supports these, see widestMismatchKernel().
+//
+//--------------------------------------------------
+
+#include "mismatch_kernels.hpp"
+#include <immintrin.h>
+#include <stdint.h>
+
+using namespace std;
+
+//The number of 64 bit words of the first string that are compared
+//with all other strings of a block before moving on. 512 words of
+//data and unknownData is 8 KiB which stays in the L1 cache.
+static const size_t STRIP_WORDS = 512;
+
+//The number of other strings whose sums are kept in registers.
+static const size_t REGISTER_BLOCK = 4;
+
+//
+// Counts the mismatches between words [begin,end) of the first string
+// and K other strings. The words of the first string are loaded once
+// for all K strings. Eight words at a time, the last iteration masks
+// out the words beyond end, which are read as zeros and add nothing.
+//
+template<int K, bool PYRIMIDINES>
+static inline void
+count_block(const uint64_t *p1, const uint64_t *u1,
+            const uint64_t *const *p2, const uint64_t *const *u2,
+            size_t begin, size_t end, b128_mismatch_counts *counts){
+
+  const __m512i LEAST_SIGNIFCANT_BIT = _mm512_set1_epi64(0x5555555555555555LL);
+  __m512i sum_del[K], sum_ts[K], sum_pyrts[K], sum_tv[K];
+  for ( int k = 0 ; k < K ; k++ ){
+    sum_del[k] = _mm512_setzero_si512();
+    sum_ts[k] = _mm512_setzero_si512();
+    sum_pyrts[k] = _mm512_setzero_si512();
+    sum_tv[k] = _mm512_setzero_si512();
+  }
+
+  for ( size_t w = begin ; w < end ; w += 8 ){
+    const __mmask8 m = ( end - w >= 8 ? 0xff : (__mmask8) ((1u << (end - w)) - 1) );
+    const __m512i x1 = _mm512_maskz_loadu_epi64(m,p1+w);
+    const __m512i d1 = _mm512_maskz_loadu_epi64(m,u1+w);
+
+    for ( int k = 0 ; k < K ; k++ ){
+      __m512i x2 = _mm512_maskz_loadu_epi64(m,p2[k]+w);
+      __m512i del = _mm512_or_si512(d1,_mm512_maskz_loadu_epi64(m,u2[k]+w));
+      __m512i diff = _mm512_andnot_si512(del,_mm512_xor_si512(x1,x2));
+      __m512i tv = _mm512_and_si512(_mm512_srli_epi64(diff,1),LEAST_SIGNIFCANT_BIT);
+      __m512i ts = _mm512_andnot_si512(tv,_mm512_and_si512(diff,LEAST_SIGNIFCANT_BIT));
+
+      sum_del[k] = _mm512_add_epi64(sum_del[k],_mm512_popcnt_epi64(_mm512_and_si512(del,LEAST_SIGNIFCANT_BIT)));
+      sum_ts[k] = _mm512_add_epi64(sum_ts[k],_mm512_popcnt_epi64(ts));
+      sum_tv[k] = _mm512_add_epi64(sum_tv[k],_mm512_popcnt_epi64(tv));
+      if ( PYRIMIDINES ){
+        __m512i pyrts = _mm512_and_si512(_mm512_srli_epi64(_mm512_and_si512(x1,x2),1),ts);
+        sum_pyrts[k] = _mm512_add_epi64(sum_pyrts[k],_mm512_popcnt_epi64(pyrts));
+      }
+    }
+  }
+
+  for ( int k = 0 ; k < K ; k++ ){
+    counts[k].deleted += (unsigned int) _mm512_reduce_add_epi64(sum_del[k]);
+    counts[k].transitions += (unsigned int) _mm512_reduce_add_epi64(sum_ts[k]);
+    counts[k].pyrimidine_transitions += (unsigned int) _mm512_reduce_add_epi64(sum_pyrts[k]);
+    counts[k].transversions += (unsigned int) _mm512_reduce_add_epi64(sum_tv[k]);
+  }
+}
+
+template<bool PYRIMIDINES>
+static void
+count_block(size_t K,
+            const uint64_t *p1, const uint64_t *u1,
+            const uint64_t *const *p2, const uint64_t *const *u2,
+            size_t begin, size_t end, b128_mismatch_counts *counts){
+  switch ( K ){
+  case 4: count_block<4,PYRIMIDINES>(p1,u1,p2,u2,begin,end,counts); break;
+  case 3: count_block<3,PYRIMIDINES>(p1,u1,p2,u2,begin,end,counts); break;
+  case 2: count_block<2,PYRIMIDINES>(p1,u1,p2,u2,begin,end,counts); break;
+  case 1: count_block<1,PYRIMIDINES>(p1,u1,p2,u2,begin,end,counts); break;
+  }
+}
+
+void
+count_mismatches_avx512(const b128 *data1, const b128 *data2,
+                        const b128 *unknown1, const b128 *unknown2,
+                        size_t numDatas, bool countPyrimidines,
+                        b128_mismatch_counts &counts){
+  count_mismatches_block_avx512(data1,unknown1,&data2,&unknown2,1,
+                                numDatas,countPyrimidines,&counts);
+}
+
+void
+count_mismatches_block_avx512(const b128 *data, const b128 *unknown,
+                              const b128 *const *otherDatas,
+                              const b128 *const *otherUnknowns,
+                              size_t numOthers, size_t numDatas,
+                              bool countPyrimidines,
+                              b128_mismatch_counts *counts){
+  const uint64_t *p1 = reinterpret_cast<const uint64_t*>(data);
+  const uint64_t *u1 = reinterpret_cast<const uint64_t*>(unknown);
+  const uint64_t *p2[MISMATCH_BLOCK_SIZE];
+  const uint64_t *u2[MISMATCH_BLOCK_SIZE];
+  for ( size_t k = 0 ; k < numOthers ; k++ ){
+    p2[k] = reinterpret_cast<const uint64_t*>(otherDatas[k]);
+    u2[k] = reinterpret_cast<const uint64_t*>(otherUnknowns[k]);
+    counts[k].deleted = counts[k].transitions = 0;
+    counts[k].pyrimidine_transitions = counts[k].transversions = 0;
+  }
+  const size_t numWords = 2*numDatas;
+
+  for ( size_t begin = 0 ; begin < numWords ; begin += STRIP_WORDS ){
+    const size_t end = ( numWords - begin < STRIP_WORDS ? numWords : begin + STRIP_WORDS );
+    for ( size_t k = 0 ; k < numOthers ; k += REGISTER_BLOCK ){
+      const size_t K = ( numOthers - k < REGISTER_BLOCK ? numOthers - k : REGISTER_BLOCK );
+      if ( countPyrimidines )
+        count_block<true>(K,p1,u1,p2+k,u2+k,begin,end,counts+k);
+      else
+        count_block<false>(K,p1,u1,p2+k,u2+k,begin,end,counts+k);
+    }
+  }
+}
+
+void
+count_mismatches_weighted_avx512(const b128 *data1, const b128 *data2,
+                                 const b128 *unknown1, const b128 *unknown2,
+                                 const b128 *const *weightPlanes, const size_t *planeWords, size_t numPlanes,
+                                 size_t numDatas, bool countPyrimidines,
+                                 b128_mismatch_counts &counts){
+  const uint64_t *p1 = reinterpret_cast<const uint64_t*>(data1);
+  const uint64_t *p2 = reinterpret_cast<const uint64_t*>(data2);
+  const uint64_t *u1 = reinterpret_cast<const uint64_t*>(unknown1);
+  const uint64_t *u2 = reinterpret_cast<const uint64_t*>(unknown2);
+  const size_t numWords = 2*numDatas;
+
+  const __m512i LEAST_SIGNIFCANT_BIT = _mm512_set1_epi64(0x5555555555555555LL);
+  __m512i sum_del = _mm512_setzero_si512();
+  __m512i sum_ts = _mm512_setzero_si512();
+  __m512i sum_pyrts = _mm512_setzero_si512();
+  __m512i sum_tv = _mm512_setzero_si512();
+
+  for ( size_t w = 0 ; w < numWords ; w += 8 ){
+    const __mmask8 m = ( numWords - w >= 8 ? 0xff : (__mmask8) ((1u << (numWords - w)) - 1) );
+    const __m512i x1 = _mm512_maskz_loadu_epi64(m,p1+w);
+    const __m512i x2 = _mm512_maskz_loadu_epi64(m,p2+w);
+    const __m512i u = _mm512_or_si512(_mm512_maskz_loadu_epi64(m,u1+w),_mm512_maskz_loadu_epi64(m,u2+w));
+    const __m512i diff = _mm512_andnot_si512(u,_mm512_xor_si512(x1,x2));
+    const __m512i del = _mm512_and_si512(u,LEAST_SIGNIFCANT_BIT);
+    const __m512i tv = _mm512_and_si512(_mm512_srli_epi64(diff,1),LEAST_SIGNIFCANT_BIT);
+    const __m512i ts = _mm512_andnot_si512(tv,_mm512_and_si512(diff,LEAST_SIGNIFCANT_BIT));
+    const __m512i pyrts = _mm512_and_si512(_mm512_srli_epi64(_mm512_and_si512(x1,x2),1),ts);
+
+    for ( size_t b = 0 ; b < numPlanes && w < planeWords[b] ; b++ ){
+      const __m512i plane = _mm512_maskz_loadu_epi64(m,reinterpret_cast<const uint64_t*>(weightPlanes[b])+w);
+      const __m128i shift = _mm_cvtsi32_si128((int) b);
+      sum_del = _mm512_add_epi64(sum_del,_mm512_sll_epi64(_mm512_popcnt_epi64(_mm512_and_si512(del,plane)),shift));
+      sum_ts = _mm512_add_epi64(sum_ts,_mm512_sll_epi64(_mm512_popcnt_epi64(_mm512_and_si512(ts,plane)),shift));
+      sum_tv = _mm512_add_epi64(sum_tv,_mm512_sll_epi64(_mm512_popcnt_epi64(_mm512_and_si512(tv,plane)),shift));
+      if ( countPyrimidines )
+        sum_pyrts = _mm512_add_epi64(sum_pyrts,_mm512_sll_epi64(_mm512_popcnt_epi64(_mm512_and_si512(pyrts,plane)),shift));
+    }
+  }
+
+  counts.deleted = (unsigned int) _mm512_reduce_add_epi64(sum_del);
+  counts.transitions = (unsigned int) _mm512_reduce_add_epi64(sum_ts);
+  counts.pyrimidine_transitions = (unsigned int) _mm512_reduce_add_epi64(sum_pyrts);
+  counts.transversions = (unsigned int) _mm512_reduce_add_epi64(sum_tv);
+}
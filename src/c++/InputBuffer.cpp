@@ -0,0 +1,217 @@
+//--------------------------------------------------
+//
+// File: InputBuffer.cpp
+//
+//--------------------------------------------------
+
+#include "InputBuffer.hpp"
+#include "CompressedFile.hpp"
+#include "Exception.hpp"
+#include "file_utils.hpp"
+#include "config.h"
+#include <string.h>
+
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif // HAVE_MMAP
+
+using namespace std;
+
+//the size of the blocks of files that are not mapped
+static const size_t INPUT_BLOCK_SIZE = 1<<20;
+
+InputBuffer::InputBuffer(const char *filename)
+  : fp(stdin), file_was_opened(false), lineNumber(0), started(false), mapped(NULL), mappedSize(0),
+    gzip(NULL), blockPos(NULL), blockEnd(NULL){
+  if ( filename != NULL ){
+    fp = fopen(filename, "rb");
+    if ( fp == NULL )
+      THROW_EXCEPTION("File doesn't exist: \"" << filename << "\"");
+    file_was_opened = true;
+  }
+
+#ifdef HAVE_MMAP
+  struct stat st;
+  if ( fstat(fileno(fp), &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 ){
+    void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+    if ( p != MAP_FAILED ){
+      mapped = (char *) p;
+      mappedSize = st.st_size;
+      madvise(mapped, mappedSize, MADV_SEQUENTIAL);
+      blockPos = mapped;
+      blockEnd = mapped + mappedSize;
+    }
+  }
+#endif // HAVE_MMAP
+
+  //the first bytes tell if the file is compressed
+  const char *head = mapped;
+  size_t headSize = mappedSize;
+  if ( mapped == NULL ){
+    block.resize(INPUT_BLOCK_SIZE);
+    headSize = fread(&block[0], 1, block.size(), fp);
+    head = &block[0];
+    blockPos = head;
+    blockEnd = head + headSize;
+  }
+  if ( isZstdData(head, headSize) )
+    THROW_EXCEPTION("Can not read zstd compressed input, decompress it with zstd -d first");
+  if ( isGzipData(head, headSize) ){
+    if ( mapped != NULL ){
+#ifdef HAVE_MMAP
+      munmap(mapped, mappedSize);
+#endif // HAVE_MMAP
+      mapped = NULL;
+      mappedSize = 0;
+      rewind(fp);
+      gzip = new GzipReader(fp);
+    }
+    else
+      gzip = new GzipReader(fp, head, headSize);
+    blockPos = blockEnd = NULL;
+  }
+}
+
+InputBuffer::~InputBuffer(){
+  //the thread of the reader reads fp
+  delete gzip;
+#ifdef HAVE_MMAP
+  if ( mapped != NULL )
+    munmap(mapped, mappedSize);
+#endif // HAVE_MMAP
+  if ( file_was_opened )
+    fclose(fp);
+}
+
+//Reads the next block of a file that is not mapped, false at the end.
+bool
+InputBuffer::_fill(){
+  if ( mapped != NULL )
+    return false;
+  size_t numRead;
+  if ( gzip != NULL ){
+    if ( ! gzip->readBlock(block) )
+      return false;
+    numRead = block.size();
+  }
+  else {
+    block.resize(INPUT_BLOCK_SIZE);
+    numRead = fread(&block[0], 1, block.size(), fp);
+  }
+  if ( numRead == 0 )
+    return false;
+  blockPos = &block[0];
+  blockEnd = blockPos + numRead;
+  return true;
+}
+
+bool
+InputBuffer::readLine(const char *&begin, const char *&end){
+  started = true;
+  carry.clear();
+  bool carried = false;
+  for (;;){
+    if ( blockPos == blockEnd && ! _fill() ){
+      if ( ! carried )
+        return false;
+      begin = carry.data();
+      end = begin + carry.size();
+      break;
+    }
+    const char *newline = (const char *) memchr(blockPos, '\n', blockEnd-blockPos);
+    if ( newline == NULL && mapped != NULL ){
+      //the last line of the file has no '\n'
+      begin = blockPos;
+      end = blockEnd;
+      blockPos = blockEnd;
+      break;
+    }
+    if ( newline == NULL ){
+      carry.append(blockPos, blockEnd);
+      carried = true;
+      blockPos = blockEnd;
+      continue;
+    }
+    if ( carried ){
+      carry.append(blockPos, newline);
+      begin = carry.data();
+      end = begin + carry.size();
+    }
+    else {
+      begin = blockPos;
+      end = newline;
+    }
+    blockPos = newline+1;
+    break;
+  }
+  lineNumber++;
+  return true;
+}
+
+bool
+InputBuffer::readBlock(const char *&begin, const char *&end){
+  started = true;
+  if ( blockPos == blockEnd && ! _fill() )
+    return false;
+  begin = blockPos;
+  end = blockEnd;
+  blockPos = blockEnd;
+  return true;
+}
+
+void
+InputBuffer::skipToEnd(){
+  started = true;
+  blockPos = blockEnd;
+  while ( _fill() )
+    blockPos = blockEnd;
+}
+
+//---------------------------------------------------------
+// STREAM
+
+//buf is constructed after the std::istream, so it is set afterwards.
+//A broken compressed input throws from underflow(), the badbit lets
+//the exception through to the reader.
+InputBufferStream::InputBufferStream(const char *filename) : std::istream(NULL){
+  rdbuf(&buf);
+  exceptions(std::ios_base::badbit);
+  open(filename);
+}
+
+InputBufferStream::InputBufferStream() : std::istream(NULL){
+  rdbuf(&buf);
+  exceptions(std::ios_base::badbit);
+}
+
+void
+InputBufferStream::open(const char *filename, std::ios_base::openmode mode){
+  if ( filename != NULL && ! file_exists(filename) ){
+    setstate(std::ios_base::failbit);
+    return;
+  }
+  buf.input.reset(new InputBuffer(filename));
+  clear();
+}
+
+void
+InputBufferStream::close(){
+  buf.close();
+}
+
+void
+InputBufferStream::Buf::close(){
+  input.reset();
+  setg(NULL, NULL, NULL);
+}
+
+InputBufferStream::int_type
+InputBufferStream::Buf::underflow(){
+  const char *begin, *end;
+  if ( input.get() == NULL || ! input->readBlock(begin, end) )
+    return traits_type::eof();
+  //the stream only reads from the buffer
+  setg(const_cast<char *>(begin), const_cast<char *>(begin), const_cast<char *>(end));
+  return traits_type::to_int_type(*gptr());
+}
@@ -0,0 +1,116 @@
+//--------------------------------------------------
+//
+// File: InputBuffer.hpp
+//
+//--------------------------------------------------
+#ifndef INPUTBUFFER_HPP
+#define INPUTBUFFER_HPP
+
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <istream>
+#include <memory>
+
+class GzipReader;
+
+//
+// An input file handed out as lines that point into the buffer, so
+// that the readers parse the bytes where they are instead of copying
+// them into strings first.
+//
+// A regular file is mapped into memory and the kernel is told that it
+// is read sequentially, so the lines point straight into the page
+// cache. Other files, e.g. stdin or a pipe, and systems without mmap
+// are read in blocks, and only a line that continues into the next
+// block is copied.
+//
+// Files compressed with gzip are recognized by their first bytes and
+// decompressed by a GzipReader on a background thread, see
+// CompressedFile.hpp.
+//
+class InputBuffer
+{
+public:
+  // Reads stdin if filename is NULL.
+  InputBuffer(const char *filename = NULL);
+  ~InputBuffer();
+
+  // The next line without its '\n', false at the end of the file. The
+  // line stays valid as long as the buffer if the file is mapped, and
+  // until the next call otherwise.
+  bool readLine(const char *&begin, const char *&end);
+  // The rest of the current block, or the next block, false at the
+  // end of the file. Valid as the lines of readLine().
+  bool readBlock(const char *&begin, const char *&end);
+
+  // True if nothing has been read from the file.
+  bool isAtBeginning() const {return ! started;}
+  // Skips the rest of the file, e.g. after a mapped file has been
+  // parsed from getData().
+  void skipToEnd();
+
+  // The number of lines read so far.
+  size_t getLineNumber() const {return lineNumber;}
+
+  // True if the whole file is in memory, at getData() with
+  // getSize() bytes.
+  bool isMapped() const {return mapped != NULL;}
+  const char *getData() const {return mapped;}
+  size_t getSize() const {return mappedSize;}
+
+private:
+  // not copyable, the lines point into the buffer
+  InputBuffer(const InputBuffer &);
+  void operator=(const InputBuffer &);
+
+  bool _fill();
+
+  FILE *fp;
+  bool file_was_opened;
+  size_t lineNumber;
+  bool started;
+
+  //the mapped file
+  char *mapped;
+  size_t mappedSize;
+
+  GzipReader *gzip;
+
+  //the current block, or the mapped file
+  std::vector<char> block;
+  const char *blockPos;
+  const char *blockEnd;
+  std::string carry;  //a line that continues in the next block
+};
+
+//
+// An InputBuffer as a std::istream for the readers that parse with
+// the stream operators, opened and checked as a std::ifstream.
+//
+class InputBufferStream : public std::istream
+{
+public:
+  InputBufferStream();
+  // Reads stdin if filename is NULL.
+  InputBufferStream(const char *filename);
+
+  // Sets the failbit if the file does not exist.
+  void open(const char *filename, std::ios_base::openmode mode = std::ios_base::in);
+  void close();
+
+private:
+  class Buf : public std::streambuf
+  {
+  public:
+    std::unique_ptr<InputBuffer> input;
+    void close();
+  protected:
+    virtual int_type underflow();
+  };
+
+  Buf buf;
+};
+
+#endif // INPUTBUFFER_HPP
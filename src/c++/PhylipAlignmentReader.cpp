@@ -0,0 +1,53 @@
+//--------------------------------------------------
+//
+// File: PhylipAlignmentReader.cpp
+//
+//--------------------------------------------------
+
+#include "PhylipAlignmentReader.hpp"
+#include "InputBuffer.hpp"
+#include <stdio.h>
+
+using namespace std;
+
+PhylipAlignmentReader::PhylipAlignmentReader(InputBuffer &input)
+  : input(&input), in(NULL), numSequences(0), length(0){
+}
+
+PhylipAlignmentReader::PhylipAlignmentReader(std::istream &in)
+  : input(NULL), in(&in), numSequences(0), length(0){
+}
+
+void
+PhylipAlignmentReader::readHeader(){
+  const char *begin, *end;
+  string header;
+  int n, len;
+  do {//skip lines that do not contain two integers
+    if ( ! _readLine(begin, end) )
+      THROW_EXCEPTION("No PHYLIP header with the number of sequences and their length");
+    header.assign(begin, end);
+  } while ( sscanf(header.c_str(), "%d %d", &n, &len) != 2 );
+
+  if ( n < 0 || len < 0 )
+    THROW_EXCEPTION("Bad PHYLIP header: \"" << header << "\"");
+  numSequences = n;
+  length = len;
+}
+
+bool
+PhylipAlignmentReader::_readLine(const char *&begin, const char *&end){
+  if ( input != NULL ){
+    if ( ! input->readLine(begin, end) )
+      return false;
+  }
+  else {
+    if ( ! getline(*in, line) )
+      return false;
+    begin = line.data();
+    end = begin + line.size();
+  }
+  while ( end != begin && (end[-1] == ' ' || end[-1] == '\r' || end[-1] == '\t') )
+    end--;
+  return true;
+}
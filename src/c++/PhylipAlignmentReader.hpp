@@ -0,0 +1,113 @@
+//--------------------------------------------------
+//
+// File: PhylipAlignmentReader.hpp
+//
+//--------------------------------------------------
+#ifndef PHYLIPALIGNMENTREADER_HPP
+#define PHYLIPALIGNMENTREADER_HPP
+
+#include <cstddef>
+#include <cstring>
+#include <istream>
+#include <string>
+#include <vector>
+#include "Exception.hpp"
+
+class InputBuffer;
+
+//
+// Reads a PHYLIP alignment, sequential or interleaved, in one pass
+// over its lines.
+//
+// The header line holds the number of sequences and their length,
+// lines before it are skipped. The first block has a line per
+// sequence with a name of 10 chars followed by the first chars of the
+// sequence. In an interleaved file the following blocks continue the
+// sequences in the same order, without names, until a sequence has
+// all its chars. Blank lines are skipped.
+//
+// The chars of each line are handed to the caller as they are, so
+// that they can be packed straight from the mapped file, and every
+// line is looked at once.
+//
+class PhylipAlignmentReader
+{
+public:
+  // The names in a PHYLIP file have this many chars
+  static const size_t NAME_LENGTH = 10;
+
+  PhylipAlignmentReader(InputBuffer &input);
+  PhylipAlignmentReader(std::istream &in);
+
+  // Reads the lines up to and including the header. Throws if the
+  // file ends before it.
+  void readHeader();
+  size_t getNumSequences() const {return numSequences;}
+  size_t getLength() const {return length;}
+
+  // Reads the sequences after readHeader(). append(i,begin,end) adds
+  // the chars [begin,end) of a line to the sequence i and returns the
+  // number of chars of the sequence. Throws if a sequence does not
+  // get getLength() chars.
+  template<class Append>
+  void readSequences(std::vector<std::string> &names, Append append);
+
+private:
+  // The next line without its trailing white space, false at the
+  // end of the file.
+  bool _readLine(const char *&begin, const char *&end);
+
+  InputBuffer *input;
+  std::istream *in;
+  std::string line;   //the line read from in
+  size_t numSequences;
+  size_t length;
+};
+
+template<class Append>
+void
+PhylipAlignmentReader::readSequences(std::vector<std::string> &names, Append append){
+  names.assign(numSequences, std::string());
+  std::vector<size_t> lengths(numSequences, 0);
+  bool complete = numSequences == 0;
+  const char *begin, *end;
+
+  //the first block, a line with a name per sequence
+  for ( size_t i = 0 ; i < numSequences ; i++ ){
+    do {
+      if ( ! _readLine(begin, end) )
+        THROW_EXCEPTION("Unexpected end of the PHYLIP file, read " << i
+                        << " of " << numSequences << " sequences");
+    } while ( (size_t) (end - begin) <= NAME_LENGTH );//skip lines without a name and chars
+
+    const char *nameEnd = (const char *) memchr(begin, ' ', NAME_LENGTH);
+    names[i].assign(begin, nameEnd != NULL ? nameEnd : begin + NAME_LENGTH);
+    lengths[i] = append(i, begin + NAME_LENGTH, end);
+    if ( lengths[i] >= length )
+      complete = true;
+  }
+
+  //the following blocks of an interleaved file, until a sequence is
+  //complete
+  while ( ! complete ){
+    for ( size_t i = 0 ; i < numSequences ; i++ ){
+      do {
+        if ( ! _readLine(begin, end) )
+          THROW_EXCEPTION("Sequence not of correct length: " << names[i]
+                          << "    length is " << lengths[i]);
+      } while ( begin == end );
+      lengths[i] = append(i, begin, end);
+      if ( lengths[i] >= length )
+        complete = true;
+    }
+  }
+
+  // CHECK THAT ALL STRINGS HAVE THE SAME LENGTH
+  for ( size_t i = 0 ; i < numSequences ; i++ ){
+    if ( lengths[i] != length )
+      THROW_EXCEPTION("Sequence not of correct length: " << names[i]
+                      << "    length is " << lengths[i]);
+  }
+}
+
+#endif // PHYLIPALIGNMENTREADER_HPP
@@ -15,6 +15,7 @@
 #include <fstream>
 #include "nucleotide.hpp"
 #include "stl_utils.hpp"
+#include "PhylipAlignmentReader.hpp"
 
 using namespace std;
 
@@ -190,136 +191,36 @@ bool Sequence::onlyContains(std::string &chars){
 // }
 
 
-void
-Sequence::readSequences(std::vector<Sequence> &seqs, istream &fin){
-	int numSequences;
-	unsigned int seqlen;
-	const int MAXLINE = 16384;
-	char line[MAXLINE];
-	do {//skip lines which does not contain two numbers.
-		fin.getline(line,MAXLINE);
-	}while(sscanf(line,"%d %d",&numSequences,&seqlen) != 2 );
-
+//Reads the sequences with the spaces of the lines removed.
+static void
+_readSequences(std::vector<Sequence> &seqs, PhylipAlignmentReader &reader){
+	reader.readHeader();
+	const size_t numSequences = reader.getNumSequences();
 	seqs.resize(numSequences);
+	for ( size_t i = 0 ; i < numSequences ; i++ ){
+		seqs[i].seq.clear();
+		seqs[i].seq.reserve(reader.getLength()+1);
+	}
+	std::vector<std::string> names;
+	reader.readSequences(names, [&](size_t i, const char *begin, const char *end) -> size_t {
+			std::string &seq = seqs[i].seq;
+			appendAllNonChars(seq, begin, end-begin, ' ');
+			return seq.length();
+		});
+	for ( size_t i = 0 ; i < numSequences ; i++ )
+		seqs[i].name.swap(names[i]);
+}
 
-	//read the names and sequences
-	char tmpName[11];
-	for ( int i = 0 ; i < numSequences ; i++ ){
-		Sequence &s = seqs[i];
-		s.seq.clear();
-		s.seq.reserve(seqlen+1);
-
-		fin.getline(tmpName,11);//reads atmost 10 chars
-		//skip lines without 10 chars per line
-		if( !fin.fail() ){
-			if( fin.eof() ) THROW_EXCEPTION("Unexpected reading format fin.eof() == " << fin.eof());
-			i--;
-			continue;
-		}
-		s.name.clear();
-		appendUntil(s.name,tmpName,fin.gcount(), ' ');
-
-		fin.clear();
-		fin.getline(line,MAXLINE);
-
-		while( fin.fail() && fin.gcount()==MAXLINE-1 ){//didn't read all the line
-			appendAllNonChars(s.seq,line,fin.gcount(), ' ');
-			fin.clear();
-			fin.getline(line,MAXLINE);
-		}
-		if( !fin.fail()) {//we read it all including the newline char unless it ended with eof
-			appendAllNonChars(s.seq,line, fin.gcount() - (fin.eof()? 0: 1), ' ');
-		}
-		else //fail
-			THROW_EXCEPTION("Unexpected reading format fin.eof() == " << fin.eof());
-		//    PRINT_V(s.seq);
-	}//end for loop
-
-//Mehmood's Changes here'
-		//The sequences aren't neccesarily on one line but my be spread out interleaving
-		//over several lines. Therefore we read until seqlen chars have been read.
-		bool whileTrue= true;
-		// check if all the sequences has been completely read.
-		for ( int i = 0 ; i < numSequences ; i++ ){
-			if ( seqs[i].seq.length() == seqlen ){
-				whileTrue= false;
-			}
-		}
-
-		while ( whileTrue){
-			for ( int i = 0 ; i < numSequences ; i++ ){
-				Sequence &s = seqs[i];
-
-				fin.getline(line,MAXLINE);
-
-				std::string myStr;
-				myStr=line;
-
-				if (myStr.empty()){
-					if( fin.eof() )
-						THROW_EXCEPTION("Sequence not of correct length: " << seqs[i].name<< "    length is " << seqs[i].seq.length());
-					i=i-1;
-					continue;
-				}
-
-				if (!( fin.fail() && fin.gcount()==MAXLINE-1 )){
-					appendAllNonChars(s.seq,line, fin.gcount() - (fin.eof()? 0: 1), ' ');
-
-				}
-
-
-				// check if any one of the sequences is read completely and has correct
-				// seq.length but some don't have that break the loop with error msg:
-				for ( int i = 0 ; i < numSequences ; i++ ){
-						if ( seqs[i].seq.length() == seqlen ){
-							whileTrue= false;
-						}
-					}
-
-			}//end for loop
-		}
+void
+Sequence::readSequences(std::vector<Sequence> &seqs, istream &fin){
+	PhylipAlignmentReader reader(fin);
+	_readSequences(seqs, reader);
+}
 
-// Mehmood's changes end here
-
-//	//The sequences aren't neccesarily on one line but my be spread out interleaving
-//	//over several lines. Therefore we read until seqlen chars have been read.
-//	while ( seqs[0].seq.length() < seqlen ){
-//		for ( int i = 0 ; i < numSequences ; i++ ){
-//			//      PRINT_V(i);
-//			Sequence &s = seqs[i];
-//			// mehmood's changes
-//			//      fin.getline(tmpName,11);//reads atmost 10 chars
-//			//      //skip lines without 10 chars per line
-//			//      if( !fin.fail() ){
-//			//	if( fin.eof() ) THROW_EXCEPTION("Unexpected reading format fin.eof() == " << fin.eof());
-//			//	i--;
-//			//	continue;
-//			//      }
-//			//// mehmood's changes
-//			fin.clear();
-//			fin.getline(line,MAXLINE);
-//			//PRINT_V(line);
-//			while( fin.fail() && fin.gcount()==MAXLINE-1 ){//didn't read all the line
-//				appendAllNonChars(s.seq,line,fin.gcount(), ' ');
-//				fin.clear();
-//				fin.getline(line,MAXLINE);
-//				//PRINT_V(line);
-//			}
-//			if( !fin.fail()) {//we read it all including the newline char unless it ended with eof
-//				appendAllNonChars(s.seq,line,fin.gcount() - (fin.eof()? 0: 1), ' ');
-//			}
-//			else //fail
-//				THROW_EXCEPTION("Unexpected reading format fin.eof() == " << fin.eof());
-//			//PRINT_V(s.seq);
-//		}//end for loop
-//	}
-
-	// CHECK THAT ALL STRINGS HAVE THE SAME LENGTH
-	for ( int i = 0 ; i < numSequences ; i++ ){
-		if ( seqs[i].seq.length() != seqlen ){
-			THROW_EXCEPTION("Sequence not of correct length: " << seqs[i].name << "    length is " << seqs[i].seq.length());
-		}
-	}
+void
+Sequence::readSequences(std::vector<Sequence> &seqs, InputBuffer &input){
+	PhylipAlignmentReader reader(input);
+	_readSequences(seqs, reader);
 }
 
 
@@ -333,7 +234,8 @@ Sequence::printSequences(std::vector<Sequence> &seqs, std::ofstream &out){
 }
 
 void 
-Sequence::bootstrapSequences(std::vector<Sequence> &seqs, std::vector<Sequence> &boot){
+Sequence::bootstrapSequences(std::vector<Sequence> &seqs, std::vector<Sequence> &boot,
+                             const ReplicateRandom &random){
 
 
 	//ensure capacity in bootsequences
@@ -359,9 +261,9 @@ Sequence::bootstrapSequences(std::vector<Sequence> &seqs, std::vector<Sequence>
 	if( stride < seqlen){
 		for( pos=0; pos<(seqlen-stride); pos+= stride)
 			for( size_t i=0; i<stride; i++)
-				samplePositions[pos+i] = (int) (seqlen*1.0*rand()/(RAND_MAX+1.0));
+				samplePositions[pos+i] = (int) random.uniformIndex(pos+i, seqlen);
 		for (; pos<seqlen; pos++)
-			samplePositions[pos] = (int) (seqlen*1.0*rand()/(RAND_MAX+1.0));
+			samplePositions[pos] = (int) random.uniformIndex(pos, seqlen);
 
 
 		for( seq=0; seq<seqs.size(); seq++){
@@ -378,7 +280,7 @@ Sequence::bootstrapSequences(std::vector<Sequence> &seqs, std::vector<Sequence>
 	}
 	else{//seqlen<stride
 		for (pos=0; pos<seqlen; pos++)
-			samplePositions[pos] = (int) (seqlen*1.0*rand()/(RAND_MAX+1.0));
+			samplePositions[pos] = (int) random.uniformIndex(pos, seqlen);
 
 		for( seq=0; seq<seqs.size(); seq++){
 			string & b = boot[seq].seq;
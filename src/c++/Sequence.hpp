@@ -17,6 +17,9 @@
 #include "log_utils.hpp"
 #include <fstream>
 #include "file_utils.hpp"
+#include "random_utils.hpp"
+
+class InputBuffer;
 
 //
 // A simple class for handling named sequences.
@@ -66,12 +69,15 @@ public:
   // READING PHYLIP SEQUENCEFILE
   // The vector is cleared of all sequences and new  sequences are added
   static void readSequences(std::vector<Sequence> &seqs, std::istream &in);
+  static void readSequences(std::vector<Sequence> &seqs, InputBuffer &input);
   static void printSequences(std::vector<Sequence> &seqs, std::ofstream &out);
 
   //-------------------------------------------
   //BOOTSTRAPPING
-  //creates a bootstrapped data set from the sequences in seqs.
-  static void bootstrapSequences(std::vector<Sequence> &seqs, std::vector<Sequence> &boot);
+  //creates a bootstrapped data set from the sequences in seqs, drawn
+  //from the random stream of the replicate.
+  static void bootstrapSequences(std::vector<Sequence> &seqs, std::vector<Sequence> &boot,
+                                 const ReplicateRandom &random);
 
 };
 
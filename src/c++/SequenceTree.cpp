@@ -61,6 +61,48 @@ SequenceTree::setNodeNames(){
       NAME(n) = string("n")+n->getNodeId();
   } 
 }
+void
+SequenceTree::expandLeafNameLists(char separator){
+  SequenceTree::NodeVector leafs;
+  addLeafs(leafs);
+  //the new edges have length zero if the tree has lengths, and no
+  //length otherwise
+  double length = -1;
+  for ( size_t i = 0 ; i < leafs.size() ; i++ ){
+    if ( EDGE(leafs[i]) != -1 )
+      length = 0;
+  }
+  for ( size_t i = 0 ; i < leafs.size() ; i++ ){
+    SequenceTree::Node *n = leafs[i];
+    vector<string> names;
+    size_t begin = 0, end;
+    while ( (end = NAME(n).find(separator,begin)) != string::npos ){
+      names.push_back(NAME(n).substr(begin,end-begin));
+      begin = end+1;
+    }
+    if ( names.empty() )
+      continue;
+    names.push_back(NAME(n).substr(begin));
+
+    //n becomes the root of the subtree and keeps its edge, the last
+    //name is the sibling of the cherry of the other names
+    Sequence_double data;
+    data.dbl = length;
+    Sequence_double inner;
+    inner.dbl = length;
+    NAME(n) = "";
+    for ( size_t k = names.size()-1 ; k > 1 ; k-- ){
+      data.s.name = names[k];
+      n->addChild(data);
+      n = n->addChild(inner);
+    }
+    data.s.name = names[1];
+    n->addChild(data);
+    data.s.name = names[0];
+    n->addChild(data);
+  }
+}
+
 void
 SequenceTree::printSequencesPhylip(SequenceTree::NodeVector &nodes,  std::ostream &os){
   os << nodes.size() << "\t " << SEQ(nodes[0]).length() << endl;
@@ -108,6 +108,15 @@ public:
   //takes a tree and fills the name2id map
   //such that each leaf name gets an id in the range [0,numleafs)
   void createLeafNameToLeafIdMap(str2int_hashmap &name2id) const;
+
+  //---------------
+  // LEAFS OF IDENTICAL SEQUENCES
+  //Replaces every leaf whose name is a list of names separated by
+  //separator, e.g. "a,b,c", by a subtree with one leaf per name and
+  //zero length edges, i.e. ((a:0,b:0):0,c:0), or edges without
+  //lengths if the tree has none, i.e. ((a,b),c). See the option
+  //--compact-duplicates of fastdist.
+  void expandLeafNameLists(char separator=',');
   
 
   //-------------------
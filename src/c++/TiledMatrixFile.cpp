@@ -0,0 +1,153 @@
+//--------------------------------------------------
+//
+// File: TiledMatrixFile.cpp
+//
+//--------------------------------------------------
+
+#include "TiledMatrixFile.hpp"
+#include "Exception.hpp"
+#include "log_utils.hpp"
+#include <math.h>
+
+using namespace std;
+
+static const string TILED_TAG = "FASTPHYLO TILED 1";
+
+//---------------------------------------------------------
+// LAYOUT
+
+TiledMatrixLayout::TiledMatrixLayout(size_t numNodes, size_t tileSide)
+  : numNodes(numNodes), tileSide(tileSide){
+  if ( tileSide == 0 )
+    PROG_ERROR("The tiles must have a side of at least 1");
+}
+
+size_t
+TiledMatrixLayout::bandSize(size_t band) const{
+  return (bandEnd(band)-bandBegin(band))*(numNodes-bandBegin(band));
+}
+
+size_t
+TiledMatrixLayout::tileOffset(size_t band, size_t tileBand) const{
+  //the tiles before it have the same rows and together the columns
+  //from the beginning of the band
+  return (bandEnd(band)-bandBegin(band))*(bandBegin(tileBand)-bandBegin(band));
+}
+
+size_t
+TiledMatrixLayout::tileSideForMemory(size_t numNodes, size_t maxBytes, size_t maxSide){
+  //the first band is the largest
+  const size_t rowBytes = max((size_t) 1, numNodes)*sizeof(float);
+  return min(min(maxSide, max((size_t) 1, numNodes)), maxBytes/rowBytes);
+}
+
+//---------------------------------------------------------
+// WRITER
+
+TiledMatrixWriter::TiledMatrixWriter(FILE *fp) : fp(fp), band(0){
+}
+
+void
+TiledMatrixWriter::writeHeader(const std::vector<std::string> &names, size_t tileSide){
+  layout = TiledMatrixLayout(names.size(), tileSide);
+  band = 0;
+  fwrite(TILED_TAG.c_str(), sizeof(char), TILED_TAG.length(), fp);
+  //longs as in the binary format
+  long converter = names.size();
+  fwrite(&converter, sizeof converter, 1, fp);
+  converter = tileSide;
+  fwrite(&converter, sizeof converter, 1, fp);
+  for ( size_t i = 0 ; i < names.size() ; i++ ){
+    fwrite(names[i].c_str(), sizeof(char), names[i].length(), fp);
+    fwrite(":", sizeof(char), 1, fp);
+  }
+}
+
+void
+TiledMatrixWriter::writeBand(std::vector<float> &bandData){
+  if ( band >= layout.getNumBands() )
+    PROG_ERROR("Every band of the matrix has been written");
+  const size_t size = layout.bandSize(band);
+  if ( bandData.size() < size )
+    PROG_ERROR("The band is smaller than the tiles of the band");
+  for ( size_t k = 0 ; k < size ; k++ ){
+    if ( ! isfinite(bandData[k]) )
+      bandData[k] = -1.0;
+  }
+  if ( fwrite(bandData.data(), sizeof(float), size, fp) != size )
+    THROW_EXCEPTION("Could not write band " << band << " of the tiled matrix");
+  band++;
+}
+
+//---------------------------------------------------------
+// READER
+
+TiledMatrixReader::TiledMatrixReader(std::istream &in) : in(in), nextRow(0){
+}
+
+bool
+TiledMatrixReader::readHeader(std::vector<std::string> &names_){
+  string tag(TILED_TAG.length(), ' ');
+  if ( ! in.read(&tag[0], tag.length()) )
+    return false;
+  if ( tag != TILED_TAG )
+    THROW_EXCEPTION("Not a tiled distance matrix, the tag is \"" << tag << "\"");
+  long numNodes, tileSide;
+  in.read(reinterpret_cast<char*>(&numNodes), sizeof numNodes);
+  in.read(reinterpret_cast<char*>(&tileSide), sizeof tileSide);
+  if ( ! in || numNodes < 0 || tileSide <= 0 )
+    THROW_EXCEPTION("The header of the tiled distance matrix is broken");
+  layout = TiledMatrixLayout(numNodes, tileSide);
+
+  names.assign(numNodes, "");
+  for ( long i = 0 ; i < numNodes ; i++ ){
+    if ( ! getline(in, names[i], ':') )
+      THROW_EXCEPTION("The names of the tiled distance matrix end after " << i << " names");
+  }
+  names_ = names;
+  nextRow = 0;
+  return true;
+}
+
+bool
+TiledMatrixReader::readRow(StrFloRow &row){
+  const size_t numNodes = layout.getNumNodes();
+  if ( nextRow >= numNodes )
+    return false;
+  const size_t bandIndex = nextRow/layout.getTileSide();
+  if ( nextRow == layout.bandBegin(bandIndex) ){
+    band.resize(layout.bandSize(bandIndex));
+    if ( ! in.read(reinterpret_cast<char*>(band.data()), band.size()*sizeof(float)) )
+      return false;
+  }
+
+  row.resize(numNodes);
+  for ( size_t j = 0 ; j < nextRow ; j++ )
+    row.setDistance(j,0);
+  const size_t r = nextRow-layout.bandBegin(bandIndex);
+  for ( size_t tileBand = bandIndex ; tileBand < layout.getNumBands() ; tileBand++ ){
+    const size_t begin = layout.bandBegin(tileBand), end = layout.bandEnd(tileBand);
+    const float *tileRow = band.data() + layout.tileOffset(bandIndex, tileBand) + r*(end-begin);
+    for ( size_t j = max(begin, nextRow) ; j < end ; j++ )
+      row.setDistance(j, tileRow[j-begin]);
+  }
+  row.setIdentifier(names[nextRow]);
+  nextRow++;
+  return true;
+}
+
+bool
+TiledMatrixReader::readMatrix(StrFloMatrix &dm){
+  const size_t numNodes = layout.getNumNodes();
+  dm.resize(numNodes);
+  for ( size_t i = 0 ; i < numNodes ; i++ )
+    dm.setIdentifier(i, names[i]);
+  StrFloRow row(numNodes);
+  for ( size_t i = nextRow ; i < numNodes ; i++ ){
+    if ( ! readRow(row) )
+      return false;
+    for ( size_t j = i ; j < numNodes ; j++ )
+      dm.setDistance(i, j, row.getDistance(j));
+  }
+  return true;
+}
@@ -0,0 +1,105 @@
+//--------------------------------------------------
+//
+// File: TiledMatrixFile.hpp
+//
+//--------------------------------------------------
+#ifndef TILEDMATRIXFILE_HPP
+#define TILEDMATRIXFILE_HPP
+
+#include <cstdio>
+#include <algorithm>
+#include <iostream>
+#include <vector>
+#include <string>
+#include "FloatDistanceMatrix.hpp"
+#include "DistanceRow.hpp"
+
+//
+// A distance matrix stored in square tiles so that it can be written
+// and read without holding more than one band of tiles in memory.
+//
+// The file starts with the tag "FASTPHYLO TILED 1", the number of
+// sequences n and the side B of the tiles as longs, and the names
+// each followed by ':'. Then come the tiles on or above the diagonal,
+// band by band: band b holds the rows bB,...,min((b+1)B,n)-1 and its
+// tiles are the tiles of the columns bB,...,n-1, from left to right,
+// each stored row by row. The tiles on the diagonal are stored in
+// full. Several matrices may follow each other in a file.
+//
+class TiledMatrixLayout
+{
+public:
+  TiledMatrixLayout(size_t numNodes=0, size_t tileSide=1);
+
+  size_t getNumNodes() const {return numNodes;}
+  size_t getTileSide() const {return tileSide;}
+  size_t getNumBands() const {return (numNodes+tileSide-1)/tileSide;}
+
+  // The first and one past the last row of a band, which are also the
+  // columns of the tiles of the band.
+  size_t bandBegin(size_t band) const {return band*tileSide;}
+  size_t bandEnd(size_t band) const {return std::min(numNodes, (band+1)*tileSide);}
+
+  // The number of floats of a band and the offset of the tile of
+  // the columns of tileBand in it.
+  size_t bandSize(size_t band) const;
+  size_t tileOffset(size_t band, size_t tileBand) const;
+
+  // The largest side of the tiles whose bands take at most maxBytes,
+  // at most maxSide and at least 1, or 0 if not even one row fits.
+  static size_t tileSideForMemory(size_t numNodes, size_t maxBytes, size_t maxSide);
+
+private:
+  size_t numNodes;
+  size_t tileSide;
+};
+
+// Writes the matrices a band at a time.
+class TiledMatrixWriter
+{
+public:
+  TiledMatrixWriter(FILE *fp);
+
+  void writeHeader(const std::vector<std::string> &names, size_t tileSide);
+  // The next band, see TiledMatrixLayout. Distances that are not
+  // finite are written as -1 as BinaryDmOutputStream does.
+  void writeBand(std::vector<float> &band);
+
+  const TiledMatrixLayout &getLayout() const {return layout;}
+  // The band that writeBand() writes next.
+  size_t getBand() const {return band;}
+
+private:
+  FILE *fp;
+  TiledMatrixLayout layout;
+  size_t band;
+};
+
+// Reads the matrices back a band at a time, giving them row by row.
+class TiledMatrixReader
+{
+public:
+  TiledMatrixReader(std::istream &in);
+
+  // Reads the header of the next matrix, false at the end of the
+  // file.
+  bool readHeader(std::vector<std::string> &names);
+  // Reads the next row, the distances to the sequences row,...,n-1
+  // with the others 0 as in the rows of the binary format. False if
+  // the file ends before the row.
+  bool readRow(StrFloRow &row);
+  // Reads the matrix after its header, named by the names of the
+  // header.
+  bool readMatrix(StrFloMatrix &dm);
+
+  const TiledMatrixLayout &getLayout() const {return layout;}
+
+private:
+  std::istream &in;
+  TiledMatrixLayout layout;
+  std::vector<std::string> names;
+  std::vector<float> band;
+  size_t nextRow;
+};
+
+#endif // TILEDMATRIXFILE_HPP
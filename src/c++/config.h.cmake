@@ -1 +1,5 @@
 #cmakedefine WITH_LIBXML
+#cmakedefine HAVE_AVX2_KERNELS
+#cmakedefine HAVE_AVX512_KERNELS
+#cmakedefine HAVE_MMAP
+#cmakedefine HAVE_ZLIB
@@ -182,10 +182,7 @@ main(int argc, char **argv){
   bool excludeOriginal = GET_BOOLEAN_OPTION_VAL("-exclude-orig");
   
   char *seedval = GET_OPTION_VAL("-seed");
-  if ( seedval == NULL )
-    srand((unsigned int)time(NULL));
-  else
-    srand((unsigned int)atoi(seedval));
+  const uint64_t seed = ( seedval == NULL ? (unsigned int)time(NULL) : (unsigned int)atoi(seedval) );
   
   //All options read
   //-----------------------------------------
@@ -237,7 +234,7 @@ main(int argc, char **argv){
 	//boot and create dm.
 	//	Sequence::bootstrapSequences(seqs,bootseqs);
 	//Sequences2DNA_b128(bootseqs,b128seqs);
-	bootstrapSequences(seqs,b128seqs);
+	bootstrapSequences(seqs,b128seqs,ReplicateRandom(seed,b));
 	    
 	fillMatrix(dm, b128seqs, trans_model);
 	dm.setIdentifiers(names);
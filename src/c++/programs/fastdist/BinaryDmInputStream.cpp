@@ -0,0 +1,52 @@
+//--------------------------------------------------
+//
+// File: BinaryDmInputStream.cpp
+//
+//--------------------------------------------------
+
+#include "BinaryDmInputStream.hpp"
+#include "Exception.hpp"
+
+using namespace std;
+
+BinaryDmInputStream::BinaryDmInputStream(const char * filename) :
+	filename(filename), numNodes(0), nextRow(0)
+{
+	fin.open(filename, ios::binary);
+	if ( ! fin.good() )
+		THROW_EXCEPTION("File doesn't exist: \"" << filename << "\"");
+}
+
+void
+BinaryDmInputStream::readHeader(std::vector<std::string> & names) {
+	const string TAG = "FASTPHYLO 1";
+	string tag(TAG.length(), ' ');
+	//converter variable is needed for running the binary output/input
+	//also on 64-bit systems
+	long converter;
+	fin.read(&tag[0], tag.length());
+	fin.read(reinterpret_cast<char*>( &converter ), sizeof converter);
+	if ( ! fin || tag != TAG || converter < 0 )
+		THROW_EXCEPTION("Not a binary distance matrix: \"" << filename << "\"");
+	numNodes = converter;
+
+	names.assign(numNodes, "");
+	for ( size_t i = 0 ; i < numNodes ; i++ ){
+		if ( ! getline(fin, names[i], ':') )
+			THROW_EXCEPTION("The names of \"" << filename << "\" end after " << i << " names");
+	}
+	nextRow = 0;
+}
+
+bool
+BinaryDmInputStream::readRow(StrFloRow & dm) {
+	if ( nextRow >= numNodes )
+		return false;
+	buffer.resize(numNodes-nextRow);
+	if ( ! fin.read(reinterpret_cast<char*>( buffer.data() ), buffer.size()*sizeof(float)) )
+		return false;
+	for ( size_t j = nextRow ; j < numNodes ; j++ )
+		dm.setDistance(j, buffer[j-nextRow]);
+	nextRow++;
+	return true;
+}
@@ -0,0 +1,41 @@
+//--------------------------------------------------
+//
+// File: BinaryDmInputStream.hpp
+//
+//--------------------------------------------------
+
+#ifndef BINARYDMINPUTSTREAM_HPP
+#define BINARYDMINPUTSTREAM_HPP
+
+#include "DistanceRow.hpp"
+#include <fstream>
+#include "InputBuffer.hpp"
+#include <vector>
+#include <string>
+
+//
+// Reads a matrix that BinaryDmOutputStream has written a row at a
+// time, the rows having the distances to the sequences row,...,n-1,
+// so that the matrix is never held in memory.
+//
+class BinaryDmInputStream
+{
+public:
+  BinaryDmInputStream(const char * filename);
+  ~BinaryDmInputStream() {};
+
+  // Reads the tag, the number of sequences and the names.
+  void readHeader(std::vector<std::string> & names);
+  // Reads the next row into the columns row,...,n-1 of dm, which must
+  // have at least n columns, false if the file ends before it.
+  bool readRow(StrFloRow & dm);
+
+private:
+  InputBufferStream fin;
+  std::string filename;
+  size_t numNodes;
+  size_t nextRow;
+  std::vector<float> buffer;
+};
+
+#endif // BINARYDMINPUTSTREAM_HPP
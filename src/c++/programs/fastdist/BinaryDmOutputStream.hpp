@@ -9,19 +9,25 @@
 #define BINARYDMOUTPUTSTREAM_HPP_
 
 #include "DataOutputStream.hpp"
+#include "CompressedFile.hpp"
 #include <cstdio>
 #include <fstream>
 
 
 class BinaryDmOutputStream: public DataOutputStream {
 public:
-	BinaryDmOutputStream(char * filename ) : DataOutputStream(filename) {
+	// a .gz file is compressed by ofs, not by the base class
+	BinaryDmOutputStream(char * filename ) :
+	  DataOutputStream(filename != 0 && isGzipFileName(filename) ? NULL : filename), gzofs(0) {
 	  	if(filename != 0) {
 	  		writeToCout = false;
 	  		fp = 0;
 	  		delete fp;
 	  		file_was_opened = false;
-	   	ofs = open_write_binary(filename);
+	  		if(isGzipFileName(filename))
+	  			ofs = gzofs = new GzipOutputStream(filename);
+	  		else
+	   		ofs = open_write_binary(filename);
 	  	} else {
 	  		ofs = &std::cout;
 	  		writeToCout = true;
@@ -30,6 +36,8 @@ public:
 
 
 	  virtual ~BinaryDmOutputStream() {
+	  	if(gzofs != 0 && !gzofs->close())
+	  		USER_ERROR(gzofs->getError());
 	  	if(ofs != 0 && !writeToCout) {
 	  		delete ofs;
 	  		ofs = 0;
@@ -44,6 +52,7 @@ public:
 
 	private:
 	  std::ostream *ofs;
+	  GzipOutputStream *gzofs; //ofs if it is compressed
 	  std::vector<std::string> m_names;
 	  bool writeToCout;
 };
@@ -17,8 +17,10 @@ class DataInputStream
 public:
   DataInputStream() {};
   virtual ~DataInputStream() {};
-  virtual bool read( std::vector<DNA_b128_String> &b128_strings, std::string & runId, std::vector<std::string> &names, Extrainfos &extrainfos ) = 0;
+  virtual bool read( PackedAlignment &b128_strings, std::string & runId, std::vector<std::string> &names, Extrainfos &extrainfos ) = 0;
   virtual bool readSequences( std::vector<Sequence> &seqs, std::string & runId, Extrainfos &extrainfos ) = 0;
+  // The number of threads the stream may use to parse the input.
+  virtual void setNumThreads(size_t numThreads) {};
 };
 
 #endif // DATAINPUTSTREAM_HPP
@@ -1,4 +1,5 @@
 #include "DataOutputStream.hpp"
+#include "CompressedFile.hpp"
 #include <cstdio>
 #include <math.h>
 #include <iostream>
@@ -7,17 +8,35 @@ using namespace std;
 DataOutputStream::DataOutputStream(char * filename)
 { 
 	fp = NULL;
+	gzip = NULL;
 
 	file_was_opened = false;
 	if ( filename == NULL )
 	{
 		fp = stdout;
 	}
+	else if ( isGzipFileName(filename) )
+	{
+		gzip = new GzipWriter(filename);
+		fp = gzip->getFile();
+	}
 	else
 	{
 		fp = open_write_file(filename);
 	}
 }
+
+DataOutputStream::~DataOutputStream()
+{
+	//the outputs print their last lines in their own destructors,
+	//which have run by now
+	if ( gzip != NULL )
+	{
+		if ( ! gzip->close() )
+			USER_ERROR(gzip->getError());
+		delete gzip;
+	}
+}
 /*
 bool WRITEXML;
 void setXmlFlag(bool xmlFlag){
@@ -11,13 +11,15 @@
 //#include "FloatDistanceMatrix.hpp"
 #include "Extrainfos.hpp"
 
+class GzipWriter;
+
 
 class DataOutputStream
 {
 public:
   DataOutputStream( );
   DataOutputStream(char * filename = NULL);
-  virtual ~DataOutputStream() {};
+  virtual ~DataOutputStream();
   virtual void print( StrDblMatrix & dm )=0;  //Mehmood's Changes here. Email: malagori@kth.se
   virtual void printStartRun(std::vector<std::string> & names, std::string & runId, Extrainfos &extrainfos )=0;
   virtual void printEndRun()=0;
@@ -34,6 +36,7 @@ public:
 protected:
   FILE * fp;
   bool file_was_opened;
+  GzipWriter * gzip; //compresses fp if the filename ends with .gz
 
 };
 
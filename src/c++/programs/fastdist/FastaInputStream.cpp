@@ -1,212 +1,301 @@
 #include "FastaInputStream.hpp"
+#include "thread_utils.hpp"
 #include <cstdio>
+#include <cstring>
 
 
 using namespace std;
 
-FastaInputStream::~FastaInputStream() {
-  if ( file_was_opened ) 
-    fin.close();
-}
-
-FastaInputStream::FastaInputStream(char * filename)  
-{ 
-  file_was_opened = false;
-  if ( filename == 0 )
-   {
-	fp = & std::cin;
-   }
-  else
-    {
-     fin.open(filename, ifstream::in );
-     if ( ! fin.good() )
-     {
-       fin.close();
-       fin.clear();
-       THROW_EXCEPTION("File doesn't exist: \"" << filename << "\"");
-     }
-     file_was_opened = true;
-     fp = & fin;
-    }
-}
+//A mapped file is parsed on several threads when every thread gets
+//chunks of atleast this many bytes.
+#define FASTA_MIN_CHUNK_SIZE (1<<20)
 
+//The chars that may be in a sequence, checked with one lookup per
+//char.
+static const char FASTA_SEQUENCE_CHARS[] = "acgtumrwsykvhdbnxACGTUMRWSYKVHDBNX -.?";
 
-
-bool
-FastaInputStream::read( std::vector<DNA_b128_String> &b128seqs, std::string & runId, std::vector<std::string> &names,  Extrainfos &extrainfos)
-{
-  std::vector<Sequence> seqs;
-  if ( ! readSequences(seqs,runId,extrainfos) )
-  {
-  	return false;
+struct FastaCharTable{
+  bool valid[256];
+  FastaCharTable(){
+    memset(valid, 0, sizeof valid);
+    for ( const char *c = FASTA_SEQUENCE_CHARS ; *c != '\0' ; c++ )
+      valid[(unsigned char) *c] = true;
   }
-  names.clear();
-  names.reserve(seqs.size());
-  for( size_t i=0;i<seqs.size();i++) {
-    names.push_back(seqs[i].name);
+};
+static const FastaCharTable fastaChars;
+
+//The first char of [begin,end) that can not be in a sequence, or end.
+static const char *
+findInvalidChar(const char *begin, const char *end) {
+  for ( ; begin != end ; begin++ ) {
+    if ( ! fastaChars.valid[(unsigned char) *begin] )
+      break;
   }
-  Sequences2DNA_b128(seqs,b128seqs);
-  return true;
+  return begin;
 }
 
-bool
-FastaInputStream::readSeqName(std::vector<Sequence> &seqs, std::string &line, int linesRead) {
-
-  seqs.resize(linesRead);
-  std::string seqStr;
-  Sequence &s = seqs[linesRead-1];
-  string::size_type findPos = line.find_first_of("\t ",1);
-  string::size_type nameEndPos;
-  if ( findPos == string::npos ) {
-    nameEndPos = line.size() -1;
-  }
-  else {
-    nameEndPos = findPos-1;
-  }
-
-
-  s.name = line.substr(1, nameEndPos);
+//The end of the line without the trailing white space.
+static const char *
+trimLine(const char *begin, const char *end) {
+  while ( end != begin && (end[-1] == ' ' || end[-1] == '\r' || end[-1] == '\t') )
+    end--;
+  return end;
+}
 
+//The next line of the chars [pos,end) of a mapped file as readLine()
+//gives it, false at the end.
+static bool
+nextLine(const char *&pos, const char *end, const char *&lineBegin, const char *&lineEnd) {
+  if ( pos == end )
+    return false;
+  lineBegin = pos;
+  const char *newline = (const char *) memchr(pos, '\n', end-pos);
+  pos = ( newline == NULL ? end : newline+1 );
+  lineEnd = trimLine(lineBegin, newline == NULL ? end : newline);
   return true;
 }
-bool
-FastaInputStream::readSeq(std::vector<Sequence> &seqs, std::string &line, int linesRead) {
 
-  seqs.resize(linesRead);
+//The first sequence at or after pos, i.e. a '>' at the beginning of a
+//line, or end.
+static const char *
+nextRecord(const char *begin, const char *pos, const char *end) {
+  if ( pos == begin )
+    return begin;
+  pos--;
+  for (;;) {
+    const char *newline = (const char *) memchr(pos, '\n', end-pos);
+    if ( newline == NULL || newline+1 == end )
+      return end;
+    if ( newline[1] == '>' )
+      return newline+1;
+    pos = newline+1;
+  }
+}
+
+FastaInputStream::~FastaInputStream() {
+}
 
-  Sequence &s = seqs[linesRead-1];
-  std::string seqStr = s.seq;
+FastaInputStream::FastaInputStream(char * filename)  
+  : input(filename), numThreads(1), haveName(false), seq(NULL), seqLength(0)
+{ 
+}
 
-  seqStr += line;
+void
+FastaInputStream::setNumThreads(size_t numThreads) {
+  this->numThreads = numThreads;
+}
 
-  if (!fp->eof() &&  (seqStr.size() == 0 || seqStr.find_first_not_of("acgtumrwsykvhdbnxACGTUMRWSYKVHDBNX -.?") != string::npos ) ) {
-    THROW_EXCEPTION("Malformed Fasta format3\n");
-    exit(EXIT_FAILURE);
-  } else {
-     Sequence &s = seqs[linesRead-1];
-     s.seq = seqStr;
+bool
+FastaInputStream::read( PackedAlignment &b128seqs, std::string & runId, std::vector<std::string> &names,  Extrainfos &extrainfos)
+{
+  names.clear();
+  std::vector<FastaChunk> chunks;
+  if ( scanChunks(chunks) ) {
+    size_t maxLength = 0;
+    for ( size_t c = 0 ; c < chunks.size() ; c++ ) {
+      names.insert(names.end(), chunks[c].names.begin(), chunks[c].names.end());
+      maxLength = max(maxLength, chunks[c].maxLength);
+    }
+    b128seqs.reInitiate(names.size(), maxLength+1);
+    forEachSequence(chunks, [&](size_t i, const char *chars, size_t length){
+        b128seqs[i].append(chars, length);
+      });
+    return true;
   }
 
+  b128seqs.reInitiate(0,0);
+  std::string name;
+  while ( readSeq(name) ) {
+    names.push_back(name);
+    b128seqs.addSequence(seqLength+1).append(seq, seqLength);
+  }
   return true;
 }
 
 bool
 FastaInputStream::readSequences(std::vector<Sequence> &seqs,  std::string & runId, Extrainfos &extrainfos) {
-  std::string line;
-  int linesRead = 0;
-  while ( getline ( *fp, line ) ) {
-      line.erase(line.find_last_not_of(" \n\r\t")+1);
-      if ( line.size() > 0 && line[0] == '>' ) {
-        ++linesRead;
-        readSeqName( seqs , line ,linesRead );
-
-      }else{
-      	readSeq( seqs , line ,linesRead );
+  seqs.clear();
+  std::vector<FastaChunk> chunks;
+  if ( scanChunks(chunks) ) {
+    for ( size_t c = 0 ; c < chunks.size() ; c++ ) {
+      for ( size_t r = 0 ; r < chunks[c].names.size() ; r++ ) {
+        seqs.resize(seqs.size()+1);
+        seqs.back().name = chunks[c].names[r];
       }
+    }
+    forEachSequence(chunks, [&](size_t i, const char *chars, size_t length){
+        seqs[i].seq.assign(chars, length);
+      });
+    return true;
+  }
+
+  std::string name;
+  while ( readSeq(name) ) {
+    seqs.resize(seqs.size()+1);
+    seqs.back().name = name;
+    seqs.back().seq.assign(seq, seqLength);
   }
   return true;
-   //  THROW_EXCEPTION("Malformed Fasta2 format\n");
-     //exit(EXIT_FAILURE);
 }
 
-/*#include "FastaInputStream.hpp"
-#include <cstdio>
-
-using namespace std;
-
-FastaInputStream::~FastaInputStream() {
-  if ( file_was_opened )
-    fin.close();
+bool
+FastaInputStream::readLine(const char *&begin, const char *&end) {
+  if ( ! input.readLine(begin, end) )
+    return false;
+  end = trimLine(begin, end);
+  return true;
 }
 
-FastaInputStream::FastaInputStream(char * filename = 0 )
-{
-  file_was_opened = false;
-  if ( filename == 0 )
-    {
-   fp = & std::cin;    }
-  else
-    {
-     fin.open(filename, ifstream::in );
-     if ( ! fin.good() )
-     {
-       fin.close();
-       fin.clear();
-       THROW_EXCEPTION("File doesn't exist: \"" << filename << "\"");
-     }
-     file_was_opened = true;
-     fp = & fin;
-    }
+void
+FastaInputStream::readSeqName(const char *begin, const char *end, std::string &name) {
+  //the name ends at the first white space
+  const char *nameEnd = begin+1;
+  while ( nameEnd != end && *nameEnd != ' ' && *nameEnd != '\t' )
+    nameEnd++;
+  name.assign(begin+1, nameEnd);
 }
 
-
-
 bool
-FastaInputStream::read( std::vector<DNA_b128_String> &b128seqs, std::string & runId, std::vector<std::string> &names,  Extrainfos &extrainfos) 
-{
-  std::vector<Sequence> seqs;
-  if ( ! readSequences(seqs,runId,extrainfos) ) return false;
-  names.clear();names.reserve(seqs.size());
-  for( size_t i=0;i<seqs.size();i++) {
-    names.push_back(seqs[i].name);
+FastaInputStream::readSeq(std::string &name) {
+  const char *begin, *end;
+  if ( ! haveName ) {
+    //the first sequence
+    while ( ! haveName && readLine(begin, end) ) {
+      if ( begin == end )
+        continue;
+      if ( *begin != '>' )
+        THROW_EXCEPTION("Malformed Fasta format, line " << input.getLineNumber() << " comes before the first name");
+      readSeqName(begin, end, nextName);
+      haveName = true;
+    }
+    if ( ! haveName )
+      return false;
   }
-  Sequences2DNA_b128(seqs,b128seqs);
+  name.swap(nextName);
+  haveName = false;
+
+  //a sequence on one line of a mapped file is used where it is, the
+  //lines of other sequences are copied after each other since the
+  //encoder packs long runs of chars fastest
+  seq = NULL;
+  seqLength = 0;
+  bool copied = ! input.isMapped();
+  seqChars.clear();
+  while ( readLine(begin, end) ) {
+    if ( begin != end && *begin == '>' ) {
+      readSeqName(begin, end, nextName);
+      haveName = true;
+      break;
+    }
+    const char *c = findInvalidChar(begin, end);
+    if ( c != end )
+      THROW_EXCEPTION("Malformed Fasta format, the char '" << *c << "' on line " << input.getLineNumber()
+                      << " is not a nucleotide");
+    if ( seqLength == 0 && ! copied )
+      seq = begin;
+    else {
+      if ( ! copied ) {
+        seqChars.assign(seq, seqLength);
+        copied = true;
+      }
+      seqChars.append(begin, end);
+    }
+    seqLength += end-begin;
+  }
+  if ( seqLength == 0 )
+    THROW_EXCEPTION("Malformed Fasta format, the sequence \"" << name << "\" is empty");
+  if ( copied )
+    seq = seqChars.data();
   return true;
 }
 
 bool
-FastaInputStream::readSeq(std::vector<Sequence> &seqs, std::string &line, int linesRead) {
-
-  linesRead++;
-  seqs.resize(linesRead);
-  std::string seqStr;
-  Sequence &s = seqs[linesRead-1];
-  string::size_type findPos = line.find_first_of("\t ",1);
-  string::size_type nameEndPos;  
-  if ( findPos == string::npos ) {
-    nameEndPos = line.size() -1;
-  }
-  else {
-    nameEndPos = findPos-1;
+FastaInputStream::scanChunks(std::vector<FastaChunk> &chunks) {
+  //only a whole mapped file that has not been read from
+  if ( numThreads < 2 || ! input.isMapped() || ! input.isAtBeginning() )
+    return false;
+  const size_t size = input.getSize();
+  const size_t numChunks = min(4*numThreads, size/FASTA_MIN_CHUNK_SIZE);
+  if ( numChunks < 2 )
+    return false;
+
+  //the chunks begin with a sequence, except the first one
+  const char *data = input.getData();
+  const char *end = data + size;
+  chunks.resize(numChunks);
+  for ( size_t c = 0 ; c < numChunks ; c++ ) {
+    chunks[c].begin = ( c == 0 ? data : chunks[c-1].end );
+    chunks[c].end = ( c+1 == numChunks ? end : nextRecord(data, max(chunks[c].begin, data + size/numChunks*(c+1)), end) );
   }
 
-
-  s.name = line.substr(1, nameEndPos);
-
-  bool readGreaterThan = false;
-  while ( ! readGreaterThan && getline ( *fp, line ) ) {
-    //       c != 'n' && line[0] != '\0' && ! fp->eof() && fp->good()
-    if ( line.size() > 0 ) {
-      if ( line[0] == '>' ) {
-        readGreaterThan = true;
-        readSeq( seqs, line, linesRead );        
-      } else { 
-	seqStr += line;
+  WorkStealingPool pool(numThreads);
+  pool.run(numChunks, [&](size_t c){
+      FastaChunk &chunk = chunks[c];
+      chunk.maxLength = 0;
+      const char *pos = chunk.begin;
+      const char *begin, *lineEnd;
+      FastaRecord *record = NULL;
+      while ( nextLine(pos, chunk.end, begin, lineEnd) ) {
+        if ( begin != lineEnd && *begin == '>' ) {
+          chunk.names.resize(chunk.names.size()+1);
+          readSeqName(begin, lineEnd, chunk.names.back());
+          chunk.records.push_back(FastaRecord());
+          record = &chunk.records.back();
+          record->first = NULL;
+          record->end = chunk.end;
+          record->length = 0;
+          record->numLines = 0;
+          continue;
+        }
+        if ( begin == lineEnd )
+          continue;
+        if ( record == NULL )
+          THROW_EXCEPTION("Malformed Fasta format, the line \"" << string(begin, lineEnd)
+                          << "\" comes before the first name");
+        const char *invalid = findInvalidChar(begin, lineEnd);
+        if ( invalid != lineEnd )
+          THROW_EXCEPTION("Malformed Fasta format, the char '" << *invalid << "' in the sequence \""
+                          << chunk.names.back() << "\" is not a nucleotide");
+        if ( record->numLines == 0 )
+          record->first = begin;
+        record->numLines++;
+        record->length += lineEnd-begin;
+        record->end = pos;
+        chunk.maxLength = max(chunk.maxLength, record->length);
       }
-    }
-  }
-  if ( seqStr.size() == 0 || seqStr.find_first_not_of("acgtumrwsykvhdbnxACGTUMRWSYKVHDBNX -.?") != string::npos ) {
-    THROW_EXCEPTION("Malformed Fasta format\n");
-    exit(EXIT_FAILURE);
-  } else {
-     Sequence &s = seqs[linesRead-1];
-     s.seq = seqStr;
-  }
+      for ( size_t r = 0 ; r < chunk.records.size() ; r++ ) {
+        if ( chunk.records[r].length == 0 )
+          THROW_EXCEPTION("Malformed Fasta format, the sequence \"" << chunk.names[r] << "\" is empty");
+      }
+    });
+
+  input.skipToEnd();
   return true;
 }
 
-
-bool
-FastaInputStream::readSequences(std::vector<Sequence> &seqs,  std::string & runId, Extrainfos &extrainfos) {
-
-  std::string line;
-  while ( getline ( *fp, line ) ) {
-      if ( line.size() > 0 && line[0] == '>' ) {
-        readSeq( seqs , line ,0 );        
-        return true;
+void
+FastaInputStream::forEachSequence(std::vector<FastaChunk> &chunks,
+                                  const std::function<void(size_t, const char *, size_t)> &func) {
+  std::vector<size_t> firstIndex(chunks.size()+1, 0);
+  for ( size_t c = 0 ; c < chunks.size() ; c++ )
+    firstIndex[c+1] = firstIndex[c] + chunks[c].records.size();
+
+  WorkStealingPool pool(numThreads);
+  pool.run(chunks.size(), [&](size_t c){
+      std::string chars;
+      for ( size_t r = 0 ; r < chunks[c].records.size() ; r++ ) {
+        const FastaRecord &record = chunks[c].records[r];
+        if ( record.numLines <= 1 ) {
+          func(firstIndex[c]+r, record.numLines == 0 ? "" : record.first, record.length);
+          continue;
+        }
+        //the lines are gathered as in readSeq()
+        chars.clear();
+        const char *pos = record.first;
+        const char *begin, *lineEnd;
+        while ( nextLine(pos, record.end, begin, lineEnd) )
+          chars.append(begin, lineEnd);
+        func(firstIndex[c]+r, chars.data(), chars.size());
       }
-  }
-     THROW_EXCEPTION("Malformed Fasta format\n");
-     exit(EXIT_FAILURE);
+    });
 }
-*/
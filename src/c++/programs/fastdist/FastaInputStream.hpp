@@ -2,55 +2,78 @@
 #define FASTAINPUTSTREAM_HPP
 
 #include "DataInputStream.hpp"
-
-#include <iostream>
-#include <fstream>
-
+#include "InputBuffer.hpp"
+
+#include <string>
+#include <vector>
+#include <functional>
+
+//
+// Reads all the sequences of a FASTA file as one data set.
+//
+// The lines come from an InputBuffer, i.e. straight from the mapped
+// file when it is a regular file, each char of a sequence is checked
+// once and read() packs every sequence into the PackedAlignment as
+// soon as it has been read. The time is linear in the size of the
+// file and no std::vector<Sequence> is built.
+//
+// A large mapped file is parsed on the threads given to
+// setNumThreads(): it is split into chunks at the beginnings of
+// sequences, the chunks are checked in parallel, which also gives the
+// longest sequence, and then the sequences of each chunk are packed
+// into their strings of the alignment in parallel.
+//
 class FastaInputStream : public DataInputStream
 {
 public:
   FastaInputStream(char * filename = NULL);
   ~FastaInputStream();
 
-  virtual bool read( std::vector<DNA_b128_String> &b128_strings, std::string & runId, std::vector<std::string> &names, Extrainfos &extrainfos );
-  virtual bool readSequences( std::vector<Sequence> &seqs, std::string & runId, Extrainfos &extrainfos );
-protected:
-
-  bool readSeq(std::vector<Sequence> &seqs, std::string &line, int linesRead);
-  bool readSeqName(std::vector<Sequence> &seqs, std::string &line, int linesRead);
-
-  std::istream * fp;
-  std::ifstream fin;
-  bool file_was_opened;
-};
-
-#endif // FASTAINPUTSTREAM_HPP
-
-/*#ifndef FASTAINPUTSTREAM_HPP
-#define FASTAINPUTSTREAM_HPP
-
-#include "DataInputStream.hpp"
-
-#include <iostream>
-#include <fstream>
-
-class FastaInputStream : public DataInputStream
-{
-public:
-  FastaInputStream(char * filename );
-  ~FastaInputStream();
-
-  virtual bool read( std::vector<DNA_b128_String> &b128_strings, std::string & runId, std::vector<std::string> &names, Extrainfos &extrainfos );
+  virtual bool read( PackedAlignment &b128_strings, std::string & runId, std::vector<std::string> &names, Extrainfos &extrainfos );
   virtual bool readSequences( std::vector<Sequence> &seqs, std::string & runId, Extrainfos &extrainfos );
+  virtual void setNumThreads(size_t numThreads);
 protected:
 
-  bool readSeq(std::vector<Sequence> &seqs, std::string &line, int linesRead);
-
-
-  std::istream * fp;
-  std::ifstream fin;
-  bool file_was_opened;
+  // The lines of a sequence in a mapped file, from the first line
+  // that is not empty to the end of its last line.
+  typedef struct{
+    const char *first;
+    const char *end;
+    size_t length;     //the number of chars of the sequence
+    size_t numLines;   //the number of lines that are not empty
+  } FastaRecord;
+
+  typedef struct{
+    const char *begin;
+    const char *end;
+    std::vector<std::string> names;
+    std::vector<FastaRecord> records;
+    size_t maxLength;
+  } FastaChunk;
+
+  // Splits a mapped file into chunks and checks them on the threads,
+  // false if the file is read a line at a time instead.
+  bool scanChunks(std::vector<FastaChunk> &chunks);
+  // Calls func(i, chars, length) for every sequence i of the chunks on
+  // the threads.
+  void forEachSequence(std::vector<FastaChunk> &chunks,
+                       const std::function<void(size_t, const char *, size_t)> &func);
+
+  // Reads the name and the chars of the next sequence, which are the
+  // seqLength chars at seq, false at the end of the file. seq points
+  // into the mapped file or into seqChars.
+  bool readSeq(std::string &name);
+  // The next line without the trailing white space.
+  bool readLine(const char *&begin, const char *&end);
+  void readSeqName(const char *begin, const char *end, std::string &name);
+
+  InputBuffer input;
+  size_t numThreads;
+  bool haveName;      //nextName was read from the line after a sequence
+  std::string nextName;
+  const char *seq;
+  size_t seqLength;
+  std::string seqChars;
 };
 
 #endif // FASTAINPUTSTREAM_HPP
-*/
@@ -2,22 +2,23 @@
 #define PHYLIPMAINPUTSTREAM_HPP
 
 #include "DataInputStream.hpp"
+#include "InputBuffer.hpp"
 #include <iostream>
-#include <fstream>
 
+// Reads PHYLIP alignments, sequential or interleaved, from an
+// InputBuffer in one pass, packing the lines straight from the mapped
+// file.
 class PhylipMaInputStream : public DataInputStream
 {
 public:
   PhylipMaInputStream(char * filename = NULL);
   ~PhylipMaInputStream();
 
-  virtual bool read( std::vector<DNA_b128_String> &b128_strings, std::string & runId, std::vector<std::string> &names, Extrainfos &extrainfos );
+  virtual bool read( PackedAlignment &b128_strings, std::string & runId, std::vector<std::string> &names, Extrainfos &extrainfos );
   virtual bool readSequences( std::vector<Sequence> &seqs, std::string & runId, Extrainfos &extrainfos );
 
 protected:
-  std::istream * fp;
-  std::ifstream fin;
-  bool file_was_opened;
+  InputBuffer input;
 };
 
 #endif // PHYLIPMAINPUTSTREAM_HPP
@@ -0,0 +1,90 @@
+//--------------------------------------------------
+//
+// File: SparseDmOutputStream.cpp
+//
+//--------------------------------------------------
+
+#include "SparseDmOutputStream.hpp"
+#include <algorithm>
+#include <math.h>
+#include <stdint.h>
+#include <string>
+#include "log_utils.hpp"
+
+using namespace std;
+
+SparseDmOutputStream::SparseDmOutputStream(char * filename, float maxDistance, size_t numNeighbors) :
+	DataOutputStream(filename), maxDistance(maxDistance), numNeighbors(numNeighbors)
+{
+}
+
+void
+SparseDmOutputStream::printStartRun(std::vector<std::string> & names, std::string & runId, Extrainfos &extrainfos) {
+	m_names = names;
+}
+
+void
+SparseDmOutputStream::print( StrDblMatrix & dm ) {
+	const size_t numNodes = dm.getSize();
+	printHeader(numNodes);
+	StrFloRow row(numNodes);
+	for ( size_t i = 0 ; i < numNodes ; i++ ){
+		for ( size_t j = 0 ; j < numNodes ; j++ )
+			row.setDistance(j, dm.getDistance(i,j));
+		printRow(row, dm.getIdentifier(i), i, numNeighbors != 0);
+	}
+}
+
+void
+SparseDmOutputStream::printRow( StrFloRow & dm, string name, int row, bool mem_eff_flag) {
+	if ( numNeighbors != 0 && ! mem_eff_flag )
+		PROG_ERROR("The nearest neighbors need the full rows");
+	const size_t numNodes = dm.getColumns();
+
+	pairs.clear();
+	for ( size_t j = ( mem_eff_flag ? 0 : row+1 ) ; j < numNodes ; j++ ){
+		const float f = dm.getDistance(j);
+		if ( j == (size_t) row || ! isfinite(f) || f < 0 || f > maxDistance )
+			continue;
+		pairs.push_back(make_pair(f,j));
+	}
+
+	//the closest first, the pairs of equal distances by column
+	if ( numNeighbors != 0 ){
+		const size_t num = min(numNeighbors, pairs.size());
+		partial_sort(pairs.begin(), pairs.begin()+num, pairs.end());
+		pairs.resize(num);
+	}
+	printPairs(row, pairs);
+}
+
+void
+TsvDmOutputStream::printPairs( size_t row, const std::vector<std::pair<float,size_t> > &pairs ) {
+	for ( size_t k = 0 ; k < pairs.size() ; k++ )
+		fprintf(fp,"%s\t%s\t%f\n", m_names[row].c_str(), m_names[pairs[k].second].c_str(), pairs[k].first);
+}
+
+void
+SparseBinaryDmOutputStream::printHeader( size_t numNodes ) {
+	//the same header as BinaryDmOutputStream with another tag
+	string tag = "FASTPHYLO SPARSE 1";
+	fwrite(tag.c_str(), sizeof(char), tag.length(), fp);
+	long converter = numNodes;
+	fwrite(&converter, sizeof converter, 1, fp);
+	for ( size_t i = 0 ; i < numNodes ; i++ ){
+		fwrite(m_names[i].c_str(), sizeof(char), m_names[i].length(), fp);
+		fwrite(":", sizeof(char), 1, fp);
+	}
+}
+
+void
+SparseBinaryDmOutputStream::printPairs( size_t row, const std::vector<std::pair<float,size_t> > &pairs ) {
+	uint32_t numPairs = pairs.size();
+	fwrite(&numPairs, sizeof numPairs, 1, fp);
+	for ( size_t k = 0 ; k < pairs.size() ; k++ ){
+		uint32_t column = pairs[k].second;
+		float f = pairs[k].first;
+		fwrite(&column, sizeof column, 1, fp);
+		fwrite(&f, sizeof f, 1, fp);
+	}
+}
@@ -0,0 +1,84 @@
+//--------------------------------------------------
+//
+// File: SparseDmOutputStream.hpp
+//
+//--------------------------------------------------
+
+#ifndef SPARSEDMOUTPUTSTREAM_HPP
+#define SPARSEDMOUTPUTSTREAM_HPP
+
+#include "DataOutputStream.hpp"
+#include <cstddef>
+#include <utility>
+
+//
+// Streams that only write some pairs of each row, e.g. for
+// clustering where the full matrix is never needed:
+//
+// - the pairs at a distance of at most maxDistance, and/or
+// - the numNeighbors closest neighbors of each sequence.
+//
+// With numNeighbors=0 every pair within maxDistance is written once,
+// from the row of the sequence with the lower index, and the rows only
+// need the distances after the diagonal. Otherwise the rows must be
+// full, mem_eff_flag=true, and the neighbors are written closest
+// first, ties broken by the lowest index. Distances that are not
+// finite or negative, i.e. saturated, are never written.
+//
+// TsvDmOutputStream writes one pair per line:
+//   name1<TAB>name2<TAB>distance
+//
+// SparseBinaryDmOutputStream writes the tag "FASTPHYLO SPARSE 1",
+// the number of sequences as a long and the names each followed by
+// ':', as BinaryDmOutputStream does, and then for each row the number
+// of its pairs as a uint32_t followed by each pair as the column,
+// uint32_t, and the distance, float.
+//
+class SparseDmOutputStream : public DataOutputStream
+{
+public:
+  SparseDmOutputStream(char * filename, float maxDistance, size_t numNeighbors);
+  virtual ~SparseDmOutputStream() {};
+  virtual void print( StrDblMatrix & dm );
+  virtual void printStartRun(std::vector<std::string> & names, std::string & runId, Extrainfos &extrainfos );
+  virtual void printEndRun() {};
+  virtual void printRow( StrFloRow & dm, std::string name, int row, bool mem_eff_flag);
+  virtual void printHeader( size_t numNodes ) {};
+  virtual void printBootstrapSpliter(size_t numNodes) {};
+
+protected:
+  // Writes the selected pairs of row, (distance, column).
+  virtual void printPairs( size_t row, const std::vector<std::pair<float,size_t> > &pairs )=0;
+
+  std::vector<std::string> m_names;
+
+private:
+  float maxDistance;
+  size_t numNeighbors;
+  std::vector<std::pair<float,size_t> > pairs;
+};
+
+class TsvDmOutputStream : public SparseDmOutputStream
+{
+public:
+  TsvDmOutputStream(char * filename, float maxDistance, size_t numNeighbors) :
+    SparseDmOutputStream(filename, maxDistance, numNeighbors) {};
+  virtual ~TsvDmOutputStream() {};
+
+protected:
+  virtual void printPairs( size_t row, const std::vector<std::pair<float,size_t> > &pairs );
+};
+
+class SparseBinaryDmOutputStream : public SparseDmOutputStream
+{
+public:
+  SparseBinaryDmOutputStream(char * filename, float maxDistance, size_t numNeighbors) :
+    SparseDmOutputStream(filename, maxDistance, numNeighbors) {};
+  virtual ~SparseBinaryDmOutputStream() {};
+  virtual void printHeader( size_t numNodes );
+
+protected:
+  virtual void printPairs( size_t row, const std::vector<std::pair<float,size_t> > &pairs );
+};
+
+#endif // SPARSEDMOUTPUTSTREAM_HPP
@@ -0,0 +1,80 @@
+//--------------------------------------------------
+//
+// File: TiledDmOutputStream.cpp
+//
+//--------------------------------------------------
+
+#include "TiledDmOutputStream.hpp"
+#include "log_utils.hpp"
+
+using namespace std;
+
+TiledDmOutputStream::TiledDmOutputStream(char * filename, size_t maxBytes) :
+	DataOutputStream(filename), maxBytes(maxBytes), writer(fp)
+{
+}
+
+void
+TiledDmOutputStream::printStartRun(std::vector<std::string> & names, std::string & runId, Extrainfos &extrainfos) {
+	m_names = names;
+}
+
+void
+TiledDmOutputStream::printHeader( size_t numNodes ) {
+	const size_t tileSide = TiledMatrixLayout::tileSideForMemory(numNodes, maxBytes, TILED_MAX_TILE_SIDE);
+	if ( tileSide == 0 )
+		THROW_EXCEPTION("One row of the " << numNodes << " sequences does not fit in the memory of the band, "
+				<< "see --max-memory");
+	writer.writeHeader(m_names, tileSide);
+	if ( numNodes > 0 )
+		band.resize(getLayout().bandSize(0));
+}
+
+float *
+TiledDmOutputStream::getTile( size_t tileBand ) {
+	return band.data() + getLayout().tileOffset(getBand(), tileBand);
+}
+
+void
+TiledDmOutputStream::printBand() {
+	writer.writeBand(band);
+	if ( getBand() < getLayout().getNumBands() )
+		band.resize(getLayout().bandSize(getBand()));
+}
+
+void
+TiledDmOutputStream::printRow( StrFloRow & dm, string name, int row, bool mem_eff_flag) {
+	const TiledMatrixLayout &layout = getLayout();
+	const size_t b = getBand();
+	const size_t begin = layout.bandBegin(b), end = layout.bandEnd(b);
+	if ( (size_t) row < begin || (size_t) row >= end )
+		PROG_ERROR("The rows of a tiled matrix must come in order");
+
+	const size_t r = row-begin;
+	for ( size_t tileBand = b ; tileBand < layout.getNumBands() ; tileBand++ ){
+		const size_t colBegin = layout.bandBegin(tileBand), colEnd = layout.bandEnd(tileBand);
+		float *tileRow = getTile(tileBand) + r*(colEnd-colBegin);
+		for ( size_t j = max(colBegin, (size_t) row) ; j < colEnd ; j++ )
+			tileRow[j-colBegin] = dm.getDistance(j);
+	}
+	//the pairs before the diagonal of the tile on the diagonal are in
+	//the rows before
+	float *diagonal = getTile(b);
+	for ( size_t j = begin ; j < (size_t) row ; j++ )
+		diagonal[r*(end-begin) + j-begin] = diagonal[(j-begin)*(end-begin) + r];
+
+	if ( (size_t) row+1 == end )
+		printBand();
+}
+
+void
+TiledDmOutputStream::print( StrDblMatrix & dm ) {
+	const size_t numNodes = dm.getSize();
+	printHeader(numNodes);
+	StrFloRow row(numNodes);
+	for ( size_t i = 0 ; i < numNodes ; i++ ){
+		for ( size_t j = i ; j < numNodes ; j++ )
+			row.setDistance(j, dm.getDistance(i,j));
+		printRow(row, dm.getIdentifier(i), i, false);
+	}
+}
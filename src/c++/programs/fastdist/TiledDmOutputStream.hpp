@@ -0,0 +1,55 @@
+//--------------------------------------------------
+//
+// File: TiledDmOutputStream.hpp
+//
+//--------------------------------------------------
+
+#ifndef TILEDDMOUTPUTSTREAM_HPP
+#define TILEDDMOUTPUTSTREAM_HPP
+
+#include "DataOutputStream.hpp"
+#include "TiledMatrixFile.hpp"
+#include <cstddef>
+
+//The largest side of the tiles, the side of the tiles when the memory
+//is not bounded.
+#define TILED_MAX_TILE_SIDE 256
+
+//
+// Writes the matrices in the tiled format of TiledMatrixFile.hpp with
+// one band of tiles in memory. The side of the tiles is chosen by
+// printHeader() so that the band takes at most maxBytes.
+//
+// The band is either filled a tile at a time, see getTile() and
+// printBand(), or by printRow() a row at a time, the rows coming in
+// order with at least the distances after the diagonal.
+//
+class TiledDmOutputStream : public DataOutputStream
+{
+public:
+  TiledDmOutputStream(char * filename, size_t maxBytes);
+  virtual ~TiledDmOutputStream() {};
+  virtual void print( StrDblMatrix & dm );
+  virtual void printStartRun(std::vector<std::string> & names, std::string & runId, Extrainfos &extrainfos );
+  virtual void printEndRun() {};
+  virtual void printRow( StrFloRow & dm, std::string name, int row, bool mem_eff_flag);
+  virtual void printHeader( size_t numNodes );
+  virtual void printBootstrapSpliter(size_t numNodes) {};
+
+  const TiledMatrixLayout &getLayout() const {return writer.getLayout();}
+  // The band that is filled now.
+  size_t getBand() const {return writer.getBand();}
+  // The tile of the columns of tileBand in the band, see
+  // TiledMatrixLayout.
+  float *getTile( size_t tileBand );
+  // Writes the band and starts the next one.
+  void printBand();
+
+private:
+  size_t maxBytes;
+  std::vector<std::string> m_names;
+  TiledMatrixWriter writer;
+  std::vector<float> band;
+};
+
+#endif // TILEDDMOUTPUTSTREAM_HPP
@@ -55,7 +55,7 @@ XmlInputStream::XmlInputStream(char * filename)
   }
 }
 
-bool XmlInputStream::read(  std::vector<DNA_b128_String> &b128seqs, std::string & runId, std::vector<std::string> &names, Extrainfos &extrainfos )  
+bool XmlInputStream::read(  PackedAlignment &b128seqs, std::string & runId, std::vector<std::string> &names, Extrainfos &extrainfos )  
 { 
   std::vector<Sequence> seqs;
   if ( ! readSequences(seqs, runId, extrainfos) ) return false;
@@ -28,7 +28,7 @@ public:
    XmlInputStream(char * filename = NULL);
   ~XmlInputStream();
 
-  virtual bool read( std::vector<DNA_b128_String> &b128_strings, std::string & runId, std::vector<std::string> &names, Extrainfos &extrainfos );
+  virtual bool read( PackedAlignment &b128_strings, std::string & runId, std::vector<std::string> &names, Extrainfos &extrainfos );
   virtual bool readSequences( std::vector<Sequence> &seqs, std::string & runId, Extrainfos &extrainfos );
 protected:
   xmlTextReaderPtr reader;
@@ -9,6 +9,8 @@
 ///////////////////////////////////////////////
 
 #include "Sequences2DistanceMatrix.hpp"
+#include "SitePatterns.hpp"
+#include "DuplicateSequences.hpp"
 
 #include <string>
 #include <iostream>
@@ -18,9 +20,11 @@
 
 #include "config.h"
 #include "file_utils.hpp"
+#include "thread_utils.hpp"
 #include <iomanip>
 #include "log_utils.hpp"
 #include "BinaryDmOutputStream.hpp"
+#include "BinaryDmInputStream.hpp"
 #include "fastdist_gengetopt.h"
 #include "NeighborJoining.hpp"
 #include "DataInputStream.hpp"
@@ -31,6 +35,12 @@
 #include "fileFormatSchema.hpp"
 #include "XmlOutputStream.hpp"
 #include "PhylipDmOutputStream.hpp"
+#include "SparseDmOutputStream.hpp"
+#include "TiledDmOutputStream.hpp"
+#include <float.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
 
 #ifdef WITH_LIBXML
 #include "XmlInputStream.hpp"
@@ -38,6 +48,109 @@
 
 using namespace std;
 
+//Reads the next data set into b128seqs. If sitePatterns is set the
+//columns are compressed into site patterns weighted by siteWeights,
+//unless the sequences have different lengths, which are read as they
+//are with a warning.
+static bool
+readAlignment(DataInputStream *istream, bool sitePatterns, PackedAlignment &b128seqs, SiteWeights &siteWeights,
+		std::string &runId, std::vector<std::string> &names, Extrainfos &extrainfos){
+	if ( ! sitePatterns )
+		return istream->read(b128seqs,runId,names,extrainfos);
+
+	std::vector<Sequence> seqs;
+	if ( ! istream->readSequences(seqs,runId,extrainfos) )
+		return false;
+	names.clear();names.reserve(seqs.size());
+	for( size_t i=0;i<seqs.size();i++)
+		names.push_back(seqs[i].name);
+	for( size_t i=1;i<seqs.size();i++){
+		if ( seqs[i].seq.length() != seqs[0].seq.length() ){
+			cerr << "warning: --site-patterns is ignored, " << seqs[i].name << " has length " << seqs[i].seq.length()
+				<< " and " << seqs[0].name << " has length " << seqs[0].seq.length() << endl;
+			Sequences2DNA_b128(seqs,b128seqs);
+			return true;
+		}
+	}
+	compressSitePatterns(seqs,b128seqs,siteWeights);
+	return true;
+}
+
+//The matrices of b128seqs computed between one representative of each
+//set of identical sequences, see DuplicateSequences.hpp. The matrices
+//are expanded to all the sequences unless compact is set, in which
+//case names are replaced by the names of the representatives.
+static void
+fillCollapsedMatrices(std::vector<StrDblMatrix> &dms, PackedAlignment &b128seqs, std::vector<std::string> &names,
+		const std::vector<sequence_translation_model> &trans_models, size_t numThreads, bool compact){
+	DuplicateSequences duplicates;
+	duplicates.find(b128seqs);
+	PackedAlignment representatives;
+	representatives.assign(b128seqs, duplicates.getRepresentativeSequences());
+	const std::vector<size_t> &multiplicities = duplicates.getMultiplicities();
+
+	if ( compact ){
+		fillMatrices(dms, representatives, trans_models, numThreads, &multiplicities);
+		std::vector<std::string> joined;
+		duplicates.joinNames(names, joined);
+		names.swap(joined);
+		return;
+	}
+
+	std::vector<std::vector<float> > duplicateDists(trans_models.size());
+	for ( size_t m = 0 ; m < trans_models.size() ; m++ )
+		fillDuplicateDistances(duplicateDists[m], representatives, trans_models[m], &multiplicities);
+	std::vector<StrDblMatrix> repdms;
+	fillMatrices(repdms, representatives, trans_models, numThreads, &multiplicities);
+	dms.resize(trans_models.size());
+	for ( size_t m = 0 ; m < trans_models.size() ; m++ )
+		duplicates.expand(repdms[m], duplicateDists[m], dms[m]);
+}
+
+//Prints the rows of b128seqs computed as in fillCollapsedMatrices().
+static void
+printCollapsedRows(DataOutputStream *ostream, PackedAlignment &b128seqs, std::vector<std::string> &names,
+		std::string &runId, Extrainfos &extrainfos, const sequence_translation_model &trans_model,
+		size_t numThreads, bool mem_eff_flag, bool compact, bool useFixFactor, float fixfactor){
+	DuplicateSequences duplicates;
+	duplicates.find(b128seqs);
+	PackedAlignment representatives;
+	representatives.assign(b128seqs, duplicates.getRepresentativeSequences());
+	const std::vector<size_t> &multiplicities = duplicates.getMultiplicities();
+	std::vector<float> duplicateDists;
+	fillDuplicateDistances(duplicateDists, representatives, trans_model, &multiplicities);
+	AlignmentContext context;
+	context.prepareRows(representatives, trans_model, numThreads, &multiplicities);
+	StrFloRow reprow, row;
+
+	if ( compact ){
+		std::vector<std::string> joined;
+		duplicates.joinNames(names, joined);
+		ostream->printStartRun(joined,runId,extrainfos);
+		ostream->printHeader(joined.size());
+		for ( size_t r = 0 ; r < joined.size() ; r++ ){
+			fillMatrixRow(reprow, representatives, context, trans_model, r, mem_eff_flag);
+			reprow.setIdentifier(joined[r]);
+			if(useFixFactor) applyFixFactorRow(reprow,fixfactor);
+			ostream->printRow(reprow, joined[r], r, mem_eff_flag);
+		}
+		return;
+	}
+
+	ostream->printStartRun(names,runId,extrainfos);
+	ostream->printHeader(names.size());
+	for ( size_t i = 0 ; i < names.size() ; i++ ){
+		//without the memory efficient mode the row of the representative
+		//is only needed for the sequences after i
+		const size_t first = ( mem_eff_flag ? 0 : duplicates.getFirstColumn(i) );
+		fillMatrixRowFrom(reprow, representatives, context, trans_model, duplicates.getRepresentative(i), first);
+		duplicates.expandRow(reprow, duplicateDists, i, mem_eff_flag, row);
+		row.setIdentifier(names[i]);
+		if(useFixFactor) applyFixFactorRow(row,fixfactor);
+		ostream->printRow(row, names[i], i, mem_eff_flag);
+	}
+}
+
 int
 main(int argc,
 		char **argv){
@@ -72,14 +185,36 @@ main(int argc,
 	//-----------------------------------------------------
 	// EVOLUTIONARY MODEL
 
-	switch ( args_info.distance_function_arg )
-	{
-	case distance_function_arg_JC : trans_model.model = JC; break;
-	case distance_function_arg_K2P : trans_model.model = K2P; break;
-	case distance_function_arg_TN93 : trans_model.model = TN93; break;
-	case distance_function_arg_HAMMING : trans_model.model = HAMMING_DISTANCE; break;
-	default: cerr << "error: model chosen not available" << endl; exit(EXIT_FAILURE);
+	//one model for each time --distance-function is given
+	std::vector<sequence_model> models;
+	for ( unsigned int k = 0 ; k < args_info.distance_function_given ; k++ ){
+		switch ( args_info.distance_function_arg[k] )
+		{
+		case distance_function_arg_JC : models.push_back(JC); break;
+		case distance_function_arg_K2P : models.push_back(K2P); break;
+		case distance_function_arg_TN93 : models.push_back(TN93); break;
+		case distance_function_arg_HAMMING : models.push_back(HAMMING_DISTANCE); break;
+		default: cerr << "error: model chosen not available" << endl; exit(EXIT_FAILURE);
+		}
+		for ( unsigned int l = 0 ; l < k ; l++ )
+			if ( models[l] == models[k] ) {
+				cerr << "error: --distance-function " << args_info.distance_function_orig[k] << " is given twice" << endl; exit(EXIT_FAILURE);
+			}
+	}
+	if ( models.empty() )
+		models.push_back(K2P);
+
+	if ( models.size() > 1 ) {
+		if ( ! args_info.outfile_given ) {
+			cerr << "error: several distance functions can only be used together with --outfile" << endl; exit(EXIT_FAILURE);
+		}
+		if ( args_info.memory_efficient_given || args_info.output_format_arg == output_format_arg_binary
+				|| args_info.output_format_arg == output_format_arg_tsv || args_info.output_format_arg == output_format_arg_sparse
+				|| args_info.output_format_arg == output_format_arg_tiled ) {
+			cerr << "error: several distance functions can not be used with --memory-efficient or --output-format=binary, tsv, sparse or tiled" << endl; exit(EXIT_FAILURE);
+		}
 	}
+	trans_model.model = models[0];
 
 	trans_model.no_tstvratio = args_info.no_tstvratio_given;
 	trans_model.tstvratio = args_info.tstvratio_arg;
@@ -90,10 +225,14 @@ main(int argc,
 	int numboot = args_info.bootstraps_arg;
 	bool no_incl_orig = args_info.no_incl_orig_given;
 
+	//every replicate draws its columns from its own random stream
+	uint64_t seed;
 	if ( args_info.seed_given )
-		srand((unsigned int )args_info.seed_arg);
+		seed = (unsigned int) args_info.seed_arg;
 	else
-		srand((unsigned int)time(NULL));
+		seed = (unsigned int) time(NULL);
+	//the number of replicates of the previous data sets
+	uint64_t firstReplicate = 0;
 
 	//-----------------------------------------------
 	// AMBIGUITIES
@@ -108,10 +247,93 @@ main(int argc,
 	case ambiguity_frequency_model_arg_BASE : trans_model.use_base_freqs = true; break;
 	default: cerr << "programming error 2..." << endl; exit(EXIT_FAILURE);
 	}
+	//the models only differ in the correction formula
+	std::vector<sequence_translation_model> trans_models(models.size(), trans_model);
+	for ( size_t m = 0 ; m < models.size() ; m++ )
+		trans_models[m].model = models[m];
+
 	bool useFixFactor = args_info.fixfactor_given;
 	float fixfactor=args_info.fixfactor_arg;
 	int ndatasets = args_info.number_of_runs_arg;
 
+	//-----------------------------------------------
+	// THREADS
+	if ( args_info.threads_arg < 0 ) {
+		cerr << "Error: the number of threads can not be negative" << endl;
+		exit(EXIT_FAILURE);
+	}
+	size_t numThreads = args_info.threads_arg;
+	if ( numThreads == 0 )
+		numThreads = WorkStealingPool::hardwareConcurrency();
+
+	//-----------------------------------------------
+	// SITE PATTERNS
+	bool sitePatterns = args_info.site_patterns_given;
+
+	//-----------------------------------------------
+	// DUPLICATE SEQUENCES
+	bool compactDuplicates = args_info.compact_duplicates_given;
+	bool collapseDuplicates = args_info.collapse_duplicates_given || compactDuplicates;
+	if ( collapseDuplicates && ( numboot > 0 || no_incl_orig ) ) {
+		cerr << "error: --collapse-duplicates and --compact-duplicates can not be used with --bootstraps or --no-incl-orig" << endl; exit(EXIT_FAILURE);
+	}
+
+	//-----------------------------------------------
+	// SPARSE OUTPUT
+	bool sparseOutput = ( args_info.output_format_arg == output_format_arg_tsv || args_info.output_format_arg == output_format_arg_sparse );
+	if ( ( args_info.max_distance_given || args_info.nearest_neighbors_given ) && ! sparseOutput ) {
+		cerr << "error: --max-distance and --nearest-neighbors can only be used together with --output-format=tsv or sparse" << endl; exit(EXIT_FAILURE);
+	}
+	if ( sparseOutput && ( numboot > 0 || no_incl_orig || useFixFactor ) ) {
+		cerr << "error: --output-format=tsv or sparse can not be used with --bootstraps, --no-incl-orig or --fixfactor" << endl; exit(EXIT_FAILURE);
+	}
+	float maxDistance = FLT_MAX;
+	if ( args_info.max_distance_given ) {
+		if ( ! ( args_info.max_distance_arg >= 0 ) ) {
+			cerr << "error: --max-distance can not be negative" << endl; exit(EXIT_FAILURE);
+		}
+		maxDistance = args_info.max_distance_arg;
+	}
+	size_t numNeighbors = 0;
+	if ( args_info.nearest_neighbors_given ) {
+		if ( args_info.nearest_neighbors_arg <= 0 ) {
+			cerr << "error: --nearest-neighbors must be positive" << endl; exit(EXIT_FAILURE);
+		}
+		numNeighbors = args_info.nearest_neighbors_arg;
+	}
+
+	//-----------------------------------------------
+	// TILED OUTPUT
+	bool tiledOutput = ( args_info.output_format_arg == output_format_arg_tiled );
+	if ( args_info.max_memory_given && ! tiledOutput ) {
+		cerr << "error: --max-memory can only be used together with --output-format=tiled" << endl; exit(EXIT_FAILURE);
+	}
+	if ( tiledOutput && ( numboot > 0 || no_incl_orig || useFixFactor ) ) {
+		cerr << "error: --output-format=tiled can not be used with --bootstraps, --no-incl-orig or --fixfactor" << endl; exit(EXIT_FAILURE);
+	}
+	size_t maxMemory = SIZE_MAX;
+	if ( args_info.max_memory_given ) {
+		if ( args_info.max_memory_arg <= 0 ) {
+			cerr << "error: --max-memory must be positive" << endl; exit(EXIT_FAILURE);
+		}
+		maxMemory = ((size_t) args_info.max_memory_arg) << 20;
+	}
+
+	//-----------------------------------------------
+	// APPEND
+	char *appendFilename = ( args_info.append_given ? args_info.append_arg : NULL );
+	if ( appendFilename != NULL ) {
+		if ( args_info.output_format_arg != output_format_arg_binary || ! args_info.outfile_given ) {
+			cerr << "error: --append can only be used together with --output-format=binary and --outfile" << endl; exit(EXIT_FAILURE);
+		}
+		if ( strcmp(appendFilename, args_info.outfile_arg) == 0 ) {
+			cerr << "error: --append can not be the same file as --outfile" << endl; exit(EXIT_FAILURE);
+		}
+		if ( numboot > 0 || no_incl_orig || useFixFactor || collapseDuplicates ) {
+			cerr << "error: --append can not be used with --bootstraps, --no-incl-orig, --fixfactor, --collapse-duplicates or --compact-duplicates" << endl; exit(EXIT_FAILURE);
+		}
+	}
+
 	//FINNISHED PARSING ARGS
 	//---------------------------------------------------------
 	// START BUILING MATRICES
@@ -123,6 +345,8 @@ main(int argc,
 
 		DataInputStream *istream;
 		DataOutputStream *ostream;
+		//one stream for each model, ostreams[0] is ostream
+		std::vector<DataOutputStream*> ostreams;
 
 		switch( args_info.inputs_num )
 		  {
@@ -143,25 +367,200 @@ main(int argc,
 #endif // WITH_LIBXML
 		default: exit(EXIT_FAILURE);
 		}
+		istream->setNumThreads(numThreads);
 
-		switch ( args_info.output_format_arg )
+		for ( size_t m = 0 ; m < models.size() ; m++ )
 		{
-		case output_format_arg_phylip: ostream = new PhylipDmOutputStream(outputfilename);  break;
-		case output_format_arg_xml: ostream = new XmlOutputStream(outputfilename); break;
-		//Mehmood's Changes here : email: malagori@kth.se
-		case output_format_arg_binary: ostream = new BinaryDmOutputStream(outputfilename); break;
-		default: exit(EXIT_FAILURE);
+			std::string modelfilename;
+			char * filename = outputfilename;
+			if ( models.size() > 1 ) {
+				modelfilename = std::string(outputfilename) + "." + args_info.distance_function_orig[m];
+				filename = (char *) modelfilename.c_str();
+			}
+			switch ( args_info.output_format_arg )
+			{
+			case output_format_arg_phylip: ostream = new PhylipDmOutputStream(filename);  break;
+			case output_format_arg_xml: ostream = new XmlOutputStream(filename); break;
+			//Mehmood's Changes here : email: malagori@kth.se
+			case output_format_arg_binary: ostream = new BinaryDmOutputStream(filename); break;
+			case output_format_arg_tsv: ostream = new TsvDmOutputStream(filename, maxDistance, numNeighbors); break;
+			case output_format_arg_sparse: ostream = new SparseBinaryDmOutputStream(filename, maxDistance, numNeighbors); break;
+			case output_format_arg_tiled: ostream = new TiledDmOutputStream(filename, maxMemory); break;
+			default: exit(EXIT_FAILURE);
+			}
+			ostreams.push_back(ostream);
 		}
+		ostream = ostreams[0];
 
+		if ( sparseOutput ) {
+			//only the selected pairs of each row are written, see
+			//SparseDmOutputStream.hpp
+			std::vector<string> names;
+			PackedAlignment b128seqs;
+			SiteWeights siteWeights;
+			AlignmentContext context;
+			Extrainfos extrainfos;
+			//the nearest neighbors are found in the full rows, otherwise
+			//each pair is written from the row of its lower index
+			const bool fullRows = ( numNeighbors != 0 );
+			//the rows are computed in batches on the threads and written in order
+			std::vector<StrFloRow> rows(4*numThreads);
+			WorkStealingPool pool(numThreads);
+
+			for ( int ds = 0 ; ds < ndatasets || args_info.input_format_arg == input_format_arg_xml ; ds++ ){
+				std::string runId("");
+				if ( ! readAlignment(istream,sitePatterns,b128seqs,siteWeights,runId,names,extrainfos)) break;
+				if ( collapseDuplicates ){
+					printCollapsedRows(ostream, b128seqs, names, runId, extrainfos, trans_model, numThreads,
+							fullRows, compactDuplicates, false, fixfactor);
+				}
+				else{
+					const size_t numberOfSequences = b128seqs.size();
+					ostream->printStartRun(names,runId,extrainfos);
+					ostream->printHeader(numberOfSequences);
+
+					context.prepareRows(b128seqs, trans_model, numThreads);
+					for ( size_t first = 0 ; first < numberOfSequences ; first += rows.size() ){
+						const size_t batch = min(rows.size(), numberOfSequences - first);
+						pool.run(batch, [&](size_t k){
+							const size_t i = first + k;
+							fillMatrixRowWithin(rows[k], b128seqs, context, trans_model, i, ( fullRows ? 0 : i+1 ), maxDistance);
+						});
+						for ( size_t k = 0 ; k < batch ; k++ )
+							ostream->printRow(rows[k], names.at(first+k), first+k, fullRows);
+					}
+				}
+				ostream->printEndRun();
+			}//end data set loop
+		}
+		else if ( tiledOutput ) {
+			//the matrix is computed and written a band of tiles at a
+			//time, see TiledDmOutputStream.hpp
+			TiledDmOutputStream *tiledStream = (TiledDmOutputStream *) ostream;
+			std::vector<string> names;
+			PackedAlignment b128seqs;
+			SiteWeights siteWeights;
+			AlignmentContext context;
+			Extrainfos extrainfos;
+			WorkStealingPool pool(numThreads);
+
+			for ( int ds = 0 ; ds < ndatasets || args_info.input_format_arg == input_format_arg_xml ; ds++ ){
+				std::string runId("");
+				if ( ! readAlignment(istream,sitePatterns,b128seqs,siteWeights,runId,names,extrainfos)) break;
+				if ( collapseDuplicates ){
+					printCollapsedRows(ostream, b128seqs, names, runId, extrainfos, trans_model, numThreads,
+							false, compactDuplicates, false, fixfactor);
+				}
+				else{
+					ostream->printStartRun(names,runId,extrainfos);
+					ostream->printHeader(b128seqs.size());
+
+					context.prepareRows(b128seqs, trans_model, numThreads);
+					const TiledMatrixLayout &layout = tiledStream->getLayout();
+					for ( size_t b = 0 ; b < layout.getNumBands() ; b++ ){
+						const size_t rowBegin = layout.bandBegin(b), rowEnd = layout.bandEnd(b);
+						//the tiles are split in parts of rows so that the last
+						//bands, with few tiles, keep the threads busy as well
+						const size_t numTiles = layout.getNumBands()-b;
+						const size_t numParts = min(rowEnd-rowBegin, (4*numThreads+numTiles-1)/numTiles);
+						const size_t partRows = (rowEnd-rowBegin+numParts-1)/numParts;
+						pool.run(numTiles*numParts, [&](size_t k){
+							const size_t tileBand = b + k/numParts;
+							const size_t colBegin = layout.bandBegin(tileBand), colEnd = layout.bandEnd(tileBand);
+							const size_t partBegin = min(rowEnd, rowBegin + (k%numParts)*partRows);
+							const size_t partEnd = min(rowEnd, partBegin + partRows);
+							fillTile(tiledStream->getTile(tileBand) + (partBegin-rowBegin)*(colEnd-colBegin), b128seqs, context,
+									trans_model, partBegin, partEnd, colBegin, colEnd);
+						});
+						tiledStream->printBand();
+					}
+				}
+				ostream->printEndRun();
+			}//end data set loop
+		}
+		else if ( appendFilename != NULL ) {
+			//only the rows of the sequences after the ones of the old
+			//matrix are computed. The old rows are read one at a time and
+			//extended with the distances to the new sequences.
+			std::vector<string> names, oldNames;
+			PackedAlignment b128seqs;
+			SiteWeights siteWeights;
+			AlignmentContext context;
+			Extrainfos extrainfos;
+			std::string runId("");
+			if ( readAlignment(istream,sitePatterns,b128seqs,siteWeights,runId,names,extrainfos) ){
+				BinaryDmInputStream oldMatrix(appendFilename);
+				oldMatrix.readHeader(oldNames);
+				const size_t numberOfSequences = b128seqs.size();
+				const size_t numOld = oldNames.size();
+				if ( numOld > numberOfSequences || ! equal(oldNames.begin(), oldNames.end(), names.begin()) )
+					THROW_EXCEPTION("The sequences of \"" << appendFilename << "\" are not the first sequences of the alignment");
+
+				//only the appended sequences are resolved against all the
+				//others, the old ones from their closest old neighbor as
+				//their rows are read, see fillAppendedRow()
+				context.prepareAppendedRows(b128seqs, trans_model, numOld, numThreads);
+				std::vector<StrFloRow> newRows(numberOfSequences-numOld);
+				WorkStealingPool pool(numThreads);
+				pool.run(newRows.size(), [&](size_t k){
+					fillMatrixRowFrom(newRows[k], b128seqs, context, trans_model, numOld+k, numOld);
+				});
+
+				ostream->printStartRun(names,runId,extrainfos);
+				ostream->printHeader(numberOfSequences);
+				//the closest old neighbor of every old sequence, complete
+				//once its row is read since the matrix file holds the
+				//upper triangle
+				std::vector<size_t> oldNeighbors(numOld);
+				std::vector<float> oldNeighborDistances(numOld, FLT_MAX);
+				for ( size_t i = 0 ; i < numOld ; i++ )
+					oldNeighbors[i] = i;
+				std::vector<StrFloRow> rows(min(numOld, 16*numThreads), StrFloRow(numberOfSequences));
+				for ( size_t begin = 0 ; begin < numOld ; begin += rows.size() ){
+					const size_t end = min(numOld, begin+rows.size());
+					for ( size_t i = begin ; i < end ; i++ ){
+						StrFloRow &dm = rows[i-begin];
+						if ( ! oldMatrix.readRow(dm) )
+							THROW_EXCEPTION("The matrix \"" << appendFilename << "\" ends after " << i << " rows");
+						for ( size_t j = i+1 ; j < numOld ; j++ ){
+							const float dist = dm.getDistance(j);
+							if ( dist >= 0 && dist < oldNeighborDistances[i] ){
+								oldNeighborDistances[i] = dist;
+								oldNeighbors[i] = j;
+							}
+							if ( dist >= 0 && dist < oldNeighborDistances[j] ){
+								oldNeighborDistances[j] = dist;
+								oldNeighbors[j] = i;
+							}
+						}
+					}
+					pool.run(end-begin, [&](size_t r){
+						const size_t i = begin+r;
+						fillAppendedRow(rows[r], b128seqs, context, trans_model, i, numOld, oldNeighbors[i]);
+						for ( size_t k = 0 ; k < newRows.size() ; k++ )
+							newRows[k].setDistance(i, rows[r].getDistance(numOld+k));
+					});
+					for ( size_t i = begin ; i < end ; i++ )
+						ostream->printRow(rows[i-begin], names.at(i), i, false);
+				}
+				for ( size_t k = 0 ; k < newRows.size() ; k++ )
+					ostream->printRow(newRows[k], names.at(numOld+k), numOld+k, false);
+				ostream->printEndRun();
+			}
+		}
 		//Mehmood's Changes here : email: malagori@kth.se
-		if (args_info.output_format_arg == output_format_arg_binary ) {
+		else if (args_info.output_format_arg == output_format_arg_binary ) {
 			StrFloRow dm;
 			//open infile
 
 			// THE DATA WE WILL PROCESS
 			std::vector<Sequence> seqs;
 			std::vector<string> names;
-			std::vector<DNA_b128_String> b128seqs;
+			PackedAlignment b128seqs;
+			SiteWeights siteWeights;
+			SitePatternBootstrap bootstrap;
+			SitePatternReplicate replicate;
+			AlignmentContext context;
 
 			Extrainfos extrainfos;
 
@@ -172,19 +571,25 @@ main(int argc,
 				//no bootstrapping
 				std::string runId("");
 				if ( !no_incl_orig && numboot == 0){//only need to create one distance matrix
-					if ( ! istream->read(b128seqs,runId,names,extrainfos)) {
+					if ( ! readAlignment(istream,sitePatterns,b128seqs,siteWeights,runId,names,extrainfos)) {
 						break;
 					}
+					if ( collapseDuplicates ){
+						printCollapsedRows(ostream, b128seqs, names, runId, extrainfos, trans_model, numThreads,
+								false, compactDuplicates, useFixFactor, fixfactor);
+					}
+					else{
+						const size_t numberOfSequences = b128seqs.size();
+						ostream->printStartRun(names,runId,extrainfos);
+						ostream->printHeader(numberOfSequences);
 
-					const size_t numberOfSequences = b128seqs.size();
-					ostream->printStartRun(names,runId,extrainfos);
-					ostream->printHeader(numberOfSequences);
-
-					for(size_t i = 0; i < numberOfSequences; ++i){
-						fillMatrixRow(dm, b128seqs, trans_model, i, false);
-						dm.setIdentifier(names.at(i));
-						if(useFixFactor) applyFixFactorRow(dm,fixfactor);
-						ostream->printRow(dm, names.at(i), i, false);
+						context.prepareRows(b128seqs, trans_model, numThreads);
+						for(size_t i = 0; i < numberOfSequences; ++i){
+							fillMatrixRow(dm, b128seqs, context, trans_model, i, false);
+							dm.setIdentifier(names.at(i));
+							if(useFixFactor) applyFixFactorRow(dm,fixfactor);
+							ostream->printRow(dm, names.at(i), i, false);
+						}
 					}
 				}
 				//bootstrapping
@@ -201,10 +606,11 @@ main(int argc,
 					const size_t numberOfSequences = seqs.size();
 					ostream->printStartRun(names,runId,extrainfos);
 					ostream->printHeader(numberOfSequences);
+					bootstrap.reInitiate(seqs);
 					if ( !no_incl_orig ){//create the distance matrix for the original sequences
-						Sequences2DNA_b128(seqs,b128seqs);
+						context.prepareRows(bootstrap.getPatterns(), trans_model, numThreads);
 						for(size_t i = 0; i < numberOfSequences; ++i){
-							fillMatrixRow(dm, b128seqs, trans_model, i, false);
+							fillMatrixRow(dm, bootstrap.getPatterns(), context, trans_model, i, false);
 							dm.setIdentifier(names.at(i));
 							if(useFixFactor) applyFixFactorRow(dm,fixfactor);
 							ostream->printRow(dm, names.at(i), i, false);
@@ -213,16 +619,18 @@ main(int argc,
 					//start the bootstrapping
 					//	  vector<Sequence> bootsequences;
 					for ( int b = 0 ; b < numboot ; b++ ){
-						bootstrapSequences(seqs,b128seqs);
+						bootstrap.drawReplicate(ReplicateRandom(seed, firstReplicate + b), replicate);
 						std::cout << numberOfSequences << std::endl;
 						ostream->printBootstrapSpliter(numberOfSequences);
+						context.prepareRows(replicate.getPatterns(), trans_model, numThreads);
 						for(size_t i = 0; i < numberOfSequences; ++i){
-							fillMatrixRow(dm, b128seqs, trans_model, i, false);
+							fillMatrixRow(dm, replicate.getPatterns(), context, trans_model, i, false);
 							dm.setIdentifier(names.at(i));
 							if(useFixFactor) applyFixFactorRow(dm,fixfactor);
 							ostream->printRow(dm, names.at(i), i,false);
 						}
 					}
+					firstReplicate += numboot;
 				}
 				ostream->printEndRun();
 			}//end data set loop
@@ -233,7 +641,11 @@ main(int argc,
 						// THE DATA WE WILL PROCESS
 						std::vector<Sequence> seqs;
 						std::vector<string> names;
-						std::vector<DNA_b128_String> b128seqs;
+						PackedAlignment b128seqs;
+						SiteWeights siteWeights;
+						SitePatternBootstrap bootstrap;
+						SitePatternReplicate replicate;
+						AlignmentContext context;
 
 						Extrainfos extrainfos;
 
@@ -244,19 +656,25 @@ main(int argc,
 							//no bootstrapping
 							std::string runId("");
 							if ( !no_incl_orig && numboot == 0){//only need to create one distance matrix
-								if ( ! istream->read(b128seqs,runId,names,extrainfos)) {
+								if ( ! readAlignment(istream,sitePatterns,b128seqs,siteWeights,runId,names,extrainfos)) {
 									break;
 								}
+								if ( collapseDuplicates ){
+									printCollapsedRows(ostream, b128seqs, names, runId, extrainfos, trans_model, numThreads,
+											true, compactDuplicates, useFixFactor, fixfactor);
+								}
+								else{
+									const size_t numberOfSequences = b128seqs.size();
+									ostream->printStartRun(names,runId,extrainfos);
+									ostream->printHeader(numberOfSequences);
 
-								const size_t numberOfSequences = b128seqs.size();
-								ostream->printStartRun(names,runId,extrainfos);
-								ostream->printHeader(numberOfSequences);
-
-								for(size_t i = 0; i < numberOfSequences; ++i){
-									fillMatrixRow(dm, b128seqs, trans_model, i, true);
-									dm.setIdentifier(names.at(i));
-									if(useFixFactor) applyFixFactorRow(dm,fixfactor);
-									ostream->printRow(dm, names.at(i), i, true);
+									context.prepareRows(b128seqs, trans_model, numThreads);
+									for(size_t i = 0; i < numberOfSequences; ++i){
+										fillMatrixRow(dm, b128seqs, context, trans_model, i, true);
+										dm.setIdentifier(names.at(i));
+										if(useFixFactor) applyFixFactorRow(dm,fixfactor);
+										ostream->printRow(dm, names.at(i), i, true);
+									}
 								}
 							}
 							//bootstrapping
@@ -273,10 +691,11 @@ main(int argc,
 								const size_t numberOfSequences = seqs.size();
 								ostream->printStartRun(names,runId,extrainfos);
 								ostream->printHeader(numberOfSequences);
+								bootstrap.reInitiate(seqs);
 								if ( !no_incl_orig ){//create the distance matrix for the original sequences
-									Sequences2DNA_b128(seqs,b128seqs);
+									context.prepareRows(bootstrap.getPatterns(), trans_model, numThreads);
 									for(size_t i = 0; i < numberOfSequences; ++i){
-										fillMatrixRow(dm, b128seqs, trans_model, i, true);
+										fillMatrixRow(dm, bootstrap.getPatterns(), context, trans_model, i, true);
 										dm.setIdentifier(names.at(i));
 										if(useFixFactor) applyFixFactorRow(dm,fixfactor);
 										ostream->printRow(dm, names.at(i), i, true);
@@ -285,27 +704,34 @@ main(int argc,
 								//start the bootstrapping
 								//	  vector<Sequence> bootsequences;
 								for ( int b = 0 ; b < numboot ; b++ ){
-									bootstrapSequences(seqs,b128seqs);
+									bootstrap.drawReplicate(ReplicateRandom(seed, firstReplicate + b), replicate);
 									std::cout << numberOfSequences << std::endl;
 									ostream->printBootstrapSpliter(numberOfSequences);
+									context.prepareRows(replicate.getPatterns(), trans_model, numThreads);
 									for(size_t i = 0; i < numberOfSequences; ++i){
-										fillMatrixRow(dm, b128seqs, trans_model, i, true);
+										fillMatrixRow(dm, replicate.getPatterns(), context, trans_model, i, true);
 										dm.setIdentifier(names.at(i));
 										if(useFixFactor) applyFixFactorRow(dm,fixfactor);
 										ostream->printRow(dm, names.at(i), i, true);
 									}
 								}
+								firstReplicate += numboot;
 							}
 							ostream->printEndRun();
 						}//end data set loop
 		}
 		else{
-			StrDblMatrix dm;
+			//dms[m] is the matrix of trans_models[m]
+			std::vector<StrDblMatrix> dms;
 			//open infile
 			// THE DATA WE WILL PROCESS
 			std::vector<Sequence> seqs;
 			std::vector<string> names;
-			std::vector<DNA_b128_String> b128seqs;
+			PackedAlignment b128seqs;
+			SiteWeights siteWeights;
+			SitePatternBootstrap bootstrap;
+			std::vector<SitePatternReplicate> replicates(max((size_t) 1, min((size_t) max(numboot,0), numThreads)));
+			std::vector<std::vector<StrDblMatrix> > bootMatrices(replicates.size());
 			Extrainfos extrainfos;
 
 			//for each dataset in the files
@@ -313,14 +739,19 @@ main(int argc,
 				//no bootstrapping
 				std::string runId("");
 				if ( !no_incl_orig && numboot == 0){//only need to create one distance matrix
-					if ( ! istream->read(b128seqs,runId,names,extrainfos)) break;
-					fillMatrix(dm, b128seqs, trans_model);
-					ostream->printStartRun(names,runId,extrainfos);
-					//          freeXmlStrings(extrainfos);
-					dm.setIdentifiers(names);
-					if(useFixFactor) applyFixFactor(dm,fixfactor);
-					//	  output << dm;
-					ostream->print(dm);
+					if ( ! readAlignment(istream,sitePatterns,b128seqs,siteWeights,runId,names,extrainfos)) break;
+					if ( collapseDuplicates )
+						fillCollapsedMatrices(dms, b128seqs, names, trans_models, numThreads, compactDuplicates);
+					else
+						fillMatrices(dms, b128seqs, trans_models, numThreads);
+					for ( size_t m = 0 ; m < ostreams.size() ; m++ ){
+						ostreams[m]->printStartRun(names,runId,extrainfos);
+						//          freeXmlStrings(extrainfos);
+						dms[m].setIdentifiers(names);
+						if(useFixFactor) applyFixFactor(dms[m],fixfactor);
+						//	  output << dm;
+						ostreams[m]->print(dms[m]);
+					}
 				}
 				//bootstrapping
 				else{
@@ -332,35 +763,48 @@ main(int argc,
 					for( size_t i=0;i<seqs.size();i++)
 						names.push_back(seqs[i].name);
 
-					ostream->printStartRun(names,runId,extrainfos);
+					for ( size_t m = 0 ; m < ostreams.size() ; m++ )
+						ostreams[m]->printStartRun(names,runId,extrainfos);
 					//          freeXmlStrings(extrainfos);
+					bootstrap.reInitiate(seqs);
 					if ( !no_incl_orig ){//create the distance matrix for the original sequences
-						Sequences2DNA_b128(seqs,b128seqs);
-						fillMatrix(dm, b128seqs, trans_model);
-						dm.setIdentifiers(names);
-						if(useFixFactor)
-							applyFixFactor(dm,fixfactor);
-						//       	       output << dm;
-						ostream->print(dm);
+						fillMatrices(dms, bootstrap.getPatterns(), trans_models, numThreads);
+						for ( size_t m = 0 ; m < ostreams.size() ; m++ ){
+							dms[m].setIdentifiers(names);
+							if(useFixFactor)
+								applyFixFactor(dms[m],fixfactor);
+							//       	       output << dm;
+							ostreams[m]->print(dms[m]);
+						}
 					}
 					//start the bootstrapping
-					//	  vector<Sequence> bootsequences;
-					for ( int b = 0 ; b < numboot ; b++ ){
-						//Sequence::bootstrapSequences(seqs,bootsequences);
-						//Sequences2DNA_b128(bootsequences,b128seqs);
-						bootstrapSequences(seqs,b128seqs);
-						fillMatrix(dm, b128seqs, trans_model);
-						dm.setIdentifiers(names);
-						if(useFixFactor) applyFixFactor(dm,fixfactor);
-						ostream->print(dm);
+					//The replicates are computed in batches of one replicate
+					//per thread and printed in order.
+					WorkStealingPool pool(replicates.size());
+					for ( size_t first = 0 ; first < (size_t) numboot ; first += replicates.size() ){
+						const size_t batch = min(replicates.size(), numboot - first);
+						pool.run(batch, [&](size_t k){
+							bootstrap.drawReplicate(ReplicateRandom(seed, firstReplicate + first + k), replicates[k]);
+							fillMatrices(bootMatrices[k], replicates[k].getPatterns(), trans_models, max((size_t) 1, numThreads/batch));
+						});
+						for ( size_t k = 0 ; k < batch ; k++ ){
+							for ( size_t m = 0 ; m < ostreams.size() ; m++ ){
+								bootMatrices[k][m].setIdentifiers(names);
+								if(useFixFactor) applyFixFactor(bootMatrices[k][m],fixfactor);
+								ostreams[m]->print(bootMatrices[k][m]);
+							}
+						}
 					}
+					firstReplicate += numboot;
 				}
-				ostream->printEndRun();
+				for ( size_t m = 0 ; m < ostreams.size() ; m++ )
+					ostreams[m]->printEndRun();
 			}//end data set loop
 
 			//OUTPUT THE TREES
 		}////Mehmood's Changes End : email: malagori@kth.se
-		delete ostream;
+		for ( size_t m = 0 ; m < ostreams.size() ; m++ )
+			delete ostreams[m];
 		delete istream;
 	}
 
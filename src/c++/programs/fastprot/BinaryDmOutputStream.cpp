@@ -12,13 +12,19 @@
 
 using namespace std;
 
-BinaryDmOutputStream::BinaryDmOutputStream(char *filename):DataOutputStream(filename) {
+// a .gz file is compressed by ofs, not by the base class
+BinaryDmOutputStream::BinaryDmOutputStream(char *filename):
+	DataOutputStream(filename != NULL && isGzipFileName(filename) ? NULL : filename), gzofs(NULL) {
 	if(filename != NULL) {
 		writeToCout = false;
-		delete fp;
+		if(file_was_opened)
+			fclose(fp);
 		fp = NULL;
 		file_was_opened = false;
-		ofs = open_write_binary(filename);
+		if(isGzipFileName(filename))
+			ofs = gzofs = new GzipOutputStream(filename);
+		else
+			ofs = open_write_binary(filename);
 	} else {
 		ofs = &cout;
 		writeToCout = true;
@@ -26,6 +32,8 @@ BinaryDmOutputStream::BinaryDmOutputStream(char *filename):DataOutputStream(file
 }
 
 BinaryDmOutputStream::~BinaryDmOutputStream() {
+	if(gzofs != NULL && !gzofs->close())
+		USER_ERROR(gzofs->getError());
 	if(ofs != NULL && !writeToCout) {
 		delete ofs;
 		ofs = NULL;
@@ -9,6 +9,7 @@
 #define BINARYDMOUTPUTSTREAM_HPP_
 
 #include "DataOutputStream.hpp"
+#include "CompressedFile.hpp"
 #include <cstdio>
 #include <fstream>
 
@@ -24,6 +25,7 @@ public:
 
 private:
 	ostream *ofs;
+	GzipOutputStream *gzofs; //ofs if it is compressed
 	vector<string> m_names;
 	bool writeToCout;
 };
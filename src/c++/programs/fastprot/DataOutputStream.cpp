@@ -1,4 +1,5 @@
 #include "DataOutputStream.hpp"
+#include "CompressedFile.hpp"
 #include <cstdio>
 #include <libxml/xmlreader.h>
 
@@ -6,10 +7,15 @@ using namespace std;
 
 DataOutputStream::DataOutputStream(char * filename) {
   fp = NULL;
+  gzip = NULL;
   file_was_opened = false;
   if ( filename == NULL) {
     fp = stdout;
     }
+  else if ( isGzipFileName(filename) ) {
+    gzip = new GzipWriter(filename);
+    fp = gzip->getFile();
+    }
   else {
     fp = open_write_file(filename);
     file_was_opened=true;
@@ -19,6 +25,11 @@ DataOutputStream::DataOutputStream(char * filename) {
 DataOutputStream::~DataOutputStream() {
   if (file_was_opened)
     fclose(fp);
+  if ( gzip != NULL ) {
+    if ( ! gzip->close() )
+      USER_ERROR(gzip->getError());
+    delete gzip;
+    }
 }
 
 // mehmood's addition here
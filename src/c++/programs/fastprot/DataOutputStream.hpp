@@ -10,6 +10,8 @@
 #include "DistanceRow.hpp"
 #include "Extrainfos.hpp"
 
+class GzipWriter;
+
 class DataOutputStream {
 public:
   DataOutputStream( );
@@ -31,6 +33,7 @@ public:
 protected:
   bool file_was_opened;
   FILE * fp;
+  GzipWriter * gzip; //compresses fp if the filename ends with .gz
 };
 
 #endif // DATAOUTPUTSTREAM_HPP
@@ -1,28 +1,27 @@
 #include "FastaInputStream.hpp"
 #include <cstdio>
-#include <fstream>
+#include <cstring>
 
 using namespace std;
 
+//The chars that may be in a sequence, checked with one lookup per
+//char.
+static const char FASTA_SEQUENCE_CHARS[] = "abcdefghiklmnopqrstuvwyzxABCDEFGHIKLMNOPQRSTUVWYZX -.?";
+
+struct FastaCharTable {
+	bool valid[256];
+	FastaCharTable() {
+		memset(valid, 0, sizeof valid);
+		for ( const char *c = FASTA_SEQUENCE_CHARS ; *c != '\0' ; c++ )
+			valid[(unsigned char) *c] = true;
+	}
+};
+static const FastaCharTable fastaChars;
+
 FastaInputStream::~FastaInputStream() {
-	if ( file_was_opened )
-		fin.close();
 }
 
-FastaInputStream::FastaInputStream(char * filename) {
-	file_was_opened = false;
-	if ( filename == NULL)
-		fp = & cin;
-	else {
-		fin.open(filename, ifstream::in);
-		if ( ! fin.good()) {
-			fin.close();
-			fin.clear();
-			THROW_EXCEPTION("File doesn't exist: \"" << filename << "\"");
-		}
-		file_was_opened = true;
-		fp = & fin;
-	}
+FastaInputStream::FastaInputStream(char * filename) : input(filename) {
 }
 
 bool FastaInputStream::read(vector<Sequence> &seqs, string & runId, vector<string> &names,  Extrainfos &extrainfos) {
@@ -36,62 +35,48 @@ bool FastaInputStream::read(vector<Sequence> &seqs, string & runId, vector<strin
 	return true;
 }
 
-bool FastaInputStream::readSeq(vector<Sequence> &seqs, string &line, int linesRead) {
-	linesRead++;
-	seqs.resize(linesRead);
-	string seqStr;
-	Sequence &s = seqs[linesRead-1];
-	string::size_type findPos = line.find_first_of("\t ",1);
-	string::size_type nameEndPos;
-	if ( findPos == string::npos ) {
-		nameEndPos = line.size() -1;
-	}
-	else {
-		nameEndPos = findPos-1;
-	}
-	s.name = line.substr(1, nameEndPos);
-	//std::cerr<<"s.name: "<<s.name<<std::endl;
-	bool readGreaterThan = false;
-	while (  !readGreaterThan && getline ( *fp, line ) ) {
-		//       c != 'n' && line[0] != '\0' && ! fp->eof() && fp->good()
-		if ( line.size() > 0 ) {
-			if ( line[0] == '>' ) {
-				readGreaterThan = true;
-				readSeq( seqs, line, linesRead );
-			}
-			else {
-				/* //      std::cerr<<"line: "<<line<<"\n"<<std::endl;
-				string seqLine;
-				seqLine=line;
-				//      std::cerr<<"seqLine: "<<seqLine<<"\n"<<std::endl;
-				seqStr=seqLine; */
-				seqStr += line;
-		        //std::cerr<<"seqStr1: "<<seqStr<<"\n"<<std::endl;
-			}
-		}
-	}
-	//  std::cerr<<"seqStr: "<<seqStr<<"\n"<<std::endl;
-	if ((seqStr.size() == 0 || seqStr.find_first_not_of("abcdefghiklmnopqrstuvwyzxABCDEFGHIKLMNOPQRSTUVWYZX -.?") != string::npos )) {
-		THROW_EXCEPTION("Malformed Fasta format\n");
-		exit(EXIT_FAILURE);
-	}
-	else {
-		Sequence &s = seqs[linesRead-1];
-		s.seq = seqStr;
-	    //std::cerr<<"seqName= "<<s.name<<"\nseqStr2: "<<seqStr<<std::endl;
-	}
+bool FastaInputStream::readLine(const char *&begin, const char *&end) {
+	if ( ! input.readLine(begin, end) )
+		return false;
+	while ( end != begin && (end[-1] == ' ' || end[-1] == '\r' || end[-1] == '\t') )
+		end--;
 	return true;
 }
 
+void FastaInputStream::readSeqName(const char *begin, const char *end, string &name) {
+	//the name ends at the first white space
+	const char *nameEnd = begin+1;
+	while ( nameEnd != end && *nameEnd != ' ' && *nameEnd != '\t' )
+		nameEnd++;
+	name.assign(begin+1, nameEnd);
+}
+
 bool FastaInputStream::readSequences(vector<Sequence> &seqs, string & runId, Extrainfos &extrainfos) {
-	string line;
-	while ( getline (*fp, line)) {
-		line.erase(line.find_last_not_of(" \n\r\t")+1);
-		if ( line.size() > 0 && line[0] == '>' ) {
-			readSeq( seqs , line ,0 );
-			return true;
+	seqs.clear();
+	const char *begin, *end;
+	while ( readLine(begin, end) ) {
+		if ( begin == end )
+			continue;
+		if ( *begin == '>' ) {
+			seqs.resize(seqs.size()+1);
+			readSeqName(begin, end, seqs.back().name);
+			continue;
 		}
+		//the lines before the first name are skipped
+		if ( seqs.empty() )
+			continue;
+		for ( const char *c = begin ; c != end ; c++ ) {
+			if ( ! fastaChars.valid[(unsigned char) *c] )
+				THROW_EXCEPTION("Malformed Fasta format, the char '" << *c << "' on line " << input.getLineNumber()
+						<< " is not an amino acid");
+		}
+		seqs.back().seq.append(begin, end);
+	}
+	if ( seqs.empty() )
+		THROW_EXCEPTION("Malformed Fasta format\n");
+	for ( size_t i = 0 ; i < seqs.size() ; i++ ) {
+		if ( seqs[i].seq.empty() )
+			THROW_EXCEPTION("Malformed Fasta format, the sequence \"" << seqs[i].name << "\" is empty");
 	}
-	THROW_EXCEPTION("Malformed Fasta format\n");
-	exit(EXIT_FAILURE);
+	return true;
 }
@@ -2,10 +2,14 @@
 #define FASTAINPUTSTREAM_HPP
 
 #include "DataInputStream.hpp"
+#include "InputBuffer.hpp"
 #include <iostream>
 
 using namespace std;
 
+// Reads the sequences of a FASTA file from an InputBuffer, i.e.
+// straight from the mapped file when it is a regular file, checking
+// each char once.
 class FastaInputStream : public DataInputStream {
 public:
   FastaInputStream(char * filename );
@@ -14,10 +18,9 @@ public:
   bool readSequences( std::vector<Sequence> &seqs, std::string & runId, Extrainfos &extrainfos );
 
 protected:
-  bool readSeq(std::vector<Sequence> &seqs, std::string &line, int linesRead);
-  istream * fp;
-  ifstream fin;
-  bool file_was_opened;
+  bool readLine(const char *&begin, const char *&end);
+  void readSeqName(const char *begin, const char *end, string &name);
+  InputBuffer input;
 };
 
 #endif // FASTAINPUTSTREAM_HPP
@@ -2,12 +2,14 @@
 #define PHYLIPMAINPUTSTREAM_HPP
 
 #include "DataInputStream.hpp"
+#include "InputBuffer.hpp"
 
 #include <iostream>
-#include <fstream>
 
 using namespace std;
 
+// Reads PHYLIP alignments, sequential or interleaved, from an
+// InputBuffer in one pass.
 class PhylipMaInputStream : public DataInputStream
 {
 public:
@@ -18,9 +20,7 @@ public:
   virtual bool readSequences( std::vector<Sequence> &seqs, std::string & runId, Extrainfos &extrainfos );
 
 protected:
-  istream * fp;
-  ifstream fin;
-  bool file_was_opened;
+  InputBuffer input;
 };
 
 #endif // PHYLIPMAINPUTSTREAM_HPP
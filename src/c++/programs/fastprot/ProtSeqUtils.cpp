@@ -108,8 +108,9 @@ Matrix count_replacements(const Sequence &s1, const Sequence &s2){
  * Code adapted from Sequences2DistanceMatrix.cpp - bootstrapSequences()
  * @param seq Original vector with sequences
  * @param bseq Vector with new bootstrapped sequences
+ * @param random The random stream of the replicate
  */
-void bootstrap_sequences(const std::vector<Sequence> &seqs, std::vector<Sequence> &bseqs){
+void bootstrap_sequences(const std::vector<Sequence> &seqs, std::vector<Sequence> &bseqs, const ReplicateRandom &random){
   //ensure capacity in bootsequences
   bseqs.resize(seqs.size());
 
@@ -129,9 +130,9 @@ void bootstrap_sequences(const std::vector<Sequence> &seqs, std::vector<Sequence
   if( stride < seqlen){
     for( pos=0; pos<(seqlen-stride); pos+= stride)
       for( size_t i=0; i<stride; i++)
-        samplePositions[pos+i] = (int) (seqlen*1.0*rand()/(RAND_MAX+1.0));
+        samplePositions[pos+i] = (int) random.uniformIndex(pos+i, seqlen);
     for (; pos<seqlen; pos++)
-      samplePositions[pos] = (int) (seqlen*1.0*rand()/(RAND_MAX+1.0));
+      samplePositions[pos] = (int) random.uniformIndex(pos, seqlen);
 
 
     for( seq=0; seq<seqs.size(); seq++){
@@ -154,7 +155,7 @@ void bootstrap_sequences(const std::vector<Sequence> &seqs, std::vector<Sequence
   }
   else{//seqlen<stride
     for (pos=0; pos<seqlen; pos++)
-      samplePositions[pos] = (int) (seqlen*1.0*rand()/(RAND_MAX+1.0));    
+      samplePositions[pos] = (int) random.uniformIndex(pos, seqlen);    
 
     for( seq=0; seq<seqs.size(); seq++){
       const std::string & s = seqs[seq].seq;
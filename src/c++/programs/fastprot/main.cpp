@@ -129,10 +129,14 @@ int main (int argc, char **argv) {
     cerr << "error: No output. No bootstrap or original data will be written" << endl;
     exit(EXIT_FAILURE);
     }
+  //every replicate draws its columns from its own random stream
+  uint64_t seed;
   if ( args_info.seed_given ) 
-    srand((unsigned int )args_info.seed_arg);
+    seed = (unsigned int) args_info.seed_arg;
   else
-    srand((unsigned int)time(NULL));
+    seed = (unsigned int) time(NULL);
+  //the number of replicates of the previous data sets
+  uint64_t firstReplicate = 0;
   try {
     char *inputfilename = NULL;
     char *outputfilename = NULL;
@@ -208,7 +212,7 @@ int main (int argc, char **argv) {
 			// Bootstrapping
 			for (int b=0; b < numboot; b++) {
 				vector<Sequence> bseqs;
-				bootstrap_sequences(seqs, bseqs);
+				bootstrap_sequences(seqs, bseqs, ReplicateRandom(seed, firstReplicate + b));
 				if (trans_model.sd)
 					calculate_distances(bseqs, dm, trans_model, sdm);
 				else
@@ -218,6 +222,7 @@ int main (int argc, char **argv) {
 				if (trans_model.sd && !binary_format_type)
 					ostream->printSD(sdm);
 			}
+			firstReplicate += numboot;
 			if (!binary_format_type)
 				ostream->printEndRun();
 		}
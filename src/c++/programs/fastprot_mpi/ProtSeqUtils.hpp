@@ -2,6 +2,7 @@
 #define _PROTSEQUTILS_HPP_
 
 #include <vector>
+#include "../../random_utils.hpp"
 
   // Forward Declarations
   class Matrix;
@@ -20,6 +21,7 @@
   double count_id_dist(const Sequence &s1, const Sequence &s2);
   
   
-  //! Performs bootstrapping
-  void bootstrap_sequences(const std::vector<Sequence> &seqs, std::vector<Sequence> &bseqs); 
+  //! Performs bootstrapping, drawing the columns from the stream random
+  void bootstrap_sequences(const std::vector<Sequence> &seqs, std::vector<Sequence> &bseqs,
+                           const ReplicateRandom &random); 
 #endif
@@ -127,10 +127,14 @@ int main (int argc, char **argv){
 		int numboot = args_info.bootstraps_arg;
 		bool no_incl_orig = args_info.no_incl_orig_given;
 
+		//every replicate draws its columns from its own random stream
+		uint64_t seed;
 		if ( args_info.seed_given )
-			srand((unsigned int )args_info.seed_arg);
+			seed = (unsigned int) args_info.seed_arg;
 		else
-			srand((unsigned int)time(NULL));
+			seed = (unsigned int) time(NULL);
+		//the number of replicates of the previous data sets
+		uint64_t firstReplicate = 0;
 
 		try {
 			char * inputfilename = 0;
@@ -261,7 +265,7 @@ int main (int argc, char **argv){
 				// Bootstrapping
 				for (int b=0; b < numboot; b++){
 					std::vector<Sequence> bseqs;
-					bootstrap_sequences(seqs, bseqs);
+					bootstrap_sequences(seqs, bseqs, ReplicateRandom(seed, firstReplicate + b));
 
 					calculate_distances(bseqs, dm, trans_model);
 
@@ -269,6 +273,7 @@ int main (int argc, char **argv){
 					ostream->printStartRun(names, runId, extrainfos);
 					ostream->print(dm);
 				}
+				firstReplicate += numboot;
 				if (!binary_format_type){
 					ostream->printEndRun();
 				}
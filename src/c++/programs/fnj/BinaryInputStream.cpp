@@ -19,9 +19,10 @@ BinaryInputStream::~BinaryInputStream() {
 BinaryInputStream::BinaryInputStream(char * filename)  {
 	input_was_read=false;
 	file_was_opened = false;
-	if (filename==NULL)
-		fp = &cin;
-	else {
+	if (filename==NULL) {
+		fin.open(NULL);
+		fp = &fin;
+	} else {
 		fin.open(filename, ios::binary );
 		if (!fin.good()) {
 			fin.close();
@@ -78,7 +79,7 @@ readstatus BinaryInputStream::readDM(StrFloMatrix & dm, std::vector<std::string>
 	for(int i = 0; i < newSize; ++i) {
 		for(int j = i; j < newSize; ++j) {
 			float f;
-			if (fp->read( reinterpret_cast<char*>( &f ), sizeof(f))==0)
+			if (!fp->read( reinterpret_cast<char*>( &f ), sizeof(f)))
 				return END_OF_RUN;
 			dm.setDistance(i, j, f);
 		}
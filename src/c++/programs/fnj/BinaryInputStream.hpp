@@ -12,6 +12,7 @@
 #include <cstdio>
 #include <iostream>
 #include <fstream>
+#include "InputBuffer.hpp"
 #include <vector>
 #include <string>
 
@@ -26,7 +27,7 @@ public:
 
 protected:
   istream *fp;
-  ifstream fin;
+  InputBufferStream fin;
   bool file_was_opened;
   int newSize;
   bool input_was_read;
@@ -16,9 +16,10 @@ PhylipDmInputStream::~PhylipDmInputStream() {
 
 PhylipDmInputStream::PhylipDmInputStream(char *filename) {
 	file_was_opened = false;
-	if (filename ==NULL)
-		fp = &cin;
-	else {
+	if (filename ==NULL) {
+		fin.open(NULL);
+		fp = &fin;
+	} else {
 		fin.open(filename, ifstream::in);
 		if (fin.peek()==ifstream::traits_type::eof()) {
 			fin.close();
@@ -45,7 +46,7 @@ readstatus PhylipDmInputStream::readDM(StrDblMatrix &dm, vector<string> & names,
 	string line;
 	int i1,i2,linePos,newSize;
 
-	if (getline(*fp,line)==0)
+	if (!getline(*fp,line))
 		return END_OF_RUN;
 
 	newSize=atoi(line.c_str());
@@ -8,6 +8,7 @@
 #include "DataInputStream.hpp"
 #include <iostream>
 #include <fstream>
+#include "InputBuffer.hpp"
 #include <vector>
 #include <string>
 
@@ -21,7 +22,7 @@ public:
   readstatus readDM( StrFloMatrix & dm, vector<string> & names, string & runId, Extrainfos & extrainfos );
 protected:
   istream * fp;
-  ifstream fin;
+  InputBufferStream fin;
   bool file_was_opened;
 };
 
@@ -0,0 +1,56 @@
+//--------------------------------------------------
+//
+// File: TiledInputStream.cpp
+//
+//--------------------------------------------------
+
+#include "TiledInputStream.hpp"
+
+using namespace std;
+
+TiledInputStream::TiledInputStream(char * filename) {
+	file_was_opened = false;
+	if (filename==NULL) {
+		fin.open(NULL);
+		reader = new TiledMatrixReader(fin);
+	} else {
+		fin.open(filename, ios::binary );
+		if (!fin.good()) {
+			fin.close();
+			fin.clear();
+			THROW_EXCEPTION("File doesn't exist: \"" << filename << "\"");
+		}
+		file_was_opened = true;
+		reader = new TiledMatrixReader(fin);
+	}
+}
+
+TiledInputStream::~TiledInputStream() {
+	delete reader;
+	if (file_was_opened)
+		fin.close();
+}
+
+readstatus TiledInputStream::readDM(StrFloMatrix & dm, std::vector<std::string> & names, std::string & runId, Extrainfos & extrainfos) {
+	if (!reader->readHeader(names))
+		return END_OF_RUN;
+	if (!reader->readMatrix(dm))
+		THROW_EXCEPTION("The tiled distance matrix ends before its last band");
+	return DM_READ;
+}
+
+readstatus TiledInputStream::readDM(StrDblMatrix & dm, std::vector<std::string> & names, std::string & runId, Extrainfos & extrainfos) {
+	if (!reader->readHeader(names))
+		return END_OF_RUN;
+	const size_t numNodes = names.size();
+	dm.resize(numNodes);
+	StrFloRow row(numNodes);
+	for (size_t i = 0; i < numNodes; i++) {
+		if (!reader->readRow(row))
+			THROW_EXCEPTION("The tiled distance matrix ends before its last band");
+		dm.setIdentifier(i, names[i]);
+		for (size_t j = i; j < numNodes; j++)
+			dm.setDistance(i, j, row.getDistance(j));
+	}
+	return DM_READ;
+}
@@ -0,0 +1,31 @@
+//--------------------------------------------------
+//
+// File: TiledInputStream.hpp
+//
+//--------------------------------------------------
+#ifndef TILEDINPUTSTREAM_HPP
+#define TILEDINPUTSTREAM_HPP
+
+#include "DataInputStream.hpp"
+#include "TiledMatrixFile.hpp"
+#include <fstream>
+#include "InputBuffer.hpp"
+
+//
+// Reads the matrices that fastdist --output-format=tiled writes, see
+// TiledMatrixFile.hpp. Each matrix is read a band of tiles at a time.
+//
+class TiledInputStream : public DataInputStream {
+public:
+  TiledInputStream(char *filename);
+  ~TiledInputStream();
+  readstatus readDM(StrFloMatrix & dm, std::vector<std::string> & names, std::string & runId, Extrainfos & extrainfos);
+  readstatus readDM(StrDblMatrix & dm, std::vector<std::string> & names, std::string & runId, Extrainfos & extrainfos);
+
+protected:
+  InputBufferStream fin;
+  bool file_was_opened;
+  TiledMatrixReader *reader;
+};
+
+#endif // TILEDINPUTSTREAM_HPP
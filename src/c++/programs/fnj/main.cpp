@@ -21,6 +21,7 @@
 #include "fileFormatSchema.hpp"
 #include "PhylipDmInputStream.hpp"
 #include "BinaryInputStream.hpp"
+#include "TiledInputStream.hpp"
 
 #ifdef WITH_LIBXML
 #include "XmlInputStream.hpp"
@@ -33,11 +34,13 @@ using namespace std;
 // Each created tree is added to the tree2count map.
 //
 
-template<class T> void buildTrees(T &dm, tree2int_map &tree2count, std::vector<NJ_method> &methods, str2int_hashmap &name2id) {
+template<class T> void buildTrees(T &dm, tree2int_map &tree2count, std::vector<NJ_method> &methods, str2int_hashmap &name2id, bool compactDuplicates) {
 	SequenceTree tree;
 
 	for(size_t i=0; i<methods.size(); i++){
 		computeNJTree(dm,tree,methods[i]);
+		if (compactDuplicates)
+			tree.expandLeafNameLists();
 		tree.makeCanonical(name2id);
 		tree2int_map::iterator iter = tree2count.find(tree);
 		if(iter!=tree2count.end())
@@ -47,6 +50,29 @@ template<class T> void buildTrees(T &dm, tree2int_map &tree2count, std::vector<N
 	}
 }
 
+//
+// The rows of a matrix written by fastdist --compact-duplicates are
+// named by the names of identical sequences separated by commas. With
+// compactDuplicates the names are listed one at a time in leafNames
+// and name2id, and buildTrees() adds the identical sequences as zero
+// length subtrees. Otherwise the names are kept as they are.
+//
+
+template<class T> void setLeafNames(T &dm, std::vector<std::string> &names, str2int_hashmap &name2id, bool compactDuplicates) {
+	names.clear();
+	for(size_t namei=0; namei<dm.getSize(); namei++) {
+		const std::string &identifier = dm.getIdentifier(namei);
+		size_t begin = 0, end;
+		while ( compactDuplicates && (end = identifier.find(',',begin)) != std::string::npos ) {
+			names.push_back(identifier.substr(begin,end-begin));
+			begin = end+1;
+		}
+		names.push_back(identifier.substr(begin));
+	}
+	for(size_t namei=0; namei<names.size(); namei++)
+		name2id[names[namei]] = namei;
+}
+
 int main (int argc, char **argv) {
     if(isatty(STDIN_FILENO) && argc==1) {
       cout<<"No input data or parameters. Use -h,--help for more information"<<endl;
@@ -96,6 +122,7 @@ int main (int argc, char **argv) {
 		exit(EXIT_FAILURE);
 	}
 	bool printCounts = args_info.print_counts_flag;
+	bool compactDuplicates = args_info.compact_duplicates_flag;
 	try {
 		char * inputfilename = NULL;
 		char * outputfilename = NULL;
@@ -119,6 +146,8 @@ int main (int argc, char **argv) {
 				break;
 			case input_format_arg_binary: istream = new BinaryInputStream(inputfilename);
 				break;
+			case input_format_arg_tiled: istream = new TiledInputStream(inputfilename);
+				break;
 #ifdef WITH_LIBXML
 			case input_format_arg_xml: istream = new XmlInputStream(inputfilename);
 				break;
@@ -140,6 +169,8 @@ int main (int argc, char **argv) {
 		// THE DATA WE WILL PROCESS
 		vector<Sequence> seqs;
 		vector<std::string> names;
+		//names with the lists of identical sequences expanded
+		vector<std::string> leafNames;
 		vector<DNA_b128_String> b128seqs;
 		Extrainfos extrainfos;
 		bool latestReadSuccessful = true;
@@ -153,7 +184,7 @@ int main (int argc, char **argv) {
 			run++;
 			tree2int_map tree2count((size_t)(args_info.bootstraps_arg * 1.3));
 			str2int_hashmap name2id;
-			if (args_info.input_format_arg==input_format_arg_binary) {
+			if (args_info.input_format_arg==input_format_arg_binary || args_info.input_format_arg==input_format_arg_tiled) {
 				StrFloMatrix dm;
 				for (int runNo=1; (status = istream->readDM(dm, names, runId, extrainfos))==DM_READ; runNo++) {
 					if (args_info.analyze_run_number_given) {
@@ -164,9 +195,8 @@ int main (int argc, char **argv) {
 							break;
 							}
 						}
-					for(size_t namei=0; namei<dm.getSize(); namei++)
-						name2id[dm.getIdentifier(namei)] = namei;
-					buildTrees(dm, tree2count, methods,name2id);
+					setLeafNames(dm, leafNames, name2id, compactDuplicates);
+					buildTrees(dm, tree2count, methods,name2id,compactDuplicates);
 				}
 			}
 			else {
@@ -180,14 +210,12 @@ int main (int argc, char **argv) {
 							break;
 							}
 						}
-					for(size_t namei=0; namei<dm.getSize(); namei++) {
-					     name2id[dm.getIdentifier(namei)] = namei;
-					}
-					buildTrees(dm, tree2count, methods,name2id);
+					setLeafNames(dm, leafNames, name2id, compactDuplicates);
+					buildTrees(dm, tree2count, methods,name2id,compactDuplicates);
 				}
 			}
 			if (status==END_OF_RUN)
-				ostream->print(tree2count,printCounts, runId, names, extrainfos);
+				ostream->print(tree2count,printCounts, runId, leafNames, extrainfos);
 			if (args_info.analyze_run_number_given)
 				break;
 		}//end run loop
@@ -119,10 +119,7 @@ main(int argc,
   }
 
   char *seedval = GET_OPTION_VAL("--seed");
-  if ( seedval == NULL )
-    srand((unsigned int)time(NULL));
-  else
-    srand((unsigned int)atoi(seedval));
+  const uint64_t seed = ( seedval == NULL ? (unsigned int)time(NULL) : (unsigned int)atoi(seedval) );
   
   //----------------------------------------------
   bool useFixFactor = false;
@@ -188,7 +185,7 @@ main(int argc,
 	 //start the bootstrapping
 	 vector<Sequence> bootsequences;
 	 for ( int b = 0 ; b < numboot ; b++ ){
-	   Sequence::bootstrapSequences(seqs,bootsequences);
+	   Sequence::bootstrapSequences(seqs,bootsequences,ReplicateRandom(seed,b));
 	   fillMatrix_K2P_naive(dm, bootsequences, trans_model);
 	  dm.setIdentifiers(names);
 	  if(useFixFactor) applyFixFactor(dm,fixfactor);
@@ -0,0 +1,62 @@
+//--------------------------------------------------
+//
+// File: random_utils.hpp
+//
+//--------------------------------------------------
+#ifndef RANDOM_UTILS_HPP
+#define RANDOM_UTILS_HPP
+
+#include <cstddef>
+#include <stdint.h>
+
+//
+// Counter based random numbers for bootstrapping.
+//
+// ReplicateRandom is the random stream of one bootstrap replicate.
+// Number k of the stream is a hash of the seed, the replicate and k,
+// so it does not depend on which numbers have been drawn before, by
+// this or by any other replicate. The replicates can therefore be
+// drawn on any number of threads and in any order and still be the
+// same for a given seed. The hash is the finalizer of SplitMix64, so
+// the numbers of a replicate are a SplitMix64 sequence started at a
+// state derived from the seed and the replicate.
+//
+// EXAMPLE USAGE
+// for ( size_t b = 0 ; b < numBootstraps ; b++ ){
+//   ReplicateRandom random(seed, b);
+//   for ( size_t j = 0 ; j < seqlen ; j++ )
+//     samplePositions[j] = random.uniformIndex(j, seqlen);
+// }
+//
+
+class ReplicateRandom
+{
+public:
+  ReplicateRandom(uint64_t seed, uint64_t replicate){
+    key = mix(seed ^ mix(replicate + GOLDEN_GAMMA));
+  }
+
+  // Number counter of the stream.
+  uint64_t get(uint64_t counter) const{
+    return mix(key + (counter+1)*GOLDEN_GAMMA);
+  }
+
+  // Number counter of the stream as an integer in [0,n).
+  size_t uniformIndex(uint64_t counter, size_t n) const{
+    //the 53 high bits as a double in [0,1)
+    return (size_t) ((get(counter) >> 11) * (1.0/9007199254740992.0) * n);
+  }
+
+private:
+  static const uint64_t GOLDEN_GAMMA = 0x9e3779b97f4a7c15ULL;
+
+  static uint64_t mix(uint64_t z){
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+  }
+
+  uint64_t key;
+};
+
+#endif // RANDOM_UTILS_HPP
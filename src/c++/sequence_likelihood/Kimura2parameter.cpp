@@ -10,6 +10,7 @@
 //--------------------------------------------------
 
 #include "dna_pairwise_sequence_likelihood.hpp"
+#include "solver_cache.hpp"
 #include <string>
 #include <iostream>
 #include <assert.h>
@@ -106,8 +107,8 @@ _secant_search(
 
 
 
-ML_string_distance
-compute_K2P_fixratio(int strlen, simple_string_distance sd, float fixRatio){
+static ML_string_distance
+solve_K2P_fixratio(int strlen, simple_string_distance sd, float fixRatio){
   
   float K = 2.0* fixRatio; //K is A/B. while fixRatio is A/2B
   float a = sd.transitions;
@@ -156,6 +157,30 @@ compute_K2P_fixratio(int strlen, simple_string_distance sd, float fixRatio){
   
 }
 
+//All the arguments of compute_K2P_fixratio().
+typedef struct {
+  int strlen;
+  int deletedPositions;
+  float transitions;
+  float transversions;
+  float fixRatio;
+} k2p_fixratio_key;
+
+//The distances of a matrix are computed from few distinct counts, so
+//the searches are remembered, one cache per thread.
+ML_string_distance
+compute_K2P_fixratio(int strlen, simple_string_distance sd, float fixRatio){
+  static thread_local SolverCache<k2p_fixratio_key,ML_string_distance> cache(14);
+  k2p_fixratio_key key = {strlen, sd.deletedPositions, sd.transitions, sd.transversions, fixRatio};
+  const ML_string_distance *cached = cache.find(key);
+  if ( cached != NULL )
+    return *cached;
+
+  ML_string_distance tp = solve_K2P_fixratio(strlen, sd, fixRatio);
+  cache.insert(key, tp);
+  return tp;
+}
+
 
 
 
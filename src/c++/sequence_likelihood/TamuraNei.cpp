@@ -10,6 +10,7 @@
 //--------------------------------------------------
 
 #include "dna_pairwise_sequence_likelihood.hpp"
+#include "solver_cache.hpp"
 
 #include <string>
 #include <iostream>
@@ -29,49 +30,54 @@ using namespace std;
 // transition/transversion ratio is 2 then K=4.
 
 
-static float gA;
-static float gC;
-static float gG;
-static float gT;
-static float gU;
-static float gY;
+//The parameters of one distance computation. They are passed
+//explicitly to the solver so that distances can be
+//computed on several threads at the same time.
+typedef struct {
+  float gA;
+  float gC;
+  float gG;
+  float gT;
+  float gU;
+  float gY;
 
-static float purine_ratio;//fix ratio
-static float pyrimidine_ratio;//fix ratio
-static float tU;//observed purine transitions
-static float tY;//observed pyrimidine transitions
-static float tV;//observed transversions
-static float n; //the string length
+  float purine_ratio;//fix ratio
+  float pyrimidine_ratio;//fix ratio
+  float tU;//observed purine transitions
+  float tY;//observed pyrimidine transitions
+  float tV;//observed transversions
+  float n; //the string length
+} tn93_parameters;
 
 
-static float E = exp(1.0);
+static const float E = exp(1.0);
 
 // THIS IS ACTUALLY THE DERIVATIVE OF THE LOG LIKELIHOOD!!
 static float
-partof_derivative_likelihood(float b){
-  float k1 = purine_ratio;
-  float k2 = pyrimidine_ratio;
+partof_derivative_likelihood(const tn93_parameters &p, float b){
+  float k1 = p.purine_ratio;
+  float k2 = p.pyrimidine_ratio;
   float two_b = 2*b;
   float exp_2b = powf(E,two_b);
   
 float VAL=
-  (2*tV)/(-1 + exp_2b) +
+  (2*p.tV)/(-1 + exp_2b) +
 
   ///
-  (((-2*(gY))/exp_2b + (2*(gY + (gU)*k1))/powf(E,two_b*(gY + (gU)*k1)))*tU)/
-  (-powf(E,-two_b*(gY + (gU)*k1)) + gU + (gY)/exp_2b) + 
+  (((-2*(p.gY))/exp_2b + (2*(p.gY + (p.gU)*k1))/powf(E,two_b*(p.gY + (p.gU)*k1)))*p.tU)/
+  (-powf(E,-two_b*(p.gY + (p.gU)*k1)) + p.gU + (p.gY)/exp_2b) + 
   ///
-  (((-4*(gU)*(gY))/exp_2b -
-    (2*gA*gG*((-2*(gY))/exp_2b + (2*(gY + (gU)*k1))/powf(E,two_b*(gY + (gU)*k1))))/(gU) -
-    (2*gC*gT*((-2*(gU))/exp_2b + (2*(gU + (gY)*k2))/powf(E,two_b*(gU + (gY)*k2))))/(gY)
-    )*(n - tV - tU - tY))/
-  (1 - 2*(1 - powf(E,-two_b))*(gU)*(gY) -
-   (2*gC*gT*(-powf(E,-two_b*(gU + (gY)*k2)) + gC + (gU)/exp_2b + gT))/(gY) - 
-   (2*gA*gG*(-powf(E,-two_b*(gY + (gU)*k1)) + gU + (gY)/exp_2b))/(gU)) +
+  (((-4*(p.gU)*(p.gY))/exp_2b -
+    (2*p.gA*p.gG*((-2*(p.gY))/exp_2b + (2*(p.gY + (p.gU)*k1))/powf(E,two_b*(p.gY + (p.gU)*k1))))/(p.gU) -
+    (2*p.gC*p.gT*((-2*(p.gU))/exp_2b + (2*(p.gU + (p.gY)*k2))/powf(E,two_b*(p.gU + (p.gY)*k2))))/(p.gY)
+    )*(p.n - p.tV - p.tU - p.tY))/
+  (1 - 2*(1 - powf(E,-two_b))*(p.gU)*(p.gY) -
+   (2*p.gC*p.gT*(-powf(E,-two_b*(p.gU + (p.gY)*k2)) + p.gC + (p.gU)/exp_2b + p.gT))/(p.gY) - 
+   (2*p.gA*p.gG*(-powf(E,-two_b*(p.gY + (p.gU)*k1)) + p.gU + (p.gY)/exp_2b))/(p.gU)) +
 
   ////
-  (((-2*(gU))/exp_2b + (2*(gU + (gY)*k2))/powf(E,two_b*(gU + (gY)*k2)))*tY)/
-  (-powf(E,-two_b*(gU + (gY)*k2)) + gC + (gU)/exp_2b + gT);
+  (((-2*(p.gU))/exp_2b + (2*(p.gU + (p.gY)*k2))/powf(E,two_b*(p.gU + (p.gY)*k2)))*p.tY)/
+  (-powf(E,-two_b*(p.gU + (p.gY)*k2)) + p.gC + (p.gU)/exp_2b + p.gT);
 
 // cout << " VAL = " << VAL << endl;
  return VAL;
@@ -183,9 +189,9 @@ float VAL=
 
 
 static float
-_secant_search(){
-  float x0 = ( (tU/purine_ratio) + (tY/pyrimidine_ratio) + tV)/(6.0*n);
-  float fx0 = partof_derivative_likelihood(x0);
+_secant_search(const tn93_parameters &p){
+  float x0 = ( (p.tU/p.purine_ratio) + (p.tY/p.pyrimidine_ratio) + p.tV)/(6.0*p.n);
+  float fx0 = partof_derivative_likelihood(p,x0);
   float x1;
   if ( fx0 < 0 )
     x1 = x0/2;
@@ -196,7 +202,7 @@ _secant_search(){
   int i =0;
   while (i < 20 && fabs(x1-x0) > 0.00001){
     float tmp = x1;
-    float tmpf = partof_derivative_likelihood(x1);
+    float tmpf = partof_derivative_likelihood(p,x1);
 
     x1 = x1 - (x1-x0)/(tmpf-fx0)*tmpf;
     fx0= tmpf;
@@ -216,38 +222,39 @@ _secant_search(){
 //     cout << "iter " << i << "  " << ((float)numabove)/total << endl;
 //   }
 
-  //cout << "secant search     val: " << x1 << "     funcval  " << partof_derivative_likelihood(x1) << endl; 
+  //cout << "secant search     val: " << x1 << "     funcval  " << partof_derivative_likelihood(p,x1) << endl; 
   return x1;
 }
 
 
 
-ML_string_distance
-compute_Tamura_Nei_fixratio(int strlen, TN_string_distance sd,
-                            int numAs, int numCs,
-                            int numGs, int numTs,
-                            float purine_ts_tv_ratio,
-                            float pyrimidine_ts_tv_ratio){
-  purine_ratio = 2.0* purine_ts_tv_ratio; //K is A/B. while fixRatio is A/2B
-  pyrimidine_ratio = 2.0* pyrimidine_ts_tv_ratio; //K is A/B. while fixRatio is A/2B
-  tU = sd.purine_transitions;
-  tY = sd.pyrimidine_transitions;
-  tV = sd.transversions;
-  n = (1.0*strlen) - sd.deletedPositions;
+static ML_string_distance
+solve_Tamura_Nei_fixratio(int strlen, TN_string_distance sd,
+                          int numAs, int numCs,
+                          int numGs, int numTs,
+                          float purine_ts_tv_ratio,
+                          float pyrimidine_ts_tv_ratio){
+  tn93_parameters p;
+  p.purine_ratio = 2.0* purine_ts_tv_ratio; //K is A/B. while fixRatio is A/2B
+  p.pyrimidine_ratio = 2.0* pyrimidine_ts_tv_ratio; //K is A/B. while fixRatio is A/2B
+  p.tU = sd.purine_transitions;
+  p.tY = sd.pyrimidine_transitions;
+  p.tV = sd.transversions;
+  p.n = (1.0*strlen) - sd.deletedPositions;
   
   float norm = numAs + numCs + numGs + numTs;
   
-  gA = ((float)numAs)/norm;
-  gA = ( gA < 0.000001 ? 0.000001 : gA);
-  gC = 0.000001+((float)numCs)/norm;
-  gC = ( gC < 0.000001 ? 0.000001 : gC);
-  gG = 0.000001+((float)numGs)/norm;
-  gG = ( gG < 0.000001 ? 0.000001 : gG);
-  gT = 0.000001+((float)numTs)/norm;
-  gT = ( gT < 0.000001 ? 0.000001 : gT);
+  p.gA = ((float)numAs)/norm;
+  p.gA = ( p.gA < 0.000001 ? 0.000001 : p.gA);
+  p.gC = 0.000001+((float)numCs)/norm;
+  p.gC = ( p.gC < 0.000001 ? 0.000001 : p.gC);
+  p.gG = 0.000001+((float)numGs)/norm;
+  p.gG = ( p.gG < 0.000001 ? 0.000001 : p.gG);
+  p.gT = 0.000001+((float)numTs)/norm;
+  p.gT = ( p.gT < 0.000001 ? 0.000001 : p.gT);
   
-  gU = gA+gG;
-  gY = gC+gT;
+  p.gU = p.gA+p.gG;
+  p.gY = p.gC+p.gT;
 
   //cout << "gA " << gA << endl;
   //cout << "gC " << gC << endl;
@@ -256,19 +263,19 @@ compute_Tamura_Nei_fixratio(int strlen, TN_string_distance sd,
   
   float bt_prob;
   //bt_prob = _binary_search();
-  bt_prob = _secant_search();
+  bt_prob = _secant_search(p);
   
   
 
   //the distance
   ML_string_distance tp;
-  tp.distance = 4.0*(gA*gG*purine_ratio + gT*gC*pyrimidine_ratio + gU*gY)*bt_prob;
+  tp.distance = 4.0*(p.gA*p.gG*p.purine_ratio + p.gT*p.gC*p.pyrimidine_ratio + p.gU*p.gY)*bt_prob;
 
   // FIX THE CHANGE PROBABILITIES
 
-  float tv_prob = 2.0*gU*gY*(1-exp(-2*bt_prob));
-  float ts_pyrimidine_prob = 2.0 * gT*gC/gY*(gY- exp(-2*(gY*pyrimidine_ratio+ gU)*bt_prob) + gU*exp(-2*bt_prob));
-  float ts_purine_prob = 2.0 * gA*gG/gU*(gU- exp(-2*(gU*purine_ratio+ gY)*bt_prob) + gY*exp(-2*bt_prob));
+  float tv_prob = 2.0*p.gU*p.gY*(1-exp(-2*bt_prob));
+  float ts_pyrimidine_prob = 2.0 * p.gT*p.gC/p.gY*(p.gY- exp(-2*(p.gY*p.pyrimidine_ratio+ p.gU)*bt_prob) + p.gU*exp(-2*bt_prob));
+  float ts_purine_prob = 2.0 * p.gA*p.gG/p.gU*(p.gU- exp(-2*(p.gU*p.purine_ratio+ p.gY)*bt_prob) + p.gY*exp(-2*bt_prob));
 
   assert ( tv_prob > 0.00001 && tv_prob < 0.99999);
   assert (ts_pyrimidine_prob > 0.00001 &&  ts_pyrimidine_prob < 0.99999);
@@ -284,3 +291,42 @@ compute_Tamura_Nei_fixratio(int strlen, TN_string_distance sd,
   return tp;
   
 }
+
+
+//All the arguments of compute_Tamura_Nei_fixratio().
+typedef struct {
+  int strlen;
+  int deletedPositions;
+  float purine_transitions;
+  float pyrimidine_transitions;
+  float transversions;
+  int numAs;
+  int numCs;
+  int numGs;
+  int numTs;
+  float purine_ts_tv_ratio;
+  float pyrimidine_ts_tv_ratio;
+} tn93_fixratio_key;
+
+//The distances of a matrix are computed from few distinct counts, so
+//the searches are remembered, one cache per thread.
+ML_string_distance
+compute_Tamura_Nei_fixratio(int strlen, TN_string_distance sd,
+                            int numAs, int numCs,
+                            int numGs, int numTs,
+                            float purine_ts_tv_ratio,
+                            float pyrimidine_ts_tv_ratio){
+  static thread_local SolverCache<tn93_fixratio_key,ML_string_distance> cache(15);
+  tn93_fixratio_key key = {strlen, sd.deletedPositions,
+                           sd.purine_transitions, sd.pyrimidine_transitions, sd.transversions,
+                           numAs, numCs, numGs, numTs,
+                           purine_ts_tv_ratio, pyrimidine_ts_tv_ratio};
+  const ML_string_distance *cached = cache.find(key);
+  if ( cached != NULL )
+    return *cached;
+
+  ML_string_distance tp = solve_Tamura_Nei_fixratio(strlen, sd, numAs, numCs, numGs, numTs,
+                                                    purine_ts_tv_ratio, pyrimidine_ts_tv_ratio);
+  cache.insert(key, tp);
+  return tp;
+}
@@ -0,0 +1,201 @@
+//--------------------------------------------------
+//
+// File: batch_distances.cpp
+//
+//--------------------------------------------------
+
+#include "dna_pairwise_sequence_likelihood.hpp"
+
+#include <float.h>
+#include <emmintrin.h>
+
+using namespace std;
+
+//
+// The distances are computed in chunks. The arguments of the
+// logarithms of a chunk are computed first, exactly as in the scalar
+// functions, then the logarithms are taken two at a time and finally
+// the distances are put together from them, again exactly as in the
+// scalar functions.
+//
+static const size_t CHUNK_SIZE = 256;
+
+//---------------------------------------------------
+// LOGARITHM
+//
+// The natural logarithm of two doubles with SSE2. It is the algorithm
+// of the FDLIBM log: x = 2^k*(1+f) with sqrt(2)/2 <= 1+f < sqrt(2),
+// s = f/(2+f) and log(1+f) = f - s*(f-R(s*s)) where R is a minimax
+// polynomial. The error is less than 1 ulp, so the distances, which
+// are rounded to floats, are the same as with the log of the C
+// library. Arguments that are not positive normal numbers are left to
+// the C library.
+//
+
+static const double Lg1 = 6.666666666666735130e-01;
+static const double Lg2 = 3.999999999940941908e-01;
+static const double Lg3 = 2.857142874366239149e-01;
+static const double Lg4 = 2.222219843214978396e-01;
+static const double Lg5 = 1.818357216161805012e-01;
+static const double Lg6 = 1.531383769920937332e-01;
+static const double Lg7 = 1.479819860511658591e-01;
+static const double ln2_hi = 6.93147180369123816490e-01;
+static const double ln2_lo = 1.90821492927058770002e-10;
+
+static inline __m128d
+log_sse2(__m128d x){
+  //the high 32 bits of each double in the even 32 bit lanes
+  __m128i hx = _mm_srli_epi64(_mm_castpd_si128(x), 32);
+  __m128i k = _mm_sub_epi32(_mm_srli_epi32(hx, 20), _mm_set1_epi32(1023));
+  hx = _mm_and_si128(hx, _mm_set1_epi32(0x000fffff));
+  //i is 0x100000 if the mantissa is at least sqrt(2), then x is
+  //halved and k increased
+  __m128i i = _mm_and_si128(_mm_add_epi32(hx, _mm_set1_epi32(0x95f64)), _mm_set1_epi32(0x100000));
+  hx = _mm_or_si128(hx, _mm_xor_si128(i, _mm_set1_epi32(0x3ff00000)));
+  k = _mm_add_epi32(k, _mm_srli_epi32(i, 20));
+
+  __m128i low = _mm_and_si128(_mm_castpd_si128(x), _mm_set_epi32(0, -1, 0, -1));
+  __m128d m = _mm_castsi128_pd(_mm_or_si128(low, _mm_slli_epi64(hx, 32)));
+  __m128d dk = _mm_cvtepi32_pd(_mm_shuffle_epi32(k, _MM_SHUFFLE(3,1,2,0)));
+
+  const __m128d one = _mm_set1_pd(1.0);
+  __m128d f = _mm_sub_pd(m, one);
+  __m128d s = _mm_div_pd(f, _mm_add_pd(_mm_set1_pd(2.0), f));
+  __m128d z = _mm_mul_pd(s, s);
+  __m128d w = _mm_mul_pd(z, z);
+  //t1= w*(Lg2+w*(Lg4+w*Lg6))
+  __m128d t1 = _mm_mul_pd(w, _mm_add_pd(_mm_set1_pd(Lg2),
+                 _mm_mul_pd(w, _mm_add_pd(_mm_set1_pd(Lg4), _mm_mul_pd(w, _mm_set1_pd(Lg6))))));
+  //t2= z*(Lg1+w*(Lg3+w*(Lg5+w*Lg7)))
+  __m128d t2 = _mm_mul_pd(z, _mm_add_pd(_mm_set1_pd(Lg1),
+                 _mm_mul_pd(w, _mm_add_pd(_mm_set1_pd(Lg3),
+                   _mm_mul_pd(w, _mm_add_pd(_mm_set1_pd(Lg5), _mm_mul_pd(w, _mm_set1_pd(Lg7))))))));
+  __m128d R = _mm_add_pd(t2, t1);
+  __m128d hfsq = _mm_mul_pd(_mm_mul_pd(_mm_set1_pd(0.5), f), f);
+  //dk*ln2_hi-((hfsq-(s*(hfsq+R)+dk*ln2_lo))-f)
+  __m128d r = _mm_add_pd(_mm_mul_pd(s, _mm_add_pd(hfsq, R)), _mm_mul_pd(dk, _mm_set1_pd(ln2_lo)));
+  r = _mm_sub_pd(_mm_sub_pd(hfsq, r), f);
+  return _mm_sub_pd(_mm_mul_pd(dk, _mm_set1_pd(ln2_hi)), r);
+}
+
+static inline bool
+is_positive_normal(double x){
+  return x >= DBL_MIN && x <= DBL_MAX;
+}
+
+//y[k] = log(x[k]) for k < n.
+static void
+log_array(const double *x, double *y, size_t n){
+  size_t k = 0;
+  for ( ; k + 1 < n ; k += 2 ){
+    if ( is_positive_normal(x[k]) && is_positive_normal(x[k+1]) )
+      _mm_storeu_pd(y+k, log_sse2(_mm_loadu_pd(x+k)));
+    else {
+      y[k] = log(x[k]);
+      y[k+1] = log(x[k+1]);
+    }
+  }
+  if ( k < n ){
+    if ( is_positive_normal(x[k]) ){
+      double last[2];
+      _mm_storeu_pd(last, log_sse2(_mm_set1_pd(x[k])));
+      y[k] = last[0];
+    }
+    else
+      y[k] = log(x[k]);
+  }
+}
+
+//---------------------------------------------------
+// JUKES CANTOR
+
+void
+compute_JC_distances(int strlen, const simple_string_distance *sds, size_t num, float *distances){
+  double args[CHUNK_SIZE];
+  double logs[CHUNK_SIZE];
+  for ( size_t c = 0 ; c < num ; c += CHUNK_SIZE ){
+    const size_t n = min(CHUNK_SIZE, num - c);
+    for ( size_t k = 0 ; k < n ; k++ )
+      args[k] = 1 - (4.0/3.0) * compute_p_distance(strlen,sds[c+k]);
+    log_array(args, logs, n);
+    for ( size_t k = 0 ; k < n ; k++ )
+      distances[c+k] = -(3.0/4.0) * logs[k];
+  }
+}
+
+//---------------------------------------------------
+// KIMURA 2 PARAMETER
+
+void
+compute_K2P_distances(int strlen, const simple_string_distance *sds, size_t num, float *distances){
+  double args[CHUNK_SIZE];
+  double logs[CHUNK_SIZE];
+  for ( size_t c = 0 ; c < num ; c += CHUNK_SIZE ){
+    const size_t n = min(CHUNK_SIZE, num - c);
+    for ( size_t k = 0 ; k < n ; k++ ){
+      const simple_string_distance &sd = sds[c+k];
+      int len = strlen-sd.deletedPositions;
+      float tsprob = sd.transitions/len;
+      float tvprob = sd.transversions/len;
+      args[k] = (1.0 - 2.0*tsprob-tvprob)*sqrt(1.0-2.0*tvprob);
+    }
+    log_array(args, logs, n);
+    for ( size_t k = 0 ; k < n ; k++ )
+      distances[c+k] = - 0.5 * logs[k];
+  }
+}
+
+//---------------------------------------------------
+// TAMURA NEI
+
+void
+compute_Tamura_Nei_distances(int strlen, const TN_string_distance *sds, size_t num,
+                             int numAs, int numCs, int numGs, int numTs,
+                             float *distances){
+  float norm = numAs + numCs + numGs + numTs;
+
+  //the frequencies are stored as floats before they are used, as in
+  //compute_Tamura_Nei(). Written out one by one, gcc -O2 keeps some of
+  //them as doubles and the distances differ in the last bits.
+  float pi[4];
+  const int counts[4] = {numAs, numCs, numGs, numTs};
+  for ( int b = 0 ; b < 4 ; b++ )
+    pi[b] = 0.000001+((float)counts[b])/norm;
+  float piA = pi[0], piC = pi[1], piG = pi[2], piT = pi[3];
+
+  float piR = piA+piG;
+  float piY = piC+piT;
+
+  //the parts of the formula that do not depend on the pair, evaluated
+  //as in compute_Tamura_Nei()
+  const double purine_div = 2.0*piA*piG;
+  const double pyrimidine_div = 2.0*piC*piT;
+  const double tv_purine_div = 2.0*piR;
+  const double tv_pyrimidine_div = 2.0*piY;
+  const double tv_div = 2.0*piR*piY;
+  const double purine_coef = -2.0*piA*piG/piR;
+  const double pyrimidine_coef = 2.0*piT*piC/piY;
+  const double tv_coef = 2.0*( piR*piY - piA*piG*piY/piR - piT*piC*piR/piY);
+
+  //three logarithms per pair
+  double args[3*CHUNK_SIZE];
+  double logs[3*CHUNK_SIZE];
+  for ( size_t c = 0 ; c < num ; c += CHUNK_SIZE ){
+    const size_t n = min(CHUNK_SIZE, num - c);
+    for ( size_t k = 0 ; k < n ; k++ ){
+      const TN_string_distance &sd = sds[c+k];
+      int len = strlen - sd.deletedPositions;
+      float ts_purine_prob = sd.purine_transitions/len;
+      float ts_pyrimidine_prob = sd.pyrimidine_transitions/len;
+      float tv_prob = sd.transversions/len;
+      args[3*k] = 1.0-piR*ts_purine_prob/purine_div - tv_prob/tv_purine_div;
+      args[3*k+1] = 1.0-piY*ts_pyrimidine_prob/pyrimidine_div - tv_prob/tv_pyrimidine_div;
+      args[3*k+2] = 1.0-tv_prob/tv_div;
+    }
+    log_array(args, logs, 3*n);
+    for ( size_t k = 0 ; k < n ; k++ )
+      distances[c+k] = purine_coef*logs[3*k]
+        - pyrimidine_coef*logs[3*k+1]
+        - tv_coef*logs[3*k+2];
+  }
+}
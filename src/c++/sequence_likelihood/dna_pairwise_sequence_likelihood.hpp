@@ -27,6 +27,7 @@
 #include <string>
 #include <iostream>
 #include <math.h>
+#include <cstddef>
 
 
 //MODEL
@@ -257,6 +258,28 @@ compute_Tamura_Nei_fixratio(int strlen, TN_string_distance sd,
 
 
 
+//---------------------------------------------------
+// DISTANCES OF MANY PAIRS
+//
+// The distances of compute_JC(), compute_K2P() and
+// compute_Tamura_Nei() for the num pairs with counts sds, without the
+// change probabilities, which are only needed for the ambiguities.
+// The logarithms are taken two at a time with SSE2 and the distances
+// are the same as the ones of the scalar functions.
+
+void
+compute_JC_distances(int strlen, const simple_string_distance *sds, size_t num, float *distances);
+
+void
+compute_K2P_distances(int strlen, const simple_string_distance *sds, size_t num, float *distances);
+
+void
+compute_Tamura_Nei_distances(int strlen, const TN_string_distance *sds, size_t num,
+                             int numAs, int numCs, int numGs, int numTs,
+                             float *distances);
+
+
+
 //---------------------------------------------------
 //FAKE F84
 //
@@ -0,0 +1,85 @@
+//--------------------------------------------------
+//
+// File: solver_cache.hpp
+//
+//--------------------------------------------------
+#ifndef SOLVER_CACHE_HPP
+#define SOLVER_CACHE_HPP
+
+#include <cstddef>
+#include <cstring>
+#include <stdint.h>
+#include <vector>
+
+//
+// Remembers the results of an expensive function of a few numbers,
+// e.g. the secant search of compute_K2P_fixratio(). The counts of a
+// pair of sequences are small integers, so the same counts are seen
+// many times when a matrix is computed and the search only needs to
+// be done once for each of them.
+//
+// The cache is direct mapped: a key is stored at the slot given by its
+// hash and replaces the key that was there. Keys are compared bit by
+// bit, so a cached value is exactly the value the function computed.
+// Key must be a struct of 4 byte numbers, without padding.
+//
+// The cache is not thread safe, each thread should have its own.
+//
+// EXAMPLE USAGE
+// static thread_local SolverCache<k2p_key,ML_string_distance> cache;
+// const ML_string_distance *cached = cache.find(key);
+// if ( cached != NULL )
+//   return *cached;
+// ML_string_distance result = solve(key);
+// cache.insert(key, result);
+//
+
+template<class Key, class Value>
+class SolverCache
+{
+public:
+  SolverCache(size_t logSize=12) : slots(((size_t) 1) << logSize), mask((((size_t) 1) << logSize) - 1) {}
+
+  // The value stored for key, or NULL if key is not in the cache.
+  const Value *find(const Key &key) const{
+    const slot &s = slots[hash(key) & mask];
+    if ( s.used && memcmp(&s.key, &key, sizeof(Key)) == 0 )
+      return &s.value;
+    return NULL;
+  }
+
+  void insert(const Key &key, const Value &value){
+    slot &s = slots[hash(key) & mask];
+    s.key = key;
+    s.value = value;
+    s.used = true;
+  }
+
+private:
+  typedef struct slot_{
+    slot_() : used(false) {}
+    Key key;
+    Value value;
+    bool used;
+  } slot;
+
+  std::vector<slot> slots;
+  size_t mask;
+
+  //FNV-1a over the 4 byte words of the key followed by the finalizer
+  //of SplitMix64. The counts are integers stored as floats, whose low
+  //bits are zero, and FNV alone leaves these bits in the low bits of
+  //the hash.
+  static size_t hash(const Key &key){
+    uint32_t words[sizeof(Key)/4];
+    memcpy(words, &key, sizeof(words));
+    uint64_t h = 14695981039346656037ULL;
+    for ( size_t k = 0 ; k < sizeof(Key)/4 ; k++ )
+      h = (h ^ words[k]) * 1099511628211ULL;
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+    return (size_t) (h ^ (h >> 31));
+  }
+};
+
+#endif // SOLVER_CACHE_HPP
@@ -0,0 +1,137 @@
+//--------------------------------------------------
+//
+// File: thread_utils.cpp
+//
+//--------------------------------------------------
+
+#include "thread_utils.hpp"
+
+using namespace std;
+
+WorkStealingPool::WorkStealingPool(size_t numThreads)
+  : jobGeneration(0), jobPending(0), stopping(false), jobTask(NULL), jobQueues(NULL){
+  this->numThreads = (numThreads == 0 ? 1 : numThreads);
+}
+
+WorkStealingPool::~WorkStealingPool(){
+  {
+    lock_guard<mutex> guard(jobLock);
+    stopping = true;
+  }
+  jobStart.notify_all();
+  for ( size_t k = 0 ; k < workers.size() ; k++ )
+    workers[k].join();
+}
+
+size_t
+WorkStealingPool::hardwareConcurrency(){
+  size_t n = thread::hardware_concurrency();
+  return (n == 0 ? 1 : n);
+}
+
+bool
+WorkStealingPool::popOwn(task_queue &q, size_t &task){
+  lock_guard<mutex> guard(q.lock);
+  if ( q.tasks.empty() )
+    return false;
+  task = q.tasks.front();
+  q.tasks.pop_front();
+  return true;
+}
+
+bool
+WorkStealingPool::steal(vector<task_queue> &queues, size_t thief, size_t &task){
+  for ( size_t k = 1 ; k < queues.size() ; k++ ){
+    task_queue &victim = queues[(thief + k) % queues.size()];
+    lock_guard<mutex> guard(victim.lock);
+    if ( ! victim.tasks.empty() ){
+      task = victim.tasks.back();
+      victim.tasks.pop_back();
+      return true;
+    }
+  }
+  return false;
+}
+
+void
+WorkStealingPool::run(size_t numTasks, const function<void(size_t)> &task){
+
+  const size_t nThreads = (numThreads < numTasks ? numThreads : numTasks);
+  if ( nThreads <= 1 ){
+    for ( size_t t = 0 ; t < numTasks ; t++ )
+      task(t);
+    return;
+  }
+
+  //split the tasks in contiguous chunks
+  vector<task_queue> queues(nThreads);
+  for ( size_t k = 0 ; k < nThreads ; k++ ){
+    const size_t begin = numTasks*k/nThreads;
+    const size_t end = numTasks*(k+1)/nThreads;
+    for ( size_t t = begin ; t < end ; t++ )
+      queues[k].tasks.push_back(t);
+  }
+
+  if ( workers.empty() ){
+    workers.reserve(numThreads-1);
+    for ( size_t k = 1 ; k < numThreads ; k++ )
+      workers.push_back(thread(&WorkStealingPool::workerLoop, this, k));
+  }
+
+  //the workers after the first nThreads find no queue and are done at once
+  {
+    lock_guard<mutex> guard(jobLock);
+    jobTask = &task;
+    jobQueues = &queues;
+    jobError = exception_ptr();
+    jobPending = workers.size();
+    jobGeneration++;
+  }
+  jobStart.notify_all();
+  work(0);
+  {
+    unique_lock<mutex> guard(jobLock);
+    jobDone.wait(guard, [this]{ return jobPending == 0; });
+  }
+
+  if ( jobError )
+    rethrow_exception(jobError);
+}
+
+void
+WorkStealingPool::work(size_t self){
+  vector<task_queue> &queues = *jobQueues;
+  if ( self >= queues.size() )
+    return;
+  size_t t;
+  while ( popOwn(queues[self],t) || steal(queues,self,t) ){
+    try {
+      (*jobTask)(t);
+    }
+    catch(...){
+      lock_guard<mutex> guard(errorLock);
+      if ( ! jobError )
+        jobError = current_exception();
+    }
+  }
+}
+
+void
+WorkStealingPool::workerLoop(size_t self){
+  size_t generation = 0;
+  for ( ;; ){
+    {
+      unique_lock<mutex> guard(jobLock);
+      jobStart.wait(guard, [&]{ return stopping || jobGeneration != generation; });
+      if ( stopping )
+        return;
+      generation = jobGeneration;
+    }
+    work(self);
+    {
+      lock_guard<mutex> guard(jobLock);
+      if ( --jobPending == 0 )
+        jobDone.notify_one();
+    }
+  }
+}
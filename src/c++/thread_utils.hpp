@@ -0,0 +1,137 @@
+//--------------------------------------------------
+//
+// File: thread_utils.hpp
+//
+//--------------------------------------------------
+#ifndef THREAD_UTILS_HPP
+#define THREAD_UTILS_HPP
+
+#include <cstddef>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//
+// Utilities for running independent pieces of work on several
+// threads.
+//
+// WorkStealingPool runs numTasks tasks identified by the integers
+// [0,numTasks). The tasks are initially split into contiguous chunks,
+// one per thread, so that neighbouring tasks (which usually touch
+// neighbouring memory) end up on the same thread. A thread that runs
+// out of work steals from the back of another thread's queue. This
+// balances tasks of very uneven cost, e.g. the rows of a triangular
+// matrix.
+//
+// EXAMPLE USAGE
+// WorkStealingPool pool(4);
+// pool.run(numTiles, [&](size_t tile){ computeTile(tile); });
+//
+// With one thread the tasks are executed in order on the calling
+// thread. If a task throws, the first exception is rethrown by run()
+// after all threads have finished.
+//
+// The calling thread is the first thread of the pool. The others are
+// started by the first run() and wait for the next one until the pool
+// is destroyed, so a pool that is run once per batch of rows does not
+// start threads per batch and their thread_local data, e.g. the
+// solver caches of compute_K2P_fixratio(), is kept. run() must not be
+// called from the tasks of the same pool.
+//
+
+class WorkStealingPool
+{
+public:
+  WorkStealingPool(size_t numThreads=1);
+  ~WorkStealingPool();
+
+  size_t getNumThreads() const{
+    return numThreads;
+  }
+
+  void run(size_t numTasks, const std::function<void(size_t)> &task);
+
+  // The number of hardware threads, at least 1.
+  static size_t hardwareConcurrency();
+
+private:
+  typedef struct{
+    std::mutex lock;
+    std::deque<size_t> tasks;
+  } task_queue;
+
+  size_t numThreads;
+  std::vector<std::thread> workers;  //the threads 1,...,numThreads-1
+
+  //the run the workers are woken up for, guarded by jobLock
+  std::mutex jobLock;
+  std::condition_variable jobStart, jobDone;
+  size_t jobGeneration;
+  size_t jobPending;                 //the workers still in the run
+  bool stopping;
+  const std::function<void(size_t)> *jobTask;
+  std::vector<task_queue> *jobQueues;
+  std::mutex errorLock;
+  std::exception_ptr jobError;
+
+  WorkStealingPool(const WorkStealingPool &);
+  WorkStealingPool &operator=(const WorkStealingPool &);
+
+  bool popOwn(task_queue &q, size_t &task);
+  bool steal(std::vector<task_queue> &queues, size_t thief, size_t &task);
+  // Runs tasks of the current run on the thread self until none is left.
+  void work(size_t self);
+  void workerLoop(size_t self);
+};
+
+
+//
+// Splits the strict upper triangle {(i,j) : 0<=i<j<n} into square
+// tiles of side tileSide and calls segmentFunc(i,jBegin,jEnd) for the
+// part of every row i in each tile, i.e. the pairs (i,j) with
+// jBegin<=j<jEnd and i<jBegin, on the threads of the pool. Each tile
+// touches at most 2*tileSide sequences, choose tileSide such that
+// these fit in the cache.
+//
+template<class SegmentFunction>
+void
+forEachRowSegmentInTiles(WorkStealingPool &pool, size_t n, size_t tileSide, SegmentFunction segmentFunc){
+  if ( tileSide == 0 )
+    tileSide = 1;
+  const size_t numBlocks = (n + tileSide - 1)/tileSide;
+
+  std::vector<std::pair<size_t,size_t> > tiles;
+  tiles.reserve(numBlocks*(numBlocks+1)/2);
+  for ( size_t bi = 0 ; bi < numBlocks ; bi++ )
+    for ( size_t bj = bi ; bj < numBlocks ; bj++ )
+      tiles.push_back(std::pair<size_t,size_t>(bi,bj));
+
+  pool.run(tiles.size(), [&](size_t t){
+      const size_t iBegin = tiles[t].first*tileSide;
+      const size_t iEnd = std::min(n, iBegin + tileSide);
+      const size_t jBegin = tiles[t].second*tileSide;
+      const size_t jEnd = std::min(n, jBegin + tileSide);
+      for ( size_t i = iBegin ; i < iEnd ; i++ )
+        if ( std::max(jBegin, i+1) < jEnd )
+          segmentFunc(i, std::max(jBegin, i+1), jEnd);
+    });
+}
+
+//
+// The same as above but calls pairFunc(i,j) for every pair.
+//
+template<class PairFunction>
+void
+forEachPairInTiles(WorkStealingPool &pool, size_t n, size_t tileSide, PairFunction pairFunc){
+  forEachRowSegmentInTiles(pool, n, tileSide, [&](size_t i, size_t jBegin, size_t jEnd){
+      for ( size_t j = jBegin ; j < jEnd ; j++ )
+        pairFunc(i,j);
+    });
+}
+
+#endif // THREAD_UTILS_HPP